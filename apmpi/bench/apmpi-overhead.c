@@ -0,0 +1,496 @@
+/*
+ * Copyright (C) 2017 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Per-call overhead of the APMPI wrappers.
+ *
+ * Every op is timed calling the MPI library directly (__real_PMPI_*) and
+ * through the APMPI wrappers with the module active, with darshan
+ * disabled and with the module frozen (after its output callback ran),
+ * for a range of message sizes and thread counts. The ops cover each
+ * wrapped family (point-to-point, probe/test, blocking and non-blocking
+ * collectives, RMA) and only use per-thread duplicates of MPI_COMM_SELF,
+ * so neither ranks nor threads interact.
+ *
+ * Results are written as CSV on stdout, one line per op, size, thread
+ * count and state:
+ *
+ *   op,family,bytes,threads,state,iterations,ns_per_call,overhead_ns
+ *
+ * where overhead_ns is relative to the baseline state. Lines starting
+ * with '#' carry the run configuration.
+ *
+ * The module is linked against the stub darshan-core in bench/ at the top
+ * of the tree rather than the real one. In a static darshan-runtime build
+ * tree configured with AutoPerf, "make apmpi-overhead" builds it; by hand:
+ *
+ *   mpicc -O2 -I<darshan-runtime> -I<darshan-runtime>/lib -I.. -I../../bench \
+ *       -o apmpi-overhead apmpi-overhead.c ../../bench/darshan-core-stub.c \
+ *       ../lib/darshan-apmpi.c <darshan-runtime>/lib/lookup3.o \
+ *       -Wl,@../share/ld-opts/autoperf-apmpi-ld-opts -lpthread
+ *
+ * usage: apmpi-overhead [-i iterations] [-s max bytes] [-t max threads]
+ *
+ * Threads are only used if the library provides MPI_THREAD_MULTIPLE, and
+ * the RMA ops then need a one-sided component supporting it (with Open
+ * MPI 4.x e.g. OMPI_MCA_osc=ucx; the pt2pt component refuses to create
+ * windows).
+ */
+
+#include "darshan-runtime-config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <mpi.h>
+
+#include "darshan.h"
+#include "darshan-core-stub.h"
+
+#define BENCH_ITERS_DEFAULT 100000
+#define BENCH_MAX_BYTES_DEFAULT (1024*1024)
+#define BENCH_MAX_THREADS_DEFAULT 4
+#define BENCH_MIN_ITERS 10
+
+/* call an MPI function through the wrappers or straight to the library */
+#define CALL(real, func, ...) \
+    ((real) ? __real_P ## func(__VA_ARGS__) : func(__VA_ARGS__))
+
+DARSHAN_FORWARD_DECL(PMPI_Isend, int, (const void *buf, int count, MPI_Datatype datatype, int dest, int tag,
+        MPI_Comm comm, MPI_Request *request));
+DARSHAN_FORWARD_DECL(PMPI_Irecv, int, (void *buf, int count, MPI_Datatype datatype, int source, int tag,
+        MPI_Comm comm, MPI_Request *request));
+DARSHAN_FORWARD_DECL(PMPI_Sendrecv, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype, int dest,
+        int sendtag, void *recvbuf, int recvcount, MPI_Datatype recvtype, int source, int recvtag,
+        MPI_Comm comm, MPI_Status *status));
+DARSHAN_FORWARD_DECL(PMPI_Iprobe, int, (int source, int tag, MPI_Comm comm, int *flag, MPI_Status *status));
+DARSHAN_FORWARD_DECL(PMPI_Test, int, (MPI_Request *request, int *flag, MPI_Status *status));
+DARSHAN_FORWARD_DECL(PMPI_Testall, int, (int count, MPI_Request array_of_requests[], int *flag,
+        MPI_Status array_of_statuses[]));
+DARSHAN_FORWARD_DECL(PMPI_Wait, int, (MPI_Request *request, MPI_Status *status));
+DARSHAN_FORWARD_DECL(PMPI_Waitall, int, (int count, MPI_Request array_of_requests[],
+        MPI_Status array_of_statuses[]));
+DARSHAN_FORWARD_DECL(PMPI_Barrier, int, (MPI_Comm comm));
+DARSHAN_FORWARD_DECL(PMPI_Bcast, int, (void *buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm));
+DARSHAN_FORWARD_DECL(PMPI_Allreduce, int, (const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype,
+        MPI_Op op, MPI_Comm comm));
+DARSHAN_FORWARD_DECL(PMPI_Allgather, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+        void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm));
+DARSHAN_FORWARD_DECL(PMPI_Alltoall, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+        void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm));
+DARSHAN_FORWARD_DECL(PMPI_Alltoallv, int, (const void *sendbuf, const int *sendcounts, const int *sdispls,
+        MPI_Datatype sendtype, void *recvbuf, const int *recvcounts,
+        const int *rdispls, MPI_Datatype recvtype, MPI_Comm comm));
+DARSHAN_FORWARD_DECL(PMPI_Ibarrier, int, (MPI_Comm comm, MPI_Request *request));
+DARSHAN_FORWARD_DECL(PMPI_Ibcast, int, (void *buffer, int count, MPI_Datatype datatype, int root,
+        MPI_Comm comm, MPI_Request *request));
+DARSHAN_FORWARD_DECL(PMPI_Iallreduce, int, (const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype,
+        MPI_Op op, MPI_Comm comm, MPI_Request *request));
+DARSHAN_FORWARD_DECL(PMPI_Put, int, (const void *origin_addr, int origin_count, MPI_Datatype origin_datatype,
+        int target_rank, MPI_Aint target_disp, int target_count, MPI_Datatype target_datatype, MPI_Win win));
+DARSHAN_FORWARD_DECL(PMPI_Get, int, (void *origin_addr, int origin_count, MPI_Datatype origin_datatype,
+        int target_rank, MPI_Aint target_disp, int target_count, MPI_Datatype target_datatype, MPI_Win win));
+DARSHAN_FORWARD_DECL(PMPI_Accumulate, int, (const void *origin_addr, int origin_count,
+        MPI_Datatype origin_datatype, int target_rank, MPI_Aint target_disp, int target_count,
+        MPI_Datatype target_datatype, MPI_Op op, MPI_Win win));
+DARSHAN_FORWARD_DECL(PMPI_Win_fence, int, (int assert, MPI_Win win));
+DARSHAN_FORWARD_DECL(PMPI_Win_lock, int, (int lock_type, int rank, int assert, MPI_Win win));
+DARSHAN_FORWARD_DECL(PMPI_Win_unlock, int, (int rank, MPI_Win win));
+DARSHAN_FORWARD_DECL(PMPI_Win_flush, int, (int rank, MPI_Win win));
+
+enum bench_state
+{
+    BENCH_BASELINE,
+    BENCH_ACTIVE,
+    BENCH_DISABLED,
+    BENCH_FROZEN,
+    BENCH_NUM_STATES
+};
+
+static const char *bench_state_names[BENCH_NUM_STATES] = {
+    "baseline", "active", "disabled", "frozen"
+};
+
+/* per thread resources; ops never share them across threads */
+struct bench_thread
+{
+    MPI_Comm comm;
+    MPI_Win win;
+    char *sbuf;
+    char *rbuf;
+    double ns_per_call;
+};
+
+struct bench_op
+{
+    const char *name;
+    const char *family;
+    int sized;  /* whether the op moves a message of the benchmarked size */
+    void (*fn)(struct bench_thread *t, int real, int bytes);
+};
+
+/* point-to-point */
+static void op_isend_irecv(struct bench_thread *t, int real, int bytes)
+{
+    MPI_Request req[2];
+
+    CALL(real, MPI_Irecv, t->rbuf, bytes, MPI_BYTE, 0, 0, t->comm, &req[0]);
+    CALL(real, MPI_Isend, t->sbuf, bytes, MPI_BYTE, 0, 0, t->comm, &req[1]);
+    CALL(real, MPI_Waitall, 2, req, MPI_STATUSES_IGNORE);
+}
+
+static void op_sendrecv(struct bench_thread *t, int real, int bytes)
+{
+    CALL(real, MPI_Sendrecv, t->sbuf, bytes, MPI_BYTE, 0, 0,
+        t->rbuf, bytes, MPI_BYTE, 0, 0, t->comm, MPI_STATUS_IGNORE);
+}
+
+/* probe/test */
+static void op_iprobe(struct bench_thread *t, int real, int bytes)
+{
+    int flag;
+
+    CALL(real, MPI_Iprobe, MPI_ANY_SOURCE, 0, t->comm, &flag, MPI_STATUS_IGNORE);
+}
+
+static void op_test(struct bench_thread *t, int real, int bytes)
+{
+    MPI_Request req = MPI_REQUEST_NULL;
+    int flag;
+
+    CALL(real, MPI_Test, &req, &flag, MPI_STATUS_IGNORE);
+}
+
+static void op_testall(struct bench_thread *t, int real, int bytes)
+{
+    MPI_Request req[4] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL,
+                          MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    int flag;
+
+    CALL(real, MPI_Testall, 4, req, &flag, MPI_STATUSES_IGNORE);
+}
+
+/* blocking collectives */
+static void op_barrier(struct bench_thread *t, int real, int bytes)
+{
+    CALL(real, MPI_Barrier, t->comm);
+}
+
+static void op_bcast(struct bench_thread *t, int real, int bytes)
+{
+    CALL(real, MPI_Bcast, t->sbuf, bytes, MPI_BYTE, 0, t->comm);
+}
+
+static void op_allreduce(struct bench_thread *t, int real, int bytes)
+{
+    CALL(real, MPI_Allreduce, t->sbuf, t->rbuf, bytes, MPI_BYTE, MPI_BOR, t->comm);
+}
+
+static void op_allgather(struct bench_thread *t, int real, int bytes)
+{
+    CALL(real, MPI_Allgather, t->sbuf, bytes, MPI_BYTE, t->rbuf, bytes, MPI_BYTE, t->comm);
+}
+
+static void op_alltoall(struct bench_thread *t, int real, int bytes)
+{
+    CALL(real, MPI_Alltoall, t->sbuf, bytes, MPI_BYTE, t->rbuf, bytes, MPI_BYTE, t->comm);
+}
+
+static void op_alltoallv(struct bench_thread *t, int real, int bytes)
+{
+    int displ = 0;
+
+    CALL(real, MPI_Alltoallv, t->sbuf, &bytes, &displ, MPI_BYTE,
+        t->rbuf, &bytes, &displ, MPI_BYTE, t->comm);
+}
+
+/* non-blocking collectives, completed right away */
+static void op_ibarrier(struct bench_thread *t, int real, int bytes)
+{
+    MPI_Request req;
+
+    CALL(real, MPI_Ibarrier, t->comm, &req);
+    CALL(real, MPI_Wait, &req, MPI_STATUS_IGNORE);
+}
+
+static void op_ibcast(struct bench_thread *t, int real, int bytes)
+{
+    MPI_Request req;
+
+    CALL(real, MPI_Ibcast, t->sbuf, bytes, MPI_BYTE, 0, t->comm, &req);
+    CALL(real, MPI_Wait, &req, MPI_STATUS_IGNORE);
+}
+
+static void op_iallreduce(struct bench_thread *t, int real, int bytes)
+{
+    MPI_Request req;
+
+    CALL(real, MPI_Iallreduce, t->sbuf, t->rbuf, bytes, MPI_BYTE, MPI_BOR, t->comm, &req);
+    CALL(real, MPI_Wait, &req, MPI_STATUS_IGNORE);
+}
+
+/* RMA */
+static void op_fence_put(struct bench_thread *t, int real, int bytes)
+{
+    CALL(real, MPI_Win_fence, 0, t->win);
+    CALL(real, MPI_Put, t->sbuf, bytes, MPI_BYTE, 0, 0, bytes, MPI_BYTE, t->win);
+    CALL(real, MPI_Win_fence, 0, t->win);
+}
+
+static void op_lock_get(struct bench_thread *t, int real, int bytes)
+{
+    CALL(real, MPI_Win_lock, MPI_LOCK_SHARED, 0, 0, t->win);
+    CALL(real, MPI_Get, t->rbuf, bytes, MPI_BYTE, 0, 0, bytes, MPI_BYTE, t->win);
+    CALL(real, MPI_Win_unlock, 0, t->win);
+}
+
+static void op_lock_accumulate(struct bench_thread *t, int real, int bytes)
+{
+    CALL(real, MPI_Win_lock, MPI_LOCK_SHARED, 0, 0, t->win);
+    CALL(real, MPI_Accumulate, t->sbuf, bytes, MPI_BYTE, 0, 0, bytes, MPI_BYTE, MPI_BOR, t->win);
+    CALL(real, MPI_Win_flush, 0, t->win);
+    CALL(real, MPI_Win_unlock, 0, t->win);
+}
+
+static struct bench_op bench_ops[] = {
+    {"isend_irecv_waitall", "p2p", 1, op_isend_irecv},
+    {"sendrecv", "p2p", 1, op_sendrecv},
+    {"iprobe", "probe_test", 0, op_iprobe},
+    {"test", "probe_test", 0, op_test},
+    {"testall", "probe_test", 0, op_testall},
+    {"barrier", "coll", 0, op_barrier},
+    {"bcast", "coll", 1, op_bcast},
+    {"allreduce", "coll", 1, op_allreduce},
+    {"allgather", "coll", 1, op_allgather},
+    {"alltoall", "coll", 1, op_alltoall},
+    {"alltoallv", "coll", 1, op_alltoallv},
+    {"ibarrier_wait", "icoll", 0, op_ibarrier},
+    {"ibcast_wait", "icoll", 1, op_ibcast},
+    {"iallreduce_wait", "icoll", 1, op_iallreduce},
+    {"fence_put_fence", "rma", 1, op_fence_put},
+    {"lock_get_unlock", "rma", 1, op_lock_get},
+    {"lock_acc_flush_unlock", "rma", 1, op_lock_accumulate},
+};
+#define BENCH_NUM_OPS ((int)(sizeof(bench_ops)/sizeof(bench_ops[0])))
+
+/* what a group of threads runs for one measurement */
+struct bench_run
+{
+    struct bench_op *op;
+    int real;
+    int bytes;
+    int iters;
+    pthread_barrier_t start;
+};
+
+struct bench_thread_arg
+{
+    struct bench_run *run;
+    struct bench_thread *t;
+};
+
+static void *bench_thread_main(void *arg_v)
+{
+    struct bench_thread_arg *arg = arg_v;
+    struct bench_run *run = arg->run;
+    struct bench_thread *t = arg->t;
+    double t1, t2;
+    int i;
+
+    for(i = 0; i < run->iters / 10; i++)
+        run->op->fn(t, run->real, run->bytes);
+
+    pthread_barrier_wait(&run->start);
+    t1 = PMPI_Wtime();
+    for(i = 0; i < run->iters; i++)
+        run->op->fn(t, run->real, run->bytes);
+    t2 = PMPI_Wtime();
+    t->ns_per_call = (t2 - t1) * 1e9 / run->iters;
+
+    return(NULL);
+}
+
+/* run an op on nthreads threads, returning the mean ns per call */
+static double bench_measure(struct bench_op *op, int real, int bytes, int iters,
+    struct bench_thread *threads, int nthreads)
+{
+    struct bench_run run;
+    struct bench_thread_arg args[nthreads];
+    pthread_t tids[nthreads];
+    double sum = 0.0;
+    int i;
+
+    run.op = op;
+    run.real = real;
+    run.bytes = bytes;
+    run.iters = iters;
+    pthread_barrier_init(&run.start, NULL, nthreads);
+
+    for(i = 0; i < nthreads; i++)
+    {
+        args[i].run = &run;
+        args[i].t = &threads[i];
+        pthread_create(&tids[i], NULL, bench_thread_main, &args[i]);
+    }
+    for(i = 0; i < nthreads; i++)
+    {
+        pthread_join(tids[i], NULL);
+        sum += threads[i].ns_per_call;
+    }
+    pthread_barrier_destroy(&run.start);
+
+    return(sum / nthreads);
+}
+
+/* fewer iterations for large messages, so every size takes similar time */
+static int bench_iters(int iters, int bytes)
+{
+    int n = iters / (1 + bytes / 4096);
+
+    return((n < BENCH_MIN_ITERS) ? BENCH_MIN_ITERS : n);
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_thread *threads;
+    double *results;
+    int iters = BENCH_ITERS_DEFAULT;
+    int max_bytes = BENCH_MAX_BYTES_DEFAULT;
+    int max_threads = BENCH_MAX_THREADS_DEFAULT;
+    int nsizes, nthread_counts;
+    int provided, rank;
+    int state, nthreads, op, bytes, s, tc, i;
+    int opt;
+    char version[MPI_MAX_LIBRARY_VERSION_STRING];
+    int version_len;
+
+    while((opt = getopt(argc, argv, "i:s:t:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'i':
+                iters = atoi(optarg);
+                break;
+            case 's':
+                max_bytes = atoi(optarg);
+                break;
+            case 't':
+                max_threads = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-i iterations] [-s max bytes] [-t max threads]\n", argv[0]);
+                return(1);
+        }
+    }
+    if(iters < BENCH_MIN_ITERS)
+        iters = BENCH_MIN_ITERS;
+    if(max_bytes < 8)
+        max_bytes = 8;
+    if(max_threads < 1)
+        max_threads = 1;
+
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if(provided < MPI_THREAD_MULTIPLE)
+        max_threads = 1;
+
+    /* message sizes 8, 64, ... and thread counts 1, 2, 4, ... */
+    for(nsizes = 0, bytes = 8; bytes <= max_bytes; bytes *= 8)
+        nsizes++;
+    for(nthread_counts = 0, nthreads = 1; nthreads <= max_threads; nthreads *= 2)
+        nthread_counts++;
+
+    threads = calloc(max_threads, sizeof(*threads));
+    results = calloc(BENCH_NUM_STATES * nthread_counts * BENCH_NUM_OPS * nsizes, sizeof(*results));
+    if(!threads || !results)
+    {
+        fprintf(stderr, "Error: failed to allocate benchmark state\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+#define RESULT(state, tc, op, s) \
+    results[(((state) * nthread_counts + (tc)) * BENCH_NUM_OPS + (op)) * nsizes + (s)]
+
+    for(i = 0; i < max_threads; i++)
+    {
+        PMPI_Comm_dup(MPI_COMM_SELF, &threads[i].comm);
+        threads[i].sbuf = calloc(1, max_bytes);
+        threads[i].rbuf = calloc(1, max_bytes);
+        if(!threads[i].sbuf || !threads[i].rbuf)
+        {
+            fprintf(stderr, "Error: failed to allocate benchmark buffers\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        PMPI_Win_create(threads[i].rbuf, max_bytes, 1, MPI_INFO_NULL,
+            threads[i].comm, &threads[i].win);
+    }
+
+    /* the module initializes on the first wrapped call and is frozen by
+     * its output callback, so the states are measured in this order
+     */
+    for(state = 0; state < BENCH_NUM_STATES; state++)
+    {
+        if(state == BENCH_DISABLED)
+            __darshan_disabled = 1;
+        else if(state == BENCH_FROZEN)
+        {
+            __darshan_disabled = 0;
+            darshan_core_stub_output();
+        }
+
+        for(tc = 0, nthreads = 1; tc < nthread_counts; tc++, nthreads *= 2)
+            for(op = 0; op < BENCH_NUM_OPS; op++)
+                for(s = 0, bytes = 8; s < nsizes; s++, bytes *= 8)
+                {
+                    if(!bench_ops[op].sized && s > 0)
+                        break;
+                    RESULT(state, tc, op, s) = bench_measure(&bench_ops[op],
+                        state == BENCH_BASELINE, bench_ops[op].sized ? bytes : 0,
+                        bench_iters(iters, bench_ops[op].sized ? bytes : 0),
+                        threads, nthreads);
+                }
+    }
+
+    if(rank == 0)
+    {
+        PMPI_Get_library_version(version, &version_len);
+        version[strcspn(version, "\n")] = '\0';
+        printf("# apmpi-overhead: iterations %d, max bytes %d, max threads %d\n",
+            iters, max_bytes, max_threads);
+        printf("# mpi: %s\n", version);
+        printf("op,family,bytes,threads,state,iterations,ns_per_call,overhead_ns\n");
+        for(tc = 0, nthreads = 1; tc < nthread_counts; tc++, nthreads *= 2)
+            for(op = 0; op < BENCH_NUM_OPS; op++)
+                for(s = 0, bytes = 8; s < nsizes; s++, bytes *= 8)
+                {
+                    if(!bench_ops[op].sized && s > 0)
+                        break;
+                    for(state = 0; state < BENCH_NUM_STATES; state++)
+                        printf("%s,%s,%d,%d,%s,%d,%.1f,%.1f\n",
+                            bench_ops[op].name, bench_ops[op].family,
+                            bench_ops[op].sized ? bytes : 0, nthreads,
+                            bench_state_names[state],
+                            bench_iters(iters, bench_ops[op].sized ? bytes : 0),
+                            RESULT(state, tc, op, s),
+                            RESULT(state, tc, op, s) - RESULT(BENCH_BASELINE, tc, op, s));
+                }
+    }
+#undef RESULT
+
+    darshan_core_stub_cleanup();
+    for(i = 0; i < max_threads; i++)
+    {
+        PMPI_Win_free(&threads[i].win);
+        PMPI_Comm_free(&threads[i].comm);
+        free(threads[i].sbuf);
+        free(threads[i].rbuf);
+    }
+    free(threads);
+    free(results);
+
+    MPI_Finalize();
+
+    return(0);
+}
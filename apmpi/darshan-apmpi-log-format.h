@@ -7,9 +7,13 @@
 #ifndef __APMPI_LOG_FORMAT_H
 #define __APMPI_LOG_FORMAT_H
 #define AP_PROCESSOR_NAME_MAX 128
+/* maximum number (and name length) of MPI_T performance variables that
+ * can be sampled, see DARSHAN_APMPI_PVARS */
+#define APMPI_MAX_PVARS 16
+#define APMPI_PVAR_NAME_MAX 64
 
 /* current AutoPerf MPI log format version */
-#define APMPI_VER 1
+#define APMPI_VER 3
 
 #define APMPI_MAGIC ('A'*0x100000000+\
                             'P'*0x1000000+\
@@ -101,13 +105,7 @@
 	X(MPI_ACCUMULATE) \
 	X(MPI_GET_ACCUMULATE) \
 	V(MPI_FETCH_AND_OP) \
-	V(MPI_COMPARE_AND_SWAP) /*\
-	X(MPI_WIN_CREATE) \
-	X(MPI_WIN_ALLOCATE) \
-	X(MPI_WIN_CREATE_DYNAMIC) \
-	X(MPI_WIN_ALLOCATE_SHARED) \
-	X(MPI_WIN_ATTACH) \
-	X(MPI_WIN_DETACH) */ \
+	V(MPI_COMPARE_AND_SWAP) \
 	V(MPI_WIN_FENCE) \
 	V(MPI_WIN_START) \
 	V(MPI_WIN_COMPLETE) \
@@ -123,6 +121,36 @@
 	V(MPI_WIN_FLUSH_LOCAL_ALL) \
 	V(MPI_WIN_SYNC)
 
+/* neighborhood collectives are kept after the one-sided ops so that the
+ * v1 counter arrays remain a prefix of the current ones */
+#define APMPI_MPI_BLOCKING_NEIGHBOR_COLL \
+        X(MPI_NEIGHBOR_ALLGATHER)       \
+        X(MPI_NEIGHBOR_ALLGATHERV)      \
+        X(MPI_NEIGHBOR_ALLTOALL)        \
+        X(MPI_NEIGHBOR_ALLTOALLV)       \
+        X(MPI_NEIGHBOR_ALLTOALLW)
+
+#define APMPI_MPI_NONBLOCKING_NEIGHBOR_COLL \
+        X(MPI_INEIGHBOR_ALLGATHER)      \
+        X(MPI_INEIGHBOR_ALLGATHERV)     \
+        X(MPI_INEIGHBOR_ALLTOALL)       \
+        X(MPI_INEIGHBOR_ALLTOALLV)      \
+        X(MPI_INEIGHBOR_ALLTOALLW)
+
+/* RMA window lifecycle; the message counters of the create/allocate/attach
+ * ops hold the window sizes. MPI_WIN_LOCK_ALL is a synchronization call,
+ * not part of the lifecycle, but is listed last here so that the v1
+ * counter arrays remain a prefix of the current ones */
+#define APMPI_MPI_RMA_WINDOW \
+	X(MPI_WIN_CREATE) \
+	X(MPI_WIN_ALLOCATE) \
+	V(MPI_WIN_CREATE_DYNAMIC) \
+	X(MPI_WIN_ALLOCATE_SHARED) \
+	X(MPI_WIN_ATTACH) \
+	V(MPI_WIN_DETACH) \
+	V(MPI_WIN_FREE) \
+	V(MPI_WIN_LOCK_ALL)
+
 #define I(a) \
          Y(a ## _CALL_COUNT) \
       /* Y(MPIOP_BUF_SOURCE) \  0-CPU, 1-GPU (if we can determine if it is GPU buffer then we can repeat all the counters in this record 
@@ -148,6 +176,9 @@
         APMPI_MPI_BLOCKING_COLL \
         APMPI_MPI_NONBLOCKING_COLL \
 	APMPI_MPI_ONESIDED \
+        APMPI_MPI_BLOCKING_NEIGHBOR_COLL \
+        APMPI_MPI_NONBLOCKING_NEIGHBOR_COLL \
+        APMPI_MPI_RMA_WINDOW \
         Z(APMPI_NUM_INDICES)
 
 #define Y(a) a,
@@ -177,6 +208,9 @@ enum apmpi_mpiop_indices
         APMPI_MPI_BLOCKING_COLL \
         APMPI_MPI_NONBLOCKING_COLL \
 	APMPI_MPI_ONESIDED \
+        APMPI_MPI_BLOCKING_NEIGHBOR_COLL \
+        APMPI_MPI_NONBLOCKING_NEIGHBOR_COLL \
+        APMPI_MPI_RMA_WINDOW \
         Z(APMPI_F_MPIOP_TOTALTIME_NUM_INDICES) 
 
 /* float counters for the "APMPI" module */
@@ -194,6 +228,7 @@ enum apmpi_f_mpiop_totaltime_indices
 #define APMPI_F_MPIOP_SYNCTIME_COUNTERS \
 	APMPI_MPI_COLL_SYNC \
 	APMPI_MPI_BLOCKING_COLL \
+        APMPI_MPI_BLOCKING_NEIGHBOR_COLL \
         Z(APMPI_F_MPIOP_SYNCTIME_NUM_INDICES) 
 /* float counters for the "APMPI" module */
 #define X F_SYNC
@@ -214,8 +249,56 @@ enum apmpi_f_mpi_global_indices
 {
     APMPI_F_MPI_GLOBAL_COUNTERS
 };
+
+        /* per RMA epoch type (fence, lock/lock_all, PSCW access) statistics */
+#define APMPI_MPI_RMA_EPOCHS \
+	X(MPI_RMA_FENCE) \
+	X(MPI_RMA_LOCK) \
+	X(MPI_RMA_PSCW)
+
+#define RMA_EPOCH(a) \
+        Y(a ## _EPOCHS) \
+        Y(a ## _EPOCH_BYTES) \
+        Y(a ## _EPOCH_OPS) \
+        Y(a ## _EPOCH_MAX_BYTES) \
+        Y(a ## _EPOCH_MAX_OPS)
+
+/* MPI_RMA_MAX_WIN_SIZE is the most memory a window exposed at once;
+ * regions detached from a dynamic window no longer count toward it
+ */
+#define APMPI_RMA_COUNTERS \
+	APMPI_MPI_RMA_EPOCHS \
+	Y(MPI_RMA_MAX_WIN_SIZE) \
+	Z(APMPI_RMA_NUM_INDICES)
+#define X RMA_EPOCH
+enum apmpi_rma_indices
+{
+    APMPI_RMA_COUNTERS
+};
+#undef X
+
+#define F_RMA_EPOCH(a) \
+        Y(a ## _EPOCH_TIME) \
+        Y(a ## _SYNC_TIME)
+
+#define APMPI_F_RMA_COUNTERS \
+	APMPI_MPI_RMA_EPOCHS \
+	Y(MPI_RMA_WIN_LIFETIME) \
+	Z(APMPI_F_RMA_NUM_INDICES)
+#define X F_RMA_EPOCH
+enum apmpi_f_rma_indices
+{
+    APMPI_F_RMA_COUNTERS
+};
+#undef X
 #undef Z
 #undef Y
+
+/* v1 records end where the neighborhood collective counters begin */
+#define APMPI_V1_NUM_INDICES MPI_NEIGHBOR_ALLGATHER_CALL_COUNT
+#define APMPI_V1_F_MPIOP_TOTALTIME_NUM_INDICES MPI_NEIGHBOR_ALLGATHER_TOTAL_TIME
+#define APMPI_V1_F_MPIOP_SYNCTIME_NUM_INDICES MPI_NEIGHBOR_ALLGATHER_TOTAL_SYNC_TIME
+
 /* the darshan_apmpi_record structure encompasses the data/counters
  * which would actually be logged to file by Darshan for the AP MPI
  * module. This example implementation logs the following data for each
@@ -231,8 +314,31 @@ struct darshan_apmpi_perf_record
     double fcounters[APMPI_F_MPIOP_TOTALTIME_NUM_INDICES];
     double fsynccounters[APMPI_F_MPIOP_SYNCTIME_NUM_INDICES];
     double fglobalcounters[APMPI_F_MPI_GLOBAL_NUM_INDICES];
+    uint64_t rmacounters[APMPI_RMA_NUM_INDICES];
+    double frmacounters[APMPI_F_RMA_NUM_INDICES];
+    double pvarcounters[APMPI_MAX_PVARS];
     char node_name[AP_PROCESSOR_NAME_MAX];
 };
+
+/* from v3 on, a perf record may be stored packed, with only its nonzero
+ * counters: its base record, then a word holding APMPI_PACKED_TAG in its
+ * high 32 bits and the length in bytes of the packed record (always less
+ * than a darshan_apmpi_perf_record) in its low 32 bits, then
+ *   - the node name: its length in one byte, then its bytes without a NUL
+ *   - for each counter array of the perf record, in order: a bitmap of
+ *     its nonzero entries (entry i is bit i % 8 of byte i / 8), then the
+ *     values of these entries, as LEB128 varints for the integer counters
+ *     and as 8 byte doubles for the floating point ones
+ * Words and doubles are in the byte order of the log. Perf records that
+ * would not be smaller packed are stored whole as in v2; both are told
+ * apart from the header record, and from each other, by the word after the
+ * base record.
+ */
+#define APMPI_PACKED_TAG ('A'*0x1000000+\
+                          'P'*0x10000+\
+                          'P'*0x100+\
+                          'K'*0x1)
+
 struct darshan_apmpi_header_record
 {
     struct darshan_base_record base_rec;
@@ -240,6 +346,9 @@ struct darshan_apmpi_header_record
     uint32_t sync_flag;
     double apmpi_f_variance_total_mpitime;
     double apmpi_f_variance_total_mpisynctime;
+    /* names of the MPI_T pvars stored in pvarcounters of the perf records */
+    uint32_t pvar_count;
+    char pvar_names[APMPI_MAX_PVARS][APMPI_PVAR_NAME_MAX];
 };
 
 #endif /* __APMPI_LOG_FORMAT_H */
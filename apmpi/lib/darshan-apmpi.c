@@ -11,8 +11,12 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
 #include <pthread.h>
 #include <assert.h>
+#include <stdatomic.h>
 
 #include "uthash.h"
 #include "darshan.h"
@@ -24,9 +28,18 @@ typedef long long ap_bytes_t;
 #define MIN(x,y) ((x==0.0)?y:((x<y)?x:y))
 #define APMPI_WTIME() __darshan_disabled ? 0 : darshan_core_wtime();
 
+/* once nothing can be recorded anymore (darshan disabled, module frozen or
+ * failed to initialize) the wrappers call straight through to PMPI
+ */
+#define APMPI_BYPASS(FUNC) \
+          if(__darshan_disabled || \
+             atomic_load_explicit(&apmpi_bypass, memory_order_relaxed)) \
+              return FUNC
+
 #ifdef __APMPI_COLL_SYNC
 
 #define TIME_SYNC(FUNC) \
+          APMPI_BYPASS(FUNC); \
           double tm1, tm2, tm3, tdiff, tsync;\
           int ret; \
           MAP_OR_FAIL(PMPI_Barrier);\
@@ -40,6 +53,7 @@ typedef long long ap_bytes_t;
 #else
 
 #define TIME_SYNC(FUNC) \
+          APMPI_BYPASS(FUNC); \
           double tm1, tm2, tdiff, tsync;\
           int ret; \
           tm1 = APMPI_WTIME(); \
@@ -50,6 +64,7 @@ typedef long long ap_bytes_t;
 
 #endif
 #define TIME(FUNC) \
+          APMPI_BYPASS(FUNC); \
           double tm1, tm2, tdiff;\
           int ret; \
           tm1 = APMPI_WTIME(); \
@@ -261,6 +276,52 @@ DARSHAN_FORWARD_DECL(PMPI_Win_flush_local_all, int, (MPI_Win win));
 
 DARSHAN_FORWARD_DECL(PMPI_Win_sync, int, (MPI_Win win));
 
+DARSHAN_FORWARD_DECL(PMPI_Win_create, int, (void *base, MPI_Aint size, int disp_unit,
+        MPI_Info info, MPI_Comm comm, MPI_Win *win));
+
+DARSHAN_FORWARD_DECL(PMPI_Win_allocate, int, (MPI_Aint size, int disp_unit, MPI_Info info,
+        MPI_Comm comm, void *baseptr, MPI_Win *win));
+
+DARSHAN_FORWARD_DECL(PMPI_Win_create_dynamic, int, (MPI_Info info, MPI_Comm comm, MPI_Win *win));
+
+DARSHAN_FORWARD_DECL(PMPI_Win_allocate_shared, int, (MPI_Aint size, int disp_unit, MPI_Info info,
+        MPI_Comm comm, void *baseptr, MPI_Win *win));
+
+DARSHAN_FORWARD_DECL(PMPI_Win_attach, int, (MPI_Win win, void *base, MPI_Aint size));
+
+DARSHAN_FORWARD_DECL(PMPI_Win_detach, int, (MPI_Win win, const void *base));
+
+DARSHAN_FORWARD_DECL(PMPI_Win_free, int, (MPI_Win *win));
+
+DARSHAN_FORWARD_DECL(PMPI_Win_lock_all, int, (int assert, MPI_Win win));
+
+DARSHAN_FORWARD_DECL(PMPI_Neighbor_allgather, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm));
+DARSHAN_FORWARD_DECL(PMPI_Neighbor_allgatherv, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, const int recvcounts[], const int displs[],
+                 MPI_Datatype recvtype, MPI_Comm comm));
+DARSHAN_FORWARD_DECL(PMPI_Neighbor_alltoall, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm));
+DARSHAN_FORWARD_DECL(PMPI_Neighbor_alltoallv, int, (const void *sendbuf, const int sendcounts[], const int sdispls[],
+                 MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int rdispls[],
+                 MPI_Datatype recvtype, MPI_Comm comm));
+DARSHAN_FORWARD_DECL(PMPI_Neighbor_alltoallw, int, (const void *sendbuf, const int sendcounts[], const MPI_Aint sdispls[],
+                 const MPI_Datatype sendtypes[], void *recvbuf, const int recvcounts[], const MPI_Aint rdispls[],
+                 const MPI_Datatype recvtypes[], MPI_Comm comm));
+DARSHAN_FORWARD_DECL(PMPI_Ineighbor_allgather, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm, MPI_Request * request));
+DARSHAN_FORWARD_DECL(PMPI_Ineighbor_allgatherv, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, const int recvcounts[], const int displs[],
+                 MPI_Datatype recvtype, MPI_Comm comm, MPI_Request * request));
+DARSHAN_FORWARD_DECL(PMPI_Ineighbor_alltoall, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm, MPI_Request * request));
+DARSHAN_FORWARD_DECL(PMPI_Ineighbor_alltoallv, int, (const void *sendbuf, const int sendcounts[], const int sdispls[],
+                 MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int rdispls[],
+                 MPI_Datatype recvtype, MPI_Comm comm, MPI_Request * request));
+DARSHAN_FORWARD_DECL(PMPI_Ineighbor_alltoallw, int, (const void *sendbuf, const int sendcounts[], const MPI_Aint sdispls[],
+                 const MPI_Datatype sendtypes[], void *recvbuf, const int recvcounts[], const MPI_Aint rdispls[],
+                 const MPI_Datatype recvtypes[], MPI_Comm comm, MPI_Request * request));
+
 /*
  * Global runtime struct for tracking data needed at runtime
  */
@@ -271,6 +332,7 @@ struct apmpi_runtime
     darshan_record_id rec_id;
     darshan_record_id header_id;
     int frozen; /* flag to indicate that the counters should no longer be modified */
+    int perf_record_len; /* length of the perf record once packed for output */
 };
 
 static struct apmpi_runtime *apmpi_runtime = NULL;
@@ -278,6 +340,80 @@ static pthread_mutex_t apmpi_runtime_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER
 
 static int apmpi_runtime_init_attempted = 0;
 
+/* set once the wrappers no longer need to time or record anything; read
+ * without the lock by every wrapper, so it is atomic. Relaxed ordering is
+ * enough, as PRE_RECORD() checks the module state again under the lock.
+ */
+static _Atomic int apmpi_bypass = 0;
+
+/* neighbor counts of a topology communicator, cached as an attribute
+ * so that neighborhood collectives only query the topology once
+ */
+struct apmpi_topo_neighbors
+{
+    int indegree;
+    int outdegree;
+};
+
+static int apmpi_topo_keyval = MPI_KEYVAL_INVALID;
+
+/* RMA epoch types, in the order of APMPI_MPI_RMA_EPOCHS */
+enum apmpi_rma_epoch_type
+{
+    APMPI_RMA_NONE = -1,
+    APMPI_RMA_FENCE,
+    APMPI_RMA_LOCK,
+    APMPI_RMA_PSCW
+};
+
+/* index of a per epoch type counter in the rma counter arrays */
+#define RMA_IDX(TYPE, CNT) \
+    (MPI_RMA_FENCE_ ## CNT + (TYPE) * (MPI_RMA_LOCK_EPOCHS - MPI_RMA_FENCE_EPOCHS))
+#define F_RMA_IDX(TYPE, CNT) \
+    (MPI_RMA_FENCE_ ## CNT + (TYPE) * (MPI_RMA_LOCK_EPOCH_TIME - MPI_RMA_FENCE_EPOCH_TIME))
+
+/* a memory region attached to a dynamic window */
+struct apmpi_win_region
+{
+    const void *base;
+    MPI_Aint size;
+    struct apmpi_win_region *next;
+};
+
+/* per window state, cached as an attribute of the window so that the
+ * epoch an RMA op belongs to can be found without a lookup table
+ */
+struct apmpi_win_state
+{
+    MPI_Aint size;      /* memory currently exposed by the window */
+    struct apmpi_win_region *regions; /* attached, not yet detached */
+    double create_time; /* negative if the window was not seen being created */
+    int epoch;          /* type of the open access epoch, APMPI_RMA_NONE if none */
+    int lock_depth;     /* number of outstanding lock/lock_all calls */
+    uint64_t epoch_bytes;
+    uint64_t epoch_ops;
+    double epoch_start;
+};
+
+static int apmpi_win_keyval = MPI_KEYVAL_INVALID;
+
+#if MPI_VERSION >= 3
+/* MPI_T performance variables sampled by the module, in the order they
+ * are listed in DARSHAN_APMPI_PVARS; pvars that could not be opened keep
+ * a null handle and are reported as 0
+ */
+struct apmpi_pvar
+{
+    MPI_T_pvar_handle handle;
+    MPI_Datatype datatype;
+    int count;
+};
+
+static MPI_T_pvar_session apmpi_pvar_session = MPI_T_PVAR_SESSION_NULL;
+static struct apmpi_pvar apmpi_pvars[APMPI_MAX_PVARS];
+static int apmpi_pvar_count = 0;
+#endif
+
 /* my_rank indicates the MPI rank of this process */
 static int my_rank = -1;
 
@@ -324,6 +460,18 @@ static void initialize_counters (void)
     {
         apmpi_runtime->perf_record->fsynccounters[i] = 0;
     }
+    for (i = 0; i < APMPI_RMA_NUM_INDICES; i++)
+    {
+        apmpi_runtime->perf_record->rmacounters[i] = 0;
+    }
+    for (i = 0; i < APMPI_F_RMA_NUM_INDICES; i++)
+    {
+        apmpi_runtime->perf_record->frmacounters[i] = 0;
+    }
+    for (i = 0; i < APMPI_MAX_PVARS; i++)
+    {
+        apmpi_runtime->perf_record->pvarcounters[i] = 0;
+    }
     return;
 }
 
@@ -333,6 +481,184 @@ static void finalize_counters (void)
     return;
 }
 
+#if MPI_VERSION >= 3
+/*
+ * Open a handle on the MPI_T pvar with the given name. Only pvars that are
+ * not bound to an object (or bound to a communicator, in which case
+ * MPI_COMM_WORLD is used) and have a numeric type are supported.
+ */
+static void apmpi_pvar_open(const char *name, struct apmpi_pvar *pvar)
+{
+    char pname[256];
+    int num, idx, name_len, desc_len, verbosity, var_class, bind;
+    int readonly, continuous, atomic;
+    MPI_Datatype datatype;
+    MPI_T_enum enumtype;
+    MPI_Comm comm = MPI_COMM_WORLD;
+    void *obj = NULL;
+
+    pvar->handle = MPI_T_PVAR_HANDLE_NULL;
+    if(MPI_T_pvar_get_num(&num) != MPI_SUCCESS)
+        return;
+    for(idx = 0; idx < num; idx++)
+    {
+        name_len = sizeof(pname);
+        desc_len = 0;
+        if(MPI_T_pvar_get_info(idx, pname, &name_len, &verbosity, &var_class,
+            &datatype, &enumtype, NULL, &desc_len, &bind, &readonly,
+            &continuous, &atomic) != MPI_SUCCESS)
+            continue;
+        if(strcmp(pname, name) == 0)
+            break;
+    }
+    if(idx == num)
+        return;
+
+    if(bind == MPI_T_BIND_MPI_COMM)
+        obj = &comm;
+    else if(bind != MPI_T_BIND_NO_OBJECT)
+        return;
+    if(datatype != MPI_INT && datatype != MPI_UNSIGNED &&
+        datatype != MPI_UNSIGNED_LONG && datatype != MPI_UNSIGNED_LONG_LONG &&
+        datatype != MPI_COUNT && datatype != MPI_DOUBLE)
+        return;
+
+    if(MPI_T_pvar_handle_alloc(apmpi_pvar_session, idx, obj, &pvar->handle,
+        &pvar->count) != MPI_SUCCESS)
+    {
+        pvar->handle = MPI_T_PVAR_HANDLE_NULL;
+        return;
+    }
+    pvar->datatype = datatype;
+    if(!continuous)
+        MPI_T_pvar_start(apmpi_pvar_session, pvar->handle);
+
+    return;
+}
+
+/*
+ * Open the pvars listed (comma separated, blanks around the names are
+ * ignored) in the DARSHAN_APMPI_PVARS environment variable. Rank 0 records
+ * their names in the header record. MPI_T is initialized at the thread
+ * level the application got from MPI.
+ */
+static void apmpi_pvar_initialize(void)
+{
+    char *env, *list, *tok, *end, *saveptr = NULL;
+    int required, provided;
+    int i;
+
+    env = getenv("DARSHAN_APMPI_PVARS");
+    if(!env)
+        return;
+    list = strdup(env);
+    if(!list)
+        return;
+    PMPI_Query_thread(&required);
+    if(MPI_T_init_thread(required, &provided) != MPI_SUCCESS)
+    {
+        free(list);
+        return;
+    }
+    if(MPI_T_pvar_session_create(&apmpi_pvar_session) != MPI_SUCCESS)
+    {
+        apmpi_pvar_session = MPI_T_PVAR_SESSION_NULL;
+        MPI_T_finalize();
+        free(list);
+        return;
+    }
+
+    for(tok = strtok_r(list, ",", &saveptr);
+        tok && apmpi_pvar_count < APMPI_MAX_PVARS;
+        tok = strtok_r(NULL, ",", &saveptr))
+    {
+        while(isspace((unsigned char)*tok))
+            tok++;
+        end = tok + strlen(tok);
+        while(end > tok && isspace((unsigned char)end[-1]))
+            *--end = '\0';
+        if(*tok == '\0')
+            continue;
+        i = apmpi_pvar_count++;
+        apmpi_pvar_open(tok, &apmpi_pvars[i]);
+        if(my_rank == 0)
+            strncpy(apmpi_runtime->header_record->pvar_names[i], tok,
+                APMPI_PVAR_NAME_MAX - 1);
+    }
+    if(my_rank == 0)
+        apmpi_runtime->header_record->pvar_count = apmpi_pvar_count;
+    free(list);
+
+    return;
+}
+
+/* read the current value of a pvar, summed over its elements */
+static double apmpi_pvar_read(struct apmpi_pvar *pvar)
+{
+    double val = 0.0;
+    void *buf;
+    int tsize;
+    int i;
+
+    if(pvar->handle == MPI_T_PVAR_HANDLE_NULL)
+        return(0.0);
+    PMPI_Type_size(pvar->datatype, &tsize);
+    buf = malloc(pvar->count * tsize);
+    if(!buf)
+        return(0.0);
+    if(MPI_T_pvar_read(apmpi_pvar_session, pvar->handle, buf) == MPI_SUCCESS)
+    {
+        for(i = 0; i < pvar->count; i++)
+        {
+            if(pvar->datatype == MPI_INT)
+                val += ((int *)buf)[i];
+            else if(pvar->datatype == MPI_UNSIGNED)
+                val += ((unsigned *)buf)[i];
+            else if(pvar->datatype == MPI_UNSIGNED_LONG)
+                val += ((unsigned long *)buf)[i];
+            else if(pvar->datatype == MPI_UNSIGNED_LONG_LONG)
+                val += ((unsigned long long *)buf)[i];
+            else if(pvar->datatype == MPI_COUNT)
+                val += ((MPI_Count *)buf)[i];
+            else if(pvar->datatype == MPI_DOUBLE)
+                val += ((double *)buf)[i];
+        }
+    }
+    free(buf);
+
+    return(val);
+}
+
+static void apmpi_pvar_sample(struct darshan_apmpi_perf_record *rec)
+{
+    int i;
+
+    for(i = 0; i < apmpi_pvar_count; i++)
+        rec->pvarcounters[i] = apmpi_pvar_read(&apmpi_pvars[i]);
+
+    return;
+}
+
+static void apmpi_pvar_finalize(void)
+{
+    int i;
+
+    if(apmpi_pvar_session == MPI_T_PVAR_SESSION_NULL)
+        return;
+    for(i = 0; i < apmpi_pvar_count; i++)
+    {
+        if(apmpi_pvars[i].handle != MPI_T_PVAR_HANDLE_NULL)
+            MPI_T_pvar_handle_free(apmpi_pvar_session, &apmpi_pvars[i].handle);
+    }
+    MPI_T_pvar_session_free(&apmpi_pvar_session);
+    MPI_T_finalize();
+    apmpi_pvar_session = MPI_T_PVAR_SESSION_NULL;
+    apmpi_pvar_count = 0;
+
+    return;
+}
+#endif
+
 /*
  * Function which updates all the counter data
  */
@@ -430,6 +756,9 @@ static void apmpi_runtime_initialize()
 #else
         apmpi_runtime->header_record->sync_flag = 0;
 #endif
+        apmpi_runtime->header_record->pvar_count = 0;
+        memset(apmpi_runtime->header_record->pvar_names, 0,
+            sizeof(apmpi_runtime->header_record->pvar_names));
     }
 
     apmpi_runtime->rec_id = darshan_core_gen_record_id("APMPI"); //record name
@@ -452,6 +781,9 @@ static void apmpi_runtime_initialize()
     initialize_counters();
     /* collect perf counters */
     capture(apmpi_runtime->perf_record, apmpi_runtime->rec_id);
+#if MPI_VERSION >= 3
+    apmpi_pvar_initialize();
+#endif
 
     APMPI_UNLOCK();
 
@@ -562,6 +894,9 @@ static void apmpi_mpi_redux(
         APMPI_UNLOCK();
         return;
     }
+#if MPI_VERSION >= 3
+    apmpi_pvar_sample(apmpi_runtime->perf_record);
+#endif
     double mpisync_time = 0.0;
     /* Compute Total MPI time per rank: MPI_TOTAL_COMM_TIME */
     for (i=MPI_SEND_TOTAL_TIME; i<APMPI_F_MPIOP_TOTALTIME_NUM_INDICES; i+=3){     // times (total_time, max_time, min_time)
@@ -615,6 +950,95 @@ static void apmpi_mpi_redux(
 }
 
 //#endif
+/* append to a packed record the bitmap of the nonzero entries of a counter
+ * array of n 8 byte values, then the values of these entries, as varints
+ * or as they are; returns the end of what was appended, or NULL if it does
+ * not fit before end
+ */
+static char *apmpi_pack_counters(char *p, char *end, const void *vals,
+    int n, int varint)
+{
+    char *bitmap = p;
+    uint64_t v;
+    int i;
+
+    if (end - p < (n + 7) / 8)
+        return NULL;
+    memset(bitmap, 0, (n + 7) / 8);
+    p += (n + 7) / 8;
+
+    for (i = 0; i < n; i++)
+    {
+        memcpy(&v, (const char *)vals + i * sizeof(v), sizeof(v));
+        if (v == 0)
+            continue;
+        bitmap[i / 8] |= 1 << (i % 8);
+        if (!varint)
+        {
+            if (end - p < (ptrdiff_t)sizeof(v))
+                return NULL;
+            memcpy(p, &v, sizeof(v));
+            p += sizeof(v);
+            continue;
+        }
+        do
+        {
+            if (p == end)
+                return NULL;
+            *p++ = (v & 0x7f) | (v > 0x7f ? 0x80 : 0);
+            v >>= 7;
+        } while (v);
+    }
+
+    return p;
+}
+
+/* pack the perf record in place as described in darshan-apmpi-log-format.h,
+ * unless it would not get smaller; returns its length on the log either way
+ */
+static int apmpi_pack_perf_record(struct darshan_apmpi_perf_record *rec)
+{
+    char packed[sizeof(*rec)];
+    char *p = packed, *end = packed + sizeof(packed) - 1;
+    uint64_t tag;
+    size_t name_len;
+
+    p += sizeof(rec->base_rec) + sizeof(tag);
+    name_len = strnlen(rec->node_name, AP_PROCESSOR_NAME_MAX);
+    *p++ = (unsigned char)name_len;
+    memcpy(p, rec->node_name, name_len);
+    p += name_len;
+
+    p = apmpi_pack_counters(p, end, rec->counters, APMPI_NUM_INDICES, 1);
+    if (p)
+        p = apmpi_pack_counters(p, end, rec->fcounters,
+            APMPI_F_MPIOP_TOTALTIME_NUM_INDICES, 0);
+    if (p)
+        p = apmpi_pack_counters(p, end, rec->fsynccounters,
+            APMPI_F_MPIOP_SYNCTIME_NUM_INDICES, 0);
+    if (p)
+        p = apmpi_pack_counters(p, end, rec->fglobalcounters,
+            APMPI_F_MPI_GLOBAL_NUM_INDICES, 0);
+    if (p)
+        p = apmpi_pack_counters(p, end, rec->rmacounters,
+            APMPI_RMA_NUM_INDICES, 1);
+    if (p)
+        p = apmpi_pack_counters(p, end, rec->frmacounters,
+            APMPI_F_RMA_NUM_INDICES, 0);
+    if (p)
+        p = apmpi_pack_counters(p, end, rec->pvarcounters,
+            APMPI_MAX_PVARS, 0);
+    if (!p)
+        return sizeof(*rec);
+
+    tag = ((uint64_t)APMPI_PACKED_TAG << 32) | (uint64_t)(p - packed);
+    memcpy(packed, &rec->base_rec, sizeof(rec->base_rec));
+    memcpy(packed + sizeof(rec->base_rec), &tag, sizeof(tag));
+    memcpy(rec, packed, p - packed);
+
+    return p - packed;
+}
+
 static void apmpi_output(
     void **apmpi_buf,
     int *apmpi_buf_sz)
@@ -625,9 +1049,14 @@ static void apmpi_output(
     if(my_rank == 0) {
     *apmpi_buf_sz += sizeof( *apmpi_runtime->header_record);
     }
-    *apmpi_buf_sz += sizeof( *apmpi_runtime->perf_record);
+    /* the perf record is last in the buffer, so it can shrink in place */
+    if(!apmpi_runtime->frozen)
+        apmpi_runtime->perf_record_len =
+            apmpi_pack_perf_record(apmpi_runtime->perf_record);
+    *apmpi_buf_sz += apmpi_runtime->perf_record_len;
 
     apmpi_runtime->frozen = 1;
+    atomic_store_explicit(&apmpi_bypass, 1, memory_order_relaxed);
 
     APMPI_UNLOCK();
     return;
@@ -642,10 +1071,310 @@ static void apmpi_cleanup()
     free(apmpi_runtime);
     apmpi_runtime = NULL;
 
+    if(apmpi_topo_keyval != MPI_KEYVAL_INVALID)
+        PMPI_Comm_free_keyval(&apmpi_topo_keyval);
+    if(apmpi_win_keyval != MPI_KEYVAL_INVALID)
+        PMPI_Win_free_keyval(&apmpi_win_keyval);
+#if MPI_VERSION >= 3
+    apmpi_pvar_finalize();
+#endif
+
     APMPI_UNLOCK();
     return;
 }
 
+static int apmpi_topo_neighbors_delete(MPI_Comm comm, int keyval,
+    void *attr_val, void *extra_state)
+{
+    free(attr_val);
+    return MPI_SUCCESS;
+}
+
+/*
+ * Get the number of in/out neighbors of a topology communicator. The
+ * counts are computed on first use and cached on the communicator. Only
+ * the keyval creation is done under the APMPI lock; the topology queries
+ * run without it.
+ */
+static void apmpi_get_neighbors(MPI_Comm comm, int *indegree, int *outdegree)
+{
+    struct apmpi_topo_neighbors *nbrs = NULL;
+    int flag = 0;
+    int topo, rank, ndims, weighted;
+    int in = 0, out = 0;
+
+    APMPI_LOCK();
+    if(apmpi_topo_keyval == MPI_KEYVAL_INVALID)
+        PMPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, apmpi_topo_neighbors_delete,
+            &apmpi_topo_keyval, NULL);
+    APMPI_UNLOCK();
+
+    PMPI_Comm_get_attr(comm, apmpi_topo_keyval, &nbrs, &flag);
+    if(flag)
+    {
+        *indegree = nbrs->indegree;
+        *outdegree = nbrs->outdegree;
+        return;
+    }
+
+    PMPI_Topo_test(comm, &topo);
+    if(topo == MPI_CART)
+    {
+        PMPI_Cartdim_get(comm, &ndims);
+        in = out = 2 * ndims;
+    }
+    else if(topo == MPI_GRAPH)
+    {
+        PMPI_Comm_rank(comm, &rank);
+        PMPI_Graph_neighbors_count(comm, rank, &in);
+        out = in;
+    }
+    else if(topo == MPI_DIST_GRAPH)
+    {
+        PMPI_Dist_graph_neighbors_count(comm, &in, &out, &weighted);
+    }
+    *indegree = in;
+    *outdegree = out;
+
+    /* a failed malloc only costs recomputing the counts next time */
+    nbrs = malloc(sizeof(*nbrs));
+    if(nbrs)
+    {
+        nbrs->indegree = in;
+        nbrs->outdegree = out;
+        PMPI_Comm_set_attr(comm, apmpi_topo_keyval, nbrs);
+    }
+
+    return;
+}
+
+/* called from MPI_Win_free; accounts for the lifetime of the window */
+static int apmpi_win_state_delete(MPI_Win win, int keyval,
+    void *attr_val, void *extra_state)
+{
+    struct apmpi_win_state *ws = attr_val;
+    struct apmpi_win_region *region;
+
+    APMPI_LOCK();
+    if(apmpi_runtime && !apmpi_runtime->frozen && ws->create_time >= 0)
+        apmpi_runtime->perf_record->frmacounters[MPI_RMA_WIN_LIFETIME] +=
+            darshan_core_wtime() - ws->create_time;
+    APMPI_UNLOCK();
+
+    while(ws->regions)
+    {
+        region = ws->regions;
+        ws->regions = region->next;
+        free(region);
+    }
+    free(ws);
+    return MPI_SUCCESS;
+}
+
+/*
+ * Get the state of an RMA window, creating it on first use. Must be
+ * called with the apmpi lock held.
+ */
+static struct apmpi_win_state *apmpi_get_win_state(MPI_Win win)
+{
+    struct apmpi_win_state *ws = NULL;
+    MPI_Aint *size_attr;
+    int flag = 0;
+
+    if(apmpi_win_keyval == MPI_KEYVAL_INVALID)
+        PMPI_Win_create_keyval(MPI_WIN_NULL_COPY_FN, apmpi_win_state_delete,
+            &apmpi_win_keyval, NULL);
+    else
+        PMPI_Win_get_attr(win, apmpi_win_keyval, &ws, &flag);
+
+    if(!flag)
+    {
+        ws = malloc(sizeof(*ws));
+        if(!ws)
+            return NULL;
+        memset(ws, 0, sizeof(*ws));
+        ws->create_time = -1;
+        ws->epoch = APMPI_RMA_NONE;
+        PMPI_Win_get_attr(win, MPI_WIN_SIZE, &size_attr, &flag);
+        if(flag)
+            ws->size = *size_attr;
+        PMPI_Win_set_attr(win, apmpi_win_keyval, ws);
+    }
+
+    return ws;
+}
+
+static void apmpi_rma_window_grow(struct apmpi_win_state *ws, MPI_Aint size)
+{
+    ws->size += size;
+    if(ws->size > apmpi_runtime->perf_record->rmacounters[MPI_RMA_MAX_WIN_SIZE])
+        apmpi_runtime->perf_record->rmacounters[MPI_RMA_MAX_WIN_SIZE] = ws->size;
+
+    return;
+}
+
+/* the region is remembered so that detaching it shrinks the window again */
+static void apmpi_rma_window_attached(MPI_Win win, const void *base,
+    MPI_Aint size)
+{
+    struct apmpi_win_state *ws = apmpi_get_win_state(win);
+    struct apmpi_win_region *region;
+
+    if(!ws)
+        return;
+    region = malloc(sizeof(*region));
+    if(!region)
+        return;
+    region->base = base;
+    region->size = size;
+    region->next = ws->regions;
+    ws->regions = region;
+    apmpi_rma_window_grow(ws, size);
+
+    return;
+}
+
+static void apmpi_rma_window_detached(MPI_Win win, const void *base)
+{
+    struct apmpi_win_state *ws = apmpi_get_win_state(win);
+    struct apmpi_win_region **link, *region;
+
+    if(!ws)
+        return;
+    for(link = &ws->regions; *link; link = &(*link)->next)
+    {
+        region = *link;
+        if(region->base != base)
+            continue;
+        ws->size -= region->size;
+        *link = region->next;
+        free(region);
+        break;
+    }
+
+    return;
+}
+
+static void apmpi_rma_window_created(MPI_Win win, MPI_Aint size, double tm)
+{
+    struct apmpi_win_state *ws = apmpi_get_win_state(win);
+
+    if(!ws)
+        return;
+    ws->create_time = tm;
+    ws->size = 0;
+    apmpi_rma_window_grow(ws, size);
+
+    return;
+}
+
+static void apmpi_rma_epoch_open(struct apmpi_win_state *ws, int type, double tm)
+{
+    ws->epoch = type;
+    ws->epoch_bytes = 0;
+    ws->epoch_ops = 0;
+    ws->epoch_start = tm;
+
+    return;
+}
+
+static void apmpi_rma_epoch_close(struct apmpi_win_state *ws, double tm)
+{
+    uint64_t *cnt = apmpi_runtime->perf_record->rmacounters;
+    double *fcnt = apmpi_runtime->perf_record->frmacounters;
+    int type = ws->epoch;
+
+    if(type == APMPI_RMA_NONE)
+        return;
+    cnt[RMA_IDX(type, EPOCHS)]++;
+    cnt[RMA_IDX(type, EPOCH_BYTES)] += ws->epoch_bytes;
+    cnt[RMA_IDX(type, EPOCH_OPS)] += ws->epoch_ops;
+    cnt[RMA_IDX(type, EPOCH_MAX_BYTES)] =
+        MAX(cnt[RMA_IDX(type, EPOCH_MAX_BYTES)], ws->epoch_bytes);
+    cnt[RMA_IDX(type, EPOCH_MAX_OPS)] =
+        MAX(cnt[RMA_IDX(type, EPOCH_MAX_OPS)], ws->epoch_ops);
+    fcnt[F_RMA_IDX(type, EPOCH_TIME)] += tm - ws->epoch_start;
+    ws->epoch = APMPI_RMA_NONE;
+
+    return;
+}
+
+/* a fence closes the current fence epoch and opens the next one */
+static void apmpi_rma_fence(MPI_Win win, int mode, double tm)
+{
+    struct apmpi_win_state *ws = apmpi_get_win_state(win);
+
+    if(!ws)
+        return;
+    if(ws->epoch == APMPI_RMA_FENCE)
+        apmpi_rma_epoch_close(ws, tm);
+    if(!(mode & MPI_MODE_NOSUCCEED) && ws->epoch == APMPI_RMA_NONE)
+        apmpi_rma_epoch_open(ws, APMPI_RMA_FENCE, tm);
+
+    return;
+}
+
+/* passive target epochs span from the first lock to the last unlock */
+static void apmpi_rma_lock(MPI_Win win, double tm)
+{
+    struct apmpi_win_state *ws = apmpi_get_win_state(win);
+
+    if(!ws)
+        return;
+    if(ws->lock_depth++ == 0 && ws->epoch == APMPI_RMA_NONE)
+        apmpi_rma_epoch_open(ws, APMPI_RMA_LOCK, tm);
+
+    return;
+}
+
+static void apmpi_rma_unlock(MPI_Win win, double tm)
+{
+    struct apmpi_win_state *ws = apmpi_get_win_state(win);
+
+    if(!ws || ws->lock_depth == 0)
+        return;
+    if(--ws->lock_depth == 0 && ws->epoch == APMPI_RMA_LOCK)
+        apmpi_rma_epoch_close(ws, tm);
+
+    return;
+}
+
+/* PSCW access epochs span from MPI_Win_start to MPI_Win_complete */
+static void apmpi_rma_start(MPI_Win win, double tm)
+{
+    struct apmpi_win_state *ws = apmpi_get_win_state(win);
+
+    if(!ws)
+        return;
+    if(ws->epoch == APMPI_RMA_NONE)
+        apmpi_rma_epoch_open(ws, APMPI_RMA_PSCW, tm);
+
+    return;
+}
+
+static void apmpi_rma_complete(MPI_Win win, double tm)
+{
+    struct apmpi_win_state *ws = apmpi_get_win_state(win);
+
+    if(ws && ws->epoch == APMPI_RMA_PSCW)
+        apmpi_rma_epoch_close(ws, tm);
+
+    return;
+}
+
+/* account an RMA op to the access epoch open on the window */
+static void apmpi_rma_epoch_op(MPI_Win win, ap_bytes_t bytes)
+{
+    struct apmpi_win_state *ws = apmpi_get_win_state(win);
+
+    if(!ws || ws->epoch == APMPI_RMA_NONE)
+        return;
+    ws->epoch_bytes += bytes;
+    ws->epoch_ops++;
+
+    return;
+}
+
 /* note that if the break condition is triggered in this macro, then it
  * will exit the do/while loop holding a lock that will be released in
  * POST_RECORD().  Otherwise it will release the lock here (if held) and
@@ -657,11 +1386,25 @@ static void apmpi_cleanup()
            if(!apmpi_runtime && !apmpi_runtime_init_attempted) \
                apmpi_runtime_initialize(); \
            if(apmpi_runtime && !apmpi_runtime->frozen) break; \
+           atomic_store_explicit(&apmpi_bypass, 1, memory_order_relaxed); \
            APMPI_UNLOCK(); \
        } \
        return(ret); \
    } while(0)
 
+/* bails out early, without the lock, if the module stopped recording
+ * while the call ran. Wrappers then count bytes (datatype sizes,
+ * recvcounts loops, neighbor lookups) without holding the lock, and only
+ * take it in PRE_RECORD(), which initializes the module and checks its
+ * state for the update.
+ */
+#define APMPI_PRE_COUNT() do { \
+       if(!__darshan_disabled && \
+          !atomic_load_explicit(&apmpi_bypass, memory_order_relaxed)) \
+           break; \
+       return(ret); \
+   } while(0)
+
 #define APMPI_POST_RECORD() do { \
        APMPI_UNLOCK(); \
    } while(0)
@@ -703,6 +1446,10 @@ static void apmpi_cleanup()
     apmpi_runtime->perf_record->fcounters[MPI_OP ## _MAX_TIME] = MAX(apmpi_runtime->perf_record->fcounters[Y(MPI_OP ## _MAX_TIME)], tdiff); \
     apmpi_runtime->perf_record->fcounters[MPI_OP ## _MIN_TIME] = MIN(apmpi_runtime->perf_record->fcounters[Y(MPI_OP ## _MIN_TIME)], tdiff); \
     } while(0)
+#define APMPI_RMA_SYNC_UPDATE(TYPE) do { \
+    if(ret != MPI_SUCCESS) break; \
+    apmpi_runtime->perf_record->frmacounters[F_RMA_IDX(TYPE, SYNC_TIME)] += tdiff; \
+    } while(0)
 #define Y(a) a
 
 /**********************************************************
@@ -713,9 +1460,9 @@ int DARSHAN_DECL(MPI_Send)(const void *buf, int count, MPI_Datatype datatype, in
 {
     MAP_OR_FAIL(PMPI_Send);
     TIME(__real_PMPI_Send(buf, count, datatype, dest, tag, comm));
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
     APMPI_PRE_RECORD();
-    // Potential optimization: Lock around the count - lock only if MPI_THREAD_MULTIPLE is used ... locking mutex
     APMPI_RECORD_UPDATE(MPI_SEND);
     APMPI_POST_RECORD();
     return ret;
@@ -726,6 +1473,7 @@ int DARSHAN_DECL(MPI_Ssend)(const void *buf, int count, MPI_Datatype datatype, i
 {
     MAP_OR_FAIL(PMPI_Ssend);
     TIME(__real_PMPI_Ssend(buf, count, datatype, dest, tag, comm));
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_SSEND);
@@ -738,6 +1486,7 @@ int DARSHAN_DECL(MPI_Rsend)(const void *buf, int count, MPI_Datatype datatype, i
 {
     MAP_OR_FAIL(PMPI_Rsend);
     TIME(__real_PMPI_Rsend(buf, count, datatype, dest, tag, comm));
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_RSEND);
@@ -750,6 +1499,7 @@ int DARSHAN_DECL(MPI_Bsend)(const void *buf, int count, MPI_Datatype datatype, i
 {
     MAP_OR_FAIL(PMPI_Bsend);
     TIME(__real_PMPI_Bsend(buf, count, datatype, dest, tag, comm));
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_BSEND);
@@ -763,6 +1513,7 @@ int DARSHAN_DECL(MPI_Isend)(const void *buf, int count, MPI_Datatype datatype, i
 {
     MAP_OR_FAIL(PMPI_Isend);
     TIME(__real_PMPI_Isend(buf, count, datatype, dest, tag, comm, request));
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_ISEND);
@@ -776,6 +1527,7 @@ int DARSHAN_DECL(MPI_Issend)(const void *buf, int count, MPI_Datatype datatype,
 {
     MAP_OR_FAIL(PMPI_Issend);
     TIME(__real_PMPI_Issend(buf, count, datatype, dest, tag, comm, request));
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_ISSEND);
@@ -789,6 +1541,7 @@ int DARSHAN_DECL(MPI_Irsend)(const void *buf, int count, MPI_Datatype datatype,
 {
     MAP_OR_FAIL(PMPI_Irsend);
     TIME(__real_PMPI_Irsend(buf, count, datatype, dest, tag, comm, request));
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IRSEND);
@@ -802,6 +1555,7 @@ int DARSHAN_DECL(MPI_Ibsend)(const void *buf, int count, MPI_Datatype datatype,
 {
     MAP_OR_FAIL(PMPI_Ibsend);
     TIME(__real_PMPI_Ibsend(buf, count, datatype, dest, tag, comm, request));
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IBSEND);
@@ -815,6 +1569,7 @@ int DARSHAN_DECL(MPI_Recv)(void *buf, int count, MPI_Datatype datatype, int sour
 {
     MAP_OR_FAIL(PMPI_Recv);
     TIME(__real_PMPI_Recv(buf, count, datatype, source, tag, comm, status));
+    APMPI_PRE_COUNT();
     int count_received; //, src;
     if (status != MPI_STATUS_IGNORE) {
         PMPI_Get_count(status, datatype, &count_received);
@@ -840,6 +1595,7 @@ int DARSHAN_DECL(MPI_Irecv)(void *buf, int count, MPI_Datatype datatype, int sou
     MAP_OR_FAIL(PMPI_Irecv);
 
     TIME(__real_PMPI_Irecv(buf, count, datatype, source, tag, comm, request));
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IRECV);
@@ -856,6 +1612,7 @@ int DARSHAN_DECL(MPI_Sendrecv)(const void *sendbuf, int sendcount, MPI_Datatype
     
     TIME(__real_PMPI_Sendrecv(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf, recvcount, recvtype, source, recvtag, comm, status));
     
+    APMPI_PRE_COUNT();
     int count_received; //, src;
     if (status != MPI_STATUS_IGNORE) {
         PMPI_Get_count(status, recvtype, &count_received);
@@ -870,7 +1627,6 @@ int DARSHAN_DECL(MPI_Sendrecv)(const void *sendbuf, int sendcount, MPI_Datatype
     ap_bytes_t sbytes = bytes;
     BYTECOUNTND(recvtype, count_received);
     bytes += sbytes;
-    
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_SENDRECV);
     APMPI_POST_RECORD();
@@ -885,6 +1641,7 @@ int DARSHAN_DECL(MPI_Sendrecv_replace)(void *buf, int count, MPI_Datatype dataty
     MAP_OR_FAIL(PMPI_Sendrecv_replace);
     TIME(__real_PMPI_Sendrecv_replace(buf, count, datatype, dest, sendtag, source, recvtag, comm, status));
     
+    APMPI_PRE_COUNT();
     int count_received; //, src;
     if (status != MPI_STATUS_IGNORE) {
         PMPI_Get_count(status, datatype, &count_received);
@@ -911,8 +1668,8 @@ int DARSHAN_DECL(MPI_Isendrecv)(const void *sendbuf, int sendcount, MPI_Datatype
     
     TIME(__real_PMPI_Isendrecv(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf, recvcount, recvtype, source, recvtag, comm, request));
     
+    APMPI_PRE_COUNT();
     BYTECOUNT(sendtype, sendcount + recvcount);
-    
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_ISENDRECV);
     APMPI_POST_RECORD();
@@ -929,8 +1686,8 @@ int DARSHAN_DECL(MPI_Isendrecv_replace)(void *buf, int count, MPI_Datatype datat
     
     TIME(__real_PMPI_Isendrecv_replace(buf, count, datatype, dest, sendtag, source, recvtag, comm, request));
     
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count + count);
-    
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_ISENDRECV_REPLACE);
     APMPI_POST_RECORD();
@@ -946,9 +1703,12 @@ int DARSHAN_DECL(MPI_Put)(const void *origin_addr, int origin_count, MPI_Datatyp
     MAP_OR_FAIL(PMPI_Put);
     TIME(__real_PMPI_Put(origin_addr, origin_count, origin_datatype, target_rank,
             target_disp, target_count, target_datatype, win));
+    APMPI_PRE_COUNT();
     BYTECOUNT(origin_datatype, origin_count); 
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_PUT);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_epoch_op(win, bytes);
     APMPI_POST_RECORD();
 
     return ret;
@@ -965,9 +1725,12 @@ int DARSHAN_DECL(MPI_Get)(void *origin_addr, int origin_count, MPI_Datatype
     TIME(__real_PMPI_Get(origin_addr, origin_count, origin_datatype, target_rank,
                target_disp, target_count, target_datatype, win));
     
+    APMPI_PRE_COUNT();
     BYTECOUNT(target_datatype, target_count); 
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_GET);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_epoch_op(win, bytes);
     APMPI_POST_RECORD();
     
     return ret;
@@ -988,9 +1751,12 @@ int DARSHAN_DECL(MPI_Accumulate)(const void *origin_addr, int origin_count, MPI_
                    target_disp, target_count, 
                    target_datatype, op, win));
     
+    APMPI_PRE_COUNT();
     BYTECOUNT(target_datatype, target_count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_ACCUMULATE);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_epoch_op(win, bytes);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1011,9 +1777,12 @@ int DARSHAN_DECL(MPI_Get_accumulate)(const void *origin_addr, int origin_count,
         result_datatype, target_rank, target_disp,
         target_count, target_datatype, op, win));
     
+    APMPI_PRE_COUNT();
     BYTECOUNT(target_datatype, target_count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_GET_ACCUMULATE);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_epoch_op(win, bytes);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1032,8 +1801,12 @@ int DARSHAN_DECL(MPI_Fetch_and_op)(const void *origin_addr, void *result_addr,
         datatype, target_rank, target_disp,
         op, win));
     
+    APMPI_PRE_COUNT();
+    BYTECOUNT(datatype, 1);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_FETCH_AND_OP);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_epoch_op(win, bytes);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1051,8 +1824,12 @@ int DARSHAN_DECL(MPI_Compare_and_swap)(const void *origin_addr, const void *comp
         result_addr, datatype, target_rank,
         target_disp, win));
     
+    APMPI_PRE_COUNT();
+    BYTECOUNT(datatype, 1);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_COMPARE_AND_SWAP);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_epoch_op(win, bytes);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1068,6 +1845,9 @@ int DARSHAN_DECL(MPI_Win_fence)(int assert, MPI_Win win)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_FENCE);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_FENCE);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_fence(win, assert, tm2);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1081,6 +1861,9 @@ int DARSHAN_DECL(MPI_Win_start)(MPI_Group group, int assert, MPI_Win win)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_START);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_PSCW);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_start(win, tm2);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1094,6 +1877,9 @@ int DARSHAN_DECL(MPI_Win_complete)(MPI_Win win)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_COMPLETE);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_PSCW);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_complete(win, tm2);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1107,6 +1893,7 @@ int DARSHAN_DECL(MPI_Win_post)(MPI_Group group, int assert, MPI_Win win)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_POST);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_PSCW);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1120,6 +1907,7 @@ int DARSHAN_DECL(MPI_Win_wait)(MPI_Win win)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_WAIT);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_PSCW);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1133,6 +1921,7 @@ int DARSHAN_DECL(MPI_Win_test)(MPI_Win win, int *flag)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_TEST);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_PSCW);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1146,6 +1935,9 @@ int DARSHAN_DECL(MPI_Win_lock)(int lock_type, int rank, int assert, MPI_Win win)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_LOCK);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_LOCK);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_lock(win, tm2);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1159,6 +1951,9 @@ int DARSHAN_DECL(MPI_Win_unlock)(int rank, MPI_Win win)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_UNLOCK);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_LOCK);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_unlock(win, tm2);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1172,6 +1967,9 @@ int DARSHAN_DECL(MPI_Win_unlock_all)(MPI_Win win)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_UNLOCK_ALL);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_LOCK);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_unlock(win, tm2);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1185,6 +1983,7 @@ int DARSHAN_DECL(MPI_Win_flush)(int rank, MPI_Win win)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_FLUSH);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_LOCK);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1198,6 +1997,7 @@ int DARSHAN_DECL(MPI_Win_flush_all)(MPI_Win win)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_FLUSH_ALL);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_LOCK);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1211,6 +2011,7 @@ int DARSHAN_DECL(MPI_Win_flush_local)(int rank, MPI_Win win)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_FLUSH_LOCAL);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_LOCK);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1224,6 +2025,7 @@ int DARSHAN_DECL(MPI_Win_flush_local_all)(MPI_Win win)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_FLUSH_LOCAL_ALL);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_LOCK);
     APMPI_POST_RECORD();
     
     return ret;
@@ -1237,12 +2039,145 @@ int DARSHAN_DECL(MPI_Win_sync)(MPI_Win win)
     
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_SYNC);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_LOCK);
     APMPI_POST_RECORD();
     
     return ret;
 }
 DARSHAN_WRAPPER_MAP(PMPI_Win_sync, int, (MPI_Win win), MPI_Win_sync)
 
+int DARSHAN_DECL(MPI_Win_lock_all)(int assert, MPI_Win win)
+{
+    MAP_OR_FAIL(PMPI_Win_lock_all);
+    TIME(__real_PMPI_Win_lock_all(assert, win));
+    
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_LOCK_ALL);
+    APMPI_RMA_SYNC_UPDATE(APMPI_RMA_LOCK);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_lock(win, tm2);
+    APMPI_POST_RECORD();
+    
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Win_lock_all, int, (int assert, MPI_Win win), MPI_Win_lock_all)
+
+int DARSHAN_DECL(MPI_Win_create)(void *base, MPI_Aint size, int disp_unit,
+        MPI_Info info, MPI_Comm comm, MPI_Win *win)
+{
+    MAP_OR_FAIL(PMPI_Win_create);
+    TIME(__real_PMPI_Win_create(base, size, disp_unit, info, comm, win));
+    
+    APMPI_PRE_RECORD();
+    ap_bytes_t bytes = size;
+    APMPI_RECORD_UPDATE(MPI_WIN_CREATE);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_window_created(*win, size, tm2);
+    APMPI_POST_RECORD();
+    
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Win_create, int, (void *base, MPI_Aint size, int disp_unit,
+        MPI_Info info, MPI_Comm comm, MPI_Win *win), MPI_Win_create)
+
+int DARSHAN_DECL(MPI_Win_allocate)(MPI_Aint size, int disp_unit, MPI_Info info,
+        MPI_Comm comm, void *baseptr, MPI_Win *win)
+{
+    MAP_OR_FAIL(PMPI_Win_allocate);
+    TIME(__real_PMPI_Win_allocate(size, disp_unit, info, comm, baseptr, win));
+    
+    APMPI_PRE_RECORD();
+    ap_bytes_t bytes = size;
+    APMPI_RECORD_UPDATE(MPI_WIN_ALLOCATE);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_window_created(*win, size, tm2);
+    APMPI_POST_RECORD();
+    
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Win_allocate, int, (MPI_Aint size, int disp_unit, MPI_Info info,
+        MPI_Comm comm, void *baseptr, MPI_Win *win), MPI_Win_allocate)
+
+int DARSHAN_DECL(MPI_Win_create_dynamic)(MPI_Info info, MPI_Comm comm, MPI_Win *win)
+{
+    MAP_OR_FAIL(PMPI_Win_create_dynamic);
+    TIME(__real_PMPI_Win_create_dynamic(info, comm, win));
+    
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_CREATE_DYNAMIC);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_window_created(*win, 0, tm2);
+    APMPI_POST_RECORD();
+    
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Win_create_dynamic, int, (MPI_Info info, MPI_Comm comm, MPI_Win *win),
+        MPI_Win_create_dynamic)
+
+int DARSHAN_DECL(MPI_Win_allocate_shared)(MPI_Aint size, int disp_unit, MPI_Info info,
+        MPI_Comm comm, void *baseptr, MPI_Win *win)
+{
+    MAP_OR_FAIL(PMPI_Win_allocate_shared);
+    TIME(__real_PMPI_Win_allocate_shared(size, disp_unit, info, comm, baseptr, win));
+    
+    APMPI_PRE_RECORD();
+    ap_bytes_t bytes = size;
+    APMPI_RECORD_UPDATE(MPI_WIN_ALLOCATE_SHARED);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_window_created(*win, size, tm2);
+    APMPI_POST_RECORD();
+    
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Win_allocate_shared, int, (MPI_Aint size, int disp_unit, MPI_Info info,
+        MPI_Comm comm, void *baseptr, MPI_Win *win), MPI_Win_allocate_shared)
+
+/* the size of a dynamic window is the total size of its attached memory */
+int DARSHAN_DECL(MPI_Win_attach)(MPI_Win win, void *base, MPI_Aint size)
+{
+    MAP_OR_FAIL(PMPI_Win_attach);
+    TIME(__real_PMPI_Win_attach(win, base, size));
+    
+    APMPI_PRE_RECORD();
+    ap_bytes_t bytes = size;
+    APMPI_RECORD_UPDATE(MPI_WIN_ATTACH);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_window_attached(win, base, size);
+    APMPI_POST_RECORD();
+    
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Win_attach, int, (MPI_Win win, void *base, MPI_Aint size), MPI_Win_attach)
+
+int DARSHAN_DECL(MPI_Win_detach)(MPI_Win win, const void *base)
+{
+    MAP_OR_FAIL(PMPI_Win_detach);
+    TIME(__real_PMPI_Win_detach(win, base));
+    
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_DETACH);
+    if(ret == MPI_SUCCESS)
+        apmpi_rma_window_detached(win, base);
+    APMPI_POST_RECORD();
+    
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Win_detach, int, (MPI_Win win, const void *base), MPI_Win_detach)
+
+/* the window lifetime is accounted by the attribute delete callback */
+int DARSHAN_DECL(MPI_Win_free)(MPI_Win *win)
+{
+    MAP_OR_FAIL(PMPI_Win_free);
+    TIME(__real_PMPI_Win_free(win));
+    
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE_NOMSG(MPI_WIN_FREE);
+    APMPI_POST_RECORD();
+    
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Win_free, int, (MPI_Win *win), MPI_Win_free)
+
 int DARSHAN_DECL(MPI_Probe)(int source, int tag, MPI_Comm comm, MPI_Status * status)
 {
     MAP_OR_FAIL(PMPI_Probe);
@@ -1402,11 +2337,11 @@ int DARSHAN_DECL(MPI_Bcast)(void *buffer, int count, MPI_Datatype datatype, int
     
     TIME_SYNC(__real_PMPI_Bcast(buffer, count, datatype, root, comm));
 
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes = 0;
     if (root != MPI_PROC_NULL) {
         BYTECOUNTND(datatype, count);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_BCAST);
     APMPI_POST_RECORD();
@@ -1421,11 +2356,11 @@ int DARSHAN_DECL(MPI_Reduce)(const void *sendbuf, void *recvbuf, int count, MPI_
   
     TIME_SYNC(__real_PMPI_Reduce(sendbuf, recvbuf, count, datatype, op, root, comm));
 
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes = 0;
     if (root != MPI_PROC_NULL) {
         BYTECOUNTND(datatype, count);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_REDUCE);
     APMPI_POST_RECORD();
@@ -1440,8 +2375,8 @@ int DARSHAN_DECL(MPI_Allreduce)(const void *sendbuf, void *recvbuf, int count, M
 
     TIME_SYNC(__real_PMPI_Allreduce(sendbuf, recvbuf, count, datatype, op, comm));
 
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_ALLREDUCE);
     APMPI_POST_RECORD();
@@ -1458,11 +2393,11 @@ int DARSHAN_DECL(MPI_Alltoall)(const void *sendbuf, int sendcount, MPI_Datatype
   
     TIME_SYNC(__real_PMPI_Alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm));
 
+    APMPI_PRE_COUNT();
     BYTECOUNT(recvtype, recvcount);
     int tasks;
     PMPI_Comm_size(comm, &tasks);
     bytes = bytes*tasks;
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_ALLTOALL);
     APMPI_POST_RECORD();
@@ -1480,11 +2415,11 @@ int DARSHAN_DECL(MPI_Alltoallv)(const void *sendbuf, const int *sendcounts, cons
   
     TIME_SYNC(__real_PMPI_Alltoallv(sendbuf, sendcounts, sdispls, sendtype, recvbuf, recvcounts, rdispls, recvtype, comm));
 
+    APMPI_PRE_COUNT();
     int i, tasks, count = 0;
     PMPI_Comm_size(comm, &tasks);
     for (i=0; i<tasks; i++) count += recvcounts[i];
     BYTECOUNT(recvtype, count);
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_ALLTOALLV);
     APMPI_POST_RECORD();
@@ -1502,6 +2437,7 @@ int DARSHAN_DECL(MPI_Alltoallw)(const void *sendbuf, const int sendcounts[], con
   
     TIME_SYNC(__real_PMPI_Alltoallw(sendbuf, sendcounts, sdispls, sendtypes, recvbuf, recvcounts, rdispls, recvtypes, comm));
 
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes = 0, tmp_bytes = 0;
     int i, tasks;
     PMPI_Comm_size(comm, &tasks);
@@ -1510,8 +2446,6 @@ int DARSHAN_DECL(MPI_Alltoallw)(const void *sendbuf, const int sendcounts[], con
       tmp_bytes += bytes;
     }
     bytes = tmp_bytes;
-
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_ALLTOALLW);
     APMPI_POST_RECORD();
@@ -1530,6 +2464,7 @@ int DARSHAN_DECL(MPI_Allgather)(const void *sendbuf, int sendcount, MPI_Datatype
 
     TIME_SYNC(__real_PMPI_Allgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm));
     
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes;
     if (sendbuf != MPI_IN_PLACE) {
         BYTECOUNTND(sendtype, sendcount);
@@ -1537,7 +2472,6 @@ int DARSHAN_DECL(MPI_Allgather)(const void *sendbuf, int sendcount, MPI_Datatype
     else {
         BYTECOUNTND(recvtype, recvcount);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_ALLGATHER);
     APMPI_POST_RECORD();
@@ -1555,6 +2489,7 @@ int DARSHAN_DECL(MPI_Allgatherv)(const void *sendbuf, int sendcount, MPI_Datatyp
 
     TIME_SYNC(__real_PMPI_Allgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, comm));
     
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes;
     if (sendbuf != MPI_IN_PLACE) {
          BYTECOUNTND(sendtype, sendcount);
@@ -1564,7 +2499,6 @@ int DARSHAN_DECL(MPI_Allgatherv)(const void *sendbuf, int sendcount, MPI_Datatyp
         PMPI_Comm_rank(comm, &rank);
         BYTECOUNTND(recvtype, recvcounts[rank]);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_ALLGATHERV);
     APMPI_POST_RECORD();
@@ -1581,6 +2515,7 @@ int DARSHAN_DECL(MPI_Gather)(const void *sendbuf, int sendcount, MPI_Datatype se
 
     TIME_SYNC(__real_PMPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm));
     
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes = 0;
     if (root == MPI_PROC_NULL) {
         bytes = 0;
@@ -1594,7 +2529,6 @@ int DARSHAN_DECL(MPI_Gather)(const void *sendbuf, int sendcount, MPI_Datatype se
     else {
         BYTECOUNTND(sendtype, sendcount);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_GATHER);
     APMPI_POST_RECORD();
@@ -1611,6 +2545,7 @@ int DARSHAN_DECL(MPI_Gatherv)(const void *sendbuf, int sendcount, MPI_Datatype s
 
     TIME_SYNC(__real_PMPI_Gatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, root, comm));
     
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes = 0;
     if (root == MPI_PROC_NULL) {
         bytes = 0;
@@ -1624,7 +2559,6 @@ int DARSHAN_DECL(MPI_Gatherv)(const void *sendbuf, int sendcount, MPI_Datatype s
     else {
         BYTECOUNTND(sendtype, sendcount);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_GATHERV);
     APMPI_POST_RECORD();
@@ -1642,6 +2576,7 @@ int DARSHAN_DECL(MPI_Scatter)(const void *sendbuf, int sendcount, MPI_Datatype s
 
     TIME_SYNC(__real_PMPI_Scatter(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm));
     
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes;
      if (root == MPI_PROC_NULL) {
         bytes = 0;
@@ -1655,7 +2590,6 @@ int DARSHAN_DECL(MPI_Scatter)(const void *sendbuf, int sendcount, MPI_Datatype s
     else {
         BYTECOUNTND(recvtype, recvcount);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_SCATTER);
     APMPI_POST_RECORD();
@@ -1674,6 +2608,7 @@ int DARSHAN_DECL(MPI_Scatterv)(const void *sendbuf, const int *sendcounts, const
 
     TIME_SYNC(__real_PMPI_Scatterv(sendbuf, sendcounts, displs, sendtype, recvbuf, recvcount, recvtype, root, comm));
     
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes;
     if (root == MPI_PROC_NULL) {
         bytes = 0;
@@ -1686,7 +2621,6 @@ int DARSHAN_DECL(MPI_Scatterv)(const void *sendbuf, const int *sendcounts, const
     } else {
         BYTECOUNTND(recvtype, recvcount);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_SCATTERV);
     APMPI_POST_RECORD();
@@ -1705,11 +2639,11 @@ int DARSHAN_DECL(MPI_Reduce_scatter)(const void *sendbuf, void *recvbuf, const i
     TIME_SYNC(__real_PMPI_Reduce_scatter(sendbuf, recvbuf, recvcounts,
                        datatype, op, comm));
 
+    APMPI_PRE_COUNT();
     int i, tasks, num = 0;
     PMPI_Comm_size(comm, &tasks);
     for (i=0; i<tasks; i++) num += recvcounts[i];
     BYTECOUNT(datatype, num);
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_REDUCE_SCATTER);
     APMPI_POST_RECORD();
@@ -1725,6 +2659,7 @@ int DARSHAN_DECL(MPI_Scan)(const void *sendbuf, void *recvbuf, int count, MPI_Da
 
     TIME_SYNC(__real_PMPI_Scan(sendbuf, recvbuf, count, datatype, op, comm));
     
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_SCAN);
@@ -1741,6 +2676,7 @@ int DARSHAN_DECL(MPI_Exscan)(const void *sendbuf, void *recvbuf, int count, MPI_
 
     TIME_SYNC(__real_PMPI_Exscan(sendbuf, recvbuf, count, datatype, op, comm));
 
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE_SYNC(MPI_EXSCAN);
@@ -1750,6 +2686,121 @@ int DARSHAN_DECL(MPI_Exscan)(const void *sendbuf, void *recvbuf, int count, MPI_
 DARSHAN_WRAPPER_MAP(PMPI_Exscan, int, (const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype,
                MPI_Op op, MPI_Comm comm), MPI_Exscan)
 
+/* Neighborhood collective operations */
+int DARSHAN_DECL(MPI_Neighbor_allgather)(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                  void *recvbuf, int recvcount, MPI_Datatype recvtype,
+                  MPI_Comm comm)
+{
+    MAP_OR_FAIL(PMPI_Neighbor_allgather);
+
+    TIME_SYNC(__real_PMPI_Neighbor_allgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm));
+
+    APMPI_PRE_COUNT();
+    int indegree, outdegree;
+    apmpi_get_neighbors(comm, &indegree, &outdegree);
+    BYTECOUNT(recvtype, recvcount);
+    bytes = bytes*indegree;
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE_SYNC(MPI_NEIGHBOR_ALLGATHER);
+    APMPI_POST_RECORD();
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Neighbor_allgather, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                  void *recvbuf, int recvcount, MPI_Datatype recvtype,
+                  MPI_Comm comm), MPI_Neighbor_allgather)
+
+int DARSHAN_DECL(MPI_Neighbor_allgatherv)(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                   void *recvbuf, const int recvcounts[], const int displs[],
+                   MPI_Datatype recvtype, MPI_Comm comm)
+{
+    MAP_OR_FAIL(PMPI_Neighbor_allgatherv);
+
+    TIME_SYNC(__real_PMPI_Neighbor_allgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, comm));
+
+    APMPI_PRE_COUNT();
+    int i, indegree, outdegree, count = 0;
+    apmpi_get_neighbors(comm, &indegree, &outdegree);
+    for (i=0; i<indegree; i++) count += recvcounts[i];
+    BYTECOUNT(recvtype, count);
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE_SYNC(MPI_NEIGHBOR_ALLGATHERV);
+    APMPI_POST_RECORD();
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Neighbor_allgatherv, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                   void *recvbuf, const int recvcounts[], const int displs[],
+                   MPI_Datatype recvtype, MPI_Comm comm), MPI_Neighbor_allgatherv)
+
+int DARSHAN_DECL(MPI_Neighbor_alltoall)(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype,
+                 MPI_Comm comm)
+{
+    MAP_OR_FAIL(PMPI_Neighbor_alltoall);
+
+    TIME_SYNC(__real_PMPI_Neighbor_alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm));
+
+    APMPI_PRE_COUNT();
+    int indegree, outdegree;
+    apmpi_get_neighbors(comm, &indegree, &outdegree);
+    BYTECOUNT(recvtype, recvcount);
+    bytes = bytes*indegree;
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE_SYNC(MPI_NEIGHBOR_ALLTOALL);
+    APMPI_POST_RECORD();
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Neighbor_alltoall, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype,
+                 MPI_Comm comm), MPI_Neighbor_alltoall)
+
+int DARSHAN_DECL(MPI_Neighbor_alltoallv)(const void *sendbuf, const int sendcounts[], const int sdispls[],
+                MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int rdispls[],
+                MPI_Datatype recvtype, MPI_Comm comm)
+{
+    MAP_OR_FAIL(PMPI_Neighbor_alltoallv);
+
+    TIME_SYNC(__real_PMPI_Neighbor_alltoallv(sendbuf, sendcounts, sdispls, sendtype, recvbuf, recvcounts, rdispls, recvtype, comm));
+
+    APMPI_PRE_COUNT();
+    int i, indegree, outdegree, count = 0;
+    apmpi_get_neighbors(comm, &indegree, &outdegree);
+    for (i=0; i<indegree; i++) count += recvcounts[i];
+    BYTECOUNT(recvtype, count);
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE_SYNC(MPI_NEIGHBOR_ALLTOALLV);
+    APMPI_POST_RECORD();
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Neighbor_alltoallv, int, (const void *sendbuf, const int sendcounts[], const int sdispls[],
+                 MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int rdispls[],
+                 MPI_Datatype recvtype, MPI_Comm comm), MPI_Neighbor_alltoallv)
+
+int DARSHAN_DECL(MPI_Neighbor_alltoallw)(const void *sendbuf, const int sendcounts[], const MPI_Aint sdispls[],
+                const MPI_Datatype sendtypes[], void *recvbuf, const int recvcounts[], const MPI_Aint rdispls[],
+                const MPI_Datatype recvtypes[], MPI_Comm comm)
+{
+    MAP_OR_FAIL(PMPI_Neighbor_alltoallw);
+
+    TIME_SYNC(__real_PMPI_Neighbor_alltoallw(sendbuf, sendcounts, sdispls, sendtypes, recvbuf, recvcounts, rdispls, recvtypes, comm));
+
+    APMPI_PRE_COUNT();
+    ap_bytes_t bytes = 0, tmp_bytes = 0;
+    int i, indegree, outdegree;
+    apmpi_get_neighbors(comm, &indegree, &outdegree);
+    for (i=0; i<indegree; i++) {
+      BYTECOUNTND(recvtypes[i], recvcounts[i]);
+      tmp_bytes += bytes;
+    }
+    bytes = tmp_bytes;
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE_SYNC(MPI_NEIGHBOR_ALLTOALLW);
+    APMPI_POST_RECORD();
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Neighbor_alltoallw, int, (const void *sendbuf, const int sendcounts[], const MPI_Aint sdispls[],
+                 const MPI_Datatype sendtypes[], void *recvbuf, const int recvcounts[], const MPI_Aint rdispls[],
+                 const MPI_Datatype recvtypes[], MPI_Comm comm), MPI_Neighbor_alltoallw)
+
 /* Nonblocking collective operations */
 int DARSHAN_DECL(MPI_Ibarrier)(MPI_Comm comm, MPI_Request * request)
 {
@@ -1770,11 +2821,11 @@ int DARSHAN_DECL(MPI_Ibcast)(void *buffer, int count, MPI_Datatype datatype, int
     
     TIME(__real_PMPI_Ibcast(buffer, count, datatype, root, comm, request));
 
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes = 0;
     if (root != MPI_PROC_NULL) {
         BYTECOUNTND(datatype, count);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IBCAST);
     APMPI_POST_RECORD();
@@ -1789,11 +2840,11 @@ int DARSHAN_DECL(MPI_Ireduce)(const void *sendbuf, void *recvbuf, int count, MPI
   
     TIME(__real_PMPI_Ireduce(sendbuf, recvbuf, count, datatype, op, root, comm, request));
 
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes = 0;
     if (root != MPI_PROC_NULL) {
         BYTECOUNTND(datatype, count);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IREDUCE);
     APMPI_POST_RECORD();
@@ -1808,8 +2859,8 @@ int DARSHAN_DECL(MPI_Iallreduce)(const void *sendbuf, void *recvbuf, int count,
 
     TIME(__real_PMPI_Iallreduce(sendbuf, recvbuf, count, datatype, op, comm, request));
 
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IALLREDUCE);
     APMPI_POST_RECORD();
@@ -1826,11 +2877,11 @@ int DARSHAN_DECL(MPI_Ialltoall)(const void *sendbuf, int sendcount, MPI_Datatype
   
     TIME(__real_PMPI_Ialltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm, request));
 
+    APMPI_PRE_COUNT();
     BYTECOUNT(recvtype, recvcount);
     int tasks;
     PMPI_Comm_size(comm, &tasks);
     bytes = bytes*tasks;
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IALLTOALL);
     APMPI_POST_RECORD();
@@ -1848,11 +2899,11 @@ int DARSHAN_DECL(MPI_Ialltoallv)(const void *sendbuf, const int *sendcounts, con
   
     TIME(__real_PMPI_Ialltoallv(sendbuf, sendcounts, sdispls, sendtype, recvbuf, recvcounts, rdispls, recvtype, comm, request));
 
+    APMPI_PRE_COUNT();
     int i, tasks, count = 0;
     PMPI_Comm_size(comm, &tasks);
     for (i=0; i<tasks; i++) count += recvcounts[i];
     BYTECOUNT(recvtype, count);
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IALLTOALLV);
     APMPI_POST_RECORD();
@@ -1870,6 +2921,7 @@ int DARSHAN_DECL(MPI_Ialltoallw)(const void *sendbuf, const int sendcounts[], co
   
     TIME(__real_PMPI_Ialltoallw(sendbuf, sendcounts, sdispls, sendtypes, recvbuf, recvcounts, rdispls, recvtypes, comm, request));
 
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes = 0, tmp_bytes = 0;
     int i, tasks;
     PMPI_Comm_size(comm, &tasks);
@@ -1878,7 +2930,6 @@ int DARSHAN_DECL(MPI_Ialltoallw)(const void *sendbuf, const int sendcounts[], co
       tmp_bytes += bytes;
     }
     bytes = tmp_bytes;
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IALLTOALLW);
     APMPI_POST_RECORD();
@@ -1897,6 +2948,7 @@ int DARSHAN_DECL(MPI_Iallgather)(const void *sendbuf, int sendcount, MPI_Datatyp
 
     TIME(__real_PMPI_Iallgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm, request));
     
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes;
     if (sendbuf != MPI_IN_PLACE) {
         BYTECOUNTND(sendtype, sendcount);
@@ -1904,7 +2956,6 @@ int DARSHAN_DECL(MPI_Iallgather)(const void *sendbuf, int sendcount, MPI_Datatyp
     else {
         BYTECOUNTND(recvtype, recvcount);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IALLGATHER);
     APMPI_POST_RECORD();
@@ -1922,6 +2973,7 @@ int DARSHAN_DECL(MPI_Iallgatherv)(const void *sendbuf, int sendcount, MPI_Dataty
 
     TIME(__real_PMPI_Iallgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, comm, request));
     
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes;
     if (sendbuf != MPI_IN_PLACE) {
          BYTECOUNTND(sendtype, sendcount);
@@ -1931,7 +2983,6 @@ int DARSHAN_DECL(MPI_Iallgatherv)(const void *sendbuf, int sendcount, MPI_Dataty
         PMPI_Comm_rank(comm, &rank);
         BYTECOUNTND(recvtype, recvcounts[rank]);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IALLGATHERV);
     APMPI_POST_RECORD();
@@ -1948,6 +2999,7 @@ int DARSHAN_DECL(MPI_Igather)(const void *sendbuf, int sendcount, MPI_Datatype s
 
     TIME(__real_PMPI_Igather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm, request));
     
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes = 0;
     if (root == MPI_PROC_NULL) {
         bytes = 0;
@@ -1961,7 +3013,6 @@ int DARSHAN_DECL(MPI_Igather)(const void *sendbuf, int sendcount, MPI_Datatype s
     else {
         BYTECOUNTND(sendtype, sendcount);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IGATHER);
     APMPI_POST_RECORD();
@@ -1978,6 +3029,7 @@ int DARSHAN_DECL(MPI_Igatherv)(const void *sendbuf, int sendcount, MPI_Datatype
 
     TIME(__real_PMPI_Igatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, root, comm, request));
     
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes = 0;
     if (root == MPI_PROC_NULL) {
         bytes = 0;
@@ -1991,7 +3043,6 @@ int DARSHAN_DECL(MPI_Igatherv)(const void *sendbuf, int sendcount, MPI_Datatype
     else {
         BYTECOUNTND(sendtype, sendcount);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IGATHERV);
     APMPI_POST_RECORD();
@@ -2009,6 +3060,7 @@ int DARSHAN_DECL(MPI_Iscatter)(const void *sendbuf, int sendcount, MPI_Datatype
 
     TIME(__real_PMPI_Iscatter(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm, request));
     
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes;
      if (root == MPI_PROC_NULL) {
         bytes = 0;
@@ -2022,7 +3074,6 @@ int DARSHAN_DECL(MPI_Iscatter)(const void *sendbuf, int sendcount, MPI_Datatype
     else {
         BYTECOUNTND(recvtype, recvcount);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_ISCATTER);
     APMPI_POST_RECORD();
@@ -2041,6 +3092,7 @@ int DARSHAN_DECL(MPI_Iscatterv)(const void *sendbuf, const int sendcounts[], con
 
     TIME(__real_PMPI_Iscatterv(sendbuf, sendcounts, displs, sendtype, recvbuf, recvcount, recvtype, root, comm, request));
     
+    APMPI_PRE_COUNT();
     ap_bytes_t bytes;
     if (root == MPI_PROC_NULL) {
         bytes = 0;
@@ -2053,7 +3105,6 @@ int DARSHAN_DECL(MPI_Iscatterv)(const void *sendbuf, const int sendcounts[], con
     } else {
         BYTECOUNTND(recvtype, recvcount);
     }
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_ISCATTERV);
     APMPI_POST_RECORD();
@@ -2072,11 +3123,11 @@ int DARSHAN_DECL(MPI_Ireduce_scatter)(const void *sendbuf, void *recvbuf, const
     TIME(__real_PMPI_Ireduce_scatter(sendbuf, recvbuf, recvcounts,
                        datatype, op, comm, request));
 
+    APMPI_PRE_COUNT();
     int i, tasks, num = 0;
     PMPI_Comm_size(comm, &tasks);
     for (i=0; i<tasks; i++) num += recvcounts[i];
     BYTECOUNT(datatype, num);
-
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IREDUCE_SCATTER);
     APMPI_POST_RECORD();
@@ -2092,6 +3143,7 @@ int DARSHAN_DECL(MPI_Iscan)(const void *sendbuf, void *recvbuf, int count, MPI_D
 
     TIME(__real_PMPI_Iscan(sendbuf, recvbuf, count, datatype, op, comm, request));
     
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_ISCAN);
@@ -2108,6 +3160,7 @@ int DARSHAN_DECL(MPI_Iexscan)(const void *sendbuf, void *recvbuf, int count, MPI
 
     TIME(__real_PMPI_Iexscan(sendbuf, recvbuf, count, datatype, op, comm, request));
 
+    APMPI_PRE_COUNT();
     BYTECOUNT(datatype, count);
     APMPI_PRE_RECORD();
     APMPI_RECORD_UPDATE(MPI_IEXSCAN);
@@ -2117,6 +3170,121 @@ int DARSHAN_DECL(MPI_Iexscan)(const void *sendbuf, void *recvbuf, int count, MPI
 DARSHAN_WRAPPER_MAP(PMPI_Iexscan, int, (const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype,
                MPI_Op op, MPI_Comm comm, MPI_Request * request), MPI_Iexscan)
 
+/* Nonblocking neighborhood collective operations */
+int DARSHAN_DECL(MPI_Ineighbor_allgather)(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                  void *recvbuf, int recvcount, MPI_Datatype recvtype,
+                  MPI_Comm comm, MPI_Request * request)
+{
+    MAP_OR_FAIL(PMPI_Ineighbor_allgather);
+
+    TIME(__real_PMPI_Ineighbor_allgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm, request));
+
+    APMPI_PRE_COUNT();
+    int indegree, outdegree;
+    apmpi_get_neighbors(comm, &indegree, &outdegree);
+    BYTECOUNT(recvtype, recvcount);
+    bytes = bytes*indegree;
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE(MPI_INEIGHBOR_ALLGATHER);
+    APMPI_POST_RECORD();
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Ineighbor_allgather, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                  void *recvbuf, int recvcount, MPI_Datatype recvtype,
+                  MPI_Comm comm, MPI_Request * request), MPI_Ineighbor_allgather)
+
+int DARSHAN_DECL(MPI_Ineighbor_allgatherv)(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                   void *recvbuf, const int recvcounts[], const int displs[],
+                   MPI_Datatype recvtype, MPI_Comm comm, MPI_Request * request)
+{
+    MAP_OR_FAIL(PMPI_Ineighbor_allgatherv);
+
+    TIME(__real_PMPI_Ineighbor_allgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, comm, request));
+
+    APMPI_PRE_COUNT();
+    int i, indegree, outdegree, count = 0;
+    apmpi_get_neighbors(comm, &indegree, &outdegree);
+    for (i=0; i<indegree; i++) count += recvcounts[i];
+    BYTECOUNT(recvtype, count);
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE(MPI_INEIGHBOR_ALLGATHERV);
+    APMPI_POST_RECORD();
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Ineighbor_allgatherv, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                   void *recvbuf, const int recvcounts[], const int displs[],
+                   MPI_Datatype recvtype, MPI_Comm comm, MPI_Request * request), MPI_Ineighbor_allgatherv)
+
+int DARSHAN_DECL(MPI_Ineighbor_alltoall)(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype,
+                 MPI_Comm comm, MPI_Request * request)
+{
+    MAP_OR_FAIL(PMPI_Ineighbor_alltoall);
+
+    TIME(__real_PMPI_Ineighbor_alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm, request));
+
+    APMPI_PRE_COUNT();
+    int indegree, outdegree;
+    apmpi_get_neighbors(comm, &indegree, &outdegree);
+    BYTECOUNT(recvtype, recvcount);
+    bytes = bytes*indegree;
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE(MPI_INEIGHBOR_ALLTOALL);
+    APMPI_POST_RECORD();
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Ineighbor_alltoall, int, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype,
+                 MPI_Comm comm, MPI_Request * request), MPI_Ineighbor_alltoall)
+
+int DARSHAN_DECL(MPI_Ineighbor_alltoallv)(const void *sendbuf, const int sendcounts[], const int sdispls[],
+                MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int rdispls[],
+                MPI_Datatype recvtype, MPI_Comm comm, MPI_Request * request)
+{
+    MAP_OR_FAIL(PMPI_Ineighbor_alltoallv);
+
+    TIME(__real_PMPI_Ineighbor_alltoallv(sendbuf, sendcounts, sdispls, sendtype, recvbuf, recvcounts, rdispls, recvtype, comm, request));
+
+    APMPI_PRE_COUNT();
+    int i, indegree, outdegree, count = 0;
+    apmpi_get_neighbors(comm, &indegree, &outdegree);
+    for (i=0; i<indegree; i++) count += recvcounts[i];
+    BYTECOUNT(recvtype, count);
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE(MPI_INEIGHBOR_ALLTOALLV);
+    APMPI_POST_RECORD();
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Ineighbor_alltoallv, int, (const void *sendbuf, const int sendcounts[], const int sdispls[],
+                 MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int rdispls[],
+                 MPI_Datatype recvtype, MPI_Comm comm, MPI_Request * request), MPI_Ineighbor_alltoallv)
+
+int DARSHAN_DECL(MPI_Ineighbor_alltoallw)(const void *sendbuf, const int sendcounts[], const MPI_Aint sdispls[],
+                const MPI_Datatype sendtypes[], void *recvbuf, const int recvcounts[], const MPI_Aint rdispls[],
+                const MPI_Datatype recvtypes[], MPI_Comm comm, MPI_Request * request)
+{
+    MAP_OR_FAIL(PMPI_Ineighbor_alltoallw);
+
+    TIME(__real_PMPI_Ineighbor_alltoallw(sendbuf, sendcounts, sdispls, sendtypes, recvbuf, recvcounts, rdispls, recvtypes, comm, request));
+
+    APMPI_PRE_COUNT();
+    ap_bytes_t bytes = 0, tmp_bytes = 0;
+    int i, indegree, outdegree;
+    apmpi_get_neighbors(comm, &indegree, &outdegree);
+    for (i=0; i<indegree; i++) {
+      BYTECOUNTND(recvtypes[i], recvcounts[i]);
+      tmp_bytes += bytes;
+    }
+    bytes = tmp_bytes;
+    APMPI_PRE_RECORD();
+    APMPI_RECORD_UPDATE(MPI_INEIGHBOR_ALLTOALLW);
+    APMPI_POST_RECORD();
+    return ret;
+}
+DARSHAN_WRAPPER_MAP(PMPI_Ineighbor_alltoallw, int, (const void *sendbuf, const int sendcounts[], const MPI_Aint sdispls[],
+                 const MPI_Datatype sendtypes[], void *recvbuf, const int recvcounts[], const MPI_Aint rdispls[],
+                 const MPI_Datatype recvtypes[], MPI_Comm comm, MPI_Request * request), MPI_Ineighbor_alltoallw)
+
 /*
 int DARSHAN_DECL(MPI_ )()
 {
@@ -48,6 +48,84 @@ from matplotlib.figure import Figure
 #inspect(color, methods=True)
 
 
+# message size buckets of the ops with message counters, following their
+# _CALL_COUNT and _TOTAL_BYTES counters
+HIST_BUCKETS = [
+    ("[0-256B]", "MSG_SIZE_AGG_0_256"),
+    ("[256-1KB]", "MSG_SIZE_AGG_256_1K"),
+    ("[1K-8KB]", "MSG_SIZE_AGG_1K_8K"),
+    ("[8K-256KB]", "MSG_SIZE_AGG_8K_256K"),
+    ("256K-1MB", "MSG_SIZE_AGG_256K_1M"),
+    ("[>1MB]", "MSG_SIZE_AGG_1M_PLUS"),
+]
+
+
+def load_apmpi(report):
+    """
+    Load the header record and a wide DataFrame of the APMPI perf records,
+    one row per rank and one column per counter.
+    """
+    if hasattr(backend, "log_get_apmpi_records"):
+        data = backend.log_get_apmpi_records(report.log, "APMPI")
+        names = data["counter_names"]
+        arrays = ["counters", "fcounters", "fsynccounters", "fglobalcounters",
+                  "rmacounters", "frmacounters"]
+        df = pd.concat(
+            [pd.DataFrame(data[a], columns=names[a]) for a in arrays], axis=1
+        )
+        df.insert(0, "Node_ID", [n.decode("utf-8") for n in data["node_name"]])
+        df.insert(0, "Rank", data["rank"])
+        return data["header"], df
+
+    # backends without the batch reader
+    report.mod_read_all_apmpi_records("APMPI")
+    header_rec = report.records["APMPI"][0]
+    recs = report.records["APMPI"][1:]
+    df = pd.DataFrame.from_records([rec["all_counters"] for rec in recs])
+    df.insert(0, "Node_ID", [rec["node_name"] for rec in recs])
+    df.insert(0, "Rank", [rec["rank"] for rec in recs])
+    return header_rec, df
+
+
+def mpiop_stats(df, sync_flag):
+    """
+    Stats of every (rank, op) with calls, from the wide DataFrame. The ops
+    are found once from the counter names and their counters gathered for
+    all the ranks at once as (ranks x ops) arrays.
+    """
+    cols = list(df.columns)
+    ops = [c[: -len("_CALL_COUNT")] for c in cols if c.endswith("_CALL_COUNT")]
+    count = df[[op + "_CALL_COUNT" for op in ops]].to_numpy()
+    # the time counters are a TOTAL/MIN/MAX triplet per op
+    times = df[[op + t for op in ops for t in ("_TOTAL_TIME", "_MIN_TIME", "_MAX_TIME")]] \
+        .to_numpy().reshape(len(df), len(ops), 3)
+
+    rows, opidx = np.nonzero(count)
+    stats = {
+        "Rank": df["Rank"].to_numpy()[rows],
+        "Node_ID": df["Node_ID"].to_numpy()[rows],
+        "Call": np.array(ops, dtype=object)[opidx],
+        "Total_Time": times[rows, opidx, 0],
+        "Count": count[rows, opidx],
+    }
+
+    # ops without message counters, and their buckets, are left as NaN
+    def op_column(suffix):
+        have = np.array([op + suffix in df.columns for op in ops])
+        val = np.full((len(df), len(ops)), np.nan)
+        val[:, have] = df[[op + suffix for op, h in zip(ops, have) if h]].to_numpy()
+        return val[rows, opidx]
+
+    stats["Total_Bytes"] = op_column("_TOTAL_BYTES")
+    for label, suffix in HIST_BUCKETS:
+        stats[label] = op_column("_" + suffix)
+    stats["Min_Time"] = times[rows, opidx, 1]
+    stats["Max_Time"] = times[rows, opidx, 2]
+    if sync_flag:
+        stats["Total_SYNC_Time"] = op_column("_TOTAL_SYNC_TIME")
+    return pd.DataFrame(stats)
+
+
 def main():
     parser = argparse.ArgumentParser()
     parser.add_argument(
@@ -68,14 +146,13 @@ def main():
     if "APMPI" not in report.modules:
         print("This log does not contain AutoPerf MPI data")
         return
-    r = report.mod_read_all_apmpi_records("APMPI")
+    header_rec, df_wide = load_apmpi(report)
     
     report.update_name_records()
     report.info()
     
     pdf = matplotlib.backends.backend_pdf.PdfPages("apmpi_output.pdf")
 
-    header_rec = report.records["APMPI"][0]
     sync_flag = header_rec["sync_flag"]
     print("sync_flag= ", sync_flag)
     print(
@@ -87,75 +164,39 @@ def main():
             header_rec["variance_total_mpisynctime"],
         )
 
-    df_apmpi = pd.DataFrame()
-    list_mpiop = []
-    list_rank = []
-    for rec in report.records["APMPI"][
-        1:
-    ]:  # skip the first record which is header record
-        mpi_nonzero_callcount = []
-        for k, v in rec["all_counters"].items():
-            if k.endswith("_CALL_COUNT") and v > 0:
-                mpi_nonzero_callcount.append(k[: -(len("CALL_COUNT"))])
-
-        df_rank = pd.DataFrame()
-        for mpiop in mpi_nonzero_callcount:
-            ncall = mpiop
-            ncount = mpiop + "CALL_COUNT"
-            nsize = mpiop + "TOTAL_BYTES"
-            h0 = mpiop + "MSG_SIZE_AGG_0_256"
-            h1 = mpiop + "MSG_SIZE_AGG_256_1K"
-            h2 = mpiop + "MSG_SIZE_AGG_1K_8K"
-            h3 = mpiop + "MSG_SIZE_AGG_8K_256K"
-            h4 = mpiop + "MSG_SIZE_AGG_256K_1M"
-            h5 = mpiop + "MSG_SIZE_AGG_1M_PLUS"
-            ntime = mpiop + "TOTAL_TIME"
-            mintime = mpiop + "MIN_TIME"
-            maxtime = mpiop + "MAX_TIME"
-            if sync_flag:
-                totalsync = mpiop + "TOTAL_SYNC_TIME"
-
-            mpiopstat = {}
-            mpiopstat["Rank"] = rec["rank"]
-            mpiopstat["Node_ID"] = rec["node_name"]
-            mpiopstat["Call"] = ncall[:-1]
-            mpiopstat["Total_Time"] = rec["all_counters"][ntime]
-            mpiopstat["Count"] = rec["all_counters"][ncount]
-            mpiopstat["Total_Bytes"] = rec["all_counters"].get(nsize, None)
-            mpiopstat["[0-256B]"] = rec["all_counters"].get(h0, None)
-            mpiopstat["[256-1KB]"] = rec["all_counters"].get(h1, None)
-            mpiopstat["[1K-8KB]"] = rec["all_counters"].get(h2, None)
-            mpiopstat["[8K-256KB]"] = rec["all_counters"].get(h3, None)
-            mpiopstat["256K-1MB"] = rec["all_counters"].get(h4, None)
-            mpiopstat["[>1MB]"] = rec["all_counters"].get(h5, None)
-            mpiopstat["Min_Time"] = rec["all_counters"][mintime]
-            mpiopstat["Max_Time"] = rec["all_counters"][maxtime]
-            if sync_flag and (totalsync in rec["all_counters"]):
-                mpiopstat["Total_SYNC_Time"] = rec["all_counters"][totalsync]
-
-            list_mpiop.append(mpiopstat)
-
-        rankstat = {}
-        rankstat["Rank"] = rec["rank"]
-        rankstat["Node_ID"] = rec["node_name"]
-        rankstat["Call"] = "Total_MPI_time"
-        rankstat["Total_Time"] = rec["all_counters"]["MPI_TOTAL_COMM_TIME"]
-        list_rank.append(rankstat)
-    df_rank = pd.DataFrame(list_rank)
+    df_mpiop = mpiop_stats(df_wide, sync_flag)
+
+    df_rank = pd.DataFrame({
+        "Rank": df_wide["Rank"],
+        "Node_ID": df_wide["Node_ID"],
+        "Call": "Total_MPI_time",
+        "Total_Time": df_wide["MPI_TOTAL_COMM_TIME"],
+    })
     avg_total_time = df_rank["Total_Time"].mean()
     max_total_time = df_rank["Total_Time"].max()
     min_total_time = df_rank["Total_Time"].min()
     max_rank = df_rank.loc[df_rank["Total_Time"].idxmax()]["Rank"]
     min_rank = df_rank.loc[df_rank["Total_Time"].idxmin()]["Rank"]
-    # assumption: row index and rank id are same in df_rank 
-    # .. need to check if that is an incorrect assumption
-    mean_rank = (
-        (df_rank["Total_Time"] - df_rank["Total_Time"].mean()).abs().argsort()[:1][0]
-    )
+    mean_rank = df_rank.loc[(df_rank["Total_Time"] - avg_total_time).abs().idxmin()]["Rank"]
+
+    # per op summaries across the ranks
+    df_ops = df_mpiop.groupby("Call").agg(
+        Ranks=("Rank", "size"),
+        Count=("Count", "sum"),
+        Total_Bytes=("Total_Bytes", "sum"),
+        Total_Time=("Total_Time", "sum"),
+        Mean_Time=("Total_Time", "mean"),
+        Min_Rank_Time=("Total_Time", "min"),
+        Max_Rank_Time=("Total_Time", "max"),
+        Min_Time=("Min_Time", "min"),
+        Max_Time=("Max_Time", "max"),
+    ).sort_values(by="Total_Time", ascending=False)
     pd.set_option("display.max_rows", None, "display.max_columns", None)
 
-    list_combined = list_mpiop + list_rank
-    df_apmpi = pd.DataFrame(list_combined)
+    print("MPI stats per op across all ranks\n", df_ops)
+    print("\n\n")
+
+    df_apmpi = pd.concat([df_mpiop, df_rank], ignore_index=True)
     df_apmpi = df_apmpi.sort_values(by=["Rank", "Total_Time"], ascending=[True, False])
     df_call = df_apmpi[['Call', 'Total_Time']]
     #print("MPI stats for rank with maximum MPI time")#, border_style="blue")
@@ -169,6 +210,7 @@ def main():
     # print(df_apmpi)
     df_apmpi.to_csv('apmpi.csv', index=False)
     df_rank.to_csv('apmpi_rank.csv', index=False)
+    df_ops.to_csv('apmpi_ops.csv')
 
     env = jinja2.Environment(loader=jinja2.FileSystemLoader(searchpath='.'))
     template = env.get_template('template.html')
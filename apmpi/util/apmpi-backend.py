@@ -9,10 +9,13 @@ structdefs = '''
 struct darshan_apmpi_perf_record
 {
     struct darshan_base_record base_rec;
-    uint64_t counters[396];
-    double fcounters[222];
-    double fsynccounters[16];
+    uint64_t counters[512];
+    double fcounters[276];
+    double fsynccounters[21];
     double fglobalcounters[2];
+    uint64_t rmacounters[16];
+    double frmacounters[7];
+    double pvarcounters[16];
     char   node_name[128];
 };
 struct darshan_apmpi_header_record
@@ -22,12 +25,33 @@ struct darshan_apmpi_header_record
     uint32_t sync_flag;
     double apmpi_f_variance_total_mpitime;
     double apmpi_f_variance_total_mpisynctime;
+    uint32_t pvar_count;
+    char pvar_names[16][64];
 };
 
 extern char *apmpi_counter_names[];
 extern char *apmpi_f_mpiop_totaltime_counter_names[]; 
 extern char *apmpi_f_mpiop_synctime_counter_names[];
 extern char *apmpi_f_mpi_global_counter_names[];
+extern char *apmpi_rma_counter_names[];
+extern char *apmpi_f_rma_counter_names[];
+
+struct darshan_apmpi_node_stats
+{
+    char node_name[128];
+    int64_t nranks;
+    double mpi_time_sum;
+    double mpi_time_max;
+    double sync_time_sum;
+    double sync_time_max;
+    double bytes_sum;
+    double bytes_max;
+};
+struct darshan_apmpi_nodes *darshan_log_apmpi_nodes_create(void);
+int darshan_log_apmpi_nodes_add(struct darshan_apmpi_nodes *nodes, void *rec);
+int darshan_log_apmpi_nodes_get(struct darshan_apmpi_nodes *nodes,
+    struct darshan_apmpi_node_stats **stats);
+void darshan_log_apmpi_nodes_destroy(struct darshan_apmpi_nodes *nodes);
 
 '''
 
@@ -35,13 +59,62 @@ def get_apmpi_defs():
   return structdefs
 
 
+APMPI_MAGIC = int.from_bytes(b'APMPI', 'big')
+
+_primitive_dtypes = {'uint64_t': np.uint64, 'int64_t': np.int64,
+                     'uint32_t': np.uint32, 'int32_t': np.int32,
+                     'double': np.float64}
+
+
+# numpy dtype with the layout of a struct of the cffi defs, so that records
+# can be copied into numpy arrays whole and their counters viewed there
+def _struct_dtype(ffi, ctype):
+    names = []
+    formats = []
+    offsets = []
+    if isinstance(ctype, str):
+      ctype = ffi.typeof(ctype)
+    for name, field in ctype.fields:
+      t = field.type
+      if t.kind == 'struct':
+        fmt = _struct_dtype(ffi, t)
+      elif t.kind == 'array' and t.item.cname == 'char':
+        fmt = 'S%d' % t.length
+      elif t.kind == 'array':
+        fmt = (_primitive_dtypes[t.item.cname], t.length)
+      else:
+        fmt = _primitive_dtypes[t.cname]
+      names.append(name)
+      formats.append(fmt)
+      offsets.append(field.offset)
+    return np.dtype({'names': names, 'formats': formats, 'offsets': offsets,
+                     'itemsize': ffi.sizeof(ctype)})
+
+
+# view a counter array of a record as numpy, without copying it out
+def _counters(ffi, arr, dtype):
+    return np.frombuffer(ffi.buffer(arr), dtype=dtype)
+
+
+def _get_apmpi_header(ffi, hdr):
+    rec = {}
+    rec['id'] = hdr.base_rec.id
+    rec['rank'] = hdr.base_rec.rank
+    rec['magic'] = hdr.magic
+    rec['sync_flag'] = hdr.sync_flag
+    rec['variance_total_mpitime'] = hdr.apmpi_f_variance_total_mpitime
+    rec['variance_total_mpisynctime'] = hdr.apmpi_f_variance_total_mpisynctime
+    rec['pvar_names'] = [ffi.string(hdr.pvar_names[i]).decode("utf-8")
+                         for i in range(0, min(hdr.pvar_count, 16))]
+    return rec
+
+
 # load header record
 def log_get_apmpi_record(log, mod_name, structname, dtype='dict'):
     from darshan.backend.cffi_backend import ffi, libdutil, log_get_modules, counter_names, _structdefs
 
     modules = log_get_modules(log)
 
-    rec = {}
     buf = ffi.new("void **")
     r = libdutil.darshan_log_get_record(log['handle'], modules[mod_name]['idx'], buf)
     mod_type = _structdefs[mod_name+"-"+structname]
@@ -51,60 +124,191 @@ def log_get_apmpi_record(log, mod_name, structname, dtype='dict'):
 
     if mod_type == 'struct darshan_apmpi_header_record **':
         hdr = ffi.cast(mod_type, buf)
-        rec['id'] = hdr[0].base_rec.id
-        rec['rank'] = hdr[0].base_rec.rank
-        rec['magic'] = hdr[0].magic
-        rec['sync_flag'] = hdr[0].sync_flag
-        rec['variance_total_mpitime'] = hdr[0].apmpi_f_variance_total_mpitime
-        rec['variance_total_mpisynctime'] = hdr[0].apmpi_f_variance_total_mpisynctime
+        rec = _get_apmpi_header(ffi, hdr[0])
     else:
+        rec = {}
         prf = ffi.cast(mod_type, buf)
         rec['id'] = prf[0].base_rec.id
         rec['rank'] = prf[0].base_rec.rank
         rec['node_name'] = ffi.string(prf[0].node_name).decode("utf-8")
-        
-        lst = []
-        for i in range(0, len(prf[0].counters)):
-            lst.append(prf[0].counters[i])
-        np_counters = np.array(lst, dtype=np.uint64)
+
+        # views of the record, which the backend leaves allocated
+        np_counters = _counters(ffi, prf[0].counters, np.uint64)
         d_counters = dict(zip(counter_names(mod_name), np_counters))
 
-        lst = []
-        for i in range(0, len(prf[0].fcounters)):
-            lst.append(prf[0].fcounters[i])
-        np_fcounters = np.array(lst, dtype=np.float64)
+        np_fcounters = _counters(ffi, prf[0].fcounters, np.float64)
         d_fcounters = dict(zip(counter_names(mod_name, fcnts=True, special='mpiop_totaltime_'), np_fcounters))
 
-        lst = []
-        for i in range(0, len(prf[0].fsynccounters)):
-            lst.append(prf[0].fsynccounters[i])
-        np_fsynccounters = np.array(lst, dtype=np.float64)
+        np_fsynccounters = _counters(ffi, prf[0].fsynccounters, np.float64)
         d_fsynccounters = dict(zip(counter_names(mod_name, fcnts=True, special='mpiop_synctime_'), np_fsynccounters))
 
-        lst = []
-        for i in range(0, len(prf[0].fglobalcounters)):
-            lst.append(prf[0].fglobalcounters[i])
-        np_fglobalcounters = np.array(lst, dtype=np.float64)
+        np_fglobalcounters = _counters(ffi, prf[0].fglobalcounters, np.float64)
         d_fglobalcounters = dict(zip(counter_names(mod_name, fcnts=True, special='mpi_global_'), np_fglobalcounters))
+
+        np_rmacounters = _counters(ffi, prf[0].rmacounters, np.uint64)
+        d_rmacounters = dict(zip(counter_names(mod_name, special='rma_'), np_rmacounters))
+
+        np_frmacounters = _counters(ffi, prf[0].frmacounters, np.float64)
+        d_frmacounters = dict(zip(counter_names(mod_name, fcnts=True, special='rma_'), np_frmacounters))
         
+        if dtype == 'numpy':
+            rec['counters'] = np_counters
+            rec['fcounters'] = np_fcounters
+            rec['fsynccounters'] = np_fsynccounters
+            rec['fglobalcounters'] = np_fglobalcounters
+            rec['rmacounters'] = np_rmacounters
+            rec['frmacounters'] = np_frmacounters
+
         rec['all_counters'] = {}
         rec['all_counters'].update(d_counters)
         rec['all_counters'].update(d_fcounters)
         rec['all_counters'].update(d_fsynccounters)
         rec['all_counters'].update(d_fglobalcounters)
+        rec['all_counters'].update(d_rmacounters)
+        rec['all_counters'].update(d_frmacounters)
+
+        # values of the MPI_T pvars, named by the 'pvar_names' of the header record
+        rec['pvarcounters'] = _counters(ffi, prf[0].pvarcounters, np.float64).tolist()
 
     return rec
 
 
-'''
-        if dtype == 'numpy':
-            rec['counters'] = np_counters
-            rec['fcounters'] = np_fcounters
-            rec['fsynccounters'] = np_fsynccounters
-            rec['fglobalcounters'] = np_fglobalcounters
+# load the header record and all the perf records of the log at once. The
+# perf records are copied whole into a numpy structured array, one row per
+# rank, of which 'counters', 'fcounters', ... are 2-D views (ranks x
+# counters) named by 'counter_names'. Reads the records of the module left
+# in the log, so is called on a log whose APMPI records were not read yet.
+def log_get_apmpi_records(log, mod_name='APMPI'):
+    from darshan.backend.cffi_backend import ffi, libdutil, log_get_modules, counter_names
+
+    modules = log_get_modules(log)
+    idx = modules[mod_name]['idx']
+
+    dt = _struct_dtype(ffi, 'struct darshan_apmpi_perf_record')
+    try:
+      from darshan.backend.cffi_backend import log_get_job
+      nrecs = max(int(log_get_job(log)['nprocs']), 1)
+    except Exception:
+      nrecs = 1024
+    recs = np.zeros(nrecs, dtype=dt)
+    base = ffi.cast('char *', ffi.from_buffer(recs))
+
+    hdr = None
+    count = 0
+    # one buffer, which darshan_log_get_record reuses for every record
+    buf = ffi.new("void **")
+    while libdutil.darshan_log_get_record(log['handle'], idx, buf) > 0:
+      if ffi.cast('struct darshan_apmpi_header_record *', buf[0]).magic == APMPI_MAGIC:
+        hdr = _get_apmpi_header(ffi, ffi.cast('struct darshan_apmpi_header_record *', buf[0]))
+        continue
+      if count == len(recs):
+        recs = np.concatenate((recs, np.zeros(len(recs), dtype=dt)))
+        base = ffi.cast('char *', ffi.from_buffer(recs))
+      ffi.memmove(base + count * dt.itemsize, buf[0], dt.itemsize)
+      count += 1
+    if buf[0] != ffi.NULL and hasattr(libdutil, 'darshan_free'):
+      libdutil.darshan_free(buf[0])
+
+    recs = recs[:count]
+    pvar_names = hdr['pvar_names'] if hdr else []
+    return {
+      'header': hdr,
+      'records': recs,
+      'id': recs['base_rec']['id'],
+      'rank': recs['base_rec']['rank'],
+      'node_name': recs['node_name'],
+      'counters': recs['counters'],
+      'fcounters': recs['fcounters'],
+      'fsynccounters': recs['fsynccounters'],
+      'fglobalcounters': recs['fglobalcounters'],
+      'rmacounters': recs['rmacounters'],
+      'frmacounters': recs['frmacounters'],
+      'pvarcounters': recs['pvarcounters'][:, :len(pvar_names)],
+      'counter_names': {
+        'counters': counter_names(mod_name),
+        'fcounters': counter_names(mod_name, fcnts=True, special='mpiop_totaltime_'),
+        'fsynccounters': counter_names(mod_name, fcnts=True, special='mpiop_synctime_'),
+        'fglobalcounters': counter_names(mod_name, fcnts=True, special='mpi_global_'),
+        'rmacounters': counter_names(mod_name, special='rma_'),
+        'frmacounters': counter_names(mod_name, fcnts=True, special='rma_'),
+        'pvarcounters': pvar_names,
+      },
+    }
+
+
+_node_fields = ['nranks', 'mpi_time_sum', 'mpi_time_max', 'sync_time_sum',
+                'sync_time_max', 'bytes_sum', 'bytes_max']
+
+
+# per node rollup of the perf records, grouped by node_name as they are
+# read, without keeping the ranks: the nranks and the sum and max across the
+# node's ranks of their MPI time, sync time (0 unless the log recorded it)
+# and bytes, as arrays of one value per node, sorted by 'node_name'. Grouped
+# by the logutils' darshan_log_apmpi_nodes_* where the library has them.
+# Like log_get_apmpi_records, reads the records of the module left in the
+# log.
+def log_get_apmpi_nodes(log, mod_name='APMPI'):
+    from darshan.backend.cffi_backend import ffi, libdutil, log_get_modules, counter_names
+
+    modules = log_get_modules(log)
+    idx = modules[mod_name]['idx']
+
+    hdr = None
+    buf = ffi.new("void **")
+    if hasattr(libdutil, 'darshan_log_apmpi_nodes_create'):
+      nodes = libdutil.darshan_log_apmpi_nodes_create()
+      if nodes == ffi.NULL:
+        raise MemoryError("unable to allocate the APMPI node rollup")
+      try:
+        while libdutil.darshan_log_get_record(log['handle'], idx, buf) > 0:
+          if ffi.cast('struct darshan_apmpi_header_record *', buf[0]).magic == APMPI_MAGIC:
+            hdr = _get_apmpi_header(ffi, ffi.cast('struct darshan_apmpi_header_record *', buf[0]))
+          if libdutil.darshan_log_apmpi_nodes_add(nodes, buf[0]) < 0:
+            raise MemoryError("unable to allocate the APMPI node rollup")
+        stats = ffi.new("struct darshan_apmpi_node_stats **")
+        n = libdutil.darshan_log_apmpi_nodes_get(nodes, stats)
+        if n < 0:
+          raise MemoryError("unable to allocate the APMPI node rollup")
+        dt = _struct_dtype(ffi, 'struct darshan_apmpi_node_stats')
+        recs = np.frombuffer(ffi.buffer(stats[0], n * dt.itemsize), dtype=dt).copy()
+      finally:
+        libdutil.darshan_log_apmpi_nodes_destroy(nodes)
+      names = [name.decode('utf-8') for name in recs['node_name']]
+      cols = {f: recs[f] for f in _node_fields}
+    else:
+      # bytes of the ops that move data; the window ops' bytes are sizes
+      names_c = counter_names(mod_name)
+      bytes_idx = np.array([i for i, c in enumerate(names_c)
+                            if c.endswith('_TOTAL_BYTES') and not c.startswith('MPI_WIN_')])
+      groups = {}
+      while libdutil.darshan_log_get_record(log['handle'], idx, buf) > 0:
+        if ffi.cast('struct darshan_apmpi_header_record *', buf[0]).magic == APMPI_MAGIC:
+          hdr = _get_apmpi_header(ffi, ffi.cast('struct darshan_apmpi_header_record *', buf[0]))
+          continue
+        prf = ffi.cast('struct darshan_apmpi_perf_record *', buf[0])
+        glob = _counters(ffi, prf.fglobalcounters, np.float64)
+        mpi_time = float(glob[0])
+        sync_time = float(glob[1]) if hdr and hdr['sync_flag'] else 0.0
+        nbytes = float(_counters(ffi, prf.counters, np.uint64)[bytes_idx].sum())
+        name = ffi.string(prf.node_name).decode('utf-8')
+        g = groups.get(name)
+        if g is None:
+          groups[name] = [1, mpi_time, mpi_time, sync_time, sync_time, nbytes, nbytes]
         else:
-            rec['counters'] = d_counters
-            rec['fcounters'] = d_fcounters
-            rec['fsynccounters'] = d_fsynccounters
-            rec['fglobalcounters'] = d_fglobalcounters
-'''    
+          g[0] += 1
+          g[1] += mpi_time
+          g[2] = max(g[2], mpi_time)
+          g[3] += sync_time
+          g[4] = max(g[4], sync_time)
+          g[5] += nbytes
+          g[6] = max(g[6], nbytes)
+      names = sorted(groups)
+      cols = {f: np.array([groups[name][i] for name in names],
+                          dtype=np.int64 if f == 'nranks' else np.float64)
+              for i, f in enumerate(_node_fields)}
+    if buf[0] != ffi.NULL and hasattr(libdutil, 'darshan_free'):
+      libdutil.darshan_free(buf[0])
+
+    rollup = {'header': hdr, 'node_name': names}
+    rollup.update(cols)
+    return rollup
@@ -0,0 +1,399 @@
+/*
+ * Copyright (C) 2018 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Summarized diff of the AutoPerf data of two Darshan logs.
+ *
+ * Where darshan-diff prints every counter of every rank that differs, this
+ * aggregates the APMPI records of each log across its ranks (the module's
+ * log_agg_records) and prints, per MPI op, the relative change of its
+ * calls, bytes and time from the first log to the second: a summary of an
+ * A/B comparison of two runs, e.g. before and after an MPI library
+ * upgrade. With APXC built in, the router counters are summed over the
+ * routers and compared per event in the same way.
+ *
+ * usage: darshan-apmpi-diff [-t <pct>] [-m <seconds>] <log1> <log2>
+ *
+ *   -t  only ops (events) that changed by more than <pct>% in one of
+ *       their values (default 5)
+ *   -m  only ops with more than <seconds> of time per rank in one of the
+ *       logs (default 0), to leave out the noise of ops barely used
+ *
+ * Op values are means per rank, so that runs of different sizes compare;
+ * router events are totals. Ops are printed by decreasing change of their
+ * time, events by decreasing relative change.
+ */
+
+#include "darshan-util-config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <inttypes.h>
+
+#include "darshan-logutils.h"
+#include "darshan-apmpi-log-format.h"
+#include "darshan-apmpi-logutils.h"
+#ifdef DARSHAN_USE_APXC
+#include "darshan-apxc-log-format.h"
+#include "darshan-apxc-logutils.h"
+#endif
+
+/* an MPI op and its counters; ops without message counters have no bytes */
+struct apmpi_diff_op
+{
+    const char *name;
+    int calls;
+    int bytes;
+    int time;
+};
+
+#define Y(a)
+#define Z(a)
+#define X(a) { #a, a ## _CALL_COUNT, a ## _TOTAL_BYTES, a ## _TOTAL_TIME },
+#define V(a) { #a, a ## _CALL_COUNT, -1, a ## _TOTAL_TIME },
+static const struct apmpi_diff_op apmpi_diff_ops[] = {
+    APMPI_MPIOP_COUNTERS
+};
+#undef X
+#undef V
+#undef Z
+#undef Y
+
+#define APMPI_DIFF_NOPS ((int)(sizeof(apmpi_diff_ops) / sizeof(apmpi_diff_ops[0])))
+
+/* the records of one log, aggregated */
+struct apmpi_diff_log
+{
+    int64_t nranks;
+    double variance;
+    struct darshan_apmpi_perf_record apmpi;
+#ifdef DARSHAN_USE_APXC
+    int64_t nrouters;
+    int event_count;
+    char event_names[APXC_MAX_EVENTS][APXC_EVENT_NAME_MAX];
+    /* room for APXC_MAX_EVENTS counters */
+    struct darshan_apxc_perf_record *apxc;
+#endif
+};
+
+/* a row of the diff */
+struct apmpi_diff_row
+{
+    const char *name;
+    double v1[3];
+    double v2[3];
+    /* the largest relative change of the row, and its change of time */
+    double change;
+    double delta;
+};
+
+static int load_log(const char *path, struct apmpi_diff_log *log)
+{
+    darshan_fd fd;
+    void *buf = NULL;
+    int ret = 0;
+
+    memset(log, 0, sizeof(*log));
+
+    fd = darshan_log_open(path);
+    if(!fd)
+        return(-1);
+
+    if(fd->mod_map[DARSHAN_APMPI_MOD].len == 0)
+    {
+        fprintf(stderr, "Error: %s has no APMPI records\n", path);
+        darshan_log_close(fd);
+        return(-1);
+    }
+
+    while((ret = apmpi_logutils.log_get_record(fd, &buf)) == 1)
+    {
+        if(((struct darshan_apmpi_header_record *)buf)->magic == APMPI_MAGIC)
+        {
+            log->variance = ((struct darshan_apmpi_header_record *)buf)->apmpi_f_variance_total_mpitime;
+            continue;
+        }
+        apmpi_logutils.log_agg_records(buf, &log->apmpi, log->nranks == 0);
+        log->nranks++;
+    }
+    /* sized for APMPI records */
+    free(buf);
+    buf = NULL;
+
+#ifdef DARSHAN_USE_APXC
+    if(ret == 0 && fd->mod_map[DARSHAN_APXC_MOD].len > 0)
+    {
+        struct darshan_apxc_header_record *hdr_rec;
+        char *names;
+        uint64_t off;
+        int64_t magic;
+        int i;
+
+        log->apxc = calloc(1, sizeof(*log->apxc) +
+            APXC_MAX_EVENTS * sizeof(log->apxc->counters[0]));
+        if(!log->apxc)
+            ret = -1;
+        while(log->apxc && (ret = apxc_logutils.log_get_record(fd, &buf)) == 1)
+        {
+            hdr_rec = buf;
+            magic = hdr_rec->magic;
+            if(magic == APXC_MAGIC)
+            {
+                /* the names follow the header, each NUL terminated */
+                names = (char *)(hdr_rec + 1);
+                off = 0;
+                for(i = 0; i < hdr_rec->event_count && i < APXC_MAX_EVENTS &&
+                    off < hdr_rec->event_names_size; i++)
+                {
+                    snprintf(log->event_names[i], APXC_EVENT_NAME_MAX, "%s", names + off);
+                    off += strlen(names + off) + 1;
+                }
+                log->event_count = i;
+                continue;
+            }
+            if(magic == APXC_SAMPLE_MAGIC || magic == APXC_PLACEMENT_MAGIC)
+                continue;
+            apxc_logutils.log_agg_records(buf, log->apxc, log->nrouters == 0);
+            log->nrouters++;
+        }
+        /* events no router has a counter for are not compared */
+        if(log->apxc && log->apxc->event_count < log->event_count)
+            log->event_count = log->apxc->event_count;
+    }
+#endif
+
+    free(buf);
+    darshan_log_close(fd);
+
+    if(ret < 0)
+        fprintf(stderr, "Error: failed to read the AutoPerf records of %s\n", path);
+    return(ret < 0 ? -1 : 0);
+}
+
+/* relative change from a to b, in percent; a value that appears or
+ * disappears is an infinite change
+ */
+static double rel_change(double a, double b)
+{
+    if(a == b)
+        return(0);
+    if(a == 0)
+        return(INFINITY);
+
+    return(100.0 * (b - a) / a);
+}
+
+static void set_change(struct apmpi_diff_row *row, int n)
+{
+    double c;
+    int i;
+
+    row->change = 0;
+    for(i = 0; i < n; i++)
+    {
+        c = fabs(rel_change(row->v1[i], row->v2[i]));
+        if(c > row->change)
+            row->change = c;
+    }
+
+    return;
+}
+
+static int cmp_rows_delta(const void *a, const void *b)
+{
+    double da = fabs(((const struct apmpi_diff_row *)a)->delta);
+    double db = fabs(((const struct apmpi_diff_row *)b)->delta);
+
+    return(da < db ? 1 : (da > db ? -1 : 0));
+}
+
+static void print_value(double a, double b, int is_time)
+{
+    if(is_time)
+        printf("\t%.6f\t%.6f", a, b);
+    else
+        printf("\t%.1f\t%.1f", a, b);
+    if(a == 0 && b != 0)
+        printf("\tnew");
+    else if(a != 0 && b == 0)
+        printf("\tgone");
+    else
+        printf("\t%+.1f%%", rel_change(a, b));
+
+    return;
+}
+
+static void diff_apmpi(struct apmpi_diff_log *l1, struct apmpi_diff_log *l2,
+    double threshold, double min_time)
+{
+    struct darshan_apmpi_perf_record *r1 = &l1->apmpi;
+    struct darshan_apmpi_perf_record *r2 = &l2->apmpi;
+    struct apmpi_diff_row rows[APMPI_DIFF_NOPS];
+    const struct apmpi_diff_op *op;
+    double n1 = l1->nranks ? (double)l1->nranks : 1;
+    double n2 = l2->nranks ? (double)l2->nranks : 1;
+    int nrows = 0;
+    int i;
+
+    printf("# APMPI ranks\t%" PRId64 "\t%" PRId64 "\n", l1->nranks, l2->nranks);
+    printf("# MPI_TOTAL_COMM_TIME per rank");
+    print_value(r1->fglobalcounters[MPI_TOTAL_COMM_TIME] / n1,
+        r2->fglobalcounters[MPI_TOTAL_COMM_TIME] / n2, 1);
+    printf("\n# MPI_TOTAL_COMM_TIME variance");
+    print_value(l1->variance, l2->variance, 1);
+    printf("\n# op\tcalls1\tcalls2\tcalls_change\tbytes1\tbytes2\tbytes_change"
+        "\ttime1\ttime2\ttime_change\n");
+
+    for(i = 0; i < APMPI_DIFF_NOPS; i++)
+    {
+        op = &apmpi_diff_ops[i];
+        rows[nrows].name = op->name;
+        rows[nrows].v1[0] = r1->counters[op->calls] / n1;
+        rows[nrows].v2[0] = r2->counters[op->calls] / n2;
+        rows[nrows].v1[1] = op->bytes >= 0 ? r1->counters[op->bytes] / n1 : 0;
+        rows[nrows].v2[1] = op->bytes >= 0 ? r2->counters[op->bytes] / n2 : 0;
+        rows[nrows].v1[2] = r1->fcounters[op->time] / n1;
+        rows[nrows].v2[2] = r2->fcounters[op->time] / n2;
+        rows[nrows].delta = rows[nrows].v2[2] - rows[nrows].v1[2];
+        set_change(&rows[nrows], 3);
+
+        if(rows[nrows].change <= threshold)
+            continue;
+        if(rows[nrows].v1[2] <= min_time && rows[nrows].v2[2] <= min_time)
+            continue;
+        nrows++;
+    }
+
+    qsort(rows, nrows, sizeof(*rows), cmp_rows_delta);
+    for(i = 0; i < nrows; i++)
+    {
+        printf("%s", rows[i].name);
+        print_value(rows[i].v1[0], rows[i].v2[0], 0);
+        print_value(rows[i].v1[1], rows[i].v2[1], 0);
+        print_value(rows[i].v1[2], rows[i].v2[2], 1);
+        printf("\n");
+    }
+
+    return;
+}
+
+#ifdef DARSHAN_USE_APXC
+static int cmp_rows_change(const void *a, const void *b)
+{
+    double ca = ((const struct apmpi_diff_row *)a)->change;
+    double cb = ((const struct apmpi_diff_row *)b)->change;
+
+    return(ca < cb ? 1 : (ca > cb ? -1 : 0));
+}
+
+static void diff_apxc(struct apmpi_diff_log *l1, struct apmpi_diff_log *l2,
+    double threshold)
+{
+    struct apmpi_diff_row rows[APXC_MAX_EVENTS];
+    int nrows = 0;
+    int i, j;
+
+    if(l1->nrouters == 0 && l2->nrouters == 0)
+        return;
+
+    printf("\n# APXC routers\t%" PRId64 "\t%" PRId64 "\n", l1->nrouters, l2->nrouters);
+    printf("# event\tcount1\tcount2\tchange\n");
+
+    /* the events of the first log, matched by name in the second */
+    for(i = 0; i < l1->event_count; i++)
+    {
+        for(j = 0; j < l2->event_count; j++)
+            if(strncmp(l1->event_names[i], l2->event_names[j], APXC_EVENT_NAME_MAX) == 0)
+                break;
+        if(j == l2->event_count)
+            continue;
+
+        rows[nrows].name = l1->event_names[i];
+        rows[nrows].v1[0] = (double)l1->apxc->counters[i];
+        rows[nrows].v2[0] = (double)l2->apxc->counters[j];
+        rows[nrows].delta = 0;
+        set_change(&rows[nrows], 1);
+        if(rows[nrows].change > threshold)
+            nrows++;
+    }
+
+    qsort(rows, nrows, sizeof(*rows), cmp_rows_change);
+    for(i = 0; i < nrows; i++)
+    {
+        printf("APXC_%.*s", APXC_EVENT_NAME_MAX, rows[i].name);
+        print_value(rows[i].v1[0], rows[i].v2[0], 0);
+        printf("\n");
+    }
+
+    return;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    struct apmpi_diff_log *l1, *l2;
+    double threshold = 5.0;
+    double min_time = 0.0;
+    int opt;
+    int ret = 0;
+
+    while((opt = getopt(argc, argv, "t:m:")) != -1)
+    {
+        switch(opt)
+        {
+            case 't':
+                threshold = atof(optarg);
+                break;
+            case 'm':
+                min_time = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-t <pct>] [-m <seconds>] <log1> <log2>\n", argv[0]);
+                return(1);
+        }
+    }
+    if(argc - optind != 2)
+    {
+        fprintf(stderr, "usage: %s [-t <pct>] [-m <seconds>] <log1> <log2>\n", argv[0]);
+        return(1);
+    }
+
+    l1 = calloc(1, sizeof(*l1));
+    l2 = calloc(1, sizeof(*l2));
+    if(!l1 || !l2 ||
+       load_log(argv[optind], l1) < 0 || load_log(argv[optind+1], l2) < 0)
+    {
+        ret = 1;
+        goto out;
+    }
+
+    diff_apmpi(l1, l2, threshold, min_time);
+#ifdef DARSHAN_USE_APXC
+    diff_apxc(l1, l2, threshold);
+#endif
+
+out:
+#ifdef DARSHAN_USE_APXC
+    if(l1)
+        free(l1->apxc);
+    if(l2)
+        free(l2->apxc);
+#endif
+    free(l1);
+    free(l2);
+
+    return(ret);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,615 @@
+/*
+ * Copyright (C) 2018 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Columnar export of the APMPI perf records of a Darshan log.
+ *
+ * The per rank counters are written as fixed width columns, one row per
+ * rank of the job, instead of darshan-parser's line per counter per rank,
+ * so they can be mapped straight into numpy (np.memmap with the dtype the
+ * name table describes) or wrapped as Arrow buffers without parsing.
+ *
+ * usage: darshan-apmpi-export [-c] [-s] <log> <output>
+ *
+ *   -c  counter-major: each column is stored contiguously for all the
+ *       ranks, rather than each rank's row (rank-major, the default)
+ *   -s  streaming: counter-major output is written a block of ranks at a
+ *       time into a preallocated file, which must be a regular file,
+ *       rather than from the whole log held in memory. Rank-major output
+ *       is always streamed, and only needs a regular file if the records
+ *       are out of rank order.
+ *
+ * The output, in the byte order of the host that exported it, is:
+ *
+ *   struct apmpi_export_header
+ *   struct apmpi_export_column[ncols]   the name table
+ *   padding up to data_off, a multiple of APMPI_EXPORT_ALIGN
+ *   the data
+ *
+ * Rank-major data is nrows rows of row_size bytes, a column's value at
+ * its offset in the row. Counter-major data is ncols columns of nrows
+ * values, a column starting at its offset from data_off; both offsets are
+ * multiples of APMPI_EXPORT_ALIGN in that layout. Row r holds rank r, and
+ * a rank without a perf record has its RANK column set to -1 and every
+ * other column to 0. Columns are 'i' (int64), 'u' (uint64), 'f' (double)
+ * or 's' (NUL padded bytes of the column's width).
+ *
+ * The columns are RANK, the perf record's counters in the order
+ * darshan-parser prints them (the sync times only if the log recorded
+ * them), one per MPI_T pvar named in the header record, and
+ * MPI_PROCESSOR_NAME.
+ */
+
+#include "darshan-util-config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "darshan-logutils.h"
+#include "darshan-apmpi-log-format.h"
+#include "darshan-apmpi-logutils.h"
+
+#define APMPI_EXPORT_VER 1
+#define APMPI_EXPORT_MAGIC "APMPICOL"
+#define APMPI_EXPORT_NAME_MAX 64
+#define APMPI_EXPORT_ALIGN 64
+
+/* ranks gathered before a streaming counter-major export writes them */
+#define APMPI_EXPORT_BLOCK_ROWS 1024
+
+#define ALIGN_UP(x, a) (((x) + (a) - 1) / (a) * (a))
+
+struct apmpi_export_header
+{
+    char magic[8];
+    uint32_t version;
+    /* 0 rank-major, 1 counter-major */
+    uint32_t layout;
+    uint64_t nrows;
+    uint64_t ncols;
+    uint64_t row_size;
+    uint64_t data_off;
+};
+
+struct apmpi_export_column
+{
+    char name[APMPI_EXPORT_NAME_MAX];
+    char type;
+    char pad[3];
+    uint32_t width;
+    /* in the row (rank-major) or from data_off (counter-major) */
+    uint64_t offset;
+};
+
+/* a column and where its value is found in a perf record */
+struct apmpi_export_source
+{
+    struct apmpi_export_column col;
+    /* offset in the perf record, or -1 for RANK */
+    ptrdiff_t rec_off;
+    /* offset in a row, for either layout */
+    uint64_t row_off;
+};
+
+struct apmpi_export
+{
+    FILE *out;
+    int counter_major;
+    int streaming;
+    uint64_t nrows;
+    int ncols;
+    struct apmpi_export_source *cols;
+    uint64_t row_size;
+    uint64_t data_off;
+    /* rank-major: the rows written so far, from rank 0 */
+    uint64_t high_row;
+    /* counter-major: rows held, and the first rank and presence of the
+     * rows of the current block when streaming
+     */
+    char *rows;
+    uint64_t block_base;
+    char *block_present;
+    char *col_buf;
+};
+
+static int add_column(struct apmpi_export *exp, int *max_cols,
+    const char *name, char type, uint32_t width, ptrdiff_t rec_off)
+{
+    struct apmpi_export_source *src;
+    struct apmpi_export_source *tmp;
+
+    if(exp->ncols == *max_cols)
+    {
+        *max_cols = *max_cols ? 2 * *max_cols : 1024;
+        tmp = realloc(exp->cols, *max_cols * sizeof(*exp->cols));
+        if(!tmp)
+            return(-1);
+        exp->cols = tmp;
+    }
+
+    src = &exp->cols[exp->ncols++];
+    memset(src, 0, sizeof(*src));
+    strncpy(src->col.name, name, APMPI_EXPORT_NAME_MAX - 1);
+    src->col.type = type;
+    src->col.width = width;
+    src->rec_off = rec_off;
+    src->row_off = exp->row_size;
+    exp->row_size += width;
+
+    return(0);
+}
+
+#define REC_OFF(field, i) \
+    ((ptrdiff_t)offsetof(struct darshan_apmpi_perf_record, field) + \
+     (i) * (ptrdiff_t)sizeof(((struct darshan_apmpi_perf_record *)0)->field[0]))
+
+/* lay out the columns of the records described by the header record */
+static int build_columns(struct apmpi_export *exp,
+    struct darshan_apmpi_header_record *hdr_rec)
+{
+    int max_cols = 0;
+    int pvar_count;
+    int i;
+    int ret = 0;
+
+    ret |= add_column(exp, &max_cols, "RANK", 'i', sizeof(int64_t), -1);
+    for(i = 0; i < APMPI_NUM_INDICES; i++)
+        ret |= add_column(exp, &max_cols, apmpi_counter_names[i], 'u',
+            sizeof(uint64_t), REC_OFF(counters, i));
+    for(i = 0; i < APMPI_F_MPIOP_TOTALTIME_NUM_INDICES; i++)
+        ret |= add_column(exp, &max_cols, apmpi_f_mpiop_totaltime_counter_names[i],
+            'f', sizeof(double), REC_OFF(fcounters, i));
+    if(hdr_rec->sync_flag)
+    {
+        for(i = 0; i < APMPI_F_MPIOP_SYNCTIME_NUM_INDICES; i++)
+            ret |= add_column(exp, &max_cols, apmpi_f_mpiop_synctime_counter_names[i],
+                'f', sizeof(double), REC_OFF(fsynccounters, i));
+    }
+    for(i = 0; i < APMPI_F_MPI_GLOBAL_NUM_INDICES; i++)
+    {
+        if(i == MPI_TOTAL_COMM_SYNC_TIME && !hdr_rec->sync_flag)
+            continue;
+        ret |= add_column(exp, &max_cols, apmpi_f_mpi_global_counter_names[i],
+            'f', sizeof(double), REC_OFF(fglobalcounters, i));
+    }
+    for(i = 0; i < APMPI_RMA_NUM_INDICES; i++)
+        ret |= add_column(exp, &max_cols, apmpi_rma_counter_names[i], 'u',
+            sizeof(uint64_t), REC_OFF(rmacounters, i));
+    for(i = 0; i < APMPI_F_RMA_NUM_INDICES; i++)
+        ret |= add_column(exp, &max_cols, apmpi_f_rma_counter_names[i], 'f',
+            sizeof(double), REC_OFF(frmacounters, i));
+
+    pvar_count = hdr_rec->pvar_count;
+    if(pvar_count > APMPI_MAX_PVARS)
+        pvar_count = APMPI_MAX_PVARS;
+    for(i = 0; i < pvar_count; i++)
+    {
+        hdr_rec->pvar_names[i][APMPI_PVAR_NAME_MAX-1] = '\0';
+        ret |= add_column(exp, &max_cols, hdr_rec->pvar_names[i], 'f',
+            sizeof(double), REC_OFF(pvarcounters, i));
+    }
+
+    ret |= add_column(exp, &max_cols, "MPI_PROCESSOR_NAME", 's',
+        AP_PROCESSOR_NAME_MAX, REC_OFF(node_name, 0));
+    if(ret)
+        return(-1);
+
+    /* counters are 8 bytes and the processor name a multiple of 8, so a
+     * row is always a multiple of 8 too
+     */
+    for(i = 0; i < exp->ncols; i++)
+    {
+        if(!exp->counter_major)
+            exp->cols[i].col.offset = exp->cols[i].row_off;
+        else if(i > 0)
+            exp->cols[i].col.offset = ALIGN_UP(exp->cols[i-1].col.offset +
+                exp->nrows * exp->cols[i-1].col.width, APMPI_EXPORT_ALIGN);
+    }
+    exp->data_off = ALIGN_UP(sizeof(struct apmpi_export_header) +
+        exp->ncols * sizeof(struct apmpi_export_column), APMPI_EXPORT_ALIGN);
+
+    return(0);
+}
+
+/* fill row with the columns of a perf record, or of a missing rank */
+static void fill_row(struct apmpi_export *exp, char *row,
+    struct darshan_apmpi_perf_record *prf_rec)
+{
+    struct apmpi_export_source *src;
+    int64_t rank = prf_rec ? prf_rec->base_rec.rank : -1;
+    int i;
+
+    if(!prf_rec)
+        memset(row, 0, exp->row_size);
+    for(i = 0; i < exp->ncols; i++)
+    {
+        src = &exp->cols[i];
+        if(src->rec_off < 0)
+            memcpy(row + src->row_off, &rank, sizeof(rank));
+        else if(prf_rec)
+            memcpy(row + src->row_off, (char *)prf_rec + src->rec_off,
+                src->col.width);
+    }
+
+    return;
+}
+
+static int write_at(struct apmpi_export *exp, uint64_t off, void *buf,
+    size_t len)
+{
+    if(fseeko(exp->out, off, SEEK_SET) != 0)
+        return(-1);
+    if(fwrite(buf, 1, len, exp->out) != len)
+        return(-1);
+
+    return(0);
+}
+
+static int write_header(struct apmpi_export *exp)
+{
+    struct apmpi_export_header hdr;
+    char pad[APMPI_EXPORT_ALIGN] = {0};
+    uint64_t off;
+    int i;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, APMPI_EXPORT_MAGIC, sizeof(hdr.magic));
+    hdr.version = APMPI_EXPORT_VER;
+    hdr.layout = exp->counter_major;
+    hdr.nrows = exp->nrows;
+    hdr.ncols = exp->ncols;
+    hdr.row_size = exp->row_size;
+    hdr.data_off = exp->data_off;
+
+    if(fwrite(&hdr, sizeof(hdr), 1, exp->out) != 1)
+        return(-1);
+    for(i = 0; i < exp->ncols; i++)
+    {
+        if(fwrite(&exp->cols[i].col, sizeof(exp->cols[i].col), 1, exp->out) != 1)
+            return(-1);
+    }
+    off = sizeof(hdr) + exp->ncols * sizeof(struct apmpi_export_column);
+    if(fwrite(pad, 1, exp->data_off - off, exp->out) != exp->data_off - off)
+        return(-1);
+
+    return(0);
+}
+
+/* gather the rows [first, first+count) of a column from the block of rows
+ * starting at rank base into col_buf
+ */
+static void gather_column(struct apmpi_export *exp,
+    struct apmpi_export_source *src, char *rows, uint64_t base,
+    uint64_t first, uint64_t count)
+{
+    uint64_t r;
+
+    for(r = 0; r < count; r++)
+        memcpy(exp->col_buf + r * src->col.width,
+            rows + (first - base + r) * exp->row_size + src->row_off,
+            src->col.width);
+
+    return;
+}
+
+/* write out the ranks of the current streaming block that had a record,
+ * each run of consecutive ranks a column at a time
+ */
+static int flush_block(struct apmpi_export *exp)
+{
+    struct apmpi_export_source *src;
+    uint64_t r, run;
+    int i;
+
+    for(r = 0; r < APMPI_EXPORT_BLOCK_ROWS; r = run + 1)
+    {
+        for(run = r; run < APMPI_EXPORT_BLOCK_ROWS && exp->block_present[run]; run++);
+        if(run == r)
+            continue;
+        for(i = 0; i < exp->ncols; i++)
+        {
+            src = &exp->cols[i];
+            gather_column(exp, src, exp->rows, exp->block_base,
+                exp->block_base + r, run - r);
+            if(write_at(exp, exp->data_off + src->col.offset +
+                (exp->block_base + r) * src->col.width, exp->col_buf,
+                (run - r) * src->col.width) < 0)
+                return(-1);
+        }
+    }
+    memset(exp->block_present, 0, APMPI_EXPORT_BLOCK_ROWS);
+
+    return(0);
+}
+
+static int export_start(struct apmpi_export *exp)
+{
+    struct apmpi_export_source *rank_col;
+    int64_t *missing;
+    uint64_t nrows_held;
+    uint64_t end;
+    uint64_t r, n;
+
+    if(write_header(exp) < 0)
+        return(-1);
+
+    if(!exp->counter_major)
+    {
+        exp->rows = malloc(exp->row_size);
+        return(exp->rows ? 0 : -1);
+    }
+
+    nrows_held = exp->streaming ? APMPI_EXPORT_BLOCK_ROWS : exp->nrows;
+    exp->rows = calloc(nrows_held ? nrows_held : 1, exp->row_size);
+    exp->col_buf = malloc((nrows_held ? nrows_held : 1) * AP_PROCESSOR_NAME_MAX);
+    if(!exp->rows || !exp->col_buf)
+        return(-1);
+    rank_col = &exp->cols[0];
+
+    if(!exp->streaming)
+    {
+        for(r = 0; r < exp->nrows; r++)
+            fill_row(exp, exp->rows + r * exp->row_size, NULL);
+        return(0);
+    }
+
+    exp->block_present = calloc(APMPI_EXPORT_BLOCK_ROWS, 1);
+    if(!exp->block_present)
+        return(-1);
+
+    /* preallocate the columns as zeros, with every rank missing until
+     * its record is written
+     */
+    end = exp->data_off + exp->cols[exp->ncols-1].col.offset +
+        exp->nrows * exp->cols[exp->ncols-1].col.width;
+    if(fflush(exp->out) != 0 || ftruncate(fileno(exp->out), end) < 0)
+    {
+        fprintf(stderr, "Error: streaming counter-major output must be a regular file\n");
+        return(-1);
+    }
+    missing = (int64_t *)exp->col_buf;
+    for(r = 0; r < APMPI_EXPORT_BLOCK_ROWS; r++)
+        missing[r] = -1;
+    for(r = 0; r < exp->nrows; r += n)
+    {
+        n = exp->nrows - r < APMPI_EXPORT_BLOCK_ROWS ?
+            exp->nrows - r : APMPI_EXPORT_BLOCK_ROWS;
+        if(write_at(exp, exp->data_off + rank_col->col.offset +
+            r * rank_col->col.width, missing, n * rank_col->col.width) < 0)
+            return(-1);
+    }
+
+    return(0);
+}
+
+/* write the rows of missing ranks up to, not including, rank */
+static int fill_missing_rows(struct apmpi_export *exp, uint64_t rank)
+{
+    char *row;
+
+    row = malloc(exp->row_size);
+    if(!row)
+        return(-1);
+    fill_row(exp, row, NULL);
+    for(; exp->high_row < rank; exp->high_row++)
+    {
+        if(fwrite(row, 1, exp->row_size, exp->out) != exp->row_size)
+        {
+            free(row);
+            return(-1);
+        }
+    }
+    free(row);
+
+    return(0);
+}
+
+static int export_record(struct apmpi_export *exp,
+    struct darshan_apmpi_perf_record *prf_rec)
+{
+    uint64_t rank = prf_rec->base_rec.rank;
+
+    if(prf_rec->base_rec.rank < 0 || rank >= exp->nrows)
+    {
+        fprintf(stderr, "Error: APMPI record of rank %" PRId64 " in a job of %" PRIu64 " ranks\n",
+            prf_rec->base_rec.rank, exp->nrows);
+        return(-1);
+    }
+
+    if(!exp->counter_major)
+    {
+        fill_row(exp, exp->rows, prf_rec);
+
+        /* a rank behind the rows written is rewritten in place */
+        if(rank < exp->high_row)
+        {
+            if(write_at(exp, exp->data_off + rank * exp->row_size,
+                exp->rows, exp->row_size) < 0)
+                return(-1);
+            return(fseeko(exp->out, exp->data_off + exp->high_row * exp->row_size,
+                SEEK_SET) == 0 ? 0 : -1);
+        }
+
+        if(fill_missing_rows(exp, rank) < 0)
+            return(-1);
+        if(fwrite(exp->rows, 1, exp->row_size, exp->out) != exp->row_size)
+            return(-1);
+        exp->high_row++;
+        return(0);
+    }
+
+    if(!exp->streaming)
+    {
+        fill_row(exp, exp->rows + rank * exp->row_size, prf_rec);
+        return(0);
+    }
+
+    if(rank < exp->block_base || rank >= exp->block_base + APMPI_EXPORT_BLOCK_ROWS)
+    {
+        if(flush_block(exp) < 0)
+            return(-1);
+        exp->block_base = rank - rank % APMPI_EXPORT_BLOCK_ROWS;
+    }
+    fill_row(exp, exp->rows + (rank - exp->block_base) * exp->row_size, prf_rec);
+    exp->block_present[rank - exp->block_base] = 1;
+
+    return(0);
+}
+
+static int export_finish(struct apmpi_export *exp)
+{
+    char pad[APMPI_EXPORT_ALIGN] = {0};
+    struct apmpi_export_source *src;
+    uint64_t end;
+    int i;
+
+    if(!exp->counter_major)
+    {
+        if(fill_missing_rows(exp, exp->nrows) < 0)
+            return(-1);
+    }
+    else if(exp->streaming)
+    {
+        if(flush_block(exp) < 0)
+            return(-1);
+    }
+    else
+    {
+        /* the columns follow each other, so they go out in one pass */
+        for(i = 0; i < exp->ncols; i++)
+        {
+            src = &exp->cols[i];
+            gather_column(exp, src, exp->rows, 0, 0, exp->nrows);
+            if(fwrite(exp->col_buf, src->col.width, exp->nrows, exp->out) != exp->nrows)
+                return(-1);
+            if(i == exp->ncols - 1)
+                break;
+            end = src->col.offset + exp->nrows * src->col.width;
+            if(fwrite(pad, 1, exp->cols[i+1].col.offset - end, exp->out) !=
+                exp->cols[i+1].col.offset - end)
+                return(-1);
+        }
+    }
+
+    return(fflush(exp->out) == 0 ? 0 : -1);
+}
+
+int main(int argc, char **argv)
+{
+    struct apmpi_export exp;
+    struct darshan_job job;
+    struct darshan_apmpi_header_record hdr_rec;
+    darshan_fd fd;
+    void *buf = NULL;
+    int header_seen = 0;
+    int opt;
+    int ret;
+
+    memset(&exp, 0, sizeof(exp));
+
+    while((opt = getopt(argc, argv, "cs")) != -1)
+    {
+        switch(opt)
+        {
+            case 'c':
+                exp.counter_major = 1;
+                break;
+            case 's':
+                exp.streaming = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-c] [-s] <log> <output>\n", argv[0]);
+                return(1);
+        }
+    }
+    if(argc - optind != 2)
+    {
+        fprintf(stderr, "usage: %s [-c] [-s] <log> <output>\n", argv[0]);
+        return(1);
+    }
+
+    fd = darshan_log_open(argv[optind]);
+    if(!fd)
+        return(1);
+
+    if(darshan_log_get_job(fd, &job) < 0)
+    {
+        darshan_log_close(fd);
+        return(1);
+    }
+    exp.nrows = job.nprocs;
+
+    if(fd->mod_map[DARSHAN_APMPI_MOD].len == 0)
+    {
+        fprintf(stderr, "Error: %s has no APMPI records\n", argv[optind]);
+        darshan_log_close(fd);
+        return(1);
+    }
+
+    exp.out = fopen(argv[optind+1], "w");
+    if(!exp.out)
+    {
+        fprintf(stderr, "Error: unable to open %s: %s\n", argv[optind+1],
+            strerror(errno));
+        darshan_log_close(fd);
+        return(1);
+    }
+
+    while((ret = apmpi_logutils.log_get_record(fd, &buf)) == 1)
+    {
+        if(((struct darshan_apmpi_header_record *)buf)->magic == APMPI_MAGIC)
+        {
+            if(header_seen)
+                continue;
+            memcpy(&hdr_rec, buf, sizeof(hdr_rec));
+            header_seen = 1;
+            if(build_columns(&exp, &hdr_rec) < 0 || export_start(&exp) < 0)
+                break;
+            continue;
+        }
+        if(!header_seen)
+        {
+            fprintf(stderr, "Error: APMPI perf record before the header record\n");
+            ret = -1;
+            break;
+        }
+        if(export_record(&exp, buf) < 0)
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    if(ret == 0 && header_seen && export_finish(&exp) < 0)
+        ret = -1;
+    if(ret != 0 || !header_seen)
+        fprintf(stderr, "Error: failed to export the APMPI records of %s\n",
+            argv[optind]);
+
+    if(fclose(exp.out) != 0)
+        ret = -1;
+    darshan_log_close(fd);
+    free(buf);
+    free(exp.cols);
+    free(exp.rows);
+    free(exp.block_present);
+    free(exp.col_buf);
+
+    return((ret == 0 && header_seen) ? 0 : 1);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ts=8 sts=4 sw=4 expandtab
+ */
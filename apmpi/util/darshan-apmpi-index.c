@@ -0,0 +1,715 @@
+/*
+ * Copyright (C) 2018 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Index of the AutoPerf data of an archive of Darshan logs.
+ *
+ * "build" walks a directory tree, opens every *.darshan log on a pool of
+ * threads, one log per task, and keeps a fixed size summary per job: its
+ * total and maximum per rank MPI time, the variance of the MPI time across
+ * its ranks, the ops it spent the most MPI time in and how many routers
+ * its APXC/APSS records cover. The summaries are written sorted by job
+ * start time, so that "query" answers archive wide questions, e.g. jobs
+ * with more than 30% of their time in MPI_ALLREDUCE, from the index alone.
+ *
+ * usage: darshan-apmpi-index build [-j <threads>] <dir> <index>
+ *        darshan-apmpi-index query [-a <start>] [-b <end>] [-u <uid>]
+ *            [-m <pct>] [-o <op>:<pct>] [-v <variance>] [-r <routers>]
+ *            <index>
+ *
+ *   -a, -b  jobs started at or after <start>, before <end> (epoch seconds)
+ *   -u      jobs of user <uid>
+ *   -m      jobs with more than <pct>% of their rank time in MPI
+ *   -o      jobs with more than <pct>% of their rank time in MPI op <op>;
+ *           repeatable, every threshold must hold
+ *   -v      jobs with an MPI time variance across ranks above <variance>
+ *   -r      jobs with APXC or APSS records of at least <routers> routers
+ *
+ * Shares are of the job's rank time, its run time times its nprocs. The
+ * index keeps the APMPI_INDEX_TOP_OPS ops of a job with the most time, and
+ * an op left out has less time than each of them, hence less than
+ * 1/(APMPI_INDEX_TOP_OPS+1) of the rank time: -o thresholds above that are
+ * exact, lower ones only match the ops kept.
+ *
+ * The index, in the byte order of the host that built it, is:
+ *
+ *   struct apmpi_index_header
+ *   struct apmpi_index_entry[nentries]  by start time, jobid and path
+ *   the path table, the NUL terminated path of each entry's log
+ */
+
+#define _GNU_SOURCE
+#include "darshan-util-config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "darshan-logutils.h"
+#include "darshan-apmpi-log-format.h"
+#include "darshan-apmpi-logutils.h"
+#ifdef DARSHAN_USE_APXC
+#include "darshan-apxc-log-format.h"
+#include "darshan-apxc-logutils.h"
+#endif
+#ifdef DARSHAN_USE_APSS
+#include "darshan-apss-log-format.h"
+#include "darshan-apss-logutils.h"
+#endif
+
+#define APMPI_INDEX_VER 1
+#define APMPI_INDEX_MAGIC "APMPIIDX"
+#define APMPI_INDEX_TOP_OPS 8
+#define APMPI_INDEX_MAX_OP_FILTERS 16
+
+/* the time counters of an op are its TOTAL, MIN and MAX times */
+#define APMPI_INDEX_NOPS (APMPI_F_MPIOP_TOTALTIME_NUM_INDICES / 3)
+
+struct apmpi_index_header
+{
+    char magic[8];
+    uint32_t version;
+    /* ops of the APMPI log format the op indices refer to */
+    uint32_t nops;
+    uint64_t nentries;
+    uint64_t paths_off;
+    uint64_t paths_len;
+};
+
+struct apmpi_index_op
+{
+    /* the op's _TOTAL_TIME is APMPI time counter 3 * op */
+    uint32_t op;
+    uint32_t pad;
+    /* summed over the ranks */
+    double time;
+};
+
+struct apmpi_index_entry
+{
+    int64_t jobid;
+    int64_t uid;
+    int64_t start_time;
+    int64_t nprocs;
+    double runtime;
+    /* MPI_TOTAL_COMM_TIME summed over the ranks, and of the slowest rank */
+    double mpi_time;
+    double mpi_time_max;
+    double mpi_time_variance;
+    /* (1 << module id) of the AutoPerf modules with records */
+    uint32_t modules;
+    uint32_t ntop;
+    uint32_t apxc_routers;
+    uint32_t apss_routers;
+    /* by decreasing time */
+    struct apmpi_index_op top[APMPI_INDEX_TOP_OPS];
+    /* in the path table */
+    uint64_t path_off;
+};
+
+/* a log being indexed */
+struct apmpi_index_log
+{
+    char *path;
+    struct apmpi_index_entry entry;
+    int ok;
+};
+
+struct apmpi_index_build
+{
+    struct apmpi_index_log *logs;
+    int nlogs;
+    int next;
+    pthread_mutex_t mutex;
+};
+
+static const char *progname;
+
+/* the logs found by the directory walk, nftw() passing no state */
+static struct apmpi_index_log *found_logs = NULL;
+static int found_nlogs = 0;
+static int found_max = 0;
+
+static int find_log(const char *path, const struct stat *sb, int type,
+    struct FTW *ftwbuf)
+{
+    struct apmpi_index_log *tmp;
+    size_t len = strlen(path);
+
+    if(type != FTW_F || len < 8 || strcmp(path + len - 8, ".darshan") != 0)
+        return(0);
+
+    if(found_nlogs == found_max)
+    {
+        found_max = found_max ? 2 * found_max : 1024;
+        tmp = realloc(found_logs, found_max * sizeof(*found_logs));
+        if(!tmp)
+            return(-1);
+        found_logs = tmp;
+    }
+    memset(&found_logs[found_nlogs], 0, sizeof(*found_logs));
+    found_logs[found_nlogs].path = strdup(path);
+    if(!found_logs[found_nlogs].path)
+        return(-1);
+    found_nlogs++;
+
+    return(0);
+}
+
+#if defined(DARSHAN_USE_APXC) || defined(DARSHAN_USE_APSS)
+static int is_perf_record(void *buf, int64_t magic, int64_t sample_magic,
+    int64_t placement_magic)
+{
+    /* the magic of the AutoPerf header, sample and placement records
+     * follows their base record
+     */
+    int64_t m = *(int64_t *)((char *)buf + sizeof(struct darshan_base_record));
+
+    return(m != magic && m != sample_magic && m != placement_magic);
+}
+#endif
+
+static int index_apmpi(darshan_fd fd, struct apmpi_index_entry *entry)
+{
+    struct darshan_apmpi_header_record *hdr_rec;
+    struct darshan_apmpi_perf_record *prf_rec;
+    double op_time[APMPI_INDEX_NOPS];
+    double t;
+    void *buf = NULL;
+    int i, j;
+    int ret;
+
+    memset(op_time, 0, sizeof(op_time));
+
+    while((ret = apmpi_logutils.log_get_record(fd, &buf)) == 1)
+    {
+        hdr_rec = (struct darshan_apmpi_header_record *)buf;
+        if(hdr_rec->magic == APMPI_MAGIC)
+        {
+            entry->mpi_time_variance = hdr_rec->apmpi_f_variance_total_mpitime;
+            continue;
+        }
+
+        prf_rec = (struct darshan_apmpi_perf_record *)buf;
+        t = prf_rec->fglobalcounters[MPI_TOTAL_COMM_TIME];
+        entry->mpi_time += t;
+        if(t > entry->mpi_time_max)
+            entry->mpi_time_max = t;
+        for(i = 0; i < APMPI_INDEX_NOPS; i++)
+            op_time[i] += prf_rec->fcounters[3 * i];
+    }
+    free(buf);
+    if(ret < 0)
+        return(-1);
+
+    /* insertion into the few top ops kept */
+    for(i = 0; i < APMPI_INDEX_NOPS; i++)
+    {
+        if(op_time[i] <= 0)
+            continue;
+        if(entry->ntop == APMPI_INDEX_TOP_OPS &&
+           op_time[i] <= entry->top[APMPI_INDEX_TOP_OPS-1].time)
+            continue;
+        j = entry->ntop < APMPI_INDEX_TOP_OPS ? entry->ntop++ : APMPI_INDEX_TOP_OPS - 1;
+        for(; j > 0 && entry->top[j-1].time < op_time[i]; j--)
+            entry->top[j] = entry->top[j-1];
+        entry->top[j].op = i;
+        entry->top[j].pad = 0;
+        entry->top[j].time = op_time[i];
+    }
+
+    return(0);
+}
+
+#ifdef DARSHAN_USE_APXC
+static int index_apxc(darshan_fd fd, struct apmpi_index_entry *entry)
+{
+    void *buf = NULL;
+    int ret;
+
+    while((ret = apxc_logutils.log_get_record(fd, &buf)) == 1)
+    {
+        if(is_perf_record(buf, APXC_MAGIC, APXC_SAMPLE_MAGIC, APXC_PLACEMENT_MAGIC))
+            entry->apxc_routers++;
+    }
+    free(buf);
+
+    return(ret < 0 ? -1 : 0);
+}
+#endif
+
+#ifdef DARSHAN_USE_APSS
+static int index_apss(darshan_fd fd, struct apmpi_index_entry *entry)
+{
+    void *buf = NULL;
+    int ret;
+
+    while((ret = apss_logutils.log_get_record(fd, &buf)) == 1)
+    {
+        if(is_perf_record(buf, APSS_MAGIC, APSS_SAMPLE_MAGIC, APSS_PLACEMENT_MAGIC))
+            entry->apss_routers++;
+    }
+    free(buf);
+
+    return(ret < 0 ? -1 : 0);
+}
+#endif
+
+static int index_log(struct apmpi_index_log *log)
+{
+    struct apmpi_index_entry *entry = &log->entry;
+    struct darshan_job job;
+    darshan_fd fd;
+    int ret = 0;
+
+    fd = darshan_log_open(log->path);
+    if(!fd)
+        return(-1);
+
+    if(darshan_log_get_job(fd, &job) < 0)
+    {
+        darshan_log_close(fd);
+        return(-1);
+    }
+    entry->jobid = job.jobid;
+    entry->uid = job.uid;
+    entry->start_time = job.start_time_sec;
+    entry->nprocs = job.nprocs;
+    entry->runtime = (double)(job.end_time_sec - job.start_time_sec) +
+        (double)(job.end_time_nsec - job.start_time_nsec) / 1e9;
+
+    if(fd->mod_map[DARSHAN_APMPI_MOD].len > 0)
+    {
+        entry->modules |= 1 << DARSHAN_APMPI_MOD;
+        ret = index_apmpi(fd, entry);
+    }
+#ifdef DARSHAN_USE_APXC
+    if(ret == 0 && fd->mod_map[DARSHAN_APXC_MOD].len > 0)
+    {
+        entry->modules |= 1 << DARSHAN_APXC_MOD;
+        ret = index_apxc(fd, entry);
+    }
+#endif
+#ifdef DARSHAN_USE_APSS
+    if(ret == 0 && fd->mod_map[DARSHAN_APSS_MOD].len > 0)
+    {
+        entry->modules |= 1 << DARSHAN_APSS_MOD;
+        ret = index_apss(fd, entry);
+    }
+#endif
+
+    darshan_log_close(fd);
+
+    return(ret);
+}
+
+static void *index_worker(void *arg)
+{
+    struct apmpi_index_build *build = arg;
+    int i;
+
+    while(1)
+    {
+        pthread_mutex_lock(&build->mutex);
+        i = build->next++;
+        pthread_mutex_unlock(&build->mutex);
+        if(i >= build->nlogs)
+            break;
+
+        if(index_log(&build->logs[i]) == 0)
+            build->logs[i].ok = 1;
+        else
+            fprintf(stderr, "Warning: unable to index %s\n", build->logs[i].path);
+    }
+
+    return(NULL);
+}
+
+static int cmp_logs(const void *a, const void *b)
+{
+    const struct apmpi_index_log *la = a;
+    const struct apmpi_index_log *lb = b;
+
+    if(la->ok != lb->ok)
+        return(lb->ok - la->ok);
+    if(la->entry.start_time != lb->entry.start_time)
+        return(la->entry.start_time < lb->entry.start_time ? -1 : 1);
+    if(la->entry.jobid != lb->entry.jobid)
+        return(la->entry.jobid < lb->entry.jobid ? -1 : 1);
+    return(strcmp(la->path, lb->path));
+}
+
+static int write_index(const char *path, struct apmpi_index_log *logs, int nlogs)
+{
+    struct apmpi_index_header hdr;
+    uint64_t off = 0;
+    FILE *out;
+    int ret = 0;
+    int i;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, APMPI_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.version = APMPI_INDEX_VER;
+    hdr.nops = APMPI_INDEX_NOPS;
+    hdr.nentries = nlogs;
+    hdr.paths_off = sizeof(hdr) + nlogs * sizeof(struct apmpi_index_entry);
+
+    for(i = 0; i < nlogs; i++)
+    {
+        logs[i].entry.path_off = off;
+        off += strlen(logs[i].path) + 1;
+    }
+    hdr.paths_len = off;
+
+    out = fopen(path, "w");
+    if(!out)
+    {
+        fprintf(stderr, "Error: unable to open %s: %s\n", path, strerror(errno));
+        return(-1);
+    }
+
+    if(fwrite(&hdr, sizeof(hdr), 1, out) != 1)
+        ret = -1;
+    for(i = 0; ret == 0 && i < nlogs; i++)
+        if(fwrite(&logs[i].entry, sizeof(logs[i].entry), 1, out) != 1)
+            ret = -1;
+    for(i = 0; ret == 0 && i < nlogs; i++)
+        if(fwrite(logs[i].path, strlen(logs[i].path) + 1, 1, out) != 1)
+            ret = -1;
+    if(fclose(out) != 0)
+        ret = -1;
+
+    if(ret < 0)
+        fprintf(stderr, "Error: failed to write %s\n", path);
+    return(ret);
+}
+
+static int build_index(int argc, char **argv)
+{
+    struct apmpi_index_build build;
+    pthread_t *threads;
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    int nindexed;
+    int opt;
+    int ret;
+    int i;
+
+    while((opt = getopt(argc, argv, "j:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'j':
+                nthreads = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s build [-j <threads>] <dir> <index>\n", progname);
+                return(1);
+        }
+    }
+    if(argc - optind != 2)
+    {
+        fprintf(stderr, "usage: %s build [-j <threads>] <dir> <index>\n", progname);
+        return(1);
+    }
+    if(nthreads < 1)
+        nthreads = 1;
+
+    if(nftw(argv[optind], find_log, 64, FTW_PHYS) != 0)
+    {
+        fprintf(stderr, "Error: unable to scan %s\n", argv[optind]);
+        return(1);
+    }
+
+    memset(&build, 0, sizeof(build));
+    build.logs = found_logs;
+    build.nlogs = found_nlogs;
+    pthread_mutex_init(&build.mutex, NULL);
+    if(nthreads > build.nlogs)
+        nthreads = build.nlogs > 0 ? build.nlogs : 1;
+
+    threads = malloc(nthreads * sizeof(*threads));
+    if(!threads)
+        return(1);
+    for(i = 0; i < nthreads; i++)
+    {
+        if(pthread_create(&threads[i], NULL, index_worker, &build) != 0)
+            break;
+    }
+    /* whatever threads could be started index all the logs between them */
+    if(i == 0)
+        index_worker(&build);
+    nthreads = i;
+    for(i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    pthread_mutex_destroy(&build.mutex);
+
+    /* the logs that could not be indexed sort last and are left out */
+    qsort(build.logs, build.nlogs, sizeof(*build.logs), cmp_logs);
+    for(nindexed = 0; nindexed < build.nlogs && build.logs[nindexed].ok; nindexed++);
+
+    ret = write_index(argv[optind+1], build.logs, nindexed);
+    if(ret == 0)
+        printf("indexed %d of %d logs\n", nindexed, build.nlogs);
+
+    for(i = 0; i < build.nlogs; i++)
+        free(build.logs[i].path);
+    free(build.logs);
+
+    return(ret == 0 ? 0 : 1);
+}
+
+/* name of an op, from its _TOTAL_TIME counter name */
+static void op_name(uint32_t op, char *name, size_t len)
+{
+    const char *c = apmpi_f_mpiop_totaltime_counter_names[3 * op];
+    size_t n = strlen(c) - strlen("_TOTAL_TIME");
+
+    if(n >= len)
+        n = len - 1;
+    memcpy(name, c, n);
+    name[n] = '\0';
+}
+
+static int find_op(const char *name, size_t len)
+{
+    char buf[128];
+    int i;
+
+    for(i = 0; i < APMPI_INDEX_NOPS; i++)
+    {
+        op_name(i, buf, sizeof(buf));
+        if(strlen(buf) == len && strncmp(buf, name, len) == 0)
+            return(i);
+    }
+
+    return(-1);
+}
+
+struct apmpi_index_query
+{
+    int64_t after;
+    int64_t before;
+    int64_t uid;
+    int have_uid;
+    double mpi_pct;
+    double variance;
+    uint32_t routers;
+    int nops;
+    int ops[APMPI_INDEX_MAX_OP_FILTERS];
+    double op_pct[APMPI_INDEX_MAX_OP_FILTERS];
+};
+
+static double op_share(const struct apmpi_index_entry *entry, int op, double rank_time)
+{
+    uint32_t i;
+
+    for(i = 0; i < entry->ntop; i++)
+        if(entry->top[i].op == (uint32_t)op)
+            return(100.0 * entry->top[i].time / rank_time);
+
+    return(0.0);
+}
+
+static int match_entry(const struct apmpi_index_entry *entry,
+    const struct apmpi_index_query *q)
+{
+    double rank_time = entry->runtime * entry->nprocs;
+    int i;
+
+    if(q->have_uid && entry->uid != q->uid)
+        return(0);
+    if(q->variance > 0 && entry->mpi_time_variance <= q->variance)
+        return(0);
+    if(entry->apxc_routers < q->routers && entry->apss_routers < q->routers)
+        return(0);
+    if(q->mpi_pct > 0 || q->nops > 0)
+    {
+        if(rank_time <= 0)
+            return(0);
+        if(100.0 * entry->mpi_time / rank_time <= q->mpi_pct)
+            return(0);
+        for(i = 0; i < q->nops; i++)
+            if(op_share(entry, q->ops[i], rank_time) <= q->op_pct[i])
+                return(0);
+    }
+
+    return(1);
+}
+
+static void print_entry(const struct apmpi_index_entry *entry, const char *paths)
+{
+    double rank_time = entry->runtime * entry->nprocs;
+    char name[128];
+    uint32_t i;
+
+    printf("%" PRId64 "\t%" PRId64 "\t%" PRId64 "\t%" PRId64 "\t%.3f\t%.2f\t%.6e\t%u\t%u\t",
+        entry->jobid, entry->uid, entry->start_time, entry->nprocs,
+        entry->runtime,
+        rank_time > 0 ? 100.0 * entry->mpi_time / rank_time : 0.0,
+        entry->mpi_time_variance, entry->apxc_routers, entry->apss_routers);
+    for(i = 0; i < entry->ntop; i++)
+    {
+        op_name(entry->top[i].op, name, sizeof(name));
+        printf("%s%s:%.2f", i ? "," : "", name,
+            rank_time > 0 ? 100.0 * entry->top[i].time / rank_time : 0.0);
+    }
+    printf("%s\t%s\n", entry->ntop ? "" : "-", paths + entry->path_off);
+}
+
+static int query_index(int argc, char **argv)
+{
+    struct apmpi_index_query q;
+    struct apmpi_index_header hdr;
+    struct apmpi_index_entry *entries = NULL;
+    char *paths = NULL;
+    const char *sep;
+    uint64_t lo, hi, mid;
+    uint64_t nmatch = 0;
+    FILE *in;
+    int opt;
+    int ret = 0;
+
+    memset(&q, 0, sizeof(q));
+    q.after = INT64_MIN;
+    q.before = INT64_MAX;
+
+    while((opt = getopt(argc, argv, "a:b:u:m:o:v:r:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'a':
+                q.after = strtoll(optarg, NULL, 10);
+                break;
+            case 'b':
+                q.before = strtoll(optarg, NULL, 10);
+                break;
+            case 'u':
+                q.uid = strtoll(optarg, NULL, 10);
+                q.have_uid = 1;
+                break;
+            case 'm':
+                q.mpi_pct = atof(optarg);
+                break;
+            case 'o':
+                sep = strrchr(optarg, ':');
+                if(!sep || q.nops == APMPI_INDEX_MAX_OP_FILTERS)
+                {
+                    fprintf(stderr, "Error: bad op threshold %s\n", optarg);
+                    return(1);
+                }
+                q.ops[q.nops] = find_op(optarg, sep - optarg);
+                if(q.ops[q.nops] < 0)
+                {
+                    fprintf(stderr, "Error: unknown MPI op in %s\n", optarg);
+                    return(1);
+                }
+                q.op_pct[q.nops++] = atof(sep + 1);
+                break;
+            case 'v':
+                q.variance = atof(optarg);
+                break;
+            case 'r':
+                q.routers = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                ret = 1;
+                break;
+        }
+    }
+    if(ret != 0 || argc - optind != 1)
+    {
+        fprintf(stderr, "usage: %s query [-a <start>] [-b <end>] [-u <uid>] [-m <pct>] "
+            "[-o <op>:<pct>] [-v <variance>] [-r <routers>] <index>\n", progname);
+        return(1);
+    }
+
+    in = fopen(argv[optind], "r");
+    if(!in)
+    {
+        fprintf(stderr, "Error: unable to open %s: %s\n", argv[optind], strerror(errno));
+        return(1);
+    }
+    if(fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+       memcmp(hdr.magic, APMPI_INDEX_MAGIC, sizeof(hdr.magic)) != 0 ||
+       hdr.version != APMPI_INDEX_VER || hdr.nops > APMPI_INDEX_NOPS)
+    {
+        fprintf(stderr, "Error: %s is not an APMPI index this tool can read\n", argv[optind]);
+        fclose(in);
+        return(1);
+    }
+
+    entries = malloc(hdr.nentries * sizeof(*entries) + 1);
+    paths = malloc(hdr.paths_len + 1);
+    if(!entries || !paths ||
+       fread(entries, sizeof(*entries), hdr.nentries, in) != hdr.nentries ||
+       fseeko(in, hdr.paths_off, SEEK_SET) != 0 ||
+       fread(paths, 1, hdr.paths_len, in) != hdr.paths_len)
+    {
+        fprintf(stderr, "Error: failed to read %s\n", argv[optind]);
+        ret = 1;
+        goto out;
+    }
+    paths[hdr.paths_len] = '\0';
+
+    /* the first entry started at or after q.after */
+    lo = 0;
+    hi = hdr.nentries;
+    while(lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if(entries[mid].start_time < q.after)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    printf("# jobid\tuid\tstart_time\tnprocs\truntime\tmpi_pct\tmpi_time_variance\t"
+        "apxc_routers\tapss_routers\ttop_ops\tlog\n");
+    for(; lo < hdr.nentries && entries[lo].start_time < q.before; lo++)
+    {
+        if(entries[lo].path_off >= hdr.paths_len)
+            continue;
+        if(match_entry(&entries[lo], &q))
+        {
+            print_entry(&entries[lo], paths);
+            nmatch++;
+        }
+    }
+    printf("# %" PRIu64 " of %" PRIu64 " jobs\n", nmatch, hdr.nentries);
+
+out:
+    fclose(in);
+    free(entries);
+    free(paths);
+
+    return(ret);
+}
+
+int main(int argc, char **argv)
+{
+    progname = argv[0];
+    if(argc >= 2 && strcmp(argv[1], "build") == 0)
+        return(build_index(argc - 1, argv + 1));
+    if(argc >= 2 && strcmp(argv[1], "query") == 0)
+        return(query_index(argc - 1, argv + 1));
+
+    fprintf(stderr, "usage: %s build|query ...\n", argv[0]);
+    return(1);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ts=8 sts=4 sw=4 expandtab
+ */
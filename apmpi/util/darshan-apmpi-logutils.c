@@ -12,13 +12,17 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
 
+#include "uthash.h"
+
 #include "darshan-logutils.h"
 #include "darshan-apmpi-log-format.h"
+#include "darshan-apmpi-logutils.h"
 
 /* counter name strings for the MPI module */
 #define Y(a) #a, 
@@ -47,9 +51,91 @@ char *apmpi_f_mpiop_synctime_counter_names[] = {
 char *apmpi_f_mpi_global_counter_names[] = {
     APMPI_F_MPI_GLOBAL_COUNTERS
 };
+#define X RMA_EPOCH
+char *apmpi_rma_counter_names[] = {
+    APMPI_RMA_COUNTERS
+};
+#undef X
+#define X F_RMA_EPOCH
+char *apmpi_f_rma_counter_names[] = {
+    APMPI_F_RMA_COUNTERS
+};
+#undef X
 #undef Y
 #undef Z
 
+/* call count of each op of the per op time counters, which list the ops
+ * in the same order as the integer counters, each with its total, min and
+ * max time in turn
+ */
+#define Y(a) a,
+#define Z(a)
+#define X(a) Y(a ## _CALL_COUNT)
+#define V(a) Y(a ## _CALL_COUNT)
+static const int apmpi_op_call_counts[] = {
+    APMPI_F_MPIOP_TOTALTIME_COUNTERS
+};
+#undef V
+#undef X
+#undef Z
+#undef Y
+#define APMPI_NUM_OPS ((int)(sizeof(apmpi_op_call_counts) / sizeof(apmpi_op_call_counts[0])))
+
+/* RMA counters that hold the largest value of a rank rather than a total */
+#define X(a) a ## _EPOCH_MAX_BYTES, a ## _EPOCH_MAX_OPS,
+static const int apmpi_rma_max_counters[] = {
+    APMPI_MPI_RMA_EPOCHS
+    MPI_RMA_MAX_WIN_SIZE
+};
+#undef X
+#define APMPI_NUM_RMA_MAX ((int)(sizeof(apmpi_rma_max_counters) / sizeof(apmpi_rma_max_counters[0])))
+
+/* bytes counters of the ops that move data; the window ops are left out,
+ * as their bytes hold window sizes
+ */
+#define X(a) a ## _TOTAL_BYTES,
+#define V(a)
+static const int apmpi_op_total_bytes[] = {
+    APMPI_MPI_BLOCKING_P2P
+    APMPI_MPI_NONBLOCKING_P2P
+    APMPI_MPI_BLOCKING_COLL
+    APMPI_MPI_NONBLOCKING_COLL
+    APMPI_MPI_ONESIDED
+    APMPI_MPI_BLOCKING_NEIGHBOR_COLL
+    APMPI_MPI_NONBLOCKING_NEIGHBOR_COLL
+};
+#undef V
+#undef X
+#define APMPI_NUM_BYTES_OPS ((int)(sizeof(apmpi_op_total_bytes) / sizeof(apmpi_op_total_bytes[0])))
+
+/* v1 perf record layout, before the neighborhood collective counters */
+struct darshan_apmpi_perf_record_v1
+{
+    struct darshan_base_record base_rec;
+    uint64_t counters[APMPI_V1_NUM_INDICES];
+    double fcounters[APMPI_V1_F_MPIOP_TOTALTIME_NUM_INDICES];
+    double fsynccounters[APMPI_V1_F_MPIOP_SYNCTIME_NUM_INDICES];
+    double fglobalcounters[APMPI_F_MPI_GLOBAL_NUM_INDICES];
+    char node_name[AP_PROCESSOR_NAME_MAX];
+};
+
+/* v1 header record layout, before the MPI_T pvar names */
+struct darshan_apmpi_header_record_v1
+{
+    struct darshan_base_record base_rec;
+    int64_t magic;
+    uint32_t sync_flag;
+    double apmpi_f_variance_total_mpitime;
+    double apmpi_f_variance_total_mpisynctime;
+};
+
+/* names of the MPI_T pvars, taken from the header record; a log's header
+ * is printed before its perf records, and the names are kept per thread so
+ * that threads printing different logs do not see each other's
+ */
+static __thread int apmpi_pvar_count;
+static __thread char apmpi_pvar_names[APMPI_MAX_PVARS][APMPI_PVAR_NAME_MAX];
+
 static int darshan_log_get_apmpi_rec(darshan_fd fd, void** buf_p);
 static int darshan_log_put_apmpi_rec(darshan_fd fd, void* buf);
 static void darshan_log_print_apmpi_rec(void *file_rec,
@@ -57,6 +143,7 @@ static void darshan_log_print_apmpi_rec(void *file_rec,
 static void darshan_log_print_apmpi_description(int ver);
 static void darshan_log_print_apmpi_rec_diff(void *file_rec1, char *file_name1,
     void *file_rec2, char *file_name2);
+static void darshan_log_agg_apmpi_recs(void *rec, void *agg_rec, int init_flag);
 
 struct darshan_mod_logutil_funcs apmpi_logutils =
 {
@@ -65,19 +152,165 @@ struct darshan_mod_logutil_funcs apmpi_logutils =
     .log_print_record = &darshan_log_print_apmpi_rec,
     .log_print_description = &darshan_log_print_apmpi_description,
     .log_print_diff = &darshan_log_print_apmpi_rec_diff,
-    .log_agg_records = NULL
+    .log_agg_records = &darshan_log_agg_apmpi_recs
 };
 
+/* expand a v1 perf record in place to the current layout; the v1 counter
+ * arrays are a prefix of the current ones, so new counters are zeroed
+ */
+static void darshan_log_convert_apmpi_v1_rec(struct darshan_apmpi_perf_record *prf_rec)
+{
+    struct darshan_apmpi_perf_record_v1 v1_rec;
+
+    memcpy(&v1_rec, prf_rec, sizeof(v1_rec));
+    memset(prf_rec, 0, sizeof(*prf_rec));
+
+    prf_rec->base_rec = v1_rec.base_rec;
+    memcpy(prf_rec->counters, v1_rec.counters, sizeof(v1_rec.counters));
+    memcpy(prf_rec->fcounters, v1_rec.fcounters, sizeof(v1_rec.fcounters));
+    memcpy(prf_rec->fsynccounters, v1_rec.fsynccounters, sizeof(v1_rec.fsynccounters));
+    memcpy(prf_rec->fglobalcounters, v1_rec.fglobalcounters, sizeof(v1_rec.fglobalcounters));
+    memcpy(prf_rec->node_name, v1_rec.node_name, sizeof(v1_rec.node_name));
+
+    return;
+}
+
+static void darshan_log_convert_apmpi_v1_hdr(struct darshan_apmpi_header_record *hdr_rec)
+{
+    struct darshan_apmpi_header_record_v1 v1_hdr;
+
+    memcpy(&v1_hdr, hdr_rec, sizeof(v1_hdr));
+    memset(hdr_rec, 0, sizeof(*hdr_rec));
+
+    hdr_rec->base_rec = v1_hdr.base_rec;
+    hdr_rec->magic = v1_hdr.magic;
+    hdr_rec->sync_flag = v1_hdr.sync_flag;
+    hdr_rec->apmpi_f_variance_total_mpitime = v1_hdr.apmpi_f_variance_total_mpitime;
+    hdr_rec->apmpi_f_variance_total_mpisynctime = v1_hdr.apmpi_f_variance_total_mpisynctime;
+
+    return;
+}
+
+/* remember the pvar names of a header record for printing perf records */
+static void darshan_log_save_apmpi_pvar_names(struct darshan_apmpi_header_record *hdr_rec)
+{
+    int i;
+
+    apmpi_pvar_count = hdr_rec->pvar_count;
+    if (apmpi_pvar_count > APMPI_MAX_PVARS)
+        apmpi_pvar_count = APMPI_MAX_PVARS;
+    memcpy(apmpi_pvar_names, hdr_rec->pvar_names, sizeof(apmpi_pvar_names));
+    for (i = 0; i < APMPI_MAX_PVARS; i++)
+        apmpi_pvar_names[i][APMPI_PVAR_NAME_MAX-1] = '\0';
+
+    return;
+}
+
+/* read a counter array of n 8 byte values off a packed perf record, as
+ * apmpi_pack_counters in the runtime appended it; returns the end of what
+ * was read, or NULL if the record is malformed
+ */
+static const unsigned char *darshan_log_unpack_apmpi_counters(
+    const unsigned char *p, const unsigned char *end, void *vals, int n,
+    int varint, int swap_flag)
+{
+    const unsigned char *bitmap = p;
+    uint64_t v;
+    int i, shift;
+
+    if (end - p < (n + 7) / 8)
+        return(NULL);
+    p += (n + 7) / 8;
+
+    for (i = 0; i < n; i++)
+    {
+        if (!(bitmap[i / 8] & (1 << (i % 8))))
+            continue;
+        if (!varint)
+        {
+            if (end - p < (ptrdiff_t)sizeof(v))
+                return(NULL);
+            memcpy(&v, p, sizeof(v));
+            if (swap_flag)
+                DARSHAN_BSWAP64(&v);
+            p += sizeof(v);
+        }
+        else
+        {
+            v = 0;
+            shift = 0;
+            do
+            {
+                if (p == end || shift > 63)
+                    return(NULL);
+                v |= (uint64_t)(*p & 0x7f) << shift;
+                shift += 7;
+            } while (*p++ & 0x80);
+        }
+        memcpy((char *)vals + i * sizeof(v), &v, sizeof(v));
+    }
+
+    return(p);
+}
+
+/* expand the rest of a packed perf record, from p to end, into prf_rec,
+ * whose base record is already read; returns 0, or -1 if it is malformed
+ */
+static int darshan_log_unpack_apmpi_rec(struct darshan_apmpi_perf_record *prf_rec,
+    const unsigned char *p, const unsigned char *end, int swap_flag)
+{
+    int name_len;
+
+    memset((char *)prf_rec + sizeof(prf_rec->base_rec), 0,
+        sizeof(*prf_rec) - sizeof(prf_rec->base_rec));
+
+    if (p == end)
+        return(-1);
+    name_len = *p++;
+    if (name_len > AP_PROCESSOR_NAME_MAX || end - p < name_len)
+        return(-1);
+    memcpy(prf_rec->node_name, p, name_len);
+    p += name_len;
+
+    p = darshan_log_unpack_apmpi_counters(p, end, prf_rec->counters,
+        APMPI_NUM_INDICES, 1, swap_flag);
+    if (p)
+        p = darshan_log_unpack_apmpi_counters(p, end, prf_rec->fcounters,
+            APMPI_F_MPIOP_TOTALTIME_NUM_INDICES, 0, swap_flag);
+    if (p)
+        p = darshan_log_unpack_apmpi_counters(p, end, prf_rec->fsynccounters,
+            APMPI_F_MPIOP_SYNCTIME_NUM_INDICES, 0, swap_flag);
+    if (p)
+        p = darshan_log_unpack_apmpi_counters(p, end, prf_rec->fglobalcounters,
+            APMPI_F_MPI_GLOBAL_NUM_INDICES, 0, swap_flag);
+    if (p)
+        p = darshan_log_unpack_apmpi_counters(p, end, prf_rec->rmacounters,
+            APMPI_RMA_NUM_INDICES, 1, swap_flag);
+    if (p)
+        p = darshan_log_unpack_apmpi_counters(p, end, prf_rec->frmacounters,
+            APMPI_F_RMA_NUM_INDICES, 0, swap_flag);
+    if (p)
+        p = darshan_log_unpack_apmpi_counters(p, end, prf_rec->pvarcounters,
+            APMPI_MAX_PVARS, 0, swap_flag);
+    if (p != end)
+        return(-1);
+
+    return(0);
+}
 
 static int darshan_log_get_apmpi_rec(darshan_fd fd, void** buf_p)
 {
     struct darshan_apmpi_header_record *hdr_rec;
     struct darshan_apmpi_perf_record *prf_rec;
+    int prefix_len = offsetof(struct darshan_apmpi_header_record, sync_flag);
     int rec_len;
+    int64_t magic;
     char *buffer;
+    unsigned char packed[sizeof(struct darshan_apmpi_perf_record)];
     int i;
     int ret = -1;
-    static int first_rec = 1;
+    int is_hdr = 0;
+    int is_packed = 0;
 
     if(fd->mod_map[DARSHAN_APMPI_MOD].len == 0)
         return(0);
@@ -104,30 +337,70 @@ static int darshan_log_get_apmpi_rec(darshan_fd fd, void** buf_p)
         buffer = *buf_p;
     }
 
-    if (fd->mod_ver[DARSHAN_APMPI_MOD] < APMPI_VER)
+    /* the header record has its magic where perf records start their
+     * counters, in every version
+     */
+    ret = darshan_log_get_mod(fd, DARSHAN_APMPI_MOD, buffer, prefix_len);
+    if (ret == prefix_len)
     {
-        /* perform conversion as needed */
-    }
+        magic = ((struct darshan_apmpi_header_record *)buffer)->magic;
+        if (fd->swap_flag)
+            DARSHAN_BSWAP64(&magic);
+        is_hdr = magic == APMPI_MAGIC;
+        /* from v3 on, where perf records may be packed */
+        is_packed = !is_hdr && fd->mod_ver[DARSHAN_APMPI_MOD] >= 3 &&
+            ((uint64_t)magic >> 32) == APMPI_PACKED_TAG;
 
-    /* v1, current version */
-    if (fd->mod_ver[DARSHAN_APMPI_MOD] == APMPI_VER)
-    {
-        if (first_rec)
-        {
+        if (is_packed)
+            rec_len = magic & 0xffffffff;
+        else if (is_hdr && fd->mod_ver[DARSHAN_APMPI_MOD] == 1)
+            rec_len = sizeof(struct darshan_apmpi_header_record_v1);
+        else if (is_hdr)
             rec_len = sizeof(struct darshan_apmpi_header_record);
-            first_rec = 0;
-        }
+        else if (fd->mod_ver[DARSHAN_APMPI_MOD] == 1)
+            rec_len = sizeof(struct darshan_apmpi_perf_record_v1);
         else
             rec_len = sizeof(struct darshan_apmpi_perf_record);
 
-        ret = darshan_log_get_mod(fd, DARSHAN_APMPI_MOD, buffer, rec_len);
+        if (!is_packed)
+        {
+            ret = darshan_log_get_mod(fd, DARSHAN_APMPI_MOD, buffer + prefix_len,
+                rec_len - prefix_len);
+            ret = (ret == rec_len - prefix_len) ? rec_len : -1;
+        }
+        else if (rec_len <= prefix_len || rec_len >= (int)sizeof(packed))
+        {
+            ret = -1;
+        }
+        else
+        {
+            ret = darshan_log_get_mod(fd, DARSHAN_APMPI_MOD, packed,
+                rec_len - prefix_len);
+            if (ret != rec_len - prefix_len ||
+                darshan_log_unpack_apmpi_rec((struct darshan_apmpi_perf_record *)buffer,
+                    packed, packed + ret, fd->swap_flag) < 0)
+                ret = -1;
+        }
+    }
+    else if (ret > 0)
+    {
+        ret = -1;
     }
 
-    if (ret == rec_len)
+    if (ret > 0)
     {
+        if (fd->mod_ver[DARSHAN_APMPI_MOD] == 1 && !is_hdr)
+        {
+            /* perform conversion as needed */
+            darshan_log_convert_apmpi_v1_rec((struct darshan_apmpi_perf_record*)buffer);
+        }
+        else if (fd->mod_ver[DARSHAN_APMPI_MOD] == 1)
+        {
+            darshan_log_convert_apmpi_v1_hdr((struct darshan_apmpi_header_record*)buffer);
+        }
         if(fd->swap_flag)
         {
-            if (rec_len == sizeof(struct darshan_apmpi_header_record))
+            if (is_hdr)
             {
                 hdr_rec = (struct darshan_apmpi_header_record*)buffer;
                 /* swap bytes if necessary */
@@ -137,6 +410,14 @@ static int darshan_log_get_apmpi_rec(darshan_fd fd, void** buf_p)
                 DARSHAN_BSWAP32(&(hdr_rec->sync_flag));
                 DARSHAN_BSWAP64(&(hdr_rec->apmpi_f_variance_total_mpitime));
                 DARSHAN_BSWAP64(&(hdr_rec->apmpi_f_variance_total_mpisynctime));
+                DARSHAN_BSWAP32(&(hdr_rec->pvar_count));
+            }
+            else if (is_packed)
+            {
+                /* the counters were swapped as they were unpacked */
+                prf_rec = (struct darshan_apmpi_perf_record*)buffer;
+                DARSHAN_BSWAP64(&(prf_rec->base_rec.id));
+                DARSHAN_BSWAP64(&(prf_rec->base_rec.rank));
             }
             else
             {
@@ -159,6 +440,18 @@ static int darshan_log_get_apmpi_rec(darshan_fd fd, void** buf_p)
                 {
                     DARSHAN_BSWAP64(&prf_rec->fglobalcounters[i]);
                 }
+                for (i = 0; i < APMPI_RMA_NUM_INDICES; i++)
+                {
+                    DARSHAN_BSWAP64(&prf_rec->rmacounters[i]);
+                }
+                for (i = 0; i < APMPI_F_RMA_NUM_INDICES; i++)
+                {
+                    DARSHAN_BSWAP64(&prf_rec->frmacounters[i]);
+                }
+                for (i = 0; i < APMPI_MAX_PVARS; i++)
+                {
+                    DARSHAN_BSWAP64(&prf_rec->pvarcounters[i]);
+                }
             }
         }
         *buf_p = buffer;
@@ -182,13 +475,10 @@ static int darshan_log_put_apmpi_rec(darshan_fd fd, void* buf)
 {
     int ret;
     int rec_len;
-    static int first_rec = 1;
+    struct darshan_apmpi_header_record *hdr_rec = buf;
 
-    if (first_rec)
-    {
+    if (hdr_rec->magic == APMPI_MAGIC)
         rec_len = sizeof(struct darshan_apmpi_header_record);
-        first_rec = 0;
-    }
     else
         rec_len = sizeof(struct darshan_apmpi_perf_record);
     
@@ -204,12 +494,11 @@ static void darshan_log_print_apmpi_rec(void *rec, char *file_name,
     char *mnt_pt, char *fs_type)
 {
     int i;
-    static int first_rec = 1;
-    static int sync_flag;
+    static __thread int sync_flag;
     struct darshan_apmpi_header_record *hdr_rec;
     struct darshan_apmpi_perf_record *prf_rec;
     
-    if (first_rec)
+    if (((struct darshan_apmpi_header_record *)rec)->magic == APMPI_MAGIC)
     {
         hdr_rec = rec;
         DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
@@ -221,8 +510,8 @@ static void darshan_log_print_apmpi_rec(void *rec, char *file_name,
             hdr_rec->base_rec.rank, hdr_rec->base_rec.id,
             "MPI_TOTAL_COMM_SYNC_TIME_VARIANCE", hdr_rec->apmpi_f_variance_total_mpisynctime,
             "", "", "");
-        first_rec = 0;
         sync_flag = hdr_rec->sync_flag;
+        darshan_log_save_apmpi_pvar_names(hdr_rec);
     }
     else
     {
@@ -266,6 +555,27 @@ static void darshan_log_print_apmpi_rec(void *rec, char *file_name,
                 prf_rec->base_rec.rank, prf_rec->base_rec.id,
                 apmpi_f_mpi_global_counter_names[1], prf_rec->fglobalcounters[1],
                 "", "", "");
+        for(i = 0; i < APMPI_RMA_NUM_INDICES; i++)
+        {
+            DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
+                prf_rec->base_rec.rank, prf_rec->base_rec.id,
+                apmpi_rma_counter_names[i], prf_rec->rmacounters[i],
+                "", "", "");
+        }
+        for(i = 0; i < APMPI_F_RMA_NUM_INDICES; i++)
+        {
+            DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
+                prf_rec->base_rec.rank, prf_rec->base_rec.id,
+                apmpi_f_rma_counter_names[i], prf_rec->frmacounters[i],
+                "", "", "");
+        }
+        for(i = 0; i < apmpi_pvar_count; i++)
+        {
+            DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
+                prf_rec->base_rec.rank, prf_rec->base_rec.id,
+                apmpi_pvar_names[i], prf_rec->pvarcounters[i],
+                "", "", "");
+        }
     }
 
     return;
@@ -288,6 +598,154 @@ static void darshan_log_print_apmpi_description(int ver)
     printf("#     MPI_*_TOTAL_SYNC_TIME: total sync time (cumulative across all calls of an op) of an MPI op, if enabled.\n");
     printf("#     MPI_TOTAL_COMM_TIME: total communication (MPI) time of a process across all the MPI ops.\n");
     printf("#     MPI_TOTAL_COMM_SYNC_TIME: total sync time of a process across all the MPI ops, if enabled.\n");
+    printf("#     MPI_WIN_{CREATE,ALLOCATE,ALLOCATE_SHARED,ATTACH}_TOTAL_BYTES: total size of the RMA windows created or attached.\n");
+    printf("#     MPI_RMA_{FENCE,LOCK,PSCW}_EPOCHS: number of completed RMA access epochs of a synchronization type.\n");
+    printf("#     MPI_RMA_*_EPOCH_BYTES: total bytes moved by RMA ops inside the epochs.\n");
+    printf("#     MPI_RMA_*_EPOCH_OPS: total number of RMA ops issued inside the epochs.\n");
+    printf("#     MPI_RMA_*_EPOCH_MAX_BYTES: largest number of bytes moved within a single epoch.\n");
+    printf("#     MPI_RMA_*_EPOCH_MAX_OPS: largest number of RMA ops issued within a single epoch.\n");
+    printf("#     MPI_RMA_MAX_WIN_SIZE: size of the largest RMA window.\n");
+    printf("#     MPI_RMA_*_EPOCH_TIME: total time spent inside the epochs (open to close).\n");
+    printf("#     MPI_RMA_*_SYNC_TIME: total time spent in the synchronization calls of the epochs.\n");
+    printf("#     MPI_RMA_WIN_LIFETIME: cumulative lifetime of the RMA windows freed by the process.\n");
+    printf("#     <pvar name>: value of an MPI_T performance variable at shutdown (summed over its elements), if requested with DARSHAN_APMPI_PVARS.\n");
+    return;
+}
+
+/* index of the first counter from i on that differs between the arrays a
+ * and b of n counters, or n. Blocks of counters are compared without a
+ * branch per counter, which vectorizes, so the stretches of a record that
+ * did not change are skipped at little more than the cost of reading them.
+ */
+#define APMPI_DIFF_BLOCK 8
+
+static int apmpi_next_diff_u(const uint64_t *a, const uint64_t *b, int i, int n)
+{
+    uint64_t d;
+    int j;
+
+    for(; i + APMPI_DIFF_BLOCK <= n; i += APMPI_DIFF_BLOCK)
+    {
+        d = 0;
+        for(j = 0; j < APMPI_DIFF_BLOCK; j++)
+            d |= a[i+j] ^ b[i+j];
+        if(d)
+            break;
+    }
+    for(; i < n && a[i] == b[i]; i++);
+
+    return(i);
+}
+
+static int apmpi_next_diff_f(const double *a, const double *b, int i, int n)
+{
+    int d;
+    int j;
+
+    for(; i + APMPI_DIFF_BLOCK <= n; i += APMPI_DIFF_BLOCK)
+    {
+        d = 0;
+        for(j = 0; j < APMPI_DIFF_BLOCK; j++)
+            d |= a[i+j] != b[i+j];
+        if(d)
+            break;
+    }
+    for(; i < n && a[i] == b[i]; i++);
+
+    return(i);
+}
+
+/* print the diff of the counter arrays a1 and a2 of the perf records
+ * prf_rec1 and prf_rec2: every counter of a record the other log lacks,
+ * else the "-"/"+" pair of each counter that differs
+ */
+static void apmpi_print_diff_u(struct darshan_apmpi_perf_record *prf_rec1,
+    const uint64_t *a1, struct darshan_apmpi_perf_record *prf_rec2,
+    const uint64_t *a2, char **names, int n)
+{
+    int i;
+
+    if (!prf_rec2)
+    {
+        for(i = 0; i < n; i++)
+        {
+            printf("- ");
+            DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
+                prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
+                names[i], a1[i], "", "", "");
+        }
+    }
+    else if (!prf_rec1)
+    {
+        for(i = 0; i < n; i++)
+        {
+            printf("+ ");
+            DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
+                prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
+                names[i], a2[i], "", "", "");
+        }
+    }
+    else
+    {
+        for(i = apmpi_next_diff_u(a1, a2, 0, n); i < n;
+            i = apmpi_next_diff_u(a1, a2, i + 1, n))
+        {
+            printf("- ");
+            DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
+                prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
+                names[i], a1[i], "", "", "");
+            printf("+ ");
+            DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
+                prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
+                names[i], a2[i], "", "", "");
+        }
+    }
+
+    return;
+}
+
+static void apmpi_print_diff_f(struct darshan_apmpi_perf_record *prf_rec1,
+    const double *a1, struct darshan_apmpi_perf_record *prf_rec2,
+    const double *a2, char **names, int n)
+{
+    int i;
+
+    if (!prf_rec2)
+    {
+        for(i = 0; i < n; i++)
+        {
+            printf("- ");
+            DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
+                prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
+                names[i], a1[i], "", "", "");
+        }
+    }
+    else if (!prf_rec1)
+    {
+        for(i = 0; i < n; i++)
+        {
+            printf("+ ");
+            DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
+                prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
+                names[i], a2[i], "", "", "");
+        }
+    }
+    else
+    {
+        for(i = apmpi_next_diff_f(a1, a2, 0, n); i < n;
+            i = apmpi_next_diff_f(a1, a2, i + 1, n))
+        {
+            printf("- ");
+            DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
+                prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
+                names[i], a1[i], "", "", "");
+            printf("+ ");
+            DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
+                prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
+                names[i], a2[i], "", "", "");
+        }
+    }
+
     return;
 }
 
@@ -303,12 +761,17 @@ static void darshan_log_print_apmpi_rec_diff(void *file_rec1, char *file_name1,
     hdr_rec2 = (struct darshan_apmpi_header_record*) file_rec2;
     prf_rec1 = (struct darshan_apmpi_perf_record*) file_rec1;
     prf_rec2 = (struct darshan_apmpi_perf_record*) file_rec2;
-    static int sync_flag;
-    sync_flag = hdr_rec1->sync_flag && hdr_rec2->sync_flag;
+    char *pvar_names[APMPI_MAX_PVARS];
+    /* whether both logs recorded sync times, from their header records */
+    static __thread int sync_flag;
+    int i;
 
-    if (hdr_rec1->magic == APMPI_MAGIC)
+    if ((hdr_rec1 ? hdr_rec1 : hdr_rec2)->magic == APMPI_MAGIC)
     {
         /* this is the header record */   
+        darshan_log_save_apmpi_pvar_names(hdr_rec1 ? hdr_rec1 : hdr_rec2);
+        sync_flag = (!hdr_rec1 || hdr_rec1->sync_flag) &&
+            (!hdr_rec2 || hdr_rec2->sync_flag);
         if (!hdr_rec2) 
         {
             printf("- ");   
@@ -386,7 +849,7 @@ static void darshan_log_print_apmpi_rec_diff(void *file_rec1, char *file_name1,
                   "MPI_PROCESSOR_NAME", prf_rec2->node_name,
                   "", "", "");
         }
-        else if (prf_rec1->node_name != prf_rec2->node_name)
+        else if (strcmp(prf_rec1->node_name, prf_rec2->node_name) != 0)
         {
             printf("- ");
             DARSHAN_S_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
@@ -399,177 +862,635 @@ static void darshan_log_print_apmpi_rec_diff(void *file_rec1, char *file_name1,
                   "MPI_PROCESSOR_NAME", prf_rec2->node_name,
                   "", "", "");
         }
-        int i;
-        for(i = 0; i < APMPI_NUM_INDICES; i++)
+        apmpi_print_diff_u(prf_rec1, prf_rec1 ? prf_rec1->counters : NULL,
+            prf_rec2, prf_rec2 ? prf_rec2->counters : NULL,
+            apmpi_counter_names, APMPI_NUM_INDICES);
+        apmpi_print_diff_f(prf_rec1, prf_rec1 ? prf_rec1->fcounters : NULL,
+            prf_rec2, prf_rec2 ? prf_rec2->fcounters : NULL,
+            apmpi_f_mpiop_totaltime_counter_names, APMPI_F_MPIOP_TOTALTIME_NUM_INDICES);
+        if(sync_flag)
+            apmpi_print_diff_f(prf_rec1, prf_rec1 ? prf_rec1->fsynccounters : NULL,
+                prf_rec2, prf_rec2 ? prf_rec2->fsynccounters : NULL,
+                apmpi_f_mpiop_synctime_counter_names, APMPI_F_MPIOP_SYNCTIME_NUM_INDICES);
+        /* MPI_TOTAL_COMM_SYNC_TIME only if the sync times were recorded */
+        apmpi_print_diff_f(prf_rec1, prf_rec1 ? prf_rec1->fglobalcounters : NULL,
+            prf_rec2, prf_rec2 ? prf_rec2->fglobalcounters : NULL,
+            apmpi_f_mpi_global_counter_names, sync_flag ? 2 : 1);
+        apmpi_print_diff_u(prf_rec1, prf_rec1 ? prf_rec1->rmacounters : NULL,
+            prf_rec2, prf_rec2 ? prf_rec2->rmacounters : NULL,
+            apmpi_rma_counter_names, APMPI_RMA_NUM_INDICES);
+        apmpi_print_diff_f(prf_rec1, prf_rec1 ? prf_rec1->frmacounters : NULL,
+            prf_rec2, prf_rec2 ? prf_rec2->frmacounters : NULL,
+            apmpi_f_rma_counter_names, APMPI_F_RMA_NUM_INDICES);
+        for(i = 0; i < apmpi_pvar_count; i++)
+            pvar_names[i] = apmpi_pvar_names[i];
+        apmpi_print_diff_f(prf_rec1, prf_rec1 ? prf_rec1->pvarcounters : NULL,
+            prf_rec2, prf_rec2 ? prf_rec2->pvarcounters : NULL,
+            pvar_names, apmpi_pvar_count);
+    }
+
+
+    return;
+}
+/* fold the perf record rec into the aggregate perf record agg_rec, which
+ * is reset first if init_flag is set. Counts, bytes and times are summed,
+ * the min and max times of an op only over the ranks that called it.
+ * Header records are skipped, so the variances of the total MPI and sync
+ * times are not merged: each log's header only holds the variance across
+ * its own ranks, and combining them would need the per-log rank counts and
+ * means, which the perf record has no room to carry.
+ */
+static void darshan_log_agg_apmpi_recs(void *rec, void *agg_rec, int init_flag)
+{
+    struct darshan_apmpi_perf_record *prf_rec = rec;
+    struct darshan_apmpi_perf_record *agg_prf_rec = agg_rec;
+    uint64_t rma_max[APMPI_NUM_RMA_MAX];
+    uint64_t calls, agg_calls;
+    double *ftime, *agg_ftime;
+    int i;
+
+    if (init_flag)
+    {
+        memset(agg_prf_rec, 0, sizeof(*agg_prf_rec));
+        agg_prf_rec->base_rec.rank = -1;
+    }
+
+    if (((struct darshan_apmpi_header_record *)rec)->magic == APMPI_MAGIC)
+        return;
+
+    /* ranks all share the perf record's id, and mostly the node; the id is
+     * still 0 until the first rank is folded in
+     */
+    if (agg_prf_rec->base_rec.id == 0)
+    {
+        agg_prf_rec->base_rec.id = prf_rec->base_rec.id;
+        memcpy(agg_prf_rec->node_name, prf_rec->node_name,
+            sizeof(agg_prf_rec->node_name));
+    }
+    else if (strncmp(agg_prf_rec->node_name, prf_rec->node_name,
+        AP_PROCESSOR_NAME_MAX) != 0)
+    {
+        agg_prf_rec->node_name[0] = '\0';
+    }
+
+    /* min and max times, before the call counts they depend on are summed */
+    for (i = 0; i < APMPI_NUM_OPS; i++)
+    {
+        calls = prf_rec->counters[apmpi_op_call_counts[i]];
+        agg_calls = agg_prf_rec->counters[apmpi_op_call_counts[i]];
+        ftime = &prf_rec->fcounters[3 * i];
+        agg_ftime = &agg_prf_rec->fcounters[3 * i];
+        agg_ftime[0] += ftime[0];
+        if (calls == 0)
+            continue;
+        if (agg_calls == 0 || ftime[1] < agg_ftime[1])
+            agg_ftime[1] = ftime[1];
+        if (ftime[2] > agg_ftime[2])
+            agg_ftime[2] = ftime[2];
+    }
+
+    for (i = 0; i < APMPI_NUM_INDICES; i++)
+        agg_prf_rec->counters[i] += prf_rec->counters[i];
+    for (i = 0; i < APMPI_F_MPIOP_SYNCTIME_NUM_INDICES; i++)
+        agg_prf_rec->fsynccounters[i] += prf_rec->fsynccounters[i];
+    for (i = 0; i < APMPI_F_RMA_NUM_INDICES; i++)
+        agg_prf_rec->frmacounters[i] += prf_rec->frmacounters[i];
+    for (i = 0; i < APMPI_MAX_PVARS; i++)
+        agg_prf_rec->pvarcounters[i] += prf_rec->pvarcounters[i];
+
+    for (i = 0; i < APMPI_NUM_RMA_MAX; i++)
+    {
+        rma_max[i] = agg_prf_rec->rmacounters[apmpi_rma_max_counters[i]];
+        if (prf_rec->rmacounters[apmpi_rma_max_counters[i]] > rma_max[i])
+            rma_max[i] = prf_rec->rmacounters[apmpi_rma_max_counters[i]];
+    }
+    for (i = 0; i < APMPI_RMA_NUM_INDICES; i++)
+        agg_prf_rec->rmacounters[i] += prf_rec->rmacounters[i];
+    for (i = 0; i < APMPI_NUM_RMA_MAX; i++)
+        agg_prf_rec->rmacounters[apmpi_rma_max_counters[i]] = rma_max[i];
+
+    for (i = 0; i < APMPI_F_MPI_GLOBAL_NUM_INDICES; i++)
+        agg_prf_rec->fglobalcounters[i] += prf_rec->fglobalcounters[i];
+
+    return;
+}
+
+/* bytes a rank moved, over the ops that move data */
+static double apmpi_rank_bytes(struct darshan_apmpi_perf_record *prf_rec)
+{
+    double bytes = 0;
+    int i;
+
+    for (i = 0; i < APMPI_NUM_BYTES_OPS; i++)
+        bytes += prf_rec->counters[apmpi_op_total_bytes[i]];
+
+    return(bytes);
+}
+
+/* metrics of the top/bottom rank report: the total MPI and sync times and
+ * bytes of a rank, then the total time of each op
+ */
+#define APMPI_TOP_COMM_TIME 0
+#define APMPI_TOP_SYNC_TIME 1
+#define APMPI_TOP_BYTES 2
+#define APMPI_TOP_OP_TIME 3
+#define APMPI_TOP_NUM_METRICS (APMPI_TOP_OP_TIME + APMPI_NUM_OPS)
+
+/* a t-digest of the per-rank MPI time, in the merging form: added values
+ * are appended after the centroids, and all are sorted and merged once the
+ * array is full. Neighbouring centroids are merged while the weight w of
+ * the merged one, centered at m of the total weight W, keeps to
+ * w <= 2 * sqrt(m * (W - m)) / APMPI_TDIGEST_DELTA, which keeps the
+ * centroids small at the tails and about APMPI_TDIGEST_DELTA * pi / 2 of
+ * them in all.
+ */
+#define APMPI_TDIGEST_DELTA 100
+#define APMPI_TDIGEST_CAP 1000
+
+struct apmpi_tdigest_centroid
+{
+    double mean;
+    double w;
+};
+
+struct apmpi_tdigest
+{
+    int n;
+    double W;
+    double min;
+    double max;
+    double sum;
+    struct apmpi_tdigest_centroid c[APMPI_TDIGEST_CAP];
+};
+
+/* a rank in the top or bottom k of a metric */
+struct apmpi_top_entry
+{
+    double key;
+    int64_t rank;
+};
+
+struct darshan_apmpi_top
+{
+    int k;
+    int sync_flag;
+    int64_t nranks;
+    /* the top k of each metric, then the bottom k, as min heaps on the key,
+     * which is the value for the top k and its negation for the bottom k
+     */
+    int count[APMPI_TOP_NUM_METRICS][2];
+    struct apmpi_top_entry *heaps;
+    struct apmpi_tdigest mpitime;
+};
+
+static int apmpi_tdigest_cmp(const void *a, const void *b)
+{
+    const struct apmpi_tdigest_centroid *c1 = a;
+    const struct apmpi_tdigest_centroid *c2 = b;
+
+    if (c1->mean < c2->mean)
+        return(-1);
+    if (c1->mean > c2->mean)
+        return(1);
+    return(0);
+}
+
+static void apmpi_tdigest_compress(struct apmpi_tdigest *td)
+{
+    struct apmpi_tdigest_centroid cur;
+    double w, m, wsofar = 0;
+    int i, out = 0;
+
+    if (td->n < 2)
+        return;
+
+    qsort(td->c, td->n, sizeof(td->c[0]), apmpi_tdigest_cmp);
+
+    /* merging in place is safe, as out never passes i */
+    cur = td->c[0];
+    for (i = 1; i < td->n; i++)
+    {
+        w = cur.w + td->c[i].w;
+        m = wsofar + w / 2;
+        if (w * w * APMPI_TDIGEST_DELTA * APMPI_TDIGEST_DELTA <=
+            4 * m * (td->W - m))
         {
-            if (!prf_rec2)
-            {   
-                printf("- ");
-                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    apmpi_counter_names[i], prf_rec1->counters[i],
-                    "", "", "");
-            }
-            else if (!prf_rec1)
-            {
-                printf("+ ");
-                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    apmpi_counter_names[i], prf_rec2->counters[i],
-                    "", "", "");
-            }
-            else if (prf_rec1->counters[i] != prf_rec2->counters[i])
-            {
-                printf("- ");
-                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    apmpi_counter_names[i], prf_rec1->counters[i],
-                    "", "", "");
-                printf("+ ");
-                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    apmpi_counter_names[i], prf_rec2->counters[i],
-                    "", "", "");
-            }
+            cur.mean += (td->c[i].mean - cur.mean) * td->c[i].w / w;
+            cur.w = w;
         }
-        
-        for(i = 0; i < APMPI_F_MPIOP_TOTALTIME_NUM_INDICES; i++)
-        {   
-            if (!prf_rec2)
-            {   
-                printf("- ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    apmpi_f_mpiop_totaltime_counter_names[i], prf_rec1->fcounters[i],
-                    "", "", "");
-            }
-            else if (!prf_rec1)
-            {
-                printf("+ ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    apmpi_f_mpiop_totaltime_counter_names[i], prf_rec2->fcounters[i],
-                    "", "", "");
-            }
-            else if (prf_rec1->counters[i] != prf_rec2->counters[i])
-            {
-                printf("- ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    apmpi_f_mpiop_totaltime_counter_names[i], prf_rec1->fcounters[i],
-                    "", "", "");
-                printf("+ ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    apmpi_f_mpiop_totaltime_counter_names[i], prf_rec2->fcounters[i],
-                    "", "", "");
-            }
-        }
-        if(sync_flag)
+        else
         {
-        for(i = 0; i < APMPI_F_MPIOP_SYNCTIME_NUM_INDICES; i++)
+            td->c[out++] = cur;
+            wsofar += cur.w;
+            cur = td->c[i];
+        }
+    }
+    td->c[out++] = cur;
+    td->n = out;
+
+    return;
+}
+
+static void apmpi_tdigest_add(struct apmpi_tdigest *td, double v)
+{
+    if (td->n == APMPI_TDIGEST_CAP)
+        apmpi_tdigest_compress(td);
+
+    if (td->W == 0 || v < td->min)
+        td->min = v;
+    if (td->W == 0 || v > td->max)
+        td->max = v;
+    td->c[td->n].mean = v;
+    td->c[td->n].w = 1;
+    td->n++;
+    td->W += 1;
+    td->sum += v;
+
+    return;
+}
+
+/* the value at quantile q, interpolated between the centers of the
+ * centroids, and the min and max at the ends
+ */
+static double apmpi_tdigest_quantile(struct apmpi_tdigest *td, double q)
+{
+    double target = q * td->W;
+    double prev_pos = 0, prev_val = td->min;
+    double pos, cum = 0;
+    int i;
+
+    if (td->n == 0)
+        return(0);
+
+    apmpi_tdigest_compress(td);
+
+    for (i = 0; i < td->n; i++)
+    {
+        pos = cum + td->c[i].w / 2;
+        if (target <= pos)
         {
-            if (!prf_rec2)
-            {
-                printf("- ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    apmpi_f_mpiop_synctime_counter_names[i], prf_rec1->fsynccounters[i],
-                    "", "", "");
+            if (pos <= prev_pos)
+                return(td->c[i].mean);
+            return(prev_val + (td->c[i].mean - prev_val) *
+                (target - prev_pos) / (pos - prev_pos));
+        }
+        prev_pos = pos;
+        prev_val = td->c[i].mean;
+        cum += td->c[i].w;
+    }
+    if (td->W <= prev_pos)
+        return(td->max);
+    return(prev_val + (td->max - prev_val) *
+        (target - prev_pos) / (td->W - prev_pos));
+}
 
-            }
-            else if (!prf_rec1)
-            {
-                printf("+ ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    apmpi_f_mpiop_synctime_counter_names[i], prf_rec2->fsynccounters[i],
-                    "", "", "");
-            }
-            else if (prf_rec1->fsynccounters[i] != prf_rec2->fsynccounters[i])
-            {
-                printf("- ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    apmpi_f_mpiop_synctime_counter_names[i], prf_rec1->fsynccounters[i],
-                    "", "", "");
-                printf("+ ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    apmpi_f_mpiop_synctime_counter_names[i], prf_rec2->fsynccounters[i],
-                    "", "", "");
-            }
+/* entries with equal keys prefer the lower rank, so reports are stable */
+static int apmpi_top_less(const struct apmpi_top_entry *a,
+    const struct apmpi_top_entry *b)
+{
+    return(a->key < b->key || (a->key == b->key && a->rank > b->rank));
+}
+
+static void apmpi_top_push(struct darshan_apmpi_top *top, int metric,
+    int bottom, double value, int64_t rank)
+{
+    struct apmpi_top_entry *heap = &top->heaps[(2 * metric + bottom) * top->k];
+    int *count = &top->count[metric][bottom];
+    struct apmpi_top_entry e, tmp;
+    int i, child;
+
+    e.key = bottom ? -value : value;
+    e.rank = rank;
+
+    if (*count < top->k)
+    {
+        /* sift up */
+        i = (*count)++;
+        heap[i] = e;
+        while (i > 0 && apmpi_top_less(&heap[i], &heap[(i - 1) / 2]))
+        {
+            tmp = heap[i];
+            heap[i] = heap[(i - 1) / 2];
+            heap[(i - 1) / 2] = tmp;
+            i = (i - 1) / 2;
         }
+        return;
+    }
+
+    if (!apmpi_top_less(&heap[0], &e))
+        return;
+
+    /* replace the smallest of the k, and sift it down */
+    heap[0] = e;
+    i = 0;
+    while ((child = 2 * i + 1) < *count)
+    {
+        if (child + 1 < *count && apmpi_top_less(&heap[child + 1], &heap[child]))
+            child++;
+        if (!apmpi_top_less(&heap[child], &heap[i]))
+            break;
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+
+    return;
+}
+
+/* highest key first */
+static int apmpi_top_cmp(const void *a, const void *b)
+{
+    if (apmpi_top_less(b, a))
+        return(-1);
+    if (apmpi_top_less(a, b))
+        return(1);
+    return(0);
+}
+
+struct darshan_apmpi_top *darshan_log_apmpi_top_create(int k)
+{
+    struct darshan_apmpi_top *top;
+
+    if (k < 1)
+        return(NULL);
+
+    top = calloc(1, sizeof(*top));
+    if (!top)
+        return(NULL);
+    top->heaps = malloc(sizeof(*top->heaps) * 2 * APMPI_TOP_NUM_METRICS * k);
+    if (!top->heaps)
+    {
+        free(top);
+        return(NULL);
+    }
+    top->k = k;
+
+    return(top);
+}
+
+/* add an APMPI record to the report; the header record only gives the
+ * sync flag, and each perf record is a rank. Ops are ranked only among the
+ * ranks that called them.
+ */
+void darshan_log_apmpi_top_add(struct darshan_apmpi_top *top, void *rec)
+{
+    struct darshan_apmpi_perf_record *prf_rec = rec;
+    struct darshan_apmpi_header_record *hdr_rec = rec;
+    int64_t rank = prf_rec->base_rec.rank;
+    double bytes;
+    int i, b;
+
+    if (hdr_rec->magic == APMPI_MAGIC)
+    {
+        top->sync_flag = hdr_rec->sync_flag;
+        return;
+    }
+
+    bytes = apmpi_rank_bytes(prf_rec);
+
+    for (b = 0; b < 2; b++)
+    {
+        apmpi_top_push(top, APMPI_TOP_COMM_TIME, b,
+            prf_rec->fglobalcounters[MPI_TOTAL_COMM_TIME], rank);
+        if (top->sync_flag)
+            apmpi_top_push(top, APMPI_TOP_SYNC_TIME, b,
+                prf_rec->fglobalcounters[MPI_TOTAL_COMM_SYNC_TIME], rank);
+        apmpi_top_push(top, APMPI_TOP_BYTES, b, bytes, rank);
+        for (i = 0; i < APMPI_NUM_OPS; i++)
+        {
+            if (prf_rec->counters[apmpi_op_call_counts[i]] == 0)
+                continue;
+            apmpi_top_push(top, APMPI_TOP_OP_TIME + i, b,
+                prf_rec->fcounters[3 * i], rank);
         }
-        //for(i = 0; i < APMPI_F_MPI_GLOBAL_NUM_INDICES; i++)
+    }
+
+    apmpi_tdigest_add(&top->mpitime,
+        prf_rec->fglobalcounters[MPI_TOTAL_COMM_TIME]);
+    top->nranks++;
+
+    return;
+}
+
+void darshan_log_apmpi_top_print(struct darshan_apmpi_top *top)
+{
+    static const double quantiles[] = {0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99};
+    struct apmpi_top_entry *heap;
+    const char *name;
+    double value;
+    int metric, b, i;
+
+    printf("\n# APMPI top and bottom %d ranks of %" PRId64 "\n",
+        top->k, top->nranks);
+    printf("# ops are ranked among the ranks that called them\n");
+    printf("#<metric>\t<order>\t<pos>\t<rank>\t<value>\n");
+    for (metric = 0; metric < APMPI_TOP_NUM_METRICS; metric++)
+    {
+        if (metric == APMPI_TOP_COMM_TIME)
+            name = apmpi_f_mpi_global_counter_names[MPI_TOTAL_COMM_TIME];
+        else if (metric == APMPI_TOP_SYNC_TIME)
+            name = apmpi_f_mpi_global_counter_names[MPI_TOTAL_COMM_SYNC_TIME];
+        else if (metric == APMPI_TOP_BYTES)
+            name = "MPI_TOTAL_BYTES";
+        else
+            name = apmpi_f_mpiop_totaltime_counter_names[3 * (metric - APMPI_TOP_OP_TIME)];
+
+        for (b = 0; b < 2; b++)
         {
-            if (!prf_rec2)
+            heap = &top->heaps[(2 * metric + b) * top->k];
+            qsort(heap, top->count[metric][b], sizeof(*heap), apmpi_top_cmp);
+            for (i = 0; i < top->count[metric][b]; i++)
             {
-                printf("- ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    apmpi_f_mpi_global_counter_names[0], prf_rec1->fglobalcounters[0],
-                    "", "", "");
+                value = b ? -heap[i].key : heap[i].key;
+                if (metric == APMPI_TOP_BYTES)
+                    printf("%s\t%s\t%d\t%" PRId64 "\t%.0lf\n", name,
+                        b ? "bottom" : "top", i + 1, heap[i].rank, value);
+                else
+                    printf("%s\t%s\t%d\t%" PRId64 "\t%lf\n", name,
+                        b ? "bottom" : "top", i + 1, heap[i].rank, value);
             }
-            else if (!prf_rec1)
-            {
-                printf("+ ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    apmpi_f_mpi_global_counter_names[0], prf_rec2->fglobalcounters[0],
-                    "", "", "");
-            }
-            else if (prf_rec1->fglobalcounters[0] != prf_rec2->fglobalcounters[0])
-            {
-                printf("- ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    apmpi_f_mpi_global_counter_names[0], prf_rec1->fglobalcounters[0],
-                    "", "", "");
-                printf("+ ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    apmpi_f_mpi_global_counter_names[0], prf_rec2->fglobalcounters[0],
-                    "", "", "");
-            }
-            if(sync_flag)
-            {
-            if (!prf_rec2)
-            {
-                printf("- ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    apmpi_f_mpi_global_counter_names[1], prf_rec1->fglobalcounters[1],
-                    "", "", "");
-            }
-            else if (!prf_rec1)
-            {
-                printf("+ ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    apmpi_f_mpi_global_counter_names[1], prf_rec2->fglobalcounters[1],
-                    "", "", "");
-            }
-            else if (prf_rec1->fglobalcounters[1] != prf_rec2->fglobalcounters[1])
-            {
-                printf("- ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    apmpi_f_mpi_global_counter_names[1], prf_rec1->fglobalcounters[1],
-                    "", "", "");
-                printf("+ ");
-                DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APMPI_MOD],
-                    prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    apmpi_f_mpi_global_counter_names[1], prf_rec2->fglobalcounters[1],
-                    "", "", "");
-            }
-           }
-       }
+        }
+    }
+
+    if (top->nranks == 0)
+        return;
+
+    name = apmpi_f_mpi_global_counter_names[MPI_TOTAL_COMM_TIME];
+    printf("\n# per rank %s, quantiles estimated with a t-digest\n", name);
+    printf("#<metric>\t<quantile>\t<value>\n");
+    printf("%s\tmin\t%lf\n", name, top->mpitime.min);
+    for (i = 0; i < (int)(sizeof(quantiles) / sizeof(quantiles[0])); i++)
+        printf("%s\tp%g\t%lf\n", name, quantiles[i] * 100,
+            apmpi_tdigest_quantile(&top->mpitime, quantiles[i]));
+    printf("%s\tmax\t%lf\n", name, top->mpitime.max);
+    printf("%s\tmean\t%lf\n", name, top->mpitime.sum / top->mpitime.W);
+
+    return;
+}
+
+void darshan_log_apmpi_top_destroy(struct darshan_apmpi_top *top)
+{
+    if (!top)
+        return;
+    free(top->heaps);
+    free(top);
+
+    return;
+}
+
+/* a node of the rollup, hashed by its name */
+struct apmpi_node_entry
+{
+    struct darshan_apmpi_node_stats stats;
+    UT_hash_handle hlink;
+};
+
+struct darshan_apmpi_nodes
+{
+    int sync_flag;
+    int count;
+    struct apmpi_node_entry *hash;
+    /* the stats as last returned by darshan_log_apmpi_nodes_get */
+    struct darshan_apmpi_node_stats *sorted;
+};
+
+struct darshan_apmpi_nodes *darshan_log_apmpi_nodes_create(void)
+{
+    return(calloc(1, sizeof(struct darshan_apmpi_nodes)));
+}
+
+/* add an APMPI record to the rollup; the header record only gives the sync
+ * flag, and each perf record is a rank of the node it names
+ */
+int darshan_log_apmpi_nodes_add(struct darshan_apmpi_nodes *nodes, void *rec)
+{
+    struct darshan_apmpi_perf_record *prf_rec = rec;
+    struct darshan_apmpi_header_record *hdr_rec = rec;
+    struct darshan_apmpi_node_stats *stats;
+    struct apmpi_node_entry *entry;
+    char name[AP_PROCESSOR_NAME_MAX];
+    double mpi_time, sync_time, bytes;
+
+    if (hdr_rec->magic == APMPI_MAGIC)
+    {
+        nodes->sync_flag = hdr_rec->sync_flag;
+        return(0);
     }
 
+    strncpy(name, prf_rec->node_name, AP_PROCESSOR_NAME_MAX);
+    name[AP_PROCESSOR_NAME_MAX-1] = '\0';
+
+    HASH_FIND(hlink, nodes->hash, name, strlen(name), entry);
+    if (!entry)
+    {
+        entry = calloc(1, sizeof(*entry));
+        if (!entry)
+            return(-1);
+        memcpy(entry->stats.node_name, name, sizeof(name));
+        HASH_ADD(hlink, nodes->hash, stats.node_name, strlen(name), entry);
+        nodes->count++;
+    }
+
+    mpi_time = prf_rec->fglobalcounters[MPI_TOTAL_COMM_TIME];
+    sync_time = nodes->sync_flag ?
+        prf_rec->fglobalcounters[MPI_TOTAL_COMM_SYNC_TIME] : 0;
+    bytes = apmpi_rank_bytes(prf_rec);
+
+    stats = &entry->stats;
+    if (stats->nranks == 0 || mpi_time > stats->mpi_time_max)
+        stats->mpi_time_max = mpi_time;
+    if (stats->nranks == 0 || sync_time > stats->sync_time_max)
+        stats->sync_time_max = sync_time;
+    if (stats->nranks == 0 || bytes > stats->bytes_max)
+        stats->bytes_max = bytes;
+    stats->mpi_time_sum += mpi_time;
+    stats->sync_time_sum += sync_time;
+    stats->bytes_sum += bytes;
+    stats->nranks++;
+
+    return(0);
+}
+
+static int apmpi_node_cmp(const void *a, const void *b)
+{
+    const struct darshan_apmpi_node_stats *n1 = a;
+    const struct darshan_apmpi_node_stats *n2 = b;
+
+    return(strcmp(n1->node_name, n2->node_name));
+}
+
+/* the number of nodes, with their stats in *stats, or -1 on error */
+int darshan_log_apmpi_nodes_get(struct darshan_apmpi_nodes *nodes,
+    struct darshan_apmpi_node_stats **stats)
+{
+    struct apmpi_node_entry *entry, *tmp;
+    int i = 0;
+
+    free(nodes->sorted);
+    nodes->sorted = malloc(sizeof(*nodes->sorted) * (nodes->count ? nodes->count : 1));
+    if (!nodes->sorted)
+        return(-1);
+
+    HASH_ITER(hlink, nodes->hash, entry, tmp)
+    {
+        nodes->sorted[i++] = entry->stats;
+    }
+    qsort(nodes->sorted, nodes->count, sizeof(*nodes->sorted), apmpi_node_cmp);
+
+    *stats = nodes->sorted;
+    return(nodes->count);
+}
+
+void darshan_log_apmpi_nodes_print(struct darshan_apmpi_nodes *nodes)
+{
+    struct darshan_apmpi_node_stats *stats;
+    int64_t nranks = 0;
+    int count;
+    int i;
+
+    count = darshan_log_apmpi_nodes_get(nodes, &stats);
+    if (count < 0)
+        return;
+    for (i = 0; i < count; i++)
+        nranks += stats[i].nranks;
+
+    printf("\n# APMPI per node rollup of %" PRId64 " ranks on %d nodes\n",
+        nranks, count);
+    printf("# MPI times and bytes are summed over and maxed across the ranks of each node\n");
+    printf("#<node>\t<ranks>\t<time_sum>\t<time_max>\t");
+    if (nodes->sync_flag)
+        printf("<sync_time_sum>\t<sync_time_max>\t");
+    printf("<bytes_sum>\t<bytes_max>\n");
+    for (i = 0; i < count; i++)
+    {
+        printf("%s\t%" PRId64 "\t%lf\t%lf\t", stats[i].node_name,
+            stats[i].nranks, stats[i].mpi_time_sum, stats[i].mpi_time_max);
+        if (nodes->sync_flag)
+            printf("%lf\t%lf\t", stats[i].sync_time_sum, stats[i].sync_time_max);
+        printf("%.0lf\t%.0lf\n", stats[i].bytes_sum, stats[i].bytes_max);
+    }
 
     return;
 }
+
+void darshan_log_apmpi_nodes_destroy(struct darshan_apmpi_nodes *nodes)
+{
+    struct apmpi_node_entry *entry, *tmp;
+
+    if (!nodes)
+        return;
+    HASH_ITER(hlink, nodes->hash, entry, tmp)
+    {
+        HASH_DELETE(hlink, nodes->hash, entry);
+        free(entry);
+    }
+    free(nodes->sorted);
+    free(nodes);
+
+    return;
+}
+
 /*
  * Local variables:
  *  c-indent-level: 4
@@ -7,11 +7,52 @@
 #ifndef __APMPI_LOG_UTILS_H
 #define __APMPI_LOG_UTILS_H
 
+#include "darshan-apmpi-log-format.h"
+
 extern char *apmpi_counter_names[];
 extern char *apmpi_f_mpiop_totaltime_counter_names[]; 
 extern char *apmpi_f_mpiop_synctime_counter_names[];
 extern char *apmpi_f_mpi_global_counter_names[];
+extern char *apmpi_rma_counter_names[];
+extern char *apmpi_f_rma_counter_names[];
 extern struct darshan_mod_logutil_funcs apmpi_logutils;
 
+/* one pass report of the ranks with the highest and lowest MPI times and
+ * bytes: feed it every APMPI record of a log in turn with
+ * darshan_log_apmpi_top_add, then print it. Its memory depends on k only,
+ * not on the number of ranks.
+ */
+struct darshan_apmpi_top;
+struct darshan_apmpi_top *darshan_log_apmpi_top_create(int k);
+void darshan_log_apmpi_top_add(struct darshan_apmpi_top *top, void *rec);
+void darshan_log_apmpi_top_print(struct darshan_apmpi_top *top);
+void darshan_log_apmpi_top_destroy(struct darshan_apmpi_top *top);
+
+/* per node rollup of the APMPI perf records, grouped by node_name in one
+ * pass: feed it every APMPI record of a log in turn with
+ * darshan_log_apmpi_nodes_add. darshan_log_apmpi_nodes_get gives the
+ * nodes' stats sorted by node name, in an array that stays valid until the
+ * rollup is destroyed; the sync times are 0 unless the log recorded them.
+ */
+struct darshan_apmpi_node_stats
+{
+    char node_name[AP_PROCESSOR_NAME_MAX];
+    int64_t nranks;
+    double mpi_time_sum;
+    double mpi_time_max;
+    double sync_time_sum;
+    double sync_time_max;
+    double bytes_sum;
+    double bytes_max;
+};
+
+struct darshan_apmpi_nodes;
+struct darshan_apmpi_nodes *darshan_log_apmpi_nodes_create(void);
+int darshan_log_apmpi_nodes_add(struct darshan_apmpi_nodes *nodes, void *rec);
+int darshan_log_apmpi_nodes_get(struct darshan_apmpi_nodes *nodes,
+    struct darshan_apmpi_node_stats **stats);
+void darshan_log_apmpi_nodes_print(struct darshan_apmpi_nodes *nodes);
+void darshan_log_apmpi_nodes_destroy(struct darshan_apmpi_nodes *nodes);
+
 #endif
 
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2018 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Report of the slowest and fastest ranks of a Darshan log's APMPI data.
+ *
+ * Makes one pass over the APMPI records and prints, for the total MPI
+ * time, the sync time (if the log recorded it), the bytes and the time of
+ * each MPI op, the k ranks with the highest and the k with the lowest
+ * values, followed by quantiles of the per rank MPI time. Only k ranks
+ * per metric are kept, so jobs of any size are reported in the same
+ * memory, without printing every rank and sorting the output.
+ *
+ * usage: darshan-apmpi-top [-k <k>] [-n] <log>
+ *
+ *   -k  ranks to report at each end of each metric (default 5)
+ *   -n  also roll the ranks up per node: the sum and max of their MPI
+ *       time, sync time and bytes, one line per node
+ */
+
+#include "darshan-util-config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "darshan-logutils.h"
+#include "darshan-apmpi-log-format.h"
+#include "darshan-apmpi-logutils.h"
+
+int main(int argc, char **argv)
+{
+    struct darshan_apmpi_top *top;
+    struct darshan_apmpi_nodes *nodes = NULL;
+    darshan_fd fd;
+    void *buf = NULL;
+    int k = 5;
+    int node_flag = 0;
+    int opt;
+    int ret;
+
+    while((opt = getopt(argc, argv, "k:n")) != -1)
+    {
+        switch(opt)
+        {
+            case 'k':
+                k = atoi(optarg);
+                break;
+            case 'n':
+                node_flag = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-k <k>] [-n] <log>\n", argv[0]);
+                return(1);
+        }
+    }
+    if(argc - optind != 1 || k < 1)
+    {
+        fprintf(stderr, "usage: %s [-k <k>] [-n] <log>\n", argv[0]);
+        return(1);
+    }
+
+    fd = darshan_log_open(argv[optind]);
+    if(!fd)
+        return(1);
+
+    if(fd->mod_map[DARSHAN_APMPI_MOD].len == 0)
+    {
+        fprintf(stderr, "Error: %s has no APMPI records\n", argv[optind]);
+        darshan_log_close(fd);
+        return(1);
+    }
+
+    top = darshan_log_apmpi_top_create(k);
+    if(node_flag)
+        nodes = darshan_log_apmpi_nodes_create();
+    if(!top || (node_flag && !nodes))
+    {
+        fprintf(stderr, "Error: unable to allocate the report\n");
+        darshan_log_apmpi_top_destroy(top);
+        darshan_log_close(fd);
+        return(1);
+    }
+
+    while((ret = apmpi_logutils.log_get_record(fd, &buf)) == 1)
+    {
+        darshan_log_apmpi_top_add(top, buf);
+        if(nodes && darshan_log_apmpi_nodes_add(nodes, buf) < 0)
+        {
+            fprintf(stderr, "Error: unable to allocate the node rollup\n");
+            ret = -1;
+            break;
+        }
+    }
+    free(buf);
+    darshan_log_close(fd);
+
+    if(ret < 0)
+    {
+        fprintf(stderr, "Error: unable to read the APMPI records of %s\n",
+            argv[optind]);
+        darshan_log_apmpi_top_destroy(top);
+        darshan_log_apmpi_nodes_destroy(nodes);
+        return(1);
+    }
+
+    darshan_log_apmpi_top_print(top);
+    if(nodes)
+        darshan_log_apmpi_nodes_print(nodes);
+    darshan_log_apmpi_top_destroy(top);
+    darshan_log_apmpi_nodes_destroy(nodes);
+
+    return(0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ts=8 sts=4 sw=4 expandtab
+ */
@@ -8,7 +8,7 @@
 #define __DARSHAN_APNVGPU_LOG_FORMAT_H
 
 /* current log format version, to support backwards compatibility */
-#define APNVGPU_VER 0.1
+#define APNVGPU_VER 1
 
 #define APNVGPU_COUNTERS \
     /* cpu-gpu transfer size */\
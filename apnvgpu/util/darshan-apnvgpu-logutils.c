@@ -21,18 +21,20 @@
 #include "darshan-apnvgpu-log-format.h"
 
 /* counter name strings for the APNVGPU module */
-#define Y(a) #a,
-#define X(a) Y(APNVGPU_ ## a)
-#define Z(a) #a
+#define X(a) #a,
 char *apnvgpu_counter_names[] = {
-    APNVGPU_COUNTERS,
+    APNVGPU_COUNTERS
+};
+char *apnvgpu_f_counter_names[] = {
     APNVGPU_F_COUNTERS
 };
-#undef Y
-#undef X
-#define X(a) #a,
 #undef X
-#undef Z
+
+static int darshan_log_get_apnvgpu_record(darshan_fd fd, void** apnvgpu_buf_p);
+static void darshan_log_print_apnvgpu_record(void *file_rec,
+    char *file_name, char *mnt_pt, char *fs_type);
+static void darshan_log_print_apnvgpu_description(int ver);
+static void darshan_log_agg_apnvgpu_records(void *rec, void *agg_rec, int init_flag);
 
 struct darshan_mod_logutil_funcs apnvgpu_logutils =
 {
@@ -41,7 +43,7 @@ struct darshan_mod_logutil_funcs apnvgpu_logutils =
     .log_print_record = darshan_log_print_apnvgpu_record,
     .log_print_description = darshan_log_print_apnvgpu_description,
     .log_print_diff = NULL,
-    .log_agg_records = NULL
+    .log_agg_records = darshan_log_agg_apnvgpu_records
 };
 
 /* retrieve a APNVGPU record from log file descriptor 'fd', storing the
@@ -58,14 +60,14 @@ static int darshan_log_get_apnvgpu_record(darshan_fd fd, void** apnvgpu_buf_p)
         return(0);
 
     if(fd->mod_ver[DARSHAN_APNVGPU_MOD] == 0 ||
-        fd->mod_ver[DARSHAN_APNVGPU_MOD] > DARSHAN_APNVGPU_VER)
+        fd->mod_ver[DARSHAN_APNVGPU_MOD] > APNVGPU_VER)
     {
         fprintf(stderr, "Error: Invalid APNVGPU module version number (got %d)\n",
             fd->mod_ver[DARSHAN_APNVGPU_MOD]);
         return(-1);
     }
 
-    if(*apnvgpu_buf_p == APNVGPU)
+    if(*apnvgpu_buf_p == NULL)
     {
         rec = malloc(sizeof(*rec));
         if(!rec)
@@ -76,7 +78,7 @@ static int darshan_log_get_apnvgpu_record(darshan_fd fd, void** apnvgpu_buf_p)
     ret = darshan_log_get_mod(fd, DARSHAN_APNVGPU_MOD, rec,
         sizeof(struct darshan_apnvgpu_record));
 
-    if(*apnvgpu_buf_p == APNVGPU)
+    if(*apnvgpu_buf_p == NULL)
     {
         if(ret == sizeof(struct darshan_apnvgpu_record))
             *apnvgpu_buf_p = rec;
@@ -146,6 +148,35 @@ static void darshan_log_print_apnvgpu_description(int ver)
 
     return;
 }
+
+/* fold the APNVGPU record 'rec' into the aggregate record 'agg_rec', which
+ * is reset first if 'init_flag' is set; transfer sizes and times are summed
+ */
+static void darshan_log_agg_apnvgpu_records(void *rec, void *agg_rec, int init_flag)
+{
+    struct darshan_apnvgpu_record *apnvgpu_rec =
+        (struct darshan_apnvgpu_record *)rec;
+    struct darshan_apnvgpu_record *agg_apnvgpu_rec =
+        (struct darshan_apnvgpu_record *)agg_rec;
+    int i;
+
+    if(init_flag)
+    {
+        memset(agg_apnvgpu_rec, 0, sizeof(*agg_apnvgpu_rec));
+        agg_apnvgpu_rec->base_rec.id = apnvgpu_rec->base_rec.id;
+        agg_apnvgpu_rec->base_rec.rank = -1;
+    }
+
+    for(i=0; i<APNVGPU_NUM_INDICES; i++)
+        agg_apnvgpu_rec->counters[i] += apnvgpu_rec->counters[i];
+
+    for(i=0; i<APNVGPU_F_NUM_INDICES; i++)
+        agg_apnvgpu_rec->fcounters[i] += apnvgpu_rec->fcounters[i];
+
+    return;
+}
+
+
 /*
  * Local variables:
  *  c-indent-level: 4
@@ -8,6 +8,7 @@
 #define __APNVGPU_LOG_UTILS_H
 
 extern char *apnvgpu_counter_names[];
+extern char *apnvgpu_f_counter_names[];
 
 extern struct darshan_mod_logutil_funcs apnvgpu_logutils;
 
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef __APPERF_LOG_FORMAT_H
+#define __APPERF_LOG_FORMAT_H
+
+/* current AutoPerf perf_event log format version */
+#define APPERF_VER 1
+
+/* limits of the perf_event event list, which is loaded at runtime and
+ * recorded by name in the header record; a perf record flags the events
+ * it counted in a 64 bit mask
+ */
+#define APPERF_MAX_EVENTS 64
+#define APPERF_EVENT_NAME_MAX 64
+
+/* bytes taken by a table of event names of size bytes, padded so that the
+ * record following it stays 8 byte aligned
+ */
+#define APPERF_EVENT_NAMES_SIZE(size) (((size) + 7) & ~(uint64_t)7)
+
+#define APPERF_MAGIC ('A'*0x100000000000000+\
+                            'P'*0x1000000000000+\
+                            'P'*0x10000000000+\
+                            'E'*0x100000000+\
+                            'R'*0x1000000+\
+                            'F'*0x10000+\
+                            'H'*0x100+\
+                            'D'*0x1)
+
+/* default event list, used unless DARSHAN_APPERF_EVENTS or
+ * DARSHAN_APPERF_EVENTS_FILE name another one. Software events count in
+ * any container, the hardware ones are left out where the PMU is hidden.
+ */
+#define APPERF_PERF_COUNTERS \
+    /* software events */\
+    X(TASK_CLOCK) \
+    X(CONTEXT_SWITCHES) \
+    X(CPU_MIGRATIONS) \
+    X(PAGE_FAULTS) \
+    /* hardware events */\
+    X(CPU_CYCLES) \
+    X(INSTRUCTIONS) \
+    X(CACHE_REFERENCES) \
+    X(CACHE_MISSES) \
+    /* end of counters */\
+    Z(APPERF_NUM_INDICES)
+
+/* scopes of the counters of a perf record */
+#define APPERF_SCOPES \
+    X(SCOPE_RANK) \
+    X(SCOPE_NODE) \
+    Z(SCOPE_NUM_INDICES)
+
+#define X(a) a,
+#define Z(a) a
+/* integer counters for the "APPERF" module */
+enum darshan_apperf_perf_indices
+{
+    APPERF_PERF_COUNTERS
+};
+
+enum apperf_scopes
+{
+    APPERF_SCOPES
+};
+#undef Z
+#undef X
+
+/* the darshan_apperf_perf_record is written by every rank in rank scope,
+ * counting the events of the thread that initialized Darshan, or by the
+ * lowest rank of each node in node scope, counting the events of every CPU
+ * of the node. Every event of the header record has its slot, but only
+ * those with their bit set in counted could be opened; the others are 0.
+ * Events that were multiplexed are scaled up to the time they were
+ * enabled, and time_enabled and time_running are those of the group of
+ * events that ran for the smallest share of its time.
+ */
+struct darshan_apperf_perf_record
+{
+    struct darshan_base_record base_rec;
+    int64_t node;
+    int64_t ranks;
+    uint64_t counted;
+    uint64_t time_enabled;
+    uint64_t time_running;
+    /* one counter per event, in the order of the header record's names */
+    uint64_t counters[APPERF_MAX_EVENTS];
+};
+
+/* the header record is followed by event_names_size bytes holding the
+ * names of its event_count events, each NUL terminated, padded with NULs
+ */
+struct darshan_apperf_header_record
+{
+    struct darshan_base_record base_rec;
+    int64_t magic;
+    int64_t scope;
+    int64_t nnodes;
+    uint64_t event_count;
+    uint64_t event_names_size;
+};
+
+#endif /* __APPERF_LOG_FORMAT_H */
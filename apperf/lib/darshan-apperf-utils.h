@@ -0,0 +1,201 @@
+#ifndef __APPERF_UTILS_H__
+#define __APPERF_UTILS_H__
+
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/* locations of the PMU and CPU descriptions, overridable at build time so
+ * the module can be run against a fake tree off the machine
+ */
+#ifndef APPERF_PMU_PATH
+#define APPERF_PMU_PATH "/sys/bus/event_source/devices"
+#endif
+#ifndef APPERF_CPU_PATH
+#define APPERF_CPU_PATH "/sys/devices/system/cpu/online"
+#endif
+
+/* most CPUs of a node counted in node scope */
+#define PERF_MAX_CPUS 1024
+
+/*
+ * Events known by name, counted by the generic hardware and software PMUs;
+ * any other event is named pmu:config, as in uncore_imc_0:0x304
+ */
+struct perf_event_def
+{
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+};
+
+static const struct perf_event_def perf_generic_events[] =
+{
+    {"TASK_CLOCK", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"CPU_CLOCK", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK},
+    {"CONTEXT_SWITCHES", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"CPU_MIGRATIONS", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+    {"PAGE_FAULTS", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {"MINOR_FAULTS", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN},
+    {"MAJOR_FAULTS", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ},
+    {"CPU_CYCLES", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"INSTRUCTIONS", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"CACHE_REFERENCES", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+    {"CACHE_MISSES", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"BRANCH_INSTRUCTIONS", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+    {"BRANCH_MISSES", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"BUS_CYCLES", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BUS_CYCLES},
+    {"STALLED_CYCLES_FRONTEND", PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND},
+    {"STALLED_CYCLES_BACKEND", PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND},
+    {"REF_CPU_CYCLES", PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES},
+    {NULL, 0, 0}
+};
+
+static int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu,
+                           int group_fd, unsigned long flags)
+{
+    return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+/*
+ * Read a small sysfs file into buf as a string
+ */
+static int perf_read_file(const char *path, char *buf, size_t size)
+{
+    ssize_t len;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    len = read(fd, buf, size - 1);
+    close(fd);
+    if (len <= 0)
+    {
+        return -1;
+    }
+    buf[len] = '\0';
+
+    return 0;
+}
+
+/*
+ * Parse a CPU list such as 0-3,8,10-11, returning the number of CPUs
+ */
+static int perf_parse_cpus(const char *buf, int *cpus, int max)
+{
+    const char *p = buf;
+    char *end;
+    long first, last;
+    int count = 0;
+
+    while (*p && count < max)
+    {
+        first = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1)
+                break;
+            p = end;
+        }
+        for (; first <= last && count < max; first++)
+            cpus[count++] = first;
+        if (*p != ',')
+            break;
+        p++;
+    }
+
+    return count;
+}
+
+/*
+ * Type of the PMU named pmu, as the kernel numbers it, or -1
+ */
+static int perf_pmu_type(const char *pmu, uint32_t *type)
+{
+    char path[PATH_MAX];
+    char buf[32];
+
+    snprintf(path, sizeof(path), "%s/%s/type", APPERF_PMU_PATH, pmu);
+    if (perf_read_file(path, buf, sizeof(buf)) < 0)
+    {
+        return -1;
+    }
+    *type = strtoul(buf, NULL, 10);
+
+    return 0;
+}
+
+/*
+ * CPUs a PMU counts on: those in its cpumask, one per socket for uncore
+ * PMUs, or else every online CPU
+ */
+static int perf_pmu_cpus(const char *pmu, int *cpus, int max)
+{
+    char path[PATH_MAX];
+    char buf[4096];
+
+    if (pmu)
+    {
+        snprintf(path, sizeof(path), "%s/%s/cpumask", APPERF_PMU_PATH, pmu);
+        if (perf_read_file(path, buf, sizeof(buf)) == 0)
+            return perf_parse_cpus(buf, cpus, max);
+    }
+    if (perf_read_file(APPERF_CPU_PATH, buf, sizeof(buf)) < 0)
+    {
+        return 0;
+    }
+
+    return perf_parse_cpus(buf, cpus, max);
+}
+
+/*
+ * Look up an event by name, returning -1 if it is neither a generic event
+ * nor a pmu:config one. pmu is left empty for generic events, which are
+ * given their type; the type of a pmu:config event is read from its PMU
+ * when it is opened.
+ */
+static int perf_lookup_event(const char *name, char *pmu, size_t pmu_size,
+                             uint32_t *type, uint64_t *config)
+{
+    const char *sep;
+    char *end;
+    int i;
+
+    for (i = 0; perf_generic_events[i].name; i++)
+    {
+        if (strcmp(perf_generic_events[i].name, name) == 0)
+        {
+            pmu[0] = '\0';
+            *type = perf_generic_events[i].type;
+            *config = perf_generic_events[i].config;
+            return 0;
+        }
+    }
+
+    sep = strchr(name, ':');
+    if (sep == NULL || sep == name || sep - name >= pmu_size)
+    {
+        return -1;
+    }
+    *config = strtoull(sep + 1, &end, 0);
+    if (end == sep + 1 || *end != '\0')
+    {
+        return -1;
+    }
+    memcpy(pmu, name, sep - name);
+    pmu[sep - name] = '\0';
+
+    return 0;
+}
+
+#endif /* __APPERF_UTILS_H__ */
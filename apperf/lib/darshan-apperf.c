@@ -0,0 +1,680 @@
+/*
+ * Copyright (C) 2017 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#define _XOPEN_SOURCE 500
+#define _GNU_SOURCE
+
+#include "darshan-runtime-config.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "uthash.h"
+#include "darshan.h"
+#include "darshan-dynamic.h"
+#include "darshan-apperf-log-format.h"
+
+#include "darshan-apperf-utils.h"
+
+/*
+ * perf_events is the default event list, the counters listed in the log
+ * header.
+ */
+#define X(a) #a,
+#define Z(a) #a
+static char* perf_events[] =
+{
+    APPERF_PERF_COUNTERS
+};
+#undef X
+#undef Z
+
+/* size of the first allocation of event groups */
+#define GROUPS_INIT 16
+
+/*
+ * <Description>
+ *
+ * This module does not intercept any system calls. It opens perf_event
+ * counters at initialization and reads them at shutdown.
+ */
+
+/*
+ * An event of the list, as given to perf_event_open; pmu names the PMU of
+ * a pmu:config event, whose type is looked up when it is opened
+ */
+struct apperf_event
+{
+    char pmu[APPERF_EVENT_NAME_MAX];
+    uint32_t type;
+    uint64_t config;
+};
+
+/*
+ * Events of one PMU on one CPU (or of the calling thread in rank scope),
+ * opened as a group so that a single read() returns all of their counts.
+ * fds[0] is the group leader.
+ */
+struct apperf_group
+{
+    uint32_t type;
+    int cpu;
+    int count;
+    int fds[APPERF_MAX_EVENTS];
+    int events[APPERF_MAX_EVENTS];
+};
+
+/*
+ * Global runtime struct for tracking data needed at runtime
+ */
+struct apperf_runtime
+{
+    struct darshan_apperf_header_record *header_record;
+    struct darshan_apperf_perf_record *perf_record;
+    darshan_record_id header_id;
+    darshan_record_id perf_id;
+    int scope;
+    int event_count;
+    char event_names[APPERF_MAX_EVENTS * APPERF_EVENT_NAME_MAX]; /* NUL terminated */
+    size_t event_names_size;
+    struct apperf_event events[APPERF_MAX_EVENTS];
+    struct apperf_group *groups;
+    int group_count;
+    int group_max;
+    /* nr, time_enabled, time_running, then one value per group member */
+    uint64_t read_buf[3 + APPERF_MAX_EVENTS];
+    int node;
+    int node_ranks;
+    int node_leader;
+    int perf_record_marked;
+};
+
+static struct apperf_runtime *apperf_runtime = NULL;
+static pthread_mutex_t apperf_runtime_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+/* my_rank indicates the MPI rank of this process */
+static int my_rank = -1;
+
+/* internal helper functions for the APPERF module */
+void apperf_runtime_initialize(void);
+
+/* forward declaration for shutdown function needed to interface with darshan-core */
+static void apperf_mpi_redux(
+    void *buffer,
+    MPI_Comm mod_comm,
+    darshan_record_id *shared_recs,
+    int shared_rec_count);
+static void apperf_output(
+        void **buffer,
+        int *size);
+static void apperf_cleanup(
+        void);
+
+/* macros for obtaining/releasing the APPERF module lock */
+#define APPERF_LOCK() pthread_mutex_lock(&apperf_runtime_mutex)
+#define APPERF_UNLOCK() pthread_mutex_unlock(&apperf_runtime_mutex)
+
+/*
+ * Read an event list file, one or more names per line with '#' starting
+ * a comment, into a string of names separated by white space.
+ */
+static char *read_event_file(const char *path)
+{
+    FILE *f;
+    char *buf;
+    long len;
+    long i;
+    int comment = 0;
+
+    f = fopen(path, "r");
+    if (f == NULL)
+    {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = malloc(len + 1);
+    if (buf)
+    {
+        len = fread(buf, sizeof(char), len, f);
+        buf[len] = '\0';
+        for (i = 0; i < len; i++)
+        {
+            if (buf[i] == '#')
+                comment = 1;
+            else if (buf[i] == '\n')
+                comment = 0;
+            if (comment)
+                buf[i] = ' ';
+        }
+    }
+    fclose(f);
+
+    return buf;
+}
+
+/*
+ * Add an event to the list, recording its name if it is a generic or
+ * pmu:config event. Whether it can be opened is left to open_event(), so
+ * every rank gives an event the same slot.
+ */
+static void add_event(const char *name)
+{
+    int i = apperf_runtime->event_count;
+    struct apperf_event *ev = &apperf_runtime->events[i];
+    size_t len = strlen(name);
+
+    if (i == APPERF_MAX_EVENTS || len >= APPERF_EVENT_NAME_MAX)
+        return;
+    if (perf_lookup_event(name, ev->pmu, sizeof(ev->pmu), &ev->type, &ev->config) < 0)
+        return;
+
+    memcpy(apperf_runtime->event_names + apperf_runtime->event_names_size,
+           name, len + 1);
+    apperf_runtime->event_names_size += len + 1;
+    apperf_runtime->event_count++;
+
+    return;
+}
+
+/*
+ * Open an event in the last group of its PMU and CPU, or as the leader of
+ * a new group when there is none or the PMU cannot fit it in that one
+ */
+static int add_group_event(struct perf_event_attr *attr, int event, pid_t pid, int cpu)
+{
+    struct apperf_group *g = NULL;
+    struct apperf_group *tmp;
+    int fd;
+    int i;
+
+    for (i = apperf_runtime->group_count - 1; i >= 0; i--)
+    {
+        if (apperf_runtime->groups[i].type == attr->type &&
+            apperf_runtime->groups[i].cpu == cpu)
+        {
+            g = &apperf_runtime->groups[i];
+            break;
+        }
+    }
+
+    if (g && g->count < APPERF_MAX_EVENTS)
+    {
+        attr->disabled = 0;
+        fd = perf_event_open(attr, pid, cpu, g->fds[0], PERF_FLAG_FD_CLOEXEC);
+        if (fd >= 0)
+        {
+            g->fds[g->count] = fd;
+            g->events[g->count++] = event;
+            return 0;
+        }
+    }
+
+    /* the leader holds the group disabled until every event is added */
+    attr->disabled = 1;
+    fd = perf_event_open(attr, pid, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (apperf_runtime->group_count == apperf_runtime->group_max)
+    {
+        i = apperf_runtime->group_max ? apperf_runtime->group_max * 2 : GROUPS_INIT;
+        tmp = realloc(apperf_runtime->groups, i * sizeof(*tmp));
+        if (!tmp)
+        {
+            close(fd);
+            return -1;
+        }
+        apperf_runtime->groups = tmp;
+        apperf_runtime->group_max = i;
+    }
+    g = &apperf_runtime->groups[apperf_runtime->group_count++];
+    g->type = attr->type;
+    g->cpu = cpu;
+    g->count = 1;
+    g->fds[0] = fd;
+    g->events[0] = event;
+
+    return 0;
+}
+
+/*
+ * Open the ith event of the list for the calling thread in rank scope, or
+ * on every CPU of its PMU in node scope
+ */
+static void open_event(int i)
+{
+    struct apperf_event *ev = &apperf_runtime->events[i];
+    struct perf_event_attr attr;
+    int cpus[PERF_MAX_CPUS];
+    int ncpus = 1;
+    int c;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = ev->type;
+    attr.config = ev->config;
+    attr.read_format = PERF_FORMAT_GROUP |
+                       PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    if (ev->pmu[0] && perf_pmu_type(ev->pmu, &attr.type) < 0)
+        return;
+
+    if (apperf_runtime->scope == SCOPE_NODE)
+    {
+        ncpus = perf_pmu_cpus(ev->pmu[0] ? ev->pmu : NULL, cpus, PERF_MAX_CPUS);
+    }
+    else
+    {
+        /* user space only, as allowed without privileges */
+        if (!ev->pmu[0])
+        {
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+        }
+        cpus[0] = -1;
+    }
+
+    for (c = 0; c < ncpus; c++)
+    {
+        add_group_event(&attr, i,
+                        (apperf_runtime->scope == SCOPE_NODE) ? -1 : 0,
+                        cpus[c]);
+    }
+
+    return;
+}
+
+/*
+ * Load the event list named by DARSHAN_APPERF_EVENTS (comma separated) or
+ * DARSHAN_APPERF_EVENTS_FILE, or the default one
+ */
+static void load_events (void)
+{
+    char *env, *list = NULL, *tok, *saveptr = NULL;
+    int i;
+
+    apperf_runtime->event_count = 0;
+    apperf_runtime->event_names_size = 0;
+
+    if ((env = getenv("DARSHAN_APPERF_EVENTS")) != NULL)
+        list = strdup(env);
+    else if ((env = getenv("DARSHAN_APPERF_EVENTS_FILE")) != NULL)
+        list = read_event_file(env);
+
+    if (list)
+    {
+        for (tok = strtok_r(list, ", \t\r\n", &saveptr);
+             tok;
+             tok = strtok_r(NULL, ", \t\r\n", &saveptr))
+        {
+            add_event(tok);
+        }
+        free(list);
+    }
+    else
+    {
+        for (i = TASK_CLOCK; i < APPERF_NUM_INDICES; i++)
+        {
+            add_event(perf_events[i]);
+        }
+    }
+
+    return;
+}
+
+/*
+ * Initialize counters using perf_event, opening each event of the list
+ */
+static void initialize_counters (void)
+{
+    int i;
+
+    for (i = 0; i < apperf_runtime->event_count; i++)
+        open_event(i);
+
+    for (i = 0; i < apperf_runtime->group_count; i++)
+    {
+        ioctl(apperf_runtime->groups[i].fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(apperf_runtime->groups[i].fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    return;
+}
+
+static void finalize_counters (void)
+{
+    int i, j;
+
+    for (i = 0; i < apperf_runtime->group_count; i++)
+    {
+        for (j = apperf_runtime->groups[i].count - 1; j >= 0; j--)
+            close(apperf_runtime->groups[i].fds[j]);
+    }
+    free(apperf_runtime->groups);
+    apperf_runtime->groups = NULL;
+    apperf_runtime->group_count = 0;
+    apperf_runtime->group_max = 0;
+
+    return;
+}
+
+/*
+ * Function which updates all the counter data, with one read per group
+ */
+static void capture(struct darshan_apperf_perf_record *rec,
+                    darshan_record_id rec_id)
+{
+    struct apperf_group *g;
+    uint64_t *buf = apperf_runtime->read_buf;
+    uint64_t enabled, running, val;
+    double share = 2.0;
+    ssize_t size;
+    int i, j;
+
+    memset(rec->counters, 0, sizeof(rec->counters));
+    rec->counted = 0;
+    rec->time_enabled = 0;
+    rec->time_running = 0;
+
+    for (i = 0; i < apperf_runtime->group_count; i++)
+    {
+        g = &apperf_runtime->groups[i];
+        size = (3 + g->count) * sizeof(uint64_t);
+        if (read(g->fds[0], buf, size) != size || buf[0] != g->count)
+            continue;
+
+        enabled = buf[1];
+        running = buf[2];
+        for (j = 0; j < g->count; j++)
+        {
+            /* scale up the counts of a multiplexed group */
+            val = buf[3 + j];
+            if (running < enabled)
+                val = running ? (uint64_t)((double)val * enabled / running) : 0;
+            rec->counters[g->events[j]] += val;
+            rec->counted |= (uint64_t)1 << g->events[j];
+        }
+
+        if (enabled && (double)running / enabled < share)
+        {
+            share = (double)running / enabled;
+            rec->time_enabled = enabled;
+            rec->time_running = running;
+        }
+    }
+
+    rec->node = apperf_runtime->node;
+    rec->ranks = (apperf_runtime->scope == SCOPE_NODE) ? apperf_runtime->node_ranks : 1;
+    rec->base_rec.id = rec_id;
+    rec->base_rec.rank = my_rank;
+
+    return;
+}
+
+/*
+ * Copy the names of the listed events after rank 0's header record
+ */
+static void record_event_names(void)
+{
+    struct darshan_apperf_header_record *hdr = apperf_runtime->header_record;
+    char *names = (char *)(hdr + 1);
+    size_t size = apperf_runtime->event_names_size;
+
+    hdr->event_count = apperf_runtime->event_count;
+    hdr->event_names_size = APPERF_EVENT_NAMES_SIZE(size);
+    if (size)
+        memcpy(names, apperf_runtime->event_names, size);
+    memset(names + size, 0, hdr->event_names_size - size);
+
+    return;
+}
+
+/*
+ * Elect the lowest rank on each node as its leader, and number the nodes
+ * in the order of their leaders. Collective over MPI_COMM_WORLD.
+ */
+static void elect_node_leader(int rank, int *node_leader, int *node_ranks,
+    int *node)
+{
+    MPI_Comm node_comm;
+    int node_rank;
+
+    *node = 0;
+    PMPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                         MPI_INFO_NULL, &node_comm);
+    PMPI_Comm_rank(node_comm, &node_rank);
+    PMPI_Comm_size(node_comm, node_ranks);
+    *node_leader = (node_rank == 0);
+
+    PMPI_Exscan(node_leader, node, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0)
+        *node = 0;
+    PMPI_Bcast(node, 1, MPI_INT, 0, node_comm);
+    PMPI_Comm_free(&node_comm);
+
+    return;
+}
+
+void apperf_runtime_initialize()
+{
+    size_t apperf_buf_size;
+    size_t apperf_rec_count = 1;
+    char *env;
+    int rank;
+    int node_leader, node_ranks, node;
+    int ret;
+
+    darshan_module_funcs mod_funcs = {
+        .mod_redux_func = &apperf_mpi_redux,
+        .mod_output_func = &apperf_output,
+        .mod_cleanup_func = &apperf_cleanup
+        };
+
+    APPERF_LOCK();
+
+    /* don't do anything if already initialized */
+    if(apperf_runtime)
+    {
+        APPERF_UNLOCK();
+        return;
+    }
+
+    /* the election is collective, so every rank takes part before any of
+     * them can give up on the module below
+     */
+    PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    elect_node_leader(rank, &node_leader, &node_ranks, &node);
+
+    /* initialize module's global state, which holds the event list that
+     * sizes the header record of rank 0
+     */
+    apperf_runtime = malloc(sizeof(*apperf_runtime));
+    if(!apperf_runtime)
+    {
+        APPERF_UNLOCK();
+        return;
+    }
+    memset(apperf_runtime, 0, sizeof(*apperf_runtime));
+
+    /* count per rank, or per node with DARSHAN_APPERF_SCOPE=node */
+    if ((env = getenv("DARSHAN_APPERF_SCOPE")) != NULL && strcmp(env, "node") == 0)
+        apperf_runtime->scope = SCOPE_NODE;
+    else
+        apperf_runtime->scope = SCOPE_RANK;
+
+    load_events();
+
+    apperf_buf_size = sizeof(struct darshan_apperf_header_record) +
+                      sizeof(struct darshan_apperf_perf_record);
+    if (rank == 0)
+        apperf_buf_size += APPERF_EVENT_NAMES_SIZE(apperf_runtime->event_names_size);
+
+    /* register the APPERF module with the darshan-core component */
+    ret = darshan_core_register_module(
+        DARSHAN_APPERF_MOD,
+        mod_funcs,
+        apperf_buf_size,
+        &apperf_rec_count,
+        &my_rank,
+        NULL);
+    if(ret < 0)
+    {
+        free(apperf_runtime);
+        apperf_runtime = NULL;
+        APPERF_UNLOCK();
+        return;
+    }
+
+    if (my_rank == 0)
+    {
+        apperf_runtime->header_id = darshan_core_gen_record_id("darshan-apperf-header");
+
+        /* register the apperf header record with darshan-core */
+        apperf_runtime->header_record = darshan_core_register_record(
+            apperf_runtime->header_id,
+            "darshan-apperf-header",
+            DARSHAN_APPERF_MOD,
+            sizeof(struct darshan_apperf_header_record) +
+            APPERF_EVENT_NAMES_SIZE(apperf_runtime->event_names_size),
+            NULL);
+        if(!(apperf_runtime->header_record))
+        {
+            darshan_core_unregister_module(DARSHAN_APPERF_MOD);
+            free(apperf_runtime);
+            apperf_runtime = NULL;
+            APPERF_UNLOCK();
+            return;
+        }
+        apperf_runtime->header_record->base_rec.id = apperf_runtime->header_id;
+        apperf_runtime->header_record->base_rec.rank = my_rank;
+        apperf_runtime->header_record->magic = APPERF_MAGIC;
+        apperf_runtime->header_record->scope = apperf_runtime->scope;
+    }
+
+    apperf_runtime->node_leader = node_leader;
+    apperf_runtime->node_ranks = node_ranks;
+    apperf_runtime->node = node;
+
+    /* in node scope only node leaders read counters and write a perf record */
+    if (apperf_runtime->scope == SCOPE_RANK || apperf_runtime->node_leader)
+    {
+        apperf_runtime->perf_id = darshan_core_gen_record_id("APPERF");
+        apperf_runtime->perf_record = darshan_core_register_record(
+            apperf_runtime->perf_id,
+            "APPERF",   // shared by every rank, as for APXC
+            DARSHAN_APPERF_MOD,
+            sizeof(struct darshan_apperf_perf_record),
+            NULL);
+        if(!(apperf_runtime->perf_record))
+        {
+            darshan_core_unregister_module(DARSHAN_APPERF_MOD);
+            free(apperf_runtime);
+            apperf_runtime = NULL;
+            APPERF_UNLOCK();
+            return;
+        }
+
+        initialize_counters();
+    }
+
+    if (my_rank == 0)
+        record_event_names();
+    APPERF_UNLOCK();
+
+    return;
+}
+
+/********************************************************************************
+ * shutdown function exported by this module for coordinating with darshan-core *
+ ********************************************************************************/
+
+/* Pass data for the apperf module back to darshan-core to log to file. */
+static void apperf_mpi_redux(
+    void *apperf_buf,
+    MPI_Comm mod_comm,
+    darshan_record_id *shared_recs,
+    int shared_rec_count)
+{
+    int nnodes = 0;
+
+    APPERF_LOCK();
+    if (!apperf_runtime)
+    {
+        APPERF_UNLOCK();
+        return;
+    }
+
+    /* collect perf counters */
+    if (apperf_runtime->perf_record)
+        capture(apperf_runtime->perf_record, apperf_runtime->perf_id);
+
+    /* count the nodes of the job */
+    PMPI_Reduce(&apperf_runtime->node_leader, &nnodes, 1, MPI_INT, MPI_SUM,
+                0, MPI_COMM_WORLD);
+    if (my_rank == 0)
+    {
+        apperf_runtime->header_record->nnodes = nnodes;
+    }
+
+    if (apperf_runtime->perf_record)
+    {
+        apperf_runtime->perf_record_marked = -1;
+    }
+
+    APPERF_UNLOCK();
+
+    return;
+}
+
+static void apperf_output(
+    void **apperf_buf,
+    int *apperf_buf_sz)
+{
+    APPERF_LOCK();
+    assert(apperf_runtime);
+    *apperf_buf_sz = 0;
+
+    if (my_rank == 0) {
+        *apperf_buf_sz += sizeof(*apperf_runtime->header_record) +
+                          apperf_runtime->header_record->event_names_size;
+    }
+
+    if (apperf_runtime->perf_record_marked == -1)
+    {
+        *apperf_buf_sz += sizeof(*apperf_runtime->perf_record);
+    }
+
+    APPERF_UNLOCK();
+    return;
+}
+
+static void apperf_cleanup()
+{
+    APPERF_LOCK();
+    assert(apperf_runtime);
+    finalize_counters();
+    free(apperf_runtime);
+    apperf_runtime = NULL;
+    APPERF_UNLOCK();
+    return;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ts=8 sts=4 sw=4 expandtab
+ */
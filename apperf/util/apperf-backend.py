@@ -0,0 +1,93 @@
+import cffi
+import ctypes
+
+import numpy as np
+import darshan.backend.cffi_backend
+
+# APPERF structure defs
+structdefs = '''
+struct darshan_apperf_perf_record
+{
+    struct darshan_base_record base_rec;
+    int64_t node;
+    int64_t ranks;
+    uint64_t counted;
+    uint64_t time_enabled;
+    uint64_t time_running;
+    uint64_t counters[64];
+};
+struct darshan_apperf_header_record
+{
+    struct darshan_base_record base_rec;
+    int64_t magic;
+    int64_t scope;
+    int64_t nnodes;
+    uint64_t event_count;
+    uint64_t event_names_size;
+};
+
+extern char *apperf_counter_names[];
+
+'''
+
+def get_apperf_defs():
+  return structdefs
+
+
+# the names of the events follow the header record, each NUL terminated
+def _get_apperf_event_names(ffi, hdr):
+    names = bytes(ffi.buffer(ffi.cast('char *', hdr) +
+        ffi.sizeof('struct darshan_apperf_header_record'), hdr.event_names_size))
+    return [name.decode('utf-8') for name in names.split(b'\0')[:hdr.event_count]]
+
+
+# load header record
+def log_get_apperf_record(log, mod_name, structname, dtype='dict'):
+    from darshan.backend.cffi_backend import ffi, libdutil, log_get_modules, counter_names, _structdefs
+
+    modules = log_get_modules(log)
+
+    rec = {}
+    buf = ffi.new("void **")
+    r = libdutil.darshan_log_get_record(log['handle'], modules[mod_name]['idx'], buf)
+    mod_type = _structdefs[mod_name+"-"+structname]
+
+    if r < 1:
+        return None
+
+    event_names = log.get('apperf_event_names', [])
+
+    scopes = ['rank', 'node']
+
+    if mod_type == 'struct darshan_apperf_header_record **':
+      hdr = ffi.cast(mod_type, buf)
+      rec['id'] = hdr[0].base_rec.id
+      rec['rank'] = hdr[0].base_rec.rank
+      rec['scope'] = scopes[hdr[0].scope] if 0 <= hdr[0].scope < len(scopes) else 'unknown'
+      rec['nnodes'] = hdr[0].nnodes
+      rec['event_names'] = _get_apperf_event_names(ffi, hdr[0])
+      # kept with the log, for the records that follow its header
+      log['apperf_event_names'] = rec['event_names']
+    else:
+      prf = ffi.cast(mod_type, buf)
+      rec['id'] = prf[0].base_rec.id
+      rec['rank'] = prf[0].base_rec.rank
+      rec['node'] = prf[0].node
+      rec['ranks'] = prf[0].ranks
+      rec['time_enabled'] = prf[0].time_enabled
+      rec['time_running'] = prf[0].time_running
+
+      # events that could not be opened are left out
+      names = []
+      lst = []
+      for i in range(0, len(event_names)):
+        if prf[0].counted & (1 << i):
+          names.append('APPERF_' + event_names[i])
+          lst.append(prf[0].counters[i])
+      np_counters = np.array(lst, dtype=np.uint64)
+      d_counters = dict(zip(names, np_counters))
+
+      rec['counters'] = {}
+      rec['counters'].update(d_counters)
+
+    return rec
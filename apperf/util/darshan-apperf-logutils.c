@@ -0,0 +1,514 @@
+/*
+ * Copyright (C) 2018 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#define _GNU_SOURCE
+#include "darshan-util-config.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "darshan-logutils.h"
+#include "darshan-apperf-log-format.h"
+
+/* counter name strings for the APPERF module */
+#define Y(a) #a,
+#define X(a) Y(APPERF_ ## a)
+#define Z(a) #a
+char *apperf_counter_names[] = {
+    APPERF_PERF_COUNTERS
+};
+#undef Y
+#undef X
+#define X(a) #a,
+char *apperf_scopes[] = { APPERF_SCOPES };
+#undef X
+#undef Z
+
+/* the largest record, a header record with a full table of event names */
+#define APPERF_REC_BUF_SIZE (sizeof(struct darshan_apperf_header_record) + \
+    APPERF_MAX_EVENTS * APPERF_EVENT_NAME_MAX)
+
+/* names of the perf_event events, taken from the header record; a log's
+ * header is printed before its perf records, and the names are kept per
+ * thread so that threads printing different logs do not see each other's
+ */
+static __thread int apperf_event_count;
+static __thread char apperf_event_names[APPERF_MAX_EVENTS][APPERF_EVENT_NAME_MAX];
+
+static int darshan_log_get_apperf_rec(darshan_fd fd, void** buf_p);
+static int darshan_log_put_apperf_rec(darshan_fd fd, void* buf);
+static void darshan_log_print_apperf_rec(void *file_rec,
+    char *file_name, char *mnt_pt, char *fs_type);
+static void darshan_log_print_apperf_description(int ver);
+static void darshan_log_print_apperf_rec_diff(void *file_rec1, char *file_name1,
+    void *file_rec2, char *file_name2);
+static void darshan_log_agg_apperf_recs(void *rec, void *agg_rec, int init_flag);
+
+struct darshan_mod_logutil_funcs apperf_logutils =
+{
+    .log_get_record = &darshan_log_get_apperf_rec,
+    .log_put_record = &darshan_log_put_apperf_rec,
+    .log_print_record = &darshan_log_print_apperf_rec,
+    .log_print_description = &darshan_log_print_apperf_description,
+    .log_print_diff = &darshan_log_print_apperf_rec_diff,
+    .log_agg_records = &darshan_log_agg_apperf_recs
+};
+
+/* remember the event names of a header record for printing perf records */
+static void darshan_log_save_apperf_event_names(struct darshan_apperf_header_record *hdr_rec)
+{
+    char *names = (char *)(hdr_rec + 1);
+    uint64_t off = 0;
+    size_t len;
+    int i;
+
+    apperf_event_count = hdr_rec->event_count;
+    if (apperf_event_count > APPERF_MAX_EVENTS)
+        apperf_event_count = APPERF_MAX_EVENTS;
+    for (i = 0; i < apperf_event_count; i++)
+    {
+        len = off < hdr_rec->event_names_size ?
+            strnlen(names + off, hdr_rec->event_names_size - off) : 0;
+        snprintf(apperf_event_names[i], APPERF_EVENT_NAME_MAX, "%.*s", (int)len,
+            names + off);
+        off += len + 1;
+    }
+
+    return;
+}
+
+/* name of the ith counter of a perf record, as printed */
+static char *darshan_log_apperf_counter_name(int i)
+{
+    static __thread char name[APPERF_EVENT_NAME_MAX + 8];
+
+    snprintf(name, sizeof(name), "APPERF_%s", apperf_event_names[i]);
+
+    return(name);
+}
+
+/* name of a scope, which is only trusted as far as the table goes */
+static char *darshan_log_apperf_scope_name(int64_t scope)
+{
+    if (scope < 0 || scope >= SCOPE_NUM_INDICES)
+        return("SCOPE_UNKNOWN");
+
+    return(apperf_scopes[scope]);
+}
+
+static int darshan_log_get_apperf_rec(darshan_fd fd, void** buf_p)
+{
+    struct darshan_apperf_header_record *hdr_rec;
+    struct darshan_apperf_perf_record *prf_rec;
+    int prefix_len = offsetof(struct darshan_apperf_header_record, scope);
+    int rec_len;
+    int64_t magic;
+    char *buffer;
+    int i;
+    int ret = -1;
+    int is_hdr = 0;
+
+    if(fd->mod_map[DARSHAN_APPERF_MOD].len == 0)
+        return(0);
+
+    if(fd->mod_ver[DARSHAN_APPERF_MOD] == 0 ||
+        fd->mod_ver[DARSHAN_APPERF_MOD] > APPERF_VER)
+    {
+        fprintf(stderr, "Error: Invalid APPERF module version number (got %d)\n",
+            fd->mod_ver[DARSHAN_APPERF_MOD]);
+        return(-1);
+    }
+
+    if (!*buf_p)
+    {
+        buffer = malloc(APPERF_REC_BUF_SIZE);
+        if (!buffer)
+        {
+            return(-1);
+        }
+    }
+    else
+    {
+        buffer = *buf_p;
+    }
+
+    /* the header record has its magic where perf records have their node */
+    ret = darshan_log_get_mod(fd, DARSHAN_APPERF_MOD, buffer, prefix_len);
+    if (ret <= 0)
+    {
+        if (!*buf_p) free(buffer);
+        return(ret < 0 ? -1 : 0);
+    }
+    if (ret != prefix_len)
+    {
+        if (!*buf_p) free(buffer);
+        return(-1);
+    }
+
+    magic = ((struct darshan_apperf_header_record *)buffer)->magic;
+    if (fd->swap_flag)
+        DARSHAN_BSWAP64(&magic);
+    is_hdr = magic == APPERF_MAGIC;
+
+    if (is_hdr)
+        rec_len = sizeof(struct darshan_apperf_header_record);
+    else
+        rec_len = sizeof(struct darshan_apperf_perf_record);
+
+    ret = darshan_log_get_mod(fd, DARSHAN_APPERF_MOD, buffer + prefix_len,
+        rec_len - prefix_len);
+    if (ret != rec_len - prefix_len)
+    {
+        if (!*buf_p) free(buffer);
+        return(-1);
+    }
+
+    if (is_hdr)
+    {
+        hdr_rec = (struct darshan_apperf_header_record*)buffer;
+        if (fd->swap_flag)
+        {
+            /* swap bytes if necessary */
+            DARSHAN_BSWAP64(&(hdr_rec->base_rec.id));
+            DARSHAN_BSWAP64(&(hdr_rec->base_rec.rank));
+            DARSHAN_BSWAP64(&(hdr_rec->magic));
+            DARSHAN_BSWAP64(&(hdr_rec->scope));
+            DARSHAN_BSWAP64(&(hdr_rec->nnodes));
+            DARSHAN_BSWAP64(&(hdr_rec->event_count));
+            DARSHAN_BSWAP64(&(hdr_rec->event_names_size));
+        }
+        if (hdr_rec->event_count > APPERF_MAX_EVENTS ||
+            hdr_rec->event_names_size > APPERF_MAX_EVENTS * APPERF_EVENT_NAME_MAX)
+        {
+            fprintf(stderr, "Error: invalid APPERF header record size\n");
+            if (!*buf_p) free(buffer);
+            return(-1);
+        }
+
+        /* the event names follow the header record */
+        if (hdr_rec->event_names_size > 0)
+        {
+            ret = darshan_log_get_mod(fd, DARSHAN_APPERF_MOD, buffer + rec_len,
+                hdr_rec->event_names_size);
+            if (ret != hdr_rec->event_names_size)
+            {
+                if (!*buf_p) free(buffer);
+                return(-1);
+            }
+            /* names never run past the table */
+            buffer[rec_len + hdr_rec->event_names_size - 1] = '\0';
+        }
+    }
+    else if (fd->swap_flag)
+    {
+        prf_rec = (struct darshan_apperf_perf_record*)buffer;
+        DARSHAN_BSWAP64(&(prf_rec->base_rec.id));
+        DARSHAN_BSWAP64(&(prf_rec->base_rec.rank));
+        DARSHAN_BSWAP64(&(prf_rec->node));
+        DARSHAN_BSWAP64(&(prf_rec->ranks));
+        DARSHAN_BSWAP64(&(prf_rec->counted));
+        DARSHAN_BSWAP64(&(prf_rec->time_enabled));
+        DARSHAN_BSWAP64(&(prf_rec->time_running));
+        for (i = 0; i < APPERF_MAX_EVENTS; i++)
+        {
+            DARSHAN_BSWAP64(&prf_rec->counters[i]);
+        }
+    }
+
+    *buf_p = buffer;
+    return(1);
+}
+
+static int darshan_log_put_apperf_rec(darshan_fd fd, void* buf)
+{
+    int ret;
+    int rec_len;
+    struct darshan_apperf_header_record *hdr_rec = buf;
+
+    if (hdr_rec->magic == APPERF_MAGIC)
+        rec_len = sizeof(*hdr_rec) + hdr_rec->event_names_size;
+    else
+        rec_len = sizeof(struct darshan_apperf_perf_record);
+
+    ret = darshan_log_put_mod(fd, DARSHAN_APPERF_MOD, buf,
+                              rec_len, APPERF_VER);
+    if(ret < 0)
+        return(-1);
+
+    return(0);
+}
+
+/* print the fields of a header record, each prefixed with sign */
+static void darshan_log_print_apperf_header(
+    struct darshan_apperf_header_record *hdr_rec, char *sign)
+{
+    printf("%s", sign);
+    DARSHAN_S_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+        hdr_rec->base_rec.rank, hdr_rec->base_rec.id,
+        "APPERF_SCOPE", darshan_log_apperf_scope_name(hdr_rec->scope), "", "", "");
+    printf("%s", sign);
+    DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+        hdr_rec->base_rec.rank, hdr_rec->base_rec.id,
+        "APPERF_NODES", hdr_rec->nnodes, "", "", "");
+    printf("%s", sign);
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+        hdr_rec->base_rec.rank, hdr_rec->base_rec.id,
+        "APPERF_EVENT_COUNT", hdr_rec->event_count, "", "", "");
+
+    return;
+}
+
+/* print the fields of a perf record and the events it counted, each
+ * prefixed with sign
+ */
+static void darshan_log_print_apperf_perf(
+    struct darshan_apperf_perf_record *prf_rec, char *sign)
+{
+    int i;
+
+    printf("%s", sign);
+    DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+        prf_rec->base_rec.rank, prf_rec->base_rec.id,
+        "APPERF_NODE", prf_rec->node, "", "", "");
+    printf("%s", sign);
+    DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+        prf_rec->base_rec.rank, prf_rec->base_rec.id,
+        "APPERF_RANKS", prf_rec->ranks, "", "", "");
+    printf("%s", sign);
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+        prf_rec->base_rec.rank, prf_rec->base_rec.id,
+        "APPERF_TIME_ENABLED", prf_rec->time_enabled, "", "", "");
+    printf("%s", sign);
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+        prf_rec->base_rec.rank, prf_rec->base_rec.id,
+        "APPERF_TIME_RUNNING", prf_rec->time_running, "", "", "");
+
+    for (i = 0; i < apperf_event_count; i++)
+    {
+        if (!(prf_rec->counted & ((uint64_t)1 << i)))
+            continue;
+        printf("%s", sign);
+        DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+            prf_rec->base_rec.rank, prf_rec->base_rec.id,
+            darshan_log_apperf_counter_name(i), prf_rec->counters[i],
+            "", "", "");
+    }
+
+    return;
+}
+
+static void darshan_log_print_apperf_rec(void *rec, char *file_name,
+    char *mnt_pt, char *fs_type)
+{
+    struct darshan_apperf_header_record *hdr_rec = rec;
+
+    if (hdr_rec->magic == APPERF_MAGIC)
+    {
+        darshan_log_print_apperf_header(hdr_rec, "");
+        darshan_log_save_apperf_event_names(hdr_rec);
+    }
+    else
+    {
+        darshan_log_print_apperf_perf(rec, "");
+    }
+
+    return;
+}
+
+static void darshan_log_print_apperf_description(int ver)
+{
+    printf("\n# description of APPERF counters:\n");
+    printf("#   global summary stats for the APPERF module:\n");
+    printf("#     APPERF_SCOPE: SCOPE_RANK if every rank counted its own events, or\n");
+    printf("#       SCOPE_NODE if one rank per node counted every CPU of its node\n");
+    printf("#       (DARSHAN_APPERF_SCOPE=node)\n");
+    printf("#     APPERF_NODES: total number of nodes\n");
+    printf("#     APPERF_EVENT_COUNT: number of perf_event events in the event list\n");
+    printf("#   per-rank or per-node statistics for the APPERF module:\n");
+    printf("#     APPERF_NODE: index of the node of this record\n");
+    printf("#     APPERF_RANKS: number of ranks whose events are counted by this record\n");
+    printf("#     APPERF_TIME_ENABLED, APPERF_TIME_RUNNING: nanoseconds the most\n");
+    printf("#       multiplexed group of events was enabled and counting\n");
+    printf("#     APPERF_<event>: count of each event that could be opened, scaled up\n");
+    printf("#       if it was multiplexed, set with DARSHAN_APPERF_EVENTS or\n");
+    printf("#       DARSHAN_APPERF_EVENTS_FILE as generic event names or pmu:config\n");
+    printf("#       (e.g. uncore_imc_0:0x304, counted in node scope); the default events are:\n");
+    printf("#     APPERF_TASK_CLOCK: nanoseconds the rank was running\n");
+    printf("#     APPERF_CONTEXT_SWITCHES, APPERF_CPU_MIGRATIONS, APPERF_PAGE_FAULTS\n");
+    printf("#     APPERF_CPU_CYCLES, APPERF_INSTRUCTIONS: core cycles and instructions\n");
+    printf("#     APPERF_CACHE_REFERENCES, APPERF_CACHE_MISSES: last level cache accesses\n");
+
+    return;
+}
+
+/* print a counter of two perf records that differ, or of the only one */
+static void darshan_log_print_apperf_counter_diff(
+    struct darshan_apperf_perf_record *prf_rec1,
+    struct darshan_apperf_perf_record *prf_rec2, int i)
+{
+    uint64_t bit = (uint64_t)1 << i;
+    int counted1 = prf_rec1 && (prf_rec1->counted & bit);
+    int counted2 = prf_rec2 && (prf_rec2->counted & bit);
+
+    if (counted1 == counted2 &&
+        (!counted1 || prf_rec1->counters[i] == prf_rec2->counters[i]))
+        return;
+
+    if (counted1)
+    {
+        printf("- ");
+        DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+            prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
+            darshan_log_apperf_counter_name(i), prf_rec1->counters[i],
+            "", "", "");
+    }
+    if (counted2)
+    {
+        printf("+ ");
+        DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+            prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
+            darshan_log_apperf_counter_name(i), prf_rec2->counters[i],
+            "", "", "");
+    }
+
+    return;
+}
+
+static void darshan_log_print_apperf_rec_diff(void *file_rec1, char *file_name1,
+    void *file_rec2, char *file_name2)
+{
+    struct darshan_apperf_header_record *hdr_rec1;
+    struct darshan_apperf_header_record *hdr_rec2;
+    struct darshan_apperf_perf_record   *prf_rec1;
+    struct darshan_apperf_perf_record   *prf_rec2;
+    int i;
+
+    hdr_rec1 = (struct darshan_apperf_header_record*) file_rec1;
+    hdr_rec2 = (struct darshan_apperf_header_record*) file_rec2;
+    prf_rec1 = (struct darshan_apperf_perf_record*) file_rec1;
+    prf_rec2 = (struct darshan_apperf_perf_record*) file_rec2;
+
+    if ((hdr_rec1 ? hdr_rec1 : hdr_rec2)->magic == APPERF_MAGIC)
+    {
+        /* this is the header record */
+        darshan_log_save_apperf_event_names(hdr_rec1 ? hdr_rec1 : hdr_rec2);
+        if (hdr_rec1 && hdr_rec2 &&
+            hdr_rec1->scope == hdr_rec2->scope &&
+            hdr_rec1->nnodes == hdr_rec2->nnodes &&
+            hdr_rec1->event_count == hdr_rec2->event_count)
+            return;
+
+        if (hdr_rec1)
+            darshan_log_print_apperf_header(hdr_rec1, "- ");
+        if (hdr_rec2)
+            darshan_log_print_apperf_header(hdr_rec2, "+ ");
+    }
+    else if (!prf_rec1 || !prf_rec2)
+    {
+        if (prf_rec1)
+            darshan_log_print_apperf_perf(prf_rec1, "- ");
+        if (prf_rec2)
+            darshan_log_print_apperf_perf(prf_rec2, "+ ");
+    }
+    else
+    {
+        if (prf_rec1->node != prf_rec2->node)
+        {
+            printf("- ");
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+                prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
+                "APPERF_NODE", prf_rec1->node, "", "", "");
+            printf("+ ");
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+                prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
+                "APPERF_NODE", prf_rec2->node, "", "", "");
+        }
+        if (prf_rec1->ranks != prf_rec2->ranks)
+        {
+            printf("- ");
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+                prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
+                "APPERF_RANKS", prf_rec1->ranks, "", "", "");
+            printf("+ ");
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APPERF_MOD],
+                prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
+                "APPERF_RANKS", prf_rec2->ranks, "", "", "");
+        }
+
+        for (i = 0; i < apperf_event_count; i++)
+            darshan_log_print_apperf_counter_diff(prf_rec1, prf_rec2, i);
+    }
+
+    return;
+}
+
+/* fold the perf record rec into the aggregate perf record agg_rec, which
+ * is reset first if init_flag is set. The counters and ranks are summed,
+ * an event is counted if any record counted it, and the times are those of
+ * the record whose events ran for the smallest share of their time. The
+ * header record is skipped.
+ */
+static void darshan_log_agg_apperf_recs(void *rec, void *agg_rec, int init_flag)
+{
+    struct darshan_apperf_perf_record *prf_rec = rec;
+    struct darshan_apperf_perf_record *agg_prf_rec = agg_rec;
+    int i;
+
+    if (init_flag)
+    {
+        memset(agg_prf_rec, 0, sizeof(*agg_prf_rec));
+        agg_prf_rec->base_rec.rank = -1;
+    }
+
+    if (((struct darshan_apperf_header_record *)rec)->magic == APPERF_MAGIC)
+        return;
+
+    /* an empty aggregate has no record id yet */
+    if (agg_prf_rec->base_rec.id == 0)
+    {
+        agg_prf_rec->base_rec.id = prf_rec->base_rec.id;
+        agg_prf_rec->node = prf_rec->node;
+        agg_prf_rec->time_enabled = prf_rec->time_enabled;
+        agg_prf_rec->time_running = prf_rec->time_running;
+    }
+    else
+    {
+        if (agg_prf_rec->node != prf_rec->node)
+            agg_prf_rec->node = -1;
+        if ((double)prf_rec->time_running * agg_prf_rec->time_enabled <
+            (double)agg_prf_rec->time_running * prf_rec->time_enabled)
+        {
+            agg_prf_rec->time_enabled = prf_rec->time_enabled;
+            agg_prf_rec->time_running = prf_rec->time_running;
+        }
+    }
+
+    agg_prf_rec->ranks += prf_rec->ranks;
+    agg_prf_rec->counted |= prf_rec->counted;
+    /* events a record did not count are 0 in it */
+    for (i = 0; i < APPERF_MAX_EVENTS; i++)
+        agg_prf_rec->counters[i] += prf_rec->counters[i];
+
+    return;
+}
+
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,15 @@
+/*
+ * Copyright (C) 2018 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef __APPERF_LOG_UTILS_H
+#define __APPERF_LOG_UTILS_H
+
+extern char *apperf_counter_names[];
+
+extern struct darshan_mod_logutil_funcs apperf_logutils;
+
+#endif
+
@@ -0,0 +1,12 @@
+#include <stdio.h>
+#include "darshan-log-format.h"
+#include "darshan-apperf-log-format.h"
+
+int main (int argc, char **argv)
+{
+   printf ("APPERF_NUM_INDICES = %d\n", APPERF_NUM_INDICES);
+   printf ("sizeof darshan_apperf_header_record = %d\n", sizeof(struct darshan_apperf_header_record));
+   printf ("sizeof darshan_apperf_perf_record = %d\n", sizeof(struct darshan_apperf_perf_record));
+
+   return 0;
+}
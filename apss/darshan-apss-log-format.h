@@ -8,7 +8,18 @@
 #define __APSS_LOG_FORMAT_H
 
 /* current AutoPerf Cray XC log format version */
-#define APSS_VER 1
+#define APSS_VER 2
+
+/* limits of the PAPI event set, which is loaded at runtime and recorded
+ * by name in the header record
+ */
+#define APSS_MAX_EVENTS 128
+#define APSS_EVENT_NAME_MAX 64
+
+/* bytes taken by a table of event names of size bytes, padded so that the
+ * record following it stays 8 byte aligned
+ */
+#define APSS_EVENT_NAMES_SIZE(size) (((size) + 7) & ~(uint64_t)7)
 
 #define APSS_MAGIC ('A'*0x100000000000000+\
                             'U'*0x1000000000000+\
@@ -19,6 +30,36 @@
                             'R'*0x100+\
                             'F'*0x1)
 
+#define APSS_SAMPLE_MAGIC ('A'*0x100000000000000+\
+                            'P'*0x1000000000000+\
+                            'S'*0x10000000000+\
+                            'S'*0x100000000+\
+                            'S'*0x1000000+\
+                            'M'*0x10000+\
+                            'P'*0x100+\
+                            'L'*0x1)
+
+#define APSS_PLACEMENT_MAGIC ('A'*0x100000000000000+\
+                            'P'*0x1000000000000+\
+                            'S'*0x10000000000+\
+                            'S'*0x100000000+\
+                            'P'*0x1000000+\
+                            'L'*0x10000+\
+                            'A'*0x100+\
+                            'C'*0x1)
+
+/* most routers in a placement record, a bound on corrupt records well
+ * above the slots of any EX system
+ */
+#define APSS_MAX_ROUTERS (1024*1024)
+
+/* default and largest size of the sample buffer of a router */
+#define APSS_SAMPLE_DEFAULT_BYTES (64*1024)
+#define APSS_SAMPLE_MAX_BYTES (1024*1024)
+
+/* default PAPI event set, used unless DARSHAN_APSS_EVENTS or
+ * DARSHAN_APSS_EVENTS_FILE name another one
+ */
 #define APSS_PERF_COUNTERS \
     /* PAPI counters */\
     X(CQ_CQ_OXE_NUM_STALLS) \
@@ -57,9 +98,15 @@ struct darshan_apss_perf_record
     int64_t chassis;
     int64_t blade;
     int64_t node;
-    uint64_t counters[APSS_NUM_INDICES];
+    /* one counter per event, in the order of the header record's names */
+    uint64_t event_count;
+    uint64_t counters[];
 };
 
+/* the header record is followed by event_names_size bytes holding the
+ * names of its event_count events, each NUL terminated, padded with NULs
+ */
+
 struct darshan_apss_header_record
 {
     struct darshan_base_record base_rec;
@@ -68,6 +115,56 @@ struct darshan_apss_header_record
     int64_t nchassis;
     int64_t ngroups;
     uint64_t appid;
+    uint64_t event_count;
+    uint64_t event_names_size;
+};
+
+/* the darshan_apss_sample_record is written by each node leader when
+ * DARSHAN_APSS_SAMPLE_INTERVAL is set, and is followed by data_size bytes
+ * of samples, oldest first. A sample is the time since the previous one in
+ * microseconds, then the increase of each event counter since the previous
+ * sample in header record order, all as unsigned LEB128 varints. The
+ * oldest samples are dropped when the buffer fills up. interval is the
+ * requested time between samples in microseconds and start_time the time
+ * the first sample held counts from, in seconds since the job started.
+ */
+struct darshan_apss_sample_record
+{
+    struct darshan_base_record base_rec;
+    int64_t magic;
+    int64_t group;
+    int64_t chassis;
+    int64_t blade;
+    int64_t node;
+    uint64_t interval;
+    uint64_t sample_count;
+    uint64_t dropped_count;
+    uint64_t data_size;
+    double start_time;
+};
+
+/* a router used by the job and the number of ranks placed on it. On HPE
+ * Cray EX, as in the perf and sample records, the group is the cabinet
+ * and the blade the slot of the x-name, and a node is numbered within its
+ * slot as 2 * board + node
+ */
+struct darshan_apss_router_entry
+{
+    int32_t group;
+    int32_t chassis;
+    int32_t blade;
+    uint32_t ranks;
+};
+
+/* the darshan_apss_placement_record is written by rank 0 and is followed by
+ * router_count darshan_apss_router_entry structures, one for each router
+ * used by the job, sorted by group, chassis and blade
+ */
+struct darshan_apss_placement_record
+{
+    struct darshan_base_record base_rec;
+    int64_t magic;
+    uint64_t router_count;
 };
 
 #endif /* __APSS_LOG_FORMAT_H */
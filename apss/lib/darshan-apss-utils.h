@@ -1,74 +1,159 @@
 #ifndef __APSS_UTILS_H__
 #define __APSS_UTILS_H__
 
-#include <regex.h>
+#include <limits.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
 
-static void search_hwinfo(const char * mstr, char *mode)
+/* root of the CXI device tree, overridable at build time so the module
+ * can be run against a fake tree off the machine
+ */
+#ifndef APSS_CXI_PATH
+#define APSS_CXI_PATH "/sys/class/cxi"
+#endif
+
+/* most CXI devices (NICs) of a node read by the sysfs backend */
+#define CXI_MAX_DEVICES 8
+
+/*
+ * Telemetry directories of the CXI devices of the node
+ */
+struct cxi_devices
 {
-    FILE *f;
-    int r;
-    char *fdata;
-    long len;
-    regex_t preg;
-    regmatch_t mreg[1];
-
-    r = regcomp(&preg, mstr, 0);
-
-    f = fopen ("/.hwinfo.cray", "rb");
-    fseek(f, 0, SEEK_END);
-    len = ftell(f);
-    fdata = malloc(len);
-    fseek(f, 0, SEEK_SET);
-    fread(fdata, sizeof(char), len, f);
-    fclose(f);
-
-    r = regexec(&preg, fdata, 1, mreg, 0);
-    if ((r == 0) && (mreg[0].rm_so > -1))
+    int count;
+    int dirs[CXI_MAX_DEVICES];
+};
+
+/*
+ * Open the telemetry directory of every cxi* device, returning how many
+ * were found
+ */
+static int cxi_open_devices(struct cxi_devices *devs)
+{
+    char path[PATH_MAX];
+    struct dirent *ent;
+    DIR *d;
+    int fd;
+
+    devs->count = 0;
+
+    d = opendir(APSS_CXI_PATH);
+    if (d == NULL)
+    {
+        return 0;
+    }
+    while ((ent = readdir(d)) != NULL && devs->count < CXI_MAX_DEVICES)
     {
-        sscanf(fdata+mreg[0].rm_so+strlen(mstr)-2, "%s", mode);
+        if (strncmp(ent->d_name, "cxi", 3) != 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s/device/telemetry",
+                 APSS_CXI_PATH, ent->d_name);
+        fd = open(path, O_RDONLY | O_DIRECTORY);
+        if (fd >= 0)
+            devs->dirs[devs->count++] = fd;
     }
-    regfree(&preg);
-    free(fdata);
+    closedir(d);
+
+    return devs->count;
+}
+
+static void cxi_close_devices(struct cxi_devices *devs)
+{
+    int i;
+
+    for (i = 0; i < devs->count; i++)
+        close(devs->dirs[i]);
+    devs->count = 0;
 
     return;
 }
 
-static int sstopo_get_mycoords(int *rack, int *chassis, int *blade, int *node)
+/*
+ * Open the telemetry file of an event in a device directory, named as the
+ * event in lower case, returning -1 if the device has no such counter
+ */
+static int cxi_open_counter(int dir, const char *name)
 {
-   char hostname[HOST_NAME_MAX + 1];
-    gethostname(hostname, HOST_NAME_MAX + 1);
+    char file[NAME_MAX + 1];
+    size_t i;
 
-    char a, b, c, d, e;
-    int layer_temp;
-    int rack, chassis, blade, anode;
-    /* format example: c1-0c1s2n1 c3-0c2s15n3 */
-    /* format example: x3012c0s13b0n0 */
-    sscanf(hostname,
-           "%c%d%c%d%c%d%c%d%c%d",
-           &a, &rack, &b, &layer_temp, &c, &chassis, &d, &blade, &e, &anode);
+    for (i = 0; name[i] && i < NAME_MAX; i++)
+        file[i] = tolower((unsigned char)name[i]);
+    file[i] = '\0';
 
-#ifdef DEBUG
-    fprintf(stderr, "coords = (%d,%d, %d, %d,%d,%d,%d) \n", layer_rank, blade_rank, node_rank, rack, chassis, blade, anode);
-#endif
+    return openat(dir, file, O_RDONLY);
+}
 
-    rack   = rack;
-    chassis  = chassis;
-    blade = blade;
-    node = anode;
+/*
+ * Read an open telemetry file, which holds value@seconds.nanoseconds
+ */
+static int cxi_read_counter(int fd, long long *value)
+{
+    char buf[64];
+    char *end;
+    ssize_t len;
+
+    len = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0)
+    {
+        return -1;
+    }
+    buf[len] = '\0';
+    *value = strtoll(buf, &end, 10);
+    if (end == buf)
+    {
+        return -1;
+    }
 
-  return 0;
+    return 0;
 }
 
-static unsigned int count_bits(unsigned int *bitvec, int cnt)
+/*
+ * Position of this node, from its hostname. An HPE Cray EX x-name,
+ * x<cabinet>c<chassis>s<slot>b<board>n<node>, gives the cabinet as the
+ * rack, the slot as the blade and, as EX boards hold 2 nodes, the index
+ * of the node in its slot. A Cray XC cname,
+ * c<column>-<row>c<chassis>s<slot>n<node>, gives the column as the rack.
+ * Coordinates are -1 for any other hostname.
+ */
+static int sstopo_get_mycoords(int *rack, int *chassis, int *blade, int *node)
 {
-    unsigned int count = 0;
-    int i;
+    char hostname[HOST_NAME_MAX + 1];
+    int cabinet, layer_temp, slot, board, anode;
+
+    *rack    = -1;
+    *chassis = -1;
+    *blade   = -1;
+    *node    = -1;
+
+    gethostname(hostname, HOST_NAME_MAX + 1);
+    hostname[HOST_NAME_MAX] = '\0';
 
-    for (i = 0; i < cnt; i++)
+    /* format example: x3012c0s13b0n0 */
+    if (sscanf(hostname, "x%dc%ds%db%dn%d",
+               &cabinet, chassis, &slot, &board, &anode) == 5)
+    {
+        *rack  = cabinet;
+        *blade = slot;
+        *node  = board * 2 + anode;
+    }
+    /* format example: c1-0c1s2n1 c3-0c2s15n3 */
+    else if (sscanf(hostname, "c%d-%dc%ds%dn%d",
+                    rack, &layer_temp, chassis, blade, &anode) == 5)
+    {
+        *node = anode;
+    }
+    else
     {
-        count += __builtin_popcount(bitvec[i]);
+        *rack = *chassis = *blade = -1;
     }
-    return count;
+
+#ifdef DEBUG
+    fprintf(stderr, "coords = (%d,%d,%d,%d) \n", *rack, *chassis, *blade, *node);
+#endif
+
+    return 0;
 }
 
 #endif
@@ -14,6 +14,8 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <assert.h>
+#include <errno.h>
+#include <time.h>
 #include <papi.h>
 
 #include "uthash.h"
@@ -24,7 +26,8 @@
 #include "darshan-apss-utils.h"
 
 /*
- * PAPI_events are defined by the Aries counters listed in the log header.
+ * PAPI_events is the default event set, the counters listed in the log
+ * header.
  */
 #define X(a) #a,
 #define Z(a) #a
@@ -35,9 +38,24 @@ static char* PAPI_events[] =
 #undef X
 #undef Z
 
-#define MAX_GROUPS (128)
-#define MAX_CHASSIS (MAX_GROUPS*6)
-#define MAX_BLADES (MAX_CHASSIS*16)
+/* longest unsigned LEB128 varint, for 64 bit values */
+#define VARINT_MAX 10
+
+/* sources of the router counters, chosen with DARSHAN_APSS_BACKEND */
+enum apss_backend
+{
+    BACKEND_PAPI = 0,
+    BACKEND_CXI
+};
+
+/* states of the counter sampling thread */
+enum apss_sampler_state
+{
+    SAMPLER_OFF = 0,
+    SAMPLER_STARTING,
+    SAMPLER_RUNNING,
+    SAMPLER_STOPPING
+};
 
 /*
  * <Description>
@@ -56,13 +74,40 @@ struct apss_runtime
     struct darshan_apss_perf_record *perf_record;
     darshan_record_id header_id;
     darshan_record_id rtr_id;
+    int backend;
     int PAPI_event_set;
     int PAPI_event_count;
+    char *PAPI_event_names; /* NUL terminated names of the counted events */
+    size_t PAPI_event_names_size;
+    int event_request_count; /* names loaded, which PAPI_event_names starts as */
+    struct cxi_devices cxi;
+    int cxi_fds[APSS_MAX_EVENTS][CXI_MAX_DEVICES];
+    long long cxi_base[APSS_MAX_EVENTS];
     int group;
     int chassis;
     int blade;
     int node;
+    int node_leader;
     int perf_record_marked;
+    struct darshan_apss_sample_record *sample_record;
+    darshan_record_id sample_id;
+    unsigned char *sample_data;
+    size_t sample_size;
+    size_t sample_head;
+    size_t sample_used;
+    uint64_t sample_start;
+    uint64_t sample_time;
+    long long sample_prev[APSS_MAX_EVENTS];
+    long long sample_values[APSS_MAX_EVENTS];
+    unsigned char sample_buf[(APSS_MAX_EVENTS+1)*VARINT_MAX];
+    int sample_record_marked;
+    pthread_t sampler;
+    pthread_mutex_t sampler_mutex;
+    pthread_cond_t sampler_cond;
+    int sampler_state;
+    struct darshan_apss_placement_record *placement_record;
+    int placement_record_marked;
+    void *output_buf;
 };
 
 static struct apss_runtime *apss_runtime = NULL;
@@ -93,35 +138,268 @@ static void apss_cleanup(
 #define APSS_UNLOCK() pthread_mutex_unlock(&apss_runtime_mutex)
 
 /*
- * Initialize counters using PAPI
+ * Read an event list file, one or more names per line with '#' starting
+ * a comment, into a string of names separated by white space.
  */
-static void initialize_counters (void)
+static char *read_event_file(const char *path)
+{
+    FILE *f;
+    char *buf;
+    long len;
+    long i;
+    int comment = 0;
+
+    f = fopen(path, "r");
+    if (f == NULL)
+    {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = malloc(len + 1);
+    if (buf)
+    {
+        len = fread(buf, sizeof(char), len, f);
+        buf[len] = '\0';
+        for (i = 0; i < len; i++)
+        {
+            if (buf[i] == '#')
+                comment = 1;
+            else if (buf[i] == '\n')
+                comment = 0;
+            if (comment)
+                buf[i] = ' ';
+        }
+    }
+    fclose(f);
+
+    return buf;
+}
+
+/*
+ * Open the telemetry file of an event on every CXI device that has it,
+ * returning -1 if none does
+ */
+static int add_cxi_event(int i, const char *name)
+{
+    int found = 0;
+    int d;
+
+    for (d = 0; d < apss_runtime->cxi.count; d++)
+    {
+        apss_runtime->cxi_fds[i][d] = cxi_open_counter(apss_runtime->cxi.dirs[d], name);
+        if (apss_runtime->cxi_fds[i][d] >= 0)
+            found = 1;
+    }
+
+    return found ? 0 : -1;
+}
+
+/*
+ * Append an event name to a table of NUL terminated names, unless the log
+ * format has no room for it
+ */
+static void append_event(char *names, int *count, size_t *size, const char *name)
+{
+    size_t len = strlen(name) + 1;
+
+    if (*count == APSS_MAX_EVENTS || len > APSS_EVENT_NAME_MAX)
+        return;
+
+    memcpy(names + *size, name, len);
+    *size += len;
+    (*count)++;
+
+    return;
+}
+
+/*
+ * Load the names of the event set, given by DARSHAN_APSS_EVENTS (comma
+ * separated) or DARSHAN_APSS_EVENTS_FILE, or the default one, into a table
+ * of count NUL terminated names taking size bytes. The records are sized
+ * from the table before the counters are started, so it still holds the
+ * events the backend may not accept.
+ */
+static char *load_events(int *count, size_t *size)
 {
+    char *env, *list = NULL, *tok, *saveptr = NULL;
+    char *names;
+    size_t len = 0;
     int i;
+
+    *count = 0;
+    *size = 0;
+
+    if ((env = getenv("DARSHAN_APSS_EVENTS")) != NULL)
+        list = strdup(env);
+    else if ((env = getenv("DARSHAN_APSS_EVENTS_FILE")) != NULL)
+        list = read_event_file(env);
+
+    if (list)
+    {
+        /* the names and their NULs fit in the list they are split from */
+        names = malloc(strlen(list) + 1);
+        if (names)
+        {
+            for (tok = strtok_r(list, ", \t\r\n", &saveptr);
+                 tok;
+                 tok = strtok_r(NULL, ", \t\r\n", &saveptr))
+            {
+                append_event(names, count, size, tok);
+            }
+        }
+        free(list);
+    }
+    else
+    {
+        for (i = CQ_CQ_OXE_NUM_STALLS; i < APSS_NUM_INDICES; i++)
+            len += strlen(PAPI_events[i]) + 1;
+        names = malloc(len);
+        if (names)
+        {
+            for (i = CQ_CQ_OXE_NUM_STALLS; i < APSS_NUM_INDICES; i++)
+            {
+                append_event(names, count, size, PAPI_events[i]);
+            }
+        }
+    }
+
+    return names;
+}
+
+/*
+ * Add an event to the event set. The names of the events the backend
+ * accepts are packed in place over the loaded ones, which are added in
+ * order.
+ */
+static void add_event(const char *name)
+{
+    int i = apss_runtime->PAPI_event_count;
+    size_t len = strlen(name) + 1;
     int code = 0;
 
-    PAPI_library_init(PAPI_VER_CURRENT);
-    apss_runtime->PAPI_event_set = PAPI_NULL;
-    PAPI_create_eventset(&apss_runtime->PAPI_event_set);
+    if (apss_runtime->backend == BACKEND_CXI)
+    {
+        if (add_cxi_event(i, name) < 0)
+            return;
+    }
+    else
+    {
+        if (PAPI_event_name_to_code((char *)name, &code) != PAPI_OK)
+            return;
+        if (PAPI_add_event(apss_runtime->PAPI_event_set, code) != PAPI_OK)
+            return;
+    }
+
+    memmove(apss_runtime->PAPI_event_names + apss_runtime->PAPI_event_names_size,
+            name, len);
+    apss_runtime->PAPI_event_names_size += len;
+    apss_runtime->PAPI_event_count++;
+
+    return;
+}
 
-    /* start with first PAPI counter */
-    for (i = AR_RTR_0_0_INQ_PRF_INCOMING_FLIT_VC0;
-         strcmp(PAPI_events[i], "APSS_NUM_INDICES") != 0;
-         i++)
+/*
+ * Sum the telemetry counters of each event over the CXI devices
+ */
+static int read_cxi_counters(long long *values)
+{
+    long long value;
+    int i, d;
+
+    for (i = 0; i < apss_runtime->PAPI_event_count; i++)
     {
-        PAPI_event_name_to_code(PAPI_events[i], &code);
-        PAPI_add_event(apss_runtime->PAPI_event_set, code);
+        values[i] = 0;
+        for (d = 0; d < apss_runtime->cxi.count; d++)
+        {
+            if (apss_runtime->cxi_fds[i][d] < 0)
+                continue;
+            if (cxi_read_counter(apss_runtime->cxi_fds[i][d], &value) < 0)
+                return -1;
+            values[i] += value;
+        }
     }
 
-    apss_runtime->PAPI_event_count = i;
+    return 0;
+}
 
-    PAPI_start(apss_runtime->PAPI_event_set);
+/*
+ * Read the counters, as counted since they were started or last captured
+ */
+static int read_counters(long long *values)
+{
+    int i;
+
+    if (apss_runtime->backend == BACKEND_PAPI)
+        return (PAPI_read(apss_runtime->PAPI_event_set, values) == PAPI_OK) ? 0 : -1;
+
+    if (read_cxi_counters(values) < 0)
+        return -1;
+    for (i = 0; i < apss_runtime->PAPI_event_count; i++)
+        values[i] -= apss_runtime->cxi_base[i];
+
+    return 0;
+}
+
+/*
+ * Initialize counters using PAPI, or the CXI telemetry files of the node
+ * with DARSHAN_APSS_BACKEND=cxi, with the loaded event set
+ */
+static void initialize_counters (void)
+{
+    char *name = apss_runtime->PAPI_event_names;
+    char *next;
+    int i;
+
+    /* PAPI is still used on nodes without CXI devices */
+    if (apss_runtime->backend == BACKEND_CXI &&
+        cxi_open_devices(&apss_runtime->cxi) == 0)
+        apss_runtime->backend = BACKEND_PAPI;
+
+    if (apss_runtime->backend == BACKEND_PAPI)
+    {
+        PAPI_library_init(PAPI_VER_CURRENT);
+        apss_runtime->PAPI_event_set = PAPI_NULL;
+        PAPI_create_eventset(&apss_runtime->PAPI_event_set);
+    }
+    apss_runtime->PAPI_event_count = 0;
+    apss_runtime->PAPI_event_names_size = 0;
+
+    for (i = 0; i < apss_runtime->event_request_count; i++)
+    {
+        next = name + strlen(name) + 1;
+        add_event(name);
+        name = next;
+    }
+
+    /* telemetry counters run from boot, so they count from here on */
+    if (apss_runtime->backend == BACKEND_CXI)
+        read_cxi_counters(apss_runtime->cxi_base);
+    else
+        PAPI_start(apss_runtime->PAPI_event_set);
 
     return;
 }
 
 static void finalize_counters (void)
 {
+    int i, d;
+
+    if (apss_runtime->backend == BACKEND_CXI)
+    {
+        for (i = 0; i < apss_runtime->PAPI_event_count; i++)
+        {
+            for (d = 0; d < apss_runtime->cxi.count; d++)
+            {
+                if (apss_runtime->cxi_fds[i][d] >= 0)
+                    close(apss_runtime->cxi_fds[i][d]);
+            }
+        }
+        cxi_close_devices(&apss_runtime->cxi);
+        return;
+    }
+
     PAPI_cleanup_eventset(apss_runtime->PAPI_event_set);
     PAPI_destroy_eventset(&apss_runtime->PAPI_event_set);
     PAPI_shutdown();
@@ -135,10 +413,28 @@ static void finalize_counters (void)
 static void capture(struct darshan_apss_perf_record *rec,
                     darshan_record_id rec_id)
 {
-    PAPI_stop(apss_runtime->PAPI_event_set,
-          (long long*) &rec->counters[AR_RTR_0_0_INQ_PRF_INCOMING_FLIT_VC0]);
-    PAPI_reset(apss_runtime->PAPI_event_set);
+    long long values[APSS_MAX_EVENTS];
+    int i;
 
+    if (apss_runtime->backend == BACKEND_CXI)
+    {
+        if (read_counters(values) == 0)
+        {
+            for (i = 0; i < apss_runtime->PAPI_event_count; i++)
+            {
+                rec->counters[i] = values[i];
+                apss_runtime->cxi_base[i] += values[i];
+            }
+        }
+    }
+    else
+    {
+        PAPI_stop(apss_runtime->PAPI_event_set,
+              (long long*) rec->counters);
+        PAPI_reset(apss_runtime->PAPI_event_set);
+    }
+
+    rec->event_count = apss_runtime->PAPI_event_count;
     rec->group   = apss_runtime->group;
     rec->chassis = apss_runtime->chassis;
     rec->blade   = apss_runtime->blade;
@@ -149,10 +445,459 @@ static void capture(struct darshan_apss_perf_record *rec,
     return;
 }
 
+/*
+ * Store val as an unsigned LEB128 varint at buf, returning its length
+ */
+static size_t put_varint(unsigned char *buf, uint64_t val)
+{
+    size_t len = 0;
+
+    while (val >= 0x80)
+    {
+        buf[len++] = (unsigned char)(val | 0x80);
+        val >>= 7;
+    }
+    buf[len++] = (unsigned char)val;
+
+    return len;
+}
+
+/*
+ * Read the varint at *off in the sample ring, moving *off past it and
+ * adding its length to *len
+ */
+static uint64_t get_ring_varint(size_t *off, size_t *len)
+{
+    uint64_t val = 0;
+    int shift = 0;
+    unsigned char b;
+
+    do
+    {
+        b = apss_runtime->sample_data[*off];
+        *off = (*off + 1) % apss_runtime->sample_size;
+        (*len)++;
+        if (shift < 64)
+            val |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+
+    return val;
+}
+
+/*
+ * Drop the oldest sample of the ring, which moves the start time to it
+ */
+static void drop_sample(void)
+{
+    size_t off = apss_runtime->sample_head;
+    size_t len = 0;
+    int i;
+
+    apss_runtime->sample_start += get_ring_varint(&off, &len);
+    for (i = 0; i < apss_runtime->PAPI_event_count; i++)
+        get_ring_varint(&off, &len);
+
+    apss_runtime->sample_head = off;
+    apss_runtime->sample_used -= len;
+    apss_runtime->sample_record->sample_count--;
+    apss_runtime->sample_record->dropped_count++;
+
+    return;
+}
+
+/*
+ * Read the counters and append their increase since the previous sample
+ * to the ring, dropping the oldest samples to make room
+ */
+static void take_sample(void)
+{
+    struct darshan_apss_sample_record *rec = apss_runtime->sample_record;
+    unsigned char *buf = apss_runtime->sample_buf;
+    uint64_t now;
+    size_t len = 0;
+    size_t tail, n;
+    int i;
+
+    if (read_counters(apss_runtime->sample_values) < 0)
+        return;
+    now = (uint64_t)(darshan_core_wtime() * 1e6);
+
+    len += put_varint(buf + len, now - apss_runtime->sample_time);
+    apss_runtime->sample_time = now;
+    for (i = 0; i < apss_runtime->PAPI_event_count; i++)
+    {
+        len += put_varint(buf + len,
+            (uint64_t)(apss_runtime->sample_values[i] - apss_runtime->sample_prev[i]));
+        apss_runtime->sample_prev[i] = apss_runtime->sample_values[i];
+    }
+
+    if (len > apss_runtime->sample_size)
+    {
+        /* too large to ever be held, so the series restarts after it */
+        rec->dropped_count += rec->sample_count + 1;
+        rec->sample_count = 0;
+        apss_runtime->sample_head = 0;
+        apss_runtime->sample_used = 0;
+        apss_runtime->sample_start = now;
+        return;
+    }
+    while (apss_runtime->sample_used + len > apss_runtime->sample_size)
+        drop_sample();
+
+    tail = (apss_runtime->sample_head + apss_runtime->sample_used) % apss_runtime->sample_size;
+    n = apss_runtime->sample_size - tail;
+    if (n > len)
+        n = len;
+    memcpy(apss_runtime->sample_data + tail, buf, n);
+    memcpy(apss_runtime->sample_data, buf + n, len - n);
+    apss_runtime->sample_used += len;
+    rec->sample_count++;
+
+    return;
+}
+
+static void reverse_bytes(unsigned char *buf, size_t len)
+{
+    unsigned char c;
+    size_t i;
+
+    for (i = 0; i < len / 2; i++)
+    {
+        c = buf[i];
+        buf[i] = buf[len - 1 - i];
+        buf[len - 1 - i] = c;
+    }
+
+    return;
+}
+
+/*
+ * Rotate the ring in place so the samples start the record's data
+ */
+static void finish_samples(void)
+{
+    struct darshan_apss_sample_record *rec = apss_runtime->sample_record;
+    unsigned char *data = apss_runtime->sample_data;
+    size_t head = apss_runtime->sample_head;
+    size_t size = apss_runtime->sample_size;
+
+    reverse_bytes(data, head);
+    reverse_bytes(data + head, size - head);
+    reverse_bytes(data, size);
+    apss_runtime->sample_head = 0;
+
+    rec->base_rec.id = apss_runtime->sample_id;
+    rec->base_rec.rank = my_rank;
+    rec->magic = APSS_SAMPLE_MAGIC;
+    rec->group   = apss_runtime->group;
+    rec->chassis = apss_runtime->chassis;
+    rec->blade   = apss_runtime->blade;
+    rec->node    = apss_runtime->node;
+    rec->data_size = apss_runtime->sample_used;
+    rec->start_time = apss_runtime->sample_start / 1e6;
+    apss_runtime->sample_record_marked = -1;
+
+    return;
+}
+
+/*
+ * Body of the sampling thread. It owns the counters from start to the
+ * final capture, so PAPI is never used by two threads.
+ */
+static void *sampler_main(void *arg)
+{
+    struct timespec next, now;
+    uint64_t interval = apss_runtime->sample_record->interval;
+
+    initialize_counters();
+    apss_runtime->sample_start = (uint64_t)(darshan_core_wtime() * 1e6);
+    apss_runtime->sample_time = apss_runtime->sample_start;
+
+    pthread_mutex_lock(&apss_runtime->sampler_mutex);
+    apss_runtime->sampler_state = SAMPLER_RUNNING;
+    pthread_cond_broadcast(&apss_runtime->sampler_cond);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (apss_runtime->sampler_state == SAMPLER_RUNNING)
+    {
+        next.tv_sec += interval / 1000000;
+        next.tv_nsec += (interval % 1000000) * 1000;
+        if (next.tv_nsec >= 1000000000)
+        {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        while (apss_runtime->sampler_state == SAMPLER_RUNNING &&
+               pthread_cond_timedwait(&apss_runtime->sampler_cond,
+                   &apss_runtime->sampler_mutex, &next) != ETIMEDOUT);
+        if (apss_runtime->sampler_state != SAMPLER_RUNNING)
+            break;
+
+        take_sample();
+
+        /* skip the intervals missed by a slow read */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > next.tv_sec ||
+            (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec))
+            next = now;
+    }
+    pthread_mutex_unlock(&apss_runtime->sampler_mutex);
+
+    /* the last sample covers the run up to the shutdown */
+    take_sample();
+    capture(apss_runtime->perf_record, apss_runtime->rtr_id);
+    finalize_counters();
+
+    return NULL;
+}
+
+/*
+ * Start the sampling thread, waiting for it to start the counters
+ */
+static int start_sampler(void)
+{
+    pthread_condattr_t attr;
+    int ret;
+
+    pthread_mutex_init(&apss_runtime->sampler_mutex, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&apss_runtime->sampler_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_mutex_lock(&apss_runtime->sampler_mutex);
+    apss_runtime->sampler_state = SAMPLER_STARTING;
+    ret = pthread_create(&apss_runtime->sampler, NULL, sampler_main, NULL);
+    if (ret == 0)
+    {
+        while (apss_runtime->sampler_state == SAMPLER_STARTING)
+            pthread_cond_wait(&apss_runtime->sampler_cond, &apss_runtime->sampler_mutex);
+    }
+    else
+    {
+        apss_runtime->sampler_state = SAMPLER_OFF;
+    }
+    pthread_mutex_unlock(&apss_runtime->sampler_mutex);
+
+    if (ret != 0)
+    {
+        pthread_cond_destroy(&apss_runtime->sampler_cond);
+        pthread_mutex_destroy(&apss_runtime->sampler_mutex);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Stop the sampling thread, which captures the final counters, and lay
+ * out its samples for output
+ */
+static void stop_sampler(void)
+{
+    pthread_mutex_lock(&apss_runtime->sampler_mutex);
+    apss_runtime->sampler_state = SAMPLER_STOPPING;
+    pthread_cond_broadcast(&apss_runtime->sampler_cond);
+    pthread_mutex_unlock(&apss_runtime->sampler_mutex);
+
+    pthread_join(apss_runtime->sampler, NULL);
+    pthread_cond_destroy(&apss_runtime->sampler_cond);
+    pthread_mutex_destroy(&apss_runtime->sampler_mutex);
+    apss_runtime->sampler_state = SAMPLER_OFF;
+
+    finish_samples();
+
+    return;
+}
+
+/*
+ * Register the sample record of a node leader, holding size bytes of
+ * samples taken every interval microseconds
+ */
+static void register_sample_record(uint64_t interval, size_t size)
+{
+    apss_runtime->sample_id = darshan_core_gen_record_id("APSS-SAMPLES");
+    apss_runtime->sample_record = darshan_core_register_record(
+        apss_runtime->sample_id,
+        "APSS-SAMPLES",
+        DARSHAN_APSS_MOD,
+        sizeof(struct darshan_apss_sample_record) + size,
+        NULL);
+    if (!apss_runtime->sample_record)
+        return;
+
+    apss_runtime->sample_record->interval = interval;
+    apss_runtime->sample_data = (unsigned char *)(apss_runtime->sample_record + 1);
+    apss_runtime->sample_size = size;
+
+    return;
+}
+
+/*
+ * Copy the names of the counted events, which the backend may have cut down
+ * from the loaded ones, after rank 0's header record
+ */
+static void record_event_names(void)
+{
+    struct darshan_apss_header_record *hdr = apss_runtime->header_record;
+    char *names = (char *)(hdr + 1);
+    size_t size = apss_runtime->PAPI_event_names_size;
+
+    hdr->event_count = apss_runtime->PAPI_event_count;
+    hdr->event_names_size = APSS_EVENT_NAMES_SIZE(size);
+    if (size)
+        memcpy(names, apss_runtime->PAPI_event_names, size);
+    memset(names + size, 0, hdr->event_names_size - size);
+
+    return;
+}
+
+/*
+ * Elect the lowest rank on each node to be the only one reading the
+ * counters of its NICs, which the node does not share with any other.
+ * Collective over MPI_COMM_WORLD.
+ */
+static int elect_node_leader(int rank)
+{
+    MPI_Comm node_comm;
+    int node_rank;
+
+    PMPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                         MPI_INFO_NULL, &node_comm);
+    PMPI_Comm_rank(node_comm, &node_rank);
+    PMPI_Comm_free(&node_comm);
+
+    return(node_rank == 0);
+}
+
+/* order of router entries: by group, chassis and blade */
+static int router_entry_cmp(const void *a, const void *b)
+{
+    const struct darshan_apss_router_entry *ra = a;
+    const struct darshan_apss_router_entry *rb = b;
+
+    if (ra->group != rb->group)
+        return(ra->group < rb->group ? -1 : 1);
+    if (ra->chassis != rb->chassis)
+        return(ra->chassis < rb->chassis ? -1 : 1);
+    if (ra->blade != rb->blade)
+        return(ra->blade < rb->blade ? -1 : 1);
+
+    return(0);
+}
+
+/*
+ * Gather the router of every rank on rank 0, which sorts them into the
+ * routers used by the job, each with its number of ranks, and counts the
+ * chassis and groups they span. EX cabinet numbers run into the thousands,
+ * so routers are ranked by their coordinates rather than indexed by them.
+ * Collective over MPI_COMM_WORLD; rank 0 gets the routers, to be freed,
+ * and returns how many there are, the other ranks return 0.
+ */
+static int take_census(int rank, int group, int chassis, int blade,
+                       struct darshan_apss_router_entry **routers,
+                       int *nchassis, int *ngroups)
+{
+    struct darshan_apss_router_entry mine, *all = NULL;
+    int nprocs;
+    int have_room;
+    int count = 0;
+    int i;
+
+    *routers = NULL;
+    *nchassis = 0;
+    *ngroups = 0;
+
+    mine.group = group;
+    mine.chassis = chassis;
+    mine.blade = blade;
+    mine.ranks = 1;
+
+    /* the job goes without a census if rank 0 has no room for it */
+    PMPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    if (rank == 0)
+        all = malloc(nprocs * sizeof(*all));
+    have_room = (rank != 0 || all != NULL);
+    PMPI_Bcast(&have_room, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!have_room)
+        return(0);
+    PMPI_Gather(&mine, 4, MPI_INT, all, 4, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!all)
+        return(0);
+
+    /* ranks of unknown position are not counted */
+    qsort(all, nprocs, sizeof(*all), router_entry_cmp);
+    for (i = 0; i < nprocs; i++)
+    {
+        if (all[i].group < 0)
+            continue;
+        if (count > 0 && router_entry_cmp(&all[count - 1], &all[i]) == 0)
+        {
+            all[count - 1].ranks++;
+            continue;
+        }
+        if (count == 0 || all[count - 1].group != all[i].group)
+            (*ngroups)++;
+        if (count == 0 || all[count - 1].group != all[i].group ||
+            all[count - 1].chassis != all[i].chassis)
+            (*nchassis)++;
+        all[count++] = all[i];
+    }
+    *routers = all;
+
+    return(count);
+}
+
+/*
+ * Register the router placement map of rank 0 and fill it in with the
+ * routers of the census
+ */
+static void register_placement_record(struct darshan_apss_router_entry *routers,
+                                      int router_count)
+{
+    darshan_record_id rec_id;
+
+    rec_id = darshan_core_gen_record_id("APSS-PLACEMENT");
+    apss_runtime->placement_record = darshan_core_register_record(
+        rec_id,
+        "APSS-PLACEMENT",
+        DARSHAN_APSS_MOD,
+        sizeof(struct darshan_apss_placement_record) +
+        router_count * sizeof(struct darshan_apss_router_entry),
+        NULL);
+    if (!apss_runtime->placement_record)
+        return;
+
+    apss_runtime->placement_record->base_rec.id = rec_id;
+    apss_runtime->placement_record->base_rec.rank = my_rank;
+    apss_runtime->placement_record->magic = APSS_PLACEMENT_MAGIC;
+    apss_runtime->placement_record->router_count = router_count;
+    if (router_count)
+        memcpy(apss_runtime->placement_record + 1, routers,
+               router_count * sizeof(struct darshan_apss_router_entry));
+    apss_runtime->placement_record_marked = -1;
+
+    return;
+}
+
 void apss_runtime_initialize()
 {
     size_t apss_buf_size;
+    size_t apss_rec_count = 1;
     char rtr_rec_name[128];
+    uint64_t sample_interval = 0;
+    size_t sample_size = APSS_SAMPLE_DEFAULT_BYTES;
+    char *env;
+    int rank;
+    int group, chassis, blade, node;
+    int node_leader;
+    struct darshan_apss_router_entry *routers;
+    int router_count, nchassis, ngroups;
+    char *event_names = NULL;
+    int event_count = 0;
+    size_t event_names_size = 0;
+    int ret;
 
     darshan_module_funcs mod_funcs = {
 //#ifdef HAVE_MPI
@@ -176,13 +921,60 @@ void apss_runtime_initialize()
     apss_buf_size = sizeof(struct darshan_apss_header_record) + 
                     sizeof(struct darshan_apss_perf_record);
 
+    /* optional sampling of the counters, interval given in milliseconds */
+    if ((env = getenv("DARSHAN_APSS_SAMPLE_INTERVAL")) != NULL)
+        sample_interval = strtoull(env, NULL, 10) * 1000;
+    if ((env = getenv("DARSHAN_APSS_SAMPLE_BYTES")) != NULL)
+        sample_size = strtoull(env, NULL, 10);
+    if (sample_size > APSS_SAMPLE_MAX_BYTES)
+        sample_size = APSS_SAMPLE_MAX_BYTES;
+    if (sample_interval > 0 && sample_size > 0)
+        apss_buf_size += sizeof(struct darshan_apss_sample_record) + sample_size;
+    else
+        sample_interval = 0;
+
+    /* the election and the census are collective, so every rank takes
+     * part before any of them can give up on the module below
+     */
+    PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    sstopo_get_mycoords(&group, &chassis, &blade, &node);
+    node_leader = elect_node_leader(rank);
+
+    /* rank 0 also writes the router placement map of the census, which
+     * does not change while the job runs
+     */
+    router_count = take_census(rank, group, chassis, blade, &routers,
+                               &nchassis, &ngroups);
+    if (rank == 0)
+        apss_buf_size += sizeof(struct darshan_apss_placement_record) +
+            router_count * sizeof(struct darshan_apss_router_entry);
+
+    /* the event set sizes the perf records of the node leaders and the
+     * header record of rank 0, which is one of them
+     */
+    if (node_leader)
+    {
+        event_names = load_events(&event_count, &event_names_size);
+        apss_buf_size += event_count * sizeof(uint64_t);
+        if (rank == 0)
+            apss_buf_size += APSS_EVENT_NAMES_SIZE(event_names_size);
+    }
+
     /* register the APSS module with the darshan-core component */
-    darshan_core_register_module(
+    ret = darshan_core_register_module(
         DARSHAN_APSS_MOD,
         mod_funcs,
-        &apss_buf_size,
+        apss_buf_size,
+        &apss_rec_count,
         &my_rank,
         NULL);
+    if(ret < 0)
+    {
+        free(event_names);
+        free(routers);
+        APSS_UNLOCK();
+        return;
+    }
 
 
     /* initialize module's global state */
@@ -190,10 +982,18 @@ void apss_runtime_initialize()
     if(!apss_runtime)
     {
         darshan_core_unregister_module(DARSHAN_APSS_MOD);
+        free(event_names);
+        free(routers);
         APSS_UNLOCK();
         return;
     }
     memset(apss_runtime, 0, sizeof(*apss_runtime));
+    apss_runtime->PAPI_event_names = event_names;
+    apss_runtime->event_request_count = event_count;
+
+    /* counters are read through PAPI unless DARSHAN_APSS_BACKEND=cxi */
+    if ((env = getenv("DARSHAN_APSS_BACKEND")) != NULL && strcmp(env, "cxi") == 0)
+        apss_runtime->backend = BACKEND_CXI;
 
     if (my_rank == 0)
     {
@@ -205,48 +1005,72 @@ void apss_runtime_initialize()
             //NULL,
             "darshan-apss-header",
             DARSHAN_APSS_MOD,
-            sizeof(struct darshan_apss_header_record),
+            sizeof(struct darshan_apss_header_record) +
+            APSS_EVENT_NAMES_SIZE(event_names_size),
             NULL);
         if(!(apss_runtime->header_record))
         {
             darshan_core_unregister_module(DARSHAN_APSS_MOD);
+            free(apss_runtime->PAPI_event_names);
             free(apss_runtime);
             apss_runtime = NULL;
+            free(routers);
             APSS_UNLOCK();
            return;
         }
         apss_runtime->header_record->base_rec.id = apss_runtime->header_id;
         apss_runtime->header_record->base_rec.rank = my_rank;
         apss_runtime->header_record->magic = APSS_MAGIC;
+        apss_runtime->header_record->nblades = router_count;
+        apss_runtime->header_record->nchassis = nchassis;
+        apss_runtime->header_record->ngroups = ngroups;
     }
 
-    get_xc_coords(&apss_runtime->group,
-                  &apss_runtime->chassis,
-                  &apss_runtime->blade,
-                  &apss_runtime->node);
-
-    sprintf(rtr_rec_name, "darshan-apss-rtr-%d-%d-%d",
-            apss_runtime->group, apss_runtime->chassis, apss_runtime->blade);
-    //apss_runtime->rtr_id = darshan_core_gen_record_id(rtr_rec_name);
-    apss_runtime->rtr_id = darshan_core_gen_record_id("APSS");
-    apss_runtime->perf_record = darshan_core_register_record(
-        apss_runtime->rtr_id,
-        //NULL,
-        "APSS",   // we want the record for each rank to be treated as shared records so that mpi_redux can operate on
-        //rtr_rec_name,
-        DARSHAN_APSS_MOD,
-        sizeof(struct darshan_apss_perf_record),
-        NULL);
-    if(!(apss_runtime->perf_record))
+    apss_runtime->group = group;
+    apss_runtime->chassis = chassis;
+    apss_runtime->blade = blade;
+    apss_runtime->node = node;
+    apss_runtime->node_leader = node_leader;
+
+    /* only node leaders read counters and write a perf record */
+    if (apss_runtime->node_leader)
     {
-        darshan_core_unregister_module(DARSHAN_APSS_MOD);
-        free(apss_runtime);
-        apss_runtime = NULL;
-        APSS_UNLOCK();
-        return;
+        sprintf(rtr_rec_name, "darshan-apss-rtr-%d-%d-%d",
+                apss_runtime->group, apss_runtime->chassis, apss_runtime->blade);
+        //apss_runtime->rtr_id = darshan_core_gen_record_id(rtr_rec_name);
+        apss_runtime->rtr_id = darshan_core_gen_record_id("APSS");
+        apss_runtime->perf_record = darshan_core_register_record(
+            apss_runtime->rtr_id,
+            //NULL,
+            "APSS",   // we want the record for each rank to be treated as shared records so that mpi_redux can operate on
+            //rtr_rec_name,
+            DARSHAN_APSS_MOD,
+            sizeof(struct darshan_apss_perf_record) +
+            event_count * sizeof(uint64_t),
+            NULL);
+        if(!(apss_runtime->perf_record))
+        {
+            darshan_core_unregister_module(DARSHAN_APSS_MOD);
+            free(apss_runtime->PAPI_event_names);
+            free(apss_runtime);
+            apss_runtime = NULL;
+            free(routers);
+            APSS_UNLOCK();
+            return;
+        }
+
+        if (sample_interval > 0)
+            register_sample_record(sample_interval, sample_size);
+        if (!apss_runtime->sample_record || start_sampler() < 0)
+            initialize_counters();
     }
 
-    initialize_counters();
+    if (my_rank == 0)
+    {
+        register_placement_record(routers, router_count);
+        record_event_names();
+    }
+    free(routers);
     APSS_UNLOCK();
 
     return;
@@ -264,18 +1088,6 @@ static void apss_mpi_redux(
     darshan_record_id *shared_recs,
     int shared_rec_count)
 {
-    int i;
-    int color;
-    int router_rank;
-    int router_count;
-    int chassis_count;
-    int group_count;
-    unsigned int *bitvec;
-    unsigned int bitlen;
-    unsigned int bitcnt;
-    unsigned int bitsiz;
-    MPI_Comm router_comm;
-
     APSS_LOCK();
     if (!apss_runtime)
     {
@@ -283,112 +1095,22 @@ static void apss_mpi_redux(
         return;
     }
 
-    bitcnt = sizeof(unsigned int) * 8;
-    bitlen = sizeof(unsigned int) * (MAX_BLADES/bitcnt);
-    bitsiz = bitlen / sizeof(unsigned int);
-    bitvec = malloc(bitlen);
-    
-    /* collect perf counters */
-    capture(apss_runtime->perf_record, apss_runtime->rtr_id);
+    /* collect perf counters, which the sampling thread does when it stops */
+    if (apss_runtime->sampler_state != SAMPLER_OFF)
+        stop_sampler();
+    else if (apss_runtime->node_leader)
+        capture(apss_runtime->perf_record, apss_runtime->rtr_id);
 
     if (my_rank == 0)
     {
         apss_runtime->header_record->appid = atoi((char*)getenv( csJOBID_ENV_STR ));
     }
 
-    /* count network dimensions */
-    if (bitvec)
-    {
-        int idx;
-        unsigned int uchassis;
-        unsigned int ublade;
-
-        /* group */
-        memset(bitvec, 0, bitlen);
-        idx = apss_runtime->group / bitcnt;
-        bitvec[idx] |= (1 << apss_runtime->group % bitcnt);
-        PMPI_Reduce((my_rank ? bitvec : MPI_IN_PLACE),
-                     bitvec,
-                     bitsiz,
-                     MPI_INT,
-                     MPI_BOR,
-                     0,
-                     MPI_COMM_WORLD);
-        group_count = count_bits(bitvec, bitsiz);
-
-        /* chassis */
-        memset(bitvec, 0, bitlen);
-        uchassis = apss_runtime->group * 6 + apss_runtime->chassis;
-        idx = uchassis / bitcnt;
-        bitvec[idx] |= (1 << uchassis % bitcnt);
-        PMPI_Reduce((my_rank ? bitvec : MPI_IN_PLACE),
-                    bitvec,
-                    bitsiz,
-                    MPI_INT,
-                    MPI_BOR,
-                    0,
-                    MPI_COMM_WORLD);
-        chassis_count = count_bits(bitvec, bitsiz);
-
-        /* blade */
-        memset(bitvec, 0, bitlen);
-        ublade = uchassis * 16 + apss_runtime->blade;
-        idx = ublade / bitcnt;
-        bitvec[idx] |= (1 << ublade % bitcnt);
-        PMPI_Reduce((my_rank ? bitvec : MPI_IN_PLACE),
-                    bitvec,
-                    bitsiz,
-                    MPI_INT,
-                    MPI_BOR,
-                    0,
-                    MPI_COMM_WORLD);
-        router_count = count_bits(bitvec, bitsiz);
-
-        if (my_rank == 0)
-        {
-            apss_runtime->header_record->nblades  = router_count;
-            apss_runtime->header_record->nchassis = chassis_count;
-            apss_runtime->header_record->ngroups  = group_count;
-        }
-        free(bitvec);
-    }
-    else
+    /* node leaders hold the exact counters of their NICs */
+    if (apss_runtime->node_leader)
     {
-        apss_runtime->header_record->nblades  = 0;
-        apss_runtime->header_record->nchassis = 0;
-        apss_runtime->header_record->ngroups  = 0;
+        apss_runtime->perf_record_marked = -1;
     }
-    
-    /*
-     * reduce data
-     *
-     *  aggregate data from processes which share the same blade and avg.
-     *  
-     */ 
-    color = (apss_runtime->group << (4+3)) + \
-            (apss_runtime->chassis << 4) + \
-            apss_runtime->blade;
-    PMPI_Comm_split(MPI_COMM_WORLD, color, my_rank, &router_comm);
-    PMPI_Comm_rank(router_comm,  &router_rank);
-    PMPI_Comm_size(router_comm,  &router_count);
-
-    PMPI_Reduce((router_rank?apss_runtime->perf_record->counters:MPI_IN_PLACE),
-                apss_runtime->perf_record->counters,
-                APSS_NUM_INDICES,
-                MPI_LONG_LONG_INT,
-                MPI_SUM,
-                0,
-                router_comm);
-
-    if (router_rank == 0)
-    {
-        for (i = 0; i < APSS_NUM_INDICES; i++)
-        {
-            apss_runtime->perf_record->counters[i] /= router_count;
-        }
-            apss_runtime->perf_record_marked = -1;
-    }
-    PMPI_Comm_free(&router_comm);
 
     APSS_UNLOCK();
 
@@ -400,19 +1122,75 @@ static void apss_output(
     void **apss_buf,
     int *apss_buf_sz)
 {
+    char *out;
+    int hdr_size = 0;
+    int prf_size = 0;
+    int smp_size = 0;
+    int plc_size = 0;
+    int size;
+
     APSS_LOCK();
     assert(apss_runtime);
     *apss_buf_sz = 0; 
     
     if (my_rank == 0) { 
-        *apss_buf_sz += sizeof(*apss_runtime->header_record); 
+        hdr_size = sizeof(*apss_runtime->header_record) +
+                   apss_runtime->header_record->event_names_size;
     }
     
     if (apss_runtime->perf_record_marked == -1) 
      { 
-       *apss_buf_sz += sizeof( *apss_runtime->perf_record); 
+       prf_size = sizeof(*apss_runtime->perf_record) +
+                  apss_runtime->perf_record->event_count * sizeof(uint64_t);
      }
 
+    if (apss_runtime->sample_record_marked == -1)
+    {
+        smp_size = sizeof(*apss_runtime->sample_record) +
+                   apss_runtime->sample_record->data_size;
+    }
+
+    if (apss_runtime->placement_record_marked == -1)
+    {
+        plc_size = sizeof(*apss_runtime->placement_record) +
+                   apss_runtime->placement_record->router_count *
+                   sizeof(struct darshan_apss_router_entry);
+    }
+
+    /*
+     * the records are trimmed to the events counted, the samples held and
+     * the routers found, so they are copied out to be contiguous
+     */
+    size = hdr_size + prf_size + smp_size + plc_size;
+    out = size ? malloc(size) : NULL;
+    if (out)
+    {
+        size = 0;
+        if (hdr_size)
+        {
+            memcpy(out + size, apss_runtime->header_record, hdr_size);
+            size += hdr_size;
+        }
+        if (prf_size)
+        {
+            memcpy(out + size, apss_runtime->perf_record, prf_size);
+            size += prf_size;
+        }
+        if (smp_size)
+        {
+            memcpy(out + size, apss_runtime->sample_record, smp_size);
+            size += smp_size;
+        }
+        if (plc_size)
+        {
+            memcpy(out + size, apss_runtime->placement_record, plc_size);
+            size += plc_size;
+        }
+        *apss_buf = out;
+        *apss_buf_sz = size;
+        apss_runtime->output_buf = out;
+    }
+
     APSS_UNLOCK();
     return;
 }
@@ -421,7 +1199,12 @@ static void apss_cleanup()
 {
     APSS_LOCK();
     assert(apss_runtime);
-    finalize_counters();
+    if (apss_runtime->sampler_state != SAMPLER_OFF)
+        stop_sampler();
+    else if (apss_runtime->node_leader && apss_runtime->sample_record_marked != -1)
+        finalize_counters();
+    free(apss_runtime->output_buf);
+    free(apss_runtime->PAPI_event_names);
     free(apss_runtime);
     apss_runtime = NULL;
     APSS_UNLOCK();
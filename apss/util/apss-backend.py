@@ -13,7 +13,8 @@ struct darshan_apss_perf_record
     int64_t chassis; 
     int64_t blade; 
     int64_t node;
-    uint64_t counters[10];
+    uint64_t event_count;
+    uint64_t counters[];
 };
 struct darshan_apss_header_record
 {
@@ -23,6 +24,35 @@ struct darshan_apss_header_record
     int64_t nchassis;
     int64_t ngroups;
     uint64_t appid;
+    uint64_t event_count;
+    uint64_t event_names_size;
+};
+struct darshan_apss_sample_record
+{
+    struct darshan_base_record base_rec;
+    int64_t magic;
+    int64_t group;
+    int64_t chassis;
+    int64_t blade;
+    int64_t node;
+    uint64_t interval;
+    uint64_t sample_count;
+    uint64_t dropped_count;
+    uint64_t data_size;
+    double start_time;
+};
+struct darshan_apss_router_entry
+{
+    int32_t group;
+    int32_t chassis;
+    int32_t blade;
+    uint32_t ranks;
+};
+struct darshan_apss_placement_record
+{
+    struct darshan_base_record base_rec;
+    int64_t magic;
+    uint64_t router_count;
 };
 
 extern char *apss_counter_names[];
@@ -33,13 +63,132 @@ def get_apss_defs():
   return structdefs
 
 
+APSS_MAGIC = int.from_bytes(b'AUTOPERF', 'big')
+APSS_SAMPLE_MAGIC = int.from_bytes(b'APSSSMPL', 'big')
+APSS_PLACEMENT_MAGIC = int.from_bytes(b'APSSPLAC', 'big')
+APSS_MAX_EVENTS = 128
+
+# layout of the router entries following a placement record
+_router_dtype = np.dtype([('group', np.int32), ('chassis', np.int32),
+                          ('blade', np.int32), ('ranks', np.uint32)])
+
+
+def _get_varint(data, off):
+    val = 0
+    shift = 0
+    while True:
+        b = data[off]
+        off += 1
+        val |= (b & 0x7f) << shift
+        shift += 7
+        if not b & 0x80:
+            return val, off
+
+
+# decode the samples following a sample record: the end time of each
+# sample and the increase of each event during it
+def _get_apss_samples(ffi, smp, event_names):
+    data = bytes(ffi.buffer(ffi.cast('char *', smp) +
+        ffi.sizeof('struct darshan_apss_sample_record'), smp[0].data_size))
+    count = smp[0].sample_count
+    times = np.zeros(count, dtype=np.float64)
+    deltas = np.zeros((count, len(event_names)), dtype=np.uint64)
+    time = smp[0].start_time
+    off = 0
+    for s in range(0, count):
+      dt, off = _get_varint(data, off)
+      time += dt / 1e6
+      times[s] = time
+      for i in range(0, len(event_names)):
+        deltas[s][i], off = _get_varint(data, off)
+    return times, deltas
+
+
+_primitive_dtypes = {'uint64_t': np.uint64, 'int64_t': np.int64,
+                     'uint32_t': np.uint32, 'int32_t': np.int32,
+                     'double': np.float64}
+
+
+# numpy dtype with the layout of a struct of the cffi defs, so that records
+# can be copied into numpy arrays whole and their counters viewed there; a
+# flexible array member at the end is given room for flex_len items
+def _struct_dtype(ffi, ctype, flex_len=0):
+    names = []
+    formats = []
+    offsets = []
+    itemsize = 0
+    if isinstance(ctype, str):
+      ctype = ffi.typeof(ctype)
+    for name, field in ctype.fields:
+      t = field.type
+      if t.kind == 'array' and t.cname.endswith('[]'):
+        fmt = (_primitive_dtypes[t.item.cname], flex_len)
+        itemsize = flex_len * ffi.sizeof(t.item)
+      elif t.kind == 'struct':
+        fmt = _struct_dtype(ffi, t)
+      elif t.kind == 'array' and t.item.cname == 'char':
+        fmt = 'S%d' % t.length
+      elif t.kind == 'array':
+        fmt = (_primitive_dtypes[t.item.cname], t.length)
+      else:
+        fmt = _primitive_dtypes[t.cname]
+      names.append(name)
+      formats.append(fmt)
+      offsets.append(field.offset)
+    return np.dtype({'names': names, 'formats': formats, 'offsets': offsets,
+                     'itemsize': ffi.sizeof(ctype) + itemsize})
+
+
+def _get_apss_header(ffi, hdr):
+    rec = {}
+    rec['id'] = hdr.base_rec.id
+    rec['rank'] = hdr.base_rec.rank
+    rec['nblades'] = hdr.nblades
+    rec['nchassis'] = hdr.nchassis
+    rec['ngroups'] = hdr.ngroups
+    rec['appid'] = hdr.appid
+    # the names follow the record, each NUL terminated
+    names = bytes(ffi.buffer(ffi.cast('char *', hdr) +
+        ffi.sizeof('struct darshan_apss_header_record'), hdr.event_names_size))
+    rec['event_names'] = [name.decode('utf-8') for name in
+        names.split(b'\0')[:hdr.event_count]]
+    return rec
+
+
+def _get_apss_sample(ffi, smp, event_names):
+    rec = {}
+    rec['id'] = smp.base_rec.id
+    rec['rank'] = smp.base_rec.rank
+    rec['group'] = smp.group
+    rec['chassis'] = smp.chassis
+    rec['blade'] = smp.blade
+    rec['node'] = smp.node
+    rec['interval'] = smp.interval
+    rec['dropped'] = smp.dropped_count
+    rec['start_time'] = smp.start_time
+
+    times, deltas = _get_apss_samples(ffi, smp, event_names)
+    rec['times'] = times
+    rec['samples'] = dict(zip(['APSS_' + name for name in event_names], deltas.T))
+    return rec
+
+
+def _get_apss_placement(ffi, plc):
+    rec = {}
+    rec['id'] = plc.base_rec.id
+    rec['rank'] = plc.base_rec.rank
+    rec['routers'] = np.frombuffer(ffi.buffer(ffi.cast('char *', plc) +
+        ffi.sizeof('struct darshan_apss_placement_record'),
+        plc.router_count * _router_dtype.itemsize), dtype=_router_dtype).copy()
+    return rec
+
+
 # load header record
 def log_get_apss_record(log, mod_name, structname, dtype='dict'):
     from darshan.backend.cffi_backend import ffi, libdutil, log_get_modules, counter_names, _structdefs
 
     modules = log_get_modules(log)
 
-    rec = {}
     buf = ffi.new("void **")
     r = libdutil.darshan_log_get_record(log['handle'], modules[mod_name]['idx'], buf)
     mod_type = _structdefs[mod_name+"-"+structname]
@@ -47,15 +196,18 @@ def log_get_apss_record(log, mod_name, structname, dtype='dict'):
     if r < 1:
         return None
 
+    event_names = log.get('apss_event_names', [])
+
     if mod_type == 'struct darshan_apss_header_record **':
-      hdr = ffi.cast(mod_type, buf)
-      rec['id'] = hdr[0].base_rec.id
-      rec['rank'] = hdr[0].base_rec.rank
-      rec['nblades'] = hdr[0].nblades
-      rec['nchassis'] = hdr[0].nchassis
-      rec['ngroups'] = hdr[0].ngroups
-      rec['appid'] = hdr[0].appid
+      rec = _get_apss_header(ffi, ffi.cast(mod_type, buf)[0])
+      # kept with the log, for the records that follow its header
+      log['apss_event_names'] = rec['event_names']
+    elif ffi.cast('struct darshan_apss_sample_record **', buf)[0].magic == APSS_SAMPLE_MAGIC:
+      rec = _get_apss_sample(ffi, ffi.cast('struct darshan_apss_sample_record **', buf)[0], event_names)
+    elif ffi.cast('struct darshan_apss_placement_record **', buf)[0].magic == APSS_PLACEMENT_MAGIC:
+      rec = _get_apss_placement(ffi, ffi.cast('struct darshan_apss_placement_record **', buf)[0])
     else:
+      rec = {}
       prf = ffi.cast(mod_type, buf)
       rec['id'] = prf[0].base_rec.id
       rec['rank'] = prf[0].base_rec.rank
@@ -63,15 +215,75 @@ def log_get_apss_record(log, mod_name, structname, dtype='dict'):
       rec['chassis'] = prf[0].chassis
       rec['blade'] = prf[0].blade
       rec['node'] = prf[0].node
-      
-      lst = []
-      for i in range(0, len(prf[0].counters)):
-        lst.append(prf[0].counters[i])
-      np_counters = np.array(lst, dtype=np.uint64)
-      d_counters = dict(zip(counter_names(mod_name), np_counters))
-      
-      rec['counters'] = {}
-      rec['counters'].update(d_counters)
-       
+
+      # a view of the record, which the backend leaves allocated
+      count = min(len(event_names), prf[0].event_count)
+      np_counters = np.frombuffer(ffi.buffer(prf[0].counters, count * 8),
+                                  dtype=np.uint64)
+      if dtype == 'numpy':
+        rec['counters'] = np_counters
+      else:
+        rec['counters'] = dict(zip(['APSS_' + name for name in event_names], np_counters))
+
     return rec
 
+
+# load all the records of the log at once. The perf records, one per
+# router, are copied whole into a numpy structured array, of which
+# 'counters' is a 2-D view (routers x events) named by 'counter_names';
+# the header, sample and placement records are decoded as by
+# log_get_apss_record. Reads the records of the module left in the log, so
+# is called on a log whose APSS records were not read yet.
+def log_get_apss_records(log, mod_name='APSS'):
+    from darshan.backend.cffi_backend import ffi, libdutil, log_get_modules
+
+    modules = log_get_modules(log)
+    idx = modules[mod_name]['idx']
+
+    dt = _struct_dtype(ffi, 'struct darshan_apss_perf_record', APSS_MAX_EVENTS)
+    recs = np.zeros(1024, dtype=dt)
+    base = ffi.cast('char *', ffi.from_buffer(recs))
+
+    hdr = None
+    event_names = log.get('apss_event_names', [])
+    samples = []
+    placement = None
+    count = 0
+    # one buffer, which darshan_log_get_record reuses for every record
+    buf = ffi.new("void **")
+    while libdutil.darshan_log_get_record(log['handle'], idx, buf) > 0:
+      magic = ffi.cast('struct darshan_apss_header_record *', buf[0]).magic
+      if magic == APSS_MAGIC:
+        hdr = _get_apss_header(ffi, ffi.cast('struct darshan_apss_header_record *', buf[0]))
+        event_names = hdr['event_names']
+        log['apss_event_names'] = event_names
+      elif magic == APSS_SAMPLE_MAGIC:
+        samples.append(_get_apss_sample(ffi, ffi.cast('struct darshan_apss_sample_record *', buf[0]), event_names))
+      elif magic == APSS_PLACEMENT_MAGIC:
+        placement = _get_apss_placement(ffi, ffi.cast('struct darshan_apss_placement_record *', buf[0]))
+      else:
+        if count == len(recs):
+          recs = np.concatenate((recs, np.zeros(len(recs), dtype=dt)))
+          base = ffi.cast('char *', ffi.from_buffer(recs))
+        prf = ffi.cast('struct darshan_apss_perf_record *', buf[0])
+        ffi.memmove(base + count * dt.itemsize, prf,
+            ffi.sizeof('struct darshan_apss_perf_record') + prf.event_count * 8)
+        count += 1
+    if buf[0] != ffi.NULL and hasattr(libdutil, 'darshan_free'):
+      libdutil.darshan_free(buf[0])
+
+    recs = recs[:count]
+    return {
+      'header': hdr,
+      'records': recs,
+      'id': recs['base_rec']['id'],
+      'rank': recs['base_rec']['rank'],
+      'group': recs['group'],
+      'chassis': recs['chassis'],
+      'blade': recs['blade'],
+      'node': recs['node'],
+      'counters': recs['counters'][:, :len(event_names)],
+      'counter_names': ['APSS_' + name for name in event_names],
+      'samples': samples,
+      'placement': placement,
+    }
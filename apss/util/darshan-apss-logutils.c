@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -20,17 +21,48 @@
 #include "darshan-logutils.h"
 #include "darshan-apss-log-format.h"
 
-/* counter name strings for the apss module */
+/* counter name strings for the APSS module */
 #define Y(a) #a,
-#define X(a) Y(apss_ ## a)
+#define X(a) Y(APSS_ ## a)
 #define Z(a) #a
 char *apss_counter_names[] = {
-    apss_PERF_COUNTERS
+    APSS_PERF_COUNTERS
 };
 #undef Y
 #undef X
 #undef Z
 
+/* default PAPI event names, for logs that do not record their event set */
+#define X(a) #a,
+#define Z(a) #a
+static char *apss_default_events[] = {
+    APSS_PERF_COUNTERS
+};
+#undef X
+#undef Z
+
+/* v1 records, before the event set was recorded, lack the event count
+ * and name table of the header record and the event count of the perf
+ * record, which had one counter per default event: the default event
+ * list has not changed since
+ */
+#define APSS_V1_NUM_INDICES (sizeof(apss_default_events) / sizeof(*apss_default_events) - 1)
+#define APSS_V1_HEADER_SIZE offsetof(struct darshan_apss_header_record, event_count)
+#define APSS_V1_PERF_SIZE offsetof(struct darshan_apss_perf_record, event_count)
+
+/* room for the largest header or perf record of any version; the read
+ * buffer is only grown past it for sample and placement records
+ */
+#define APSS_REC_BUF_SIZE (sizeof(struct darshan_apss_header_record) + \
+    APSS_MAX_EVENTS * APSS_EVENT_NAME_MAX)
+
+/* names of the PAPI events, taken from the header record; a log's header
+ * is printed before its perf records, and the names are kept per thread so
+ * that threads printing different logs do not see each other's
+ */
+static __thread int apss_event_count;
+static __thread char apss_event_names[APSS_MAX_EVENTS][APSS_EVENT_NAME_MAX];
+
 static int darshan_log_get_apss_rec(darshan_fd fd, void** buf_p);
 static int darshan_log_put_apss_rec(darshan_fd fd, void* buf);
 static void darshan_log_print_apss_rec(void *file_rec,
@@ -38,6 +70,7 @@ static void darshan_log_print_apss_rec(void *file_rec,
 static void darshan_log_print_apss_description(int ver);
 static void darshan_log_print_apss_rec_diff(void *file_rec1, char *file_name1,
     void *file_rec2, char *file_name2);
+static void darshan_log_agg_apss_recs(void *rec, void *agg_rec, int init_flag);
 
 struct darshan_mod_logutil_funcs apss_logutils =
 {
@@ -46,34 +79,226 @@ struct darshan_mod_logutil_funcs apss_logutils =
     .log_print_record = &darshan_log_print_apss_rec,
     .log_print_description = &darshan_log_print_apss_description,
     .log_print_diff = &darshan_log_print_apss_rec_diff,
-    .log_agg_records = NULL
+    .log_agg_records = &darshan_log_agg_apss_recs
 };
 
+/* fill in the default event set of a v1 header record, which predates it */
+static void darshan_log_convert_apss_v1_header_rec(struct darshan_apss_header_record *hdr_rec)
+{
+    char *names = (char *)(hdr_rec + 1);
+    uint64_t size = 0;
+    size_t len;
+    int i;
+
+    hdr_rec->event_count = APSS_V1_NUM_INDICES;
+    for (i = 0; i < APSS_V1_NUM_INDICES; i++)
+    {
+        len = strlen(apss_default_events[i]);
+        memcpy(names + size, apss_default_events[i], len + 1);
+        size += len + 1;
+    }
+    hdr_rec->event_names_size = APSS_EVENT_NAMES_SIZE(size);
+    memset(names + size, 0, hdr_rec->event_names_size - size);
+
+    return;
+}
+
+/* remember the event names of a header record for printing perf records */
+static void darshan_log_save_apss_event_names(struct darshan_apss_header_record *hdr_rec)
+{
+    char *names = (char *)(hdr_rec + 1);
+    uint64_t off = 0;
+    size_t len;
+    int i;
+
+    apss_event_count = hdr_rec->event_count;
+    if (apss_event_count > APSS_MAX_EVENTS)
+        apss_event_count = APSS_MAX_EVENTS;
+    for (i = 0; i < apss_event_count; i++)
+    {
+        len = off < hdr_rec->event_names_size ?
+            strnlen(names + off, hdr_rec->event_names_size - off) : 0;
+        snprintf(apss_event_names[i], APSS_EVENT_NAME_MAX, "%.*s", (int)len,
+            names + off);
+        off += len + 1;
+    }
+
+    return;
+}
+
+/* name of the ith counter of a perf record, as printed */
+static char *darshan_log_apss_counter_name(int i)
+{
+    static __thread char name[APSS_EVENT_NAME_MAX + 8];
+
+    snprintf(name, sizeof(name), "APSS_%s", apss_event_names[i]);
+
+    return(name);
+}
+
+/* counters of a perf record that have a name in the last header record */
+static int darshan_log_apss_counter_count(struct darshan_apss_perf_record *prf_rec)
+{
+    if (prf_rec->event_count < apss_event_count)
+        return(prf_rec->event_count);
+    return(apss_event_count);
+}
+
+/* name of the ith counter of a sample, as printed */
+static char *darshan_log_apss_sample_name(int i)
+{
+    static __thread char name[APSS_EVENT_NAME_MAX + 16];
+
+    snprintf(name, sizeof(name), "APSS_SAMPLE_%s", apss_event_names[i]);
+
+    return(name);
+}
+
+/* decode the varint at *off of a sample record's data, moving *off past it */
+static uint64_t darshan_log_get_apss_varint(unsigned char *data, uint64_t size,
+    uint64_t *off)
+{
+    uint64_t val = 0;
+    int shift = 0;
+    unsigned char b;
+
+    do
+    {
+        if (*off >= size)
+            return(val);
+        b = data[(*off)++];
+        if (shift < 64)
+            val |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+
+    return(val);
+}
+
+/* print the summary of a sample record, then each sample as its end time
+ * followed by the events that increased during it
+ */
+static void darshan_log_print_apss_samples(struct darshan_apss_sample_record *smp_rec)
+{
+    unsigned char *data = (unsigned char *)(smp_rec + 1);
+    uint64_t off = 0;
+    uint64_t delta;
+    uint64_t s;
+    double time = smp_rec->start_time;
+    int i;
+
+    DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APSS_GROUP", smp_rec->group, "", "", "");
+    DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APSS_CHASSIS", smp_rec->chassis, "", "", "");
+    DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APSS_BLADE", smp_rec->blade, "", "", "");
+    DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APSS_NODE", smp_rec->node, "", "", "");
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APSS_SAMPLE_INTERVAL", smp_rec->interval, "", "", "");
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APSS_SAMPLE_COUNT", smp_rec->sample_count, "", "", "");
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APSS_SAMPLE_DROPPED", smp_rec->dropped_count, "", "", "");
+    DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APSS_SAMPLE_START_TIME", smp_rec->start_time, "", "", "");
+
+    for (s = 0; s < smp_rec->sample_count; s++)
+    {
+        time += darshan_log_get_apss_varint(data, smp_rec->data_size, &off) / 1e6;
+        DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+            smp_rec->base_rec.rank, smp_rec->base_rec.id,
+            "APSS_SAMPLE_TIME", time, "", "", "");
+        for (i = 0; i < apss_event_count; i++)
+        {
+            delta = darshan_log_get_apss_varint(data, smp_rec->data_size, &off);
+            if (delta)
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+                    smp_rec->base_rec.rank, smp_rec->base_rec.id,
+                    darshan_log_apss_sample_name(i), delta, "", "", "");
+        }
+    }
+
+    return;
+}
+
+/* print the number of routers used by the job, then each router with
+ * the number of ranks on it
+ */
+static void darshan_log_print_apss_placement(
+    struct darshan_apss_placement_record *plc_rec)
+{
+    struct darshan_apss_router_entry *entry =
+        (struct darshan_apss_router_entry *)(plc_rec + 1);
+    uint64_t r;
+
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+        plc_rec->base_rec.rank, plc_rec->base_rec.id,
+        "APSS_PLACEMENT_ROUTERS", plc_rec->router_count, "", "", "");
+
+    for (r = 0; r < plc_rec->router_count; r++)
+    {
+        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+            plc_rec->base_rec.rank, plc_rec->base_rec.id,
+            "APSS_ROUTER_GROUP", entry[r].group, "", "", "");
+        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+            plc_rec->base_rec.rank, plc_rec->base_rec.id,
+            "APSS_ROUTER_CHASSIS", entry[r].chassis, "", "", "");
+        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+            plc_rec->base_rec.rank, plc_rec->base_rec.id,
+            "APSS_ROUTER_BLADE", entry[r].blade, "", "", "");
+        DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+            plc_rec->base_rec.rank, plc_rec->base_rec.id,
+            "APSS_ROUTER_RANKS", entry[r].ranks, "", "", "");
+    }
+
+    return;
+}
+
 static int darshan_log_get_apss_rec(darshan_fd fd, void** buf_p)
 {
     struct darshan_apss_header_record *hdr_rec;
     struct darshan_apss_perf_record *prf_rec;
-    int rec_len;
+    struct darshan_apss_sample_record *smp_rec;
+    struct darshan_apss_placement_record *plc_rec;
+    struct darshan_apss_router_entry *entry;
+    uint64_t tail_len = 0;
+    int prefix_len = offsetof(struct darshan_apss_sample_record, group);
+    int rec_len = 0;
+    int tail_off = 0;
+    int ver;
+    int64_t magic;
     char *buffer;
+    char *tmp;
     int i;
     int ret = -1;
-    static int first_rec = 1;
+    int is_hdr = 0;
+    int is_smp = 0;
+    int is_plc = 0;
 
-    if(fd->mod_map[DARSHAN_apss_MOD].len == 0)
+    if(fd->mod_map[DARSHAN_APSS_MOD].len == 0)
         return(0);
 
-    if(fd->mod_ver[DARSHAN_apss_MOD] == 0 ||
-        fd->mod_ver[DARSHAN_apss_MOD] > apss_VER)
+    ver = fd->mod_ver[DARSHAN_APSS_MOD];
+    if(ver == 0 || ver > APSS_VER)
     {
-        fprintf(stderr, "Error: Invalid apss module version number (got %d)\n",
-            fd->mod_ver[DARSHAN_apss_MOD]);
+        fprintf(stderr, "Error: Invalid APSS module version number (got %d)\n",
+            fd->mod_ver[DARSHAN_APSS_MOD]);
         return(-1);
     }
 
     if (!*buf_p)
     {
-        /* assume this is the largest possible record size */
-        buffer = malloc(sizeof(struct darshan_apss_perf_record));
+        buffer = malloc(APSS_REC_BUF_SIZE);
         if (!buffer)
         {
             return(-1);
@@ -84,91 +309,237 @@ static int darshan_log_get_apss_rec(darshan_fd fd, void** buf_p)
         buffer = *buf_p;
     }
 
-    if (fd->mod_ver[DARSHAN_apss_MOD] < apss_VER)
+    /* the start shared by all records tells the header, sample and
+     * placement records apart by their magic; perf records have their
+     * group there
+     */
+    ret = darshan_log_get_mod(fd, DARSHAN_APSS_MOD, buffer, prefix_len);
+    if (ret <= 0)
     {
-        /* perform conversion as needed */
+        if (!*buf_p) free(buffer);
+        return(ret < 0 ? -1 : 0);
+    }
+    if (ret != prefix_len)
+    {
+        if (!*buf_p) free(buffer);
+        return(-1);
     }
 
-    /* v1, current version */
-    if (fd->mod_ver[DARSHAN_apss_MOD] == apss_VER)
+    magic = ((struct darshan_apss_sample_record *)buffer)->magic;
+    if (fd->swap_flag)
+        DARSHAN_BSWAP64(&magic);
+    is_hdr = magic == APSS_MAGIC;
+    is_smp = !is_hdr && ver > 1 && magic == APSS_SAMPLE_MAGIC;
+    is_plc = !is_hdr && ver > 1 && magic == APSS_PLACEMENT_MAGIC;
+
+    /* each record is a fixed part followed by a tail, the size of which
+     * the fixed part gives; v1 header records have no tail, and the
+     * counters of v1 perf records are read to where they now start
+     */
+    if (is_hdr)
     {
-        if (first_rec)
-        {
-            rec_len = sizeof(struct darshan_apss_header_record);
-            first_rec = 0;
-        }
-        else
-            rec_len = sizeof(struct darshan_apss_perf_record);
+        rec_len = ver == 1 ? APSS_V1_HEADER_SIZE : sizeof(*hdr_rec);
+        tail_off = sizeof(*hdr_rec);
+    }
+    else if (is_smp)
+        rec_len = tail_off = sizeof(*smp_rec);
+    else if (is_plc)
+        rec_len = tail_off = sizeof(*plc_rec);
+    else
+    {
+        rec_len = ver == 1 ? APSS_V1_PERF_SIZE : sizeof(*prf_rec);
+        tail_off = sizeof(*prf_rec);
+    }
 
-        ret = darshan_log_get_mod(fd, DARSHAN_apss_MOD, buffer, rec_len);
+    ret = darshan_log_get_mod(fd, DARSHAN_APSS_MOD, buffer + prefix_len,
+        rec_len - prefix_len);
+    if (ret != rec_len - prefix_len)
+    {
+        if (!*buf_p) free(buffer);
+        return(-1);
     }
 
-    if (ret == rec_len)
+    if (is_hdr)
     {
-        if(fd->swap_flag)
+        hdr_rec = (struct darshan_apss_header_record *)buffer;
+        if (fd->swap_flag)
         {
-            if (rec_len == sizeof(struct darshan_apss_header_record))
-            {
-                hdr_rec = (struct darshan_apss_header_record*)buffer; 
-                /* swap bytes if necessary */
-                DARSHAN_BSWAP64(&(hdr_rec->base_rec.id));
-                DARSHAN_BSWAP64(&(hdr_rec->base_rec.rank));
-                DARSHAN_BSWAP64(&(hdr_rec->magic));
-                DARSHAN_BSWAP64(&(hdr_rec->nblades));
-                DARSHAN_BSWAP64(&(hdr_rec->nchassis));
-                DARSHAN_BSWAP64(&(hdr_rec->ngroups));
-                DARSHAN_BSWAP64(&(hdr_rec->appid));
-            }
-            else
+            DARSHAN_BSWAP64(&(hdr_rec->base_rec.id));
+            DARSHAN_BSWAP64(&(hdr_rec->base_rec.rank));
+            DARSHAN_BSWAP64(&(hdr_rec->magic));
+            DARSHAN_BSWAP64(&(hdr_rec->nblades));
+            DARSHAN_BSWAP64(&(hdr_rec->nchassis));
+            DARSHAN_BSWAP64(&(hdr_rec->ngroups));
+            DARSHAN_BSWAP64(&(hdr_rec->appid));
+            if (ver > 1)
             {
-                prf_rec = (struct darshan_apss_perf_record*)buffer;
-                DARSHAN_BSWAP64(&(prf_rec->base_rec.id));
-                DARSHAN_BSWAP64(&(prf_rec->base_rec.rank));
-                DARSHAN_BSWAP64(&(prf_rec->group));
-                DARSHAN_BSWAP64(&(prf_rec->chassis));
-                DARSHAN_BSWAP64(&(prf_rec->blade));
-                DARSHAN_BSWAP64(&(prf_rec->node));
-                for (i = 0; i < apss_NUM_INDICES; i++)
-                {
-                    DARSHAN_BSWAP64(&prf_rec->counters[i]);
-                }
+                DARSHAN_BSWAP64(&(hdr_rec->event_count));
+                DARSHAN_BSWAP64(&(hdr_rec->event_names_size));
             }
         }
-        *buf_p = buffer;
-        return(1);
+        if (ver > 1 && (hdr_rec->event_count > APSS_MAX_EVENTS ||
+            hdr_rec->event_names_size > APSS_MAX_EVENTS * APSS_EVENT_NAME_MAX))
+        {
+            fprintf(stderr, "Error: invalid APSS header record size\n");
+            if (!*buf_p) free(buffer);
+            return(-1);
+        }
+        tail_len = ver == 1 ? 0 : hdr_rec->event_names_size;
     }
-    else if (ret < 0)
+    else if (is_smp)
     {
-     //*buf_p = NULL;
-     //  if (buffer) free(buffer);
-        if (!*buf_p) free(buffer);
-        return(-1);
+        smp_rec = (struct darshan_apss_sample_record *)buffer;
+        if (fd->swap_flag)
+        {
+            DARSHAN_BSWAP64(&(smp_rec->base_rec.id));
+            DARSHAN_BSWAP64(&(smp_rec->base_rec.rank));
+            DARSHAN_BSWAP64(&(smp_rec->magic));
+            DARSHAN_BSWAP64(&(smp_rec->group));
+            DARSHAN_BSWAP64(&(smp_rec->chassis));
+            DARSHAN_BSWAP64(&(smp_rec->blade));
+            DARSHAN_BSWAP64(&(smp_rec->node));
+            DARSHAN_BSWAP64(&(smp_rec->interval));
+            DARSHAN_BSWAP64(&(smp_rec->sample_count));
+            DARSHAN_BSWAP64(&(smp_rec->dropped_count));
+            DARSHAN_BSWAP64(&(smp_rec->data_size));
+            DARSHAN_BSWAP64(&(smp_rec->start_time));
+        }
+        if (smp_rec->data_size > APSS_SAMPLE_MAX_BYTES)
+        {
+            fprintf(stderr, "Error: invalid APSS sample record size\n");
+            if (!*buf_p) free(buffer);
+            return(-1);
+        }
+        tail_len = smp_rec->data_size;
+    }
+    else if (is_plc)
+    {
+        plc_rec = (struct darshan_apss_placement_record *)buffer;
+        if (fd->swap_flag)
+        {
+            DARSHAN_BSWAP64(&(plc_rec->base_rec.id));
+            DARSHAN_BSWAP64(&(plc_rec->base_rec.rank));
+            DARSHAN_BSWAP64(&(plc_rec->magic));
+            DARSHAN_BSWAP64(&(plc_rec->router_count));
+        }
+        if (plc_rec->router_count > APSS_MAX_ROUTERS)
+        {
+            fprintf(stderr, "Error: invalid APSS placement record size\n");
+            if (!*buf_p) free(buffer);
+            return(-1);
+        }
+        tail_len = plc_rec->router_count *
+            sizeof(struct darshan_apss_router_entry);
     }
     else
     {
-     //  *buf_p = NULL;
-     //  if (buffer) free(buffer);
+        prf_rec = (struct darshan_apss_perf_record *)buffer;
+        if (fd->swap_flag)
+        {
+            DARSHAN_BSWAP64(&(prf_rec->base_rec.id));
+            DARSHAN_BSWAP64(&(prf_rec->base_rec.rank));
+            DARSHAN_BSWAP64(&(prf_rec->group));
+            DARSHAN_BSWAP64(&(prf_rec->chassis));
+            DARSHAN_BSWAP64(&(prf_rec->blade));
+            DARSHAN_BSWAP64(&(prf_rec->node));
+            if (ver > 1)
+                DARSHAN_BSWAP64(&(prf_rec->event_count));
+        }
+        if (ver == 1)
+            prf_rec->event_count = APSS_V1_NUM_INDICES;
+        if (prf_rec->event_count > APSS_MAX_EVENTS)
+        {
+            fprintf(stderr, "Error: invalid APSS perf record size\n");
+            if (!*buf_p) free(buffer);
+            return(-1);
+        }
+        tail_len = prf_rec->event_count * sizeof(uint64_t);
+    }
+
+    /* samples and routers may not fit the buffer, which is left large
+     * enough for any header or perf record read into it next
+     */
+    tmp = buffer;
+    if (tail_off + tail_len > APSS_REC_BUF_SIZE)
+        tmp = realloc(buffer, tail_off + tail_len);
+    if (!tmp)
+    {
         if (!*buf_p) free(buffer);
-        return(0);
+        return(-1);
+    }
+    if (*buf_p)
+        *buf_p = tmp;
+    buffer = tmp;
+
+    if (tail_len > 0)
+    {
+        ret = darshan_log_get_mod(fd, DARSHAN_APSS_MOD, buffer + tail_off,
+            tail_len);
+        if (ret != tail_len)
+        {
+            if (!*buf_p) free(buffer);
+            return(-1);
+        }
     }
+
+    /* sample data and event names are bytes, but counters and router
+     * entries need a swap
+     */
+    if (is_hdr)
+    {
+        hdr_rec = (struct darshan_apss_header_record *)buffer;
+        if (ver == 1)
+            darshan_log_convert_apss_v1_header_rec(hdr_rec);
+        else if (hdr_rec->event_names_size > 0)
+            /* names never run past the table */
+            ((char *)(hdr_rec + 1))[hdr_rec->event_names_size - 1] = '\0';
+    }
+    else if (is_plc && fd->swap_flag)
+    {
+        plc_rec = (struct darshan_apss_placement_record *)buffer;
+        entry = (struct darshan_apss_router_entry *)(plc_rec + 1);
+        for (i = 0; i < plc_rec->router_count; i++)
+        {
+            DARSHAN_BSWAP32(&(entry[i].group));
+            DARSHAN_BSWAP32(&(entry[i].chassis));
+            DARSHAN_BSWAP32(&(entry[i].blade));
+            DARSHAN_BSWAP32(&(entry[i].ranks));
+        }
+    }
+    else if (!is_smp && !is_plc && fd->swap_flag)
+    {
+        prf_rec = (struct darshan_apss_perf_record *)buffer;
+        for (i = 0; i < prf_rec->event_count; i++)
+        {
+            DARSHAN_BSWAP64(&prf_rec->counters[i]);
+        }
+    }
+
+    *buf_p = buffer;
+    return(1);
 }
 
 static int darshan_log_put_apss_rec(darshan_fd fd, void* buf)
 {
     int ret;
     int rec_len;
-    static int first_rec = 1;
+    struct darshan_apss_header_record *hdr_rec = buf;
+    struct darshan_apss_sample_record *smp_rec = buf;
+    struct darshan_apss_placement_record *plc_rec = buf;
+    struct darshan_apss_perf_record *prf_rec = buf;
 
-    if (first_rec)
-    {
-        rec_len = sizeof(struct darshan_apss_header_record);
-        first_rec = 0;
-    }
+    if (hdr_rec->magic == APSS_MAGIC)
+        rec_len = sizeof(*hdr_rec) + hdr_rec->event_names_size;
+    else if (smp_rec->magic == APSS_SAMPLE_MAGIC)
+        rec_len = sizeof(*smp_rec) + smp_rec->data_size;
+    else if (plc_rec->magic == APSS_PLACEMENT_MAGIC)
+        rec_len = sizeof(*plc_rec) + plc_rec->router_count *
+            sizeof(struct darshan_apss_router_entry);
     else
-        rec_len = sizeof(struct darshan_apss_perf_record);
-    
-    ret = darshan_log_put_mod(fd, DARSHAN_apss_MOD, buf,
-                              rec_len, apss_VER);
+        rec_len = sizeof(*prf_rec) + prf_rec->event_count * sizeof(uint64_t);
+
+    ret = darshan_log_put_mod(fd, DARSHAN_APSS_MOD, buf,
+                              rec_len, APSS_VER);
     if(ret < 0)
         return(-1);
 
@@ -179,50 +550,60 @@ static void darshan_log_print_apss_rec(void *rec, char *file_name,
     char *mnt_pt, char *fs_type)
 {
     int i;
-    static int first_rec = 1;
     struct darshan_apss_header_record *hdr_rec;
     struct darshan_apss_perf_record *prf_rec;
     
-    if (first_rec)
+    if (((struct darshan_apss_header_record *)rec)->magic == APSS_MAGIC)
     { 
         hdr_rec = rec;
-        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+            hdr_rec->base_rec.rank, hdr_rec->base_rec.id,
+            "APSS_GROUPS", hdr_rec->ngroups, "", "", "");
+        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
             hdr_rec->base_rec.rank, hdr_rec->base_rec.id,
-            "apss_GROUPS", hdr_rec->ngroups, "", "", "");
-        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            "APSS_CHASSIS", hdr_rec->nchassis, "", "", "");
+        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
             hdr_rec->base_rec.rank, hdr_rec->base_rec.id,
-            "apss_CHASSIS", hdr_rec->nchassis, "", "", "");
-        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            "APSS_BLADES", hdr_rec->nblades, "", "", "");
+        DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
             hdr_rec->base_rec.rank, hdr_rec->base_rec.id,
-            "apss_BLADES", hdr_rec->nblades, "", "", "");
-        DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            "APSS_APPLICATION_ID", hdr_rec->appid, "", "", "");
+        DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
             hdr_rec->base_rec.rank, hdr_rec->base_rec.id,
-            "apss_APPLICATION_ID", hdr_rec->appid, "", "", "");
-        first_rec = 0;
+            "APSS_EVENT_COUNT", hdr_rec->event_count, "", "", "");
+        darshan_log_save_apss_event_names(hdr_rec);
+    }
+    else if (((struct darshan_apss_sample_record *)rec)->magic == APSS_SAMPLE_MAGIC)
+    {
+        darshan_log_print_apss_samples(rec);
+    }
+    else if (((struct darshan_apss_placement_record *)rec)->magic == APSS_PLACEMENT_MAGIC)
+    {
+        darshan_log_print_apss_placement(rec);
     }
     else
     {
         prf_rec = rec;
         
-        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
             prf_rec->base_rec.rank, prf_rec->base_rec.id,
-            "apss_GROUP", prf_rec->group, "", "", "");
-        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            "APSS_GROUP", prf_rec->group, "", "", "");
+        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
             prf_rec->base_rec.rank, prf_rec->base_rec.id,
-            "apss_CHASSIS", prf_rec->chassis, "", "", "");
-        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            "APSS_CHASSIS", prf_rec->chassis, "", "", "");
+        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
             prf_rec->base_rec.rank, prf_rec->base_rec.id,
-            "apss_BLADE", prf_rec->blade, "", "", "");
-        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            "APSS_BLADE", prf_rec->blade, "", "", "");
+        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
             prf_rec->base_rec.rank, prf_rec->base_rec.id,
-            "apss_NODE", prf_rec->node, "", "", "");
+            "APSS_NODE", prf_rec->node, "", "", "");
 
-        for(i = 0; i < apss_NUM_INDICES; i++)
+        for(i = 0; i < darshan_log_apss_counter_count(prf_rec); i++)
         {
             
-            DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 prf_rec->base_rec.rank, prf_rec->base_rec.id,
-                apss_counter_names[i], prf_rec->counters[i],
+                darshan_log_apss_counter_name(i), prf_rec->counters[i],
                 "", "", "");
         }
     }
@@ -232,22 +613,114 @@ static void darshan_log_print_apss_rec(void *rec, char *file_name,
 
 static void darshan_log_print_apss_description(int ver)
 {
-    printf("\n# description of apss counters:\n");
-    printf("#   global summary stats for the apss module:\n");
-    printf("#     apss_GROUPS: total number of groups\n");
-    printf("#     apss_CHASSIS: total number of chassis\n");
-    printf("#     apss_BLADES: total number of blades\n");
-    printf("#   per-router statistics for the apss module:\n");
-    printf("#     apss_GROUP:   group this router is on\n");
-    printf("#     apss_CHASSIS: chassis this router is on\n");
-    printf("#     apss_BLADE:   blade this router is on\n");
-    printf("#     apss_NODE:    node connected to this router\n");
-    printf("#     apss_AR_RTR_* port counters for the 40 router-router ports\n");
-    printf("#     apss_AR_RTR_x_y_INQ_PRF_INCOMING_FLIT_VC[0-7]: flits on VCs of x y tile\n");
-    printf("#     apss_AR_RTR_x_y_INQ_PRF_ROWBUS_STALL_CNT: stalls on x y tile\n");
-    printf("#     apss_AR_RTR_PT_* port counters for the 8 router-nic ports\n");
-    printf("#     apss_AR_RTR_PT_x_y_INQ_PRF_INCOMING_FLIT_VC[0,4]: flits on VCs of x y tile\n");
-    printf("#     apss_AR_RTR_PT_x_y_INQ_PRF_REQ_ROWBUS_STALL_CNT: stalls on x y tile\n"); 
+    printf("\n# description of APSS counters:\n");
+    printf("#   global summary stats for the APSS module:\n");
+    printf("#     APSS_GROUPS: total number of groups\n");
+    printf("#     APSS_CHASSIS: total number of chassis\n");
+    printf("#     APSS_BLADES: total number of blades\n");
+    printf("#     APSS_EVENT_COUNT: number of PAPI events counted on each router\n");
+    printf("#   per-router statistics for the APSS module:\n");
+    printf("#     APSS_GROUP:   group this router is on (cabinet on EX)\n");
+    printf("#     APSS_CHASSIS: chassis this router is on\n");
+    printf("#     APSS_BLADE:   blade this router is on (slot on EX)\n");
+    printf("#     APSS_NODE:    node connected to this router (2 * board + node on EX)\n");
+    printf("#     APSS_<event>: count of each PAPI event, set with DARSHAN_APSS_EVENTS or\n");
+    printf("#       DARSHAN_APSS_EVENTS_FILE; with DARSHAN_APSS_BACKEND=cxi, the CXI telemetry\n");
+    printf("#       counter of that name in lower case, summed over the NICs of the node;\n");
+    printf("#       the default events are:\n");
+    printf("#     APSS_AR_RTR_* port counters for the 40 router-router ports\n");
+    printf("#     APSS_AR_RTR_x_y_INQ_PRF_INCOMING_FLIT_VC[0-7]: flits on VCs of x y tile\n");
+    printf("#     APSS_AR_RTR_x_y_INQ_PRF_ROWBUS_STALL_CNT: stalls on x y tile\n");
+    printf("#     APSS_AR_RTR_PT_* port counters for the 8 router-nic ports\n");
+    printf("#     APSS_AR_RTR_PT_x_y_INQ_PRF_INCOMING_FLIT_VC[0,4]: flits on VCs of x y tile\n");
+    printf("#     APSS_AR_RTR_PT_x_y_INQ_PRF_REQ_ROWBUS_STALL_CNT: stalls on x y tile\n"); 
+    printf("#   per-router samples for the APSS module, with DARSHAN_APSS_SAMPLE_INTERVAL set:\n");
+    printf("#     APSS_SAMPLE_INTERVAL: requested time between samples in microseconds\n");
+    printf("#     APSS_SAMPLE_COUNT: number of samples held\n");
+    printf("#     APSS_SAMPLE_DROPPED: oldest samples dropped when the buffer of\n");
+    printf("#       DARSHAN_APSS_SAMPLE_BYTES filled up\n");
+    printf("#     APSS_SAMPLE_START_TIME: time the first sample counts from, in seconds\n");
+    printf("#     APSS_SAMPLE_TIME: end time of a sample, followed by\n");
+    printf("#     APSS_SAMPLE_<event>: increase of each event during that sample, if any\n");
+    printf("#   router placement map for the APSS module:\n");
+    printf("#     APSS_PLACEMENT_ROUTERS: number of routers used by the job, each as\n");
+    printf("#     APSS_ROUTER_GROUP, APSS_ROUTER_CHASSIS, APSS_ROUTER_BLADE: router position\n");
+    printf("#     APSS_ROUTER_RANKS: number of ranks on that router\n");
+
+    return;
+}
+
+/* print the summary of one sample record, prefixed with sign */
+static void darshan_log_print_apss_sample_summary(
+    struct darshan_apss_sample_record *smp_rec, char *sign)
+{
+    printf("%s", sign);
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APSS_SAMPLE_INTERVAL", smp_rec->interval, "", "", "");
+    printf("%s", sign);
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APSS_SAMPLE_COUNT", smp_rec->sample_count, "", "", "");
+    printf("%s", sign);
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APSS_SAMPLE_DROPPED", smp_rec->dropped_count, "", "", "");
+    printf("%s", sign);
+    DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APSS_SAMPLE_START_TIME", smp_rec->start_time, "", "", "");
+
+    return;
+}
+
+/* sample records only differ when their summary or samples do */
+static void darshan_log_print_apss_sample_diff(
+    struct darshan_apss_sample_record *smp_rec1,
+    struct darshan_apss_sample_record *smp_rec2)
+{
+    if (smp_rec1 && smp_rec2 &&
+        smp_rec1->interval == smp_rec2->interval &&
+        smp_rec1->sample_count == smp_rec2->sample_count &&
+        smp_rec1->dropped_count == smp_rec2->dropped_count &&
+        smp_rec1->start_time == smp_rec2->start_time &&
+        smp_rec1->data_size == smp_rec2->data_size &&
+        memcmp(smp_rec1 + 1, smp_rec2 + 1, smp_rec1->data_size) == 0)
+        return;
+
+    if (smp_rec1)
+        darshan_log_print_apss_sample_summary(smp_rec1, "- ");
+    if (smp_rec2)
+        darshan_log_print_apss_sample_summary(smp_rec2, "+ ");
+
+    return;
+}
+
+/* placement records only differ when their routers do */
+static void darshan_log_print_apss_placement_diff(
+    struct darshan_apss_placement_record *plc_rec1,
+    struct darshan_apss_placement_record *plc_rec2)
+{
+    if (plc_rec1 && plc_rec2 &&
+        plc_rec1->router_count == plc_rec2->router_count &&
+        memcmp(plc_rec1 + 1, plc_rec2 + 1, plc_rec1->router_count *
+            sizeof(struct darshan_apss_router_entry)) == 0)
+        return;
+
+    if (plc_rec1)
+    {
+        printf("- ");
+        DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+            plc_rec1->base_rec.rank, plc_rec1->base_rec.id,
+            "APSS_PLACEMENT_ROUTERS", plc_rec1->router_count, "", "", "");
+    }
+    if (plc_rec2)
+    {
+        printf("+ ");
+        DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+            plc_rec2->base_rec.rank, plc_rec2->base_rec.id,
+            "APSS_PLACEMENT_ROUTERS", plc_rec2->router_count, "", "", "");
+    }
 
     return;
 }
@@ -259,222 +732,255 @@ static void darshan_log_print_apss_rec_diff(void *file_rec1, char *file_name1,
     struct darshan_apss_header_record *hdr_rec2;
     struct darshan_apss_perf_record   *prf_rec1;
     struct darshan_apss_perf_record   *prf_rec2;
+    struct darshan_apss_sample_record *smp_rec1;
+    struct darshan_apss_sample_record *smp_rec2;
+    struct darshan_apss_placement_record *plc_rec1;
+    struct darshan_apss_placement_record *plc_rec2;
 
     hdr_rec1 = (struct darshan_apss_header_record*) file_rec1;
     hdr_rec2 = (struct darshan_apss_header_record*) file_rec2;
     prf_rec1 = (struct darshan_apss_perf_record*) file_rec1;
     prf_rec2 = (struct darshan_apss_perf_record*) file_rec2;
+    smp_rec1 = (struct darshan_apss_sample_record*) file_rec1;
+    smp_rec2 = (struct darshan_apss_sample_record*) file_rec2;
+    plc_rec1 = (struct darshan_apss_placement_record*) file_rec1;
+    plc_rec2 = (struct darshan_apss_placement_record*) file_rec2;
 
-    if (hdr_rec1->magic == apss_MAGIC)
+    if (hdr_rec1->magic == APSS_MAGIC)
     {
         /* this is the header record */
+        darshan_log_save_apss_event_names(hdr_rec1 ? hdr_rec1 : hdr_rec2);
         if (!hdr_rec2)
         {
             printf("- ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec1->base_rec.rank, hdr_rec1->base_rec.id,
-                "apss_GROUPS", hdr_rec1->ngroups, "", "", "");
+                "APSS_GROUPS", hdr_rec1->ngroups, "", "", "");
             printf("- ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec1->base_rec.rank, hdr_rec1->base_rec.id,
-                "apss_CHASSIS", hdr_rec1->nchassis, "", "", "");
+                "APSS_CHASSIS", hdr_rec1->nchassis, "", "", "");
             printf("- ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec1->base_rec.rank, hdr_rec1->base_rec.id,
-                "apss_BLADES", hdr_rec1->nblades, "", "", "");
+                "APSS_BLADES", hdr_rec1->nblades, "", "", "");
             printf("- ");
-            DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec1->base_rec.rank, hdr_rec1->base_rec.id,
-                "apss_APPLICATION_ID", hdr_rec1->appid, "", "", "");
+                "APSS_APPLICATION_ID", hdr_rec1->appid, "", "", "");
         }
         else if (!hdr_rec1)
         {
             printf("+ ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec2->base_rec.rank, hdr_rec2->base_rec.id,
-                "apss_GROUPS", hdr_rec2->ngroups, "", "", "");
+                "APSS_GROUPS", hdr_rec2->ngroups, "", "", "");
             printf("+ ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec2->base_rec.rank, hdr_rec2->base_rec.id,
-                "apss_CHASSIS", hdr_rec2->nchassis, "", "", "");
+                "APSS_CHASSIS", hdr_rec2->nchassis, "", "", "");
             printf("+ ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec2->base_rec.rank, hdr_rec2->base_rec.id,
-                "apss_BLADES", hdr_rec2->nblades, "", "", "");
+                "APSS_BLADES", hdr_rec2->nblades, "", "", "");
             printf("+ ");
-            DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec2->base_rec.rank, hdr_rec2->base_rec.id,
-                "apss_APPLICATION_ID", hdr_rec2->appid, "", "", "");
+                "APSS_APPLICATION_ID", hdr_rec2->appid, "", "", "");
         }
         else
         {
             if (hdr_rec1->ngroups != hdr_rec2->ngroups)
             {
                 printf("- ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec1->base_rec.rank, hdr_rec1->base_rec.id,
-                "apss_GROUPS", hdr_rec1->ngroups, "", "", "");
+                "APSS_GROUPS", hdr_rec1->ngroups, "", "", "");
                 printf("+ ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec2->base_rec.rank, hdr_rec2->base_rec.id,
-                "apss_GROUPS", hdr_rec2->ngroups, "", "", "");
+                "APSS_GROUPS", hdr_rec2->ngroups, "", "", "");
             }
             if (hdr_rec1->nchassis != hdr_rec2->nchassis)
             {
                 printf("- ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec1->base_rec.rank, hdr_rec1->base_rec.id,
-                "apss_CHASSIS", hdr_rec1->nchassis, "", "", "");
+                "APSS_CHASSIS", hdr_rec1->nchassis, "", "", "");
                 printf("+ ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec2->base_rec.rank, hdr_rec2->base_rec.id,
-                "apss_CHASSIS", hdr_rec2->nchassis, "", "", "");
+                "APSS_CHASSIS", hdr_rec2->nchassis, "", "", "");
             }
             if (hdr_rec1->nblades != hdr_rec2->nblades)
             {
                 printf("- ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec1->base_rec.rank, hdr_rec1->base_rec.id,
-                "apss_BLADES", hdr_rec1->nblades, "", "", "");
+                "APSS_BLADES", hdr_rec1->nblades, "", "", "");
 
                 printf("+ ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec2->base_rec.rank, hdr_rec2->base_rec.id,
-                "apss_BLADES", hdr_rec2->nblades, "", "", "");
+                "APSS_BLADES", hdr_rec2->nblades, "", "", "");
             }
             if (hdr_rec1->appid != hdr_rec2->appid)
             {
                 printf("- ");
-                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+                hdr_rec1->base_rec.rank, hdr_rec1->base_rec.id,
+                "APSS_APPLICATION_ID", hdr_rec1->appid, "", "", "");
+
+                printf("+ ");
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
+                hdr_rec2->base_rec.rank, hdr_rec2->base_rec.id,
+                "APSS_APPLICATION_ID", hdr_rec2->appid, "", "", "");
+            }
+            if (hdr_rec1->event_count != hdr_rec2->event_count)
+            {
+                printf("- ");
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec1->base_rec.rank, hdr_rec1->base_rec.id,
-                "apss_APPLICATION_ID", hdr_rec1->appid, "", "", "");
+                "APSS_EVENT_COUNT", hdr_rec1->event_count, "", "", "");
 
                 printf("+ ");
-                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 hdr_rec2->base_rec.rank, hdr_rec2->base_rec.id,
-                "apss_APPLICATION_ID", hdr_rec2->appid, "", "", "");
+                "APSS_EVENT_COUNT", hdr_rec2->event_count, "", "", "");
             }
         }
     }
+    else if ((smp_rec1 ? smp_rec1 : smp_rec2)->magic == APSS_SAMPLE_MAGIC)
+    {
+        darshan_log_print_apss_sample_diff(smp_rec1, smp_rec2);
+    }
+    else if ((plc_rec1 ? plc_rec1 : plc_rec2)->magic == APSS_PLACEMENT_MAGIC)
+    {
+        darshan_log_print_apss_placement_diff(plc_rec1, plc_rec2);
+    }
     else
     {
         if (!prf_rec2)
         {
             printf("- ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                     prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    "apss_GROUP", prf_rec1->group, "", "", "");
+                    "APSS_GROUP", prf_rec1->group, "", "", "");
             printf("- ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                     prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    "apss_CHASSIS", prf_rec1->chassis, "", "", "");
+                    "APSS_CHASSIS", prf_rec1->chassis, "", "", "");
             printf("- ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                     prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    "apss_BLADE", prf_rec1->blade, "", "", "");
+                    "APSS_BLADE", prf_rec1->blade, "", "", "");
             printf("- ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                     prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                    "apss_NODE", prf_rec1->node, "", "", "");
+                    "APSS_NODE", prf_rec1->node, "", "", "");
         }
         else if (!prf_rec1)
         {
             printf("+ ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                     prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    "apss_GROUP", prf_rec2->group, "", "", "");
+                    "APSS_GROUP", prf_rec2->group, "", "", "");
             printf("+ ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                     prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    "apss_CHASSIS", prf_rec2->chassis, "", "", "");
+                    "APSS_CHASSIS", prf_rec2->chassis, "", "", "");
             printf("+ ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                     prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    "apss_BLADE", prf_rec2->blade, "", "", "");
+                    "APSS_BLADE", prf_rec2->blade, "", "", "");
             printf("+ ");
-            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+            DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                     prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                    "apss_NODE", prf_rec2->node, "", "", "");
+                    "APSS_NODE", prf_rec2->node, "", "", "");
         }
         else {
             if (prf_rec1->group != prf_rec2->group)
             {
                 printf("- ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                         prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                        "apss_GROUP", prf_rec1->group, "", "", "");
+                        "APSS_GROUP", prf_rec1->group, "", "", "");
                 printf("+ ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                         prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                        "apss_GROUP", prf_rec2->group, "", "", "");
+                        "APSS_GROUP", prf_rec2->group, "", "", "");
             }
             if (prf_rec1->chassis != prf_rec2->chassis)
             {
                 printf("- ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                         prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                        "apss_CHASSIS", prf_rec1->chassis, "", "", "");
+                        "APSS_CHASSIS", prf_rec1->chassis, "", "", "");
                 printf("+ ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                         prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                        "apss_CHASSIS", prf_rec2->chassis, "", "", "");
+                        "APSS_CHASSIS", prf_rec2->chassis, "", "", "");
             }
             if (prf_rec1->blade != prf_rec2->blade)
             {
                 printf("- ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                         prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                        "apss_BLADE", prf_rec1->blade, "", "", "");
+                        "APSS_BLADE", prf_rec1->blade, "", "", "");
                 printf("+ ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                         prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                        "apss_BLADE", prf_rec2->blade, "", "", "");
+                        "APSS_BLADE", prf_rec2->blade, "", "", "");
             }
             if (prf_rec1->node != prf_rec2->node)
             {
                 printf("- ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                         prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                        "apss_NODE", prf_rec1->node, "", "", "");
+                        "APSS_NODE", prf_rec1->node, "", "", "");
                 printf("+ ");
-                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                         prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                        "apss_NODE", prf_rec2->node, "", "", "");
+                        "APSS_NODE", prf_rec2->node, "", "", "");
             }
         } 
 
-        int i;
-        /* router tile record */
-        for(i = 0; i < apss_NUM_INDICES; i++)
+        int i, n1, n2;
+        /* router tile record; counters only one of the records has are
+         * printed as they are
+         */
+        n1 = prf_rec1 ? darshan_log_apss_counter_count(prf_rec1) : 0;
+        n2 = prf_rec2 ? darshan_log_apss_counter_count(prf_rec2) : 0;
+        for(i = 0; i < n1 || i < n2; i++)
         {
-            if (!prf_rec2)
+            if (i >= n2)
             {
                 printf("- ");
-                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                apss_counter_names[i], prf_rec1->counters[i],
+                darshan_log_apss_counter_name(i), prf_rec1->counters[i],
                 "", "", "");
             }
-            else if (!prf_rec1)
+            else if (i >= n1)
             {
                 printf("+ ");
-                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                apss_counter_names[i], prf_rec2->counters[i],
+                darshan_log_apss_counter_name(i), prf_rec2->counters[i],
                 "", "", "");
             }
             else if (prf_rec1->counters[i] != prf_rec2->counters[i])
             {
                 printf("- ");
-                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                apss_counter_names[i], prf_rec1->counters[i],
+                darshan_log_apss_counter_name(i), prf_rec1->counters[i],
                 "", "", "");
 
                 printf("+ ");
-                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_apss_MOD],
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APSS_MOD],
                 prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                apss_counter_names[i], prf_rec2->counters[i],
+                darshan_log_apss_counter_name(i), prf_rec2->counters[i],
                 "", "", "");
             }
         }
@@ -483,6 +989,64 @@ static void darshan_log_print_apss_rec_diff(void *file_rec1, char *file_name1,
     return;
 }
 
+/* fold the perf record of a router, rec, into the aggregate perf record
+ * agg_rec, which is reset first if init_flag is set. The counters are
+ * summed over the routers, and a topology index is kept only while every
+ * router shares it. Header, sample and placement records are skipped.
+ * agg_rec must have room for APSS_MAX_EVENTS counters.
+ */
+static void darshan_log_agg_apss_recs(void *rec, void *agg_rec, int init_flag)
+{
+    struct darshan_apss_perf_record *prf_rec = rec;
+    struct darshan_apss_perf_record *agg_prf_rec = agg_rec;
+    int64_t magic = ((struct darshan_apss_sample_record *)rec)->magic;
+    int i;
+
+    if (init_flag)
+    {
+        memset(agg_prf_rec, 0, sizeof(*agg_prf_rec));
+        agg_prf_rec->base_rec.rank = -1;
+    }
+
+    if (magic == APSS_MAGIC || magic == APSS_SAMPLE_MAGIC ||
+        magic == APSS_PLACEMENT_MAGIC)
+        return;
+
+    /* an empty aggregate has no record id yet */
+    if (agg_prf_rec->base_rec.id == 0)
+    {
+        agg_prf_rec->base_rec.id = prf_rec->base_rec.id;
+        agg_prf_rec->group = prf_rec->group;
+        agg_prf_rec->chassis = prf_rec->chassis;
+        agg_prf_rec->blade = prf_rec->blade;
+        agg_prf_rec->node = prf_rec->node;
+    }
+    else
+    {
+        if (agg_prf_rec->group != prf_rec->group)
+            agg_prf_rec->group = -1;
+        if (agg_prf_rec->chassis != prf_rec->chassis)
+            agg_prf_rec->chassis = -1;
+        if (agg_prf_rec->blade != prf_rec->blade)
+            agg_prf_rec->blade = -1;
+        if (agg_prf_rec->node != prf_rec->node)
+            agg_prf_rec->node = -1;
+    }
+
+    /* the aggregate grows to the longest record; counters a record does
+     * not have count as 0
+     */
+    for (i = agg_prf_rec->event_count; i < prf_rec->event_count; i++)
+        agg_prf_rec->counters[i] = 0;
+    if (agg_prf_rec->event_count < prf_rec->event_count)
+        agg_prf_rec->event_count = prf_rec->event_count;
+    for (i = 0; i < prf_rec->event_count; i++)
+        agg_prf_rec->counters[i] += prf_rec->counters[i];
+
+    return;
+}
+
+
 /*
  * Local variables:
  *  c-indent-level: 4
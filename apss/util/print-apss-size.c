@@ -7,6 +7,9 @@ int main (int argc, char **argv)
    printf ("APSS_NUM_INDICES = %d\n", APSS_NUM_INDICES);
    printf ("sizeof darshan_apss_header_record = %d\n", sizeof(struct darshan_apss_header_record));
    printf ("sizeof darshan_apss_perf_record = %d\n", sizeof(struct darshan_apss_perf_record));
+   printf ("sizeof darshan_apss_sample_record = %d\n", sizeof(struct darshan_apss_sample_record));
+   printf ("sizeof darshan_apss_placement_record = %d\n", sizeof(struct darshan_apss_placement_record));
+   printf ("sizeof darshan_apss_router_entry = %d\n", sizeof(struct darshan_apss_router_entry));
 
    return 0;
 }
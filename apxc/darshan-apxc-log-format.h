@@ -8,7 +8,18 @@
 #define __APXC_LOG_FORMAT_H
 
 /* current AutoPerf Cray XC log format version */
-#define APXC_VER 1
+#define APXC_VER 2
+
+/* limits of the PAPI event set, which is loaded at runtime and recorded
+ * by name in the header record
+ */
+#define APXC_MAX_EVENTS 512
+#define APXC_EVENT_NAME_MAX 64
+
+/* bytes taken by a table of event names of size bytes, padded so that the
+ * record following it stays 8 byte aligned
+ */
+#define APXC_EVENT_NAMES_SIZE(size) (((size) + 7) & ~(uint64_t)7)
 
 #define APXC_MAGIC ('A'*0x100000000000000+\
                             'U'*0x1000000000000+\
@@ -19,6 +30,34 @@
                             'R'*0x100+\
                             'F'*0x1)
 
+#define APXC_SAMPLE_MAGIC ('A'*0x100000000000000+\
+                            'P'*0x1000000000000+\
+                            'X'*0x10000000000+\
+                            'C'*0x100000000+\
+                            'S'*0x1000000+\
+                            'M'*0x10000+\
+                            'P'*0x100+\
+                            'L'*0x1)
+
+#define APXC_PLACEMENT_MAGIC ('A'*0x100000000000000+\
+                            'P'*0x1000000000000+\
+                            'X'*0x10000000000+\
+                            'C'*0x100000000+\
+                            'P'*0x1000000+\
+                            'L'*0x10000+\
+                            'A'*0x100+\
+                            'C'*0x1)
+
+/* most routers in a placement record: 128 groups of 6 chassis of 16 blades */
+#define APXC_MAX_ROUTERS (128*6*16)
+
+/* default and largest size of the sample buffer of a router */
+#define APXC_SAMPLE_DEFAULT_BYTES (64*1024)
+#define APXC_SAMPLE_MAX_BYTES (1024*1024)
+
+/* default PAPI event set, used unless DARSHAN_APXC_EVENTS or
+ * DARSHAN_APXC_EVENTS_FILE name another one
+ */
 #define APXC_PERF_COUNTERS \
     /* PAPI counters */\
     X(AR_RTR_0_0_INQ_PRF_INCOMING_FLIT_VC0) \
@@ -468,9 +507,14 @@ struct darshan_apxc_perf_record
     int64_t chassis;
     int64_t blade;
     int64_t node;
-    uint64_t counters[APXC_NUM_INDICES];
+    /* one counter per event, in the order of the header record's names */
+    uint64_t event_count;
+    uint64_t counters[];
 };
 
+/* the header record is followed by event_names_size bytes holding the
+ * names of its event_count events, each NUL terminated, padded with NULs
+ */
 struct darshan_apxc_header_record
 {
     struct darshan_base_record base_rec;
@@ -481,6 +525,52 @@ struct darshan_apxc_header_record
     int64_t memory_mode;
     int64_t cluster_mode;
     uint64_t appid;
+    uint64_t event_count;
+    uint64_t event_names_size;
+};
+
+/* the darshan_apxc_sample_record is written by each router leader when
+ * DARSHAN_APXC_SAMPLE_INTERVAL is set, and is followed by data_size bytes
+ * of samples, oldest first. A sample is the time since the previous one in
+ * microseconds, then the increase of each event counter since the previous
+ * sample in header record order, all as unsigned LEB128 varints. The
+ * oldest samples are dropped when the buffer fills up. interval is the
+ * requested time between samples in microseconds and start_time the time
+ * the first sample held counts from, in seconds since the job started.
+ */
+struct darshan_apxc_sample_record
+{
+    struct darshan_base_record base_rec;
+    int64_t magic;
+    int64_t group;
+    int64_t chassis;
+    int64_t blade;
+    int64_t node;
+    uint64_t interval;
+    uint64_t sample_count;
+    uint64_t dropped_count;
+    uint64_t data_size;
+    double start_time;
+};
+
+/* a router used by the job and the number of ranks placed on it */
+struct darshan_apxc_router_entry
+{
+    int32_t group;
+    int32_t chassis;
+    int32_t blade;
+    uint32_t ranks;
+};
+
+/* the darshan_apxc_placement_record is written by rank 0 and is followed by
+ * router_count darshan_apxc_router_entry structures, one for each router
+ * used by the job, sorted by group, chassis and blade
+ */
+struct darshan_apxc_placement_record
+{
+    struct darshan_base_record base_rec;
+    int64_t magic;
+    uint64_t router_count;
 };
 
 #endif /* __APXC_LOG_FORMAT_H */
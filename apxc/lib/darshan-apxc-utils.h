@@ -1,45 +1,144 @@
 #ifndef __APXC_UTILS_H__
 #define __APXC_UTILS_H__
 
-#include <regex.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* locations of the Cray node information, overridable at build time so
+ * the module can be run against fake files off the machine
+ */
+#ifndef APXC_HWINFO_PATH
+#define APXC_HWINFO_PATH "/.hwinfo.cray"
+#endif
+#ifndef APXC_CNAME_PATH
+#define APXC_CNAME_PATH "/proc/cray_xt/cname"
+#endif
+
+/* most key=value entries kept from the hwinfo file */
+#define HWINFO_MAX_ENTRIES 256
 
-static void search_hwinfo(const char * mstr, char *mode)
+/*
+ * key=value entries of the hwinfo file, pointing into its mapping
+ */
+struct hwinfo_table
+{
+    char *map;
+    size_t len;
+    int count;
+    struct
+    {
+        const char *key;
+        size_t key_len;
+        const char *value;
+        size_t value_len;
+    } entries[HWINFO_MAX_ENTRIES];
+};
+
+/*
+ * Map the hwinfo file and index its key=value lines, returning -1 if it
+ * cannot be read
+ */
+static int hwinfo_load(struct hwinfo_table *hw)
 {
-    FILE *f;
-    int r;
-    char *fdata;
-    long len;
-    regex_t preg;
-    regmatch_t mreg[1];
+    struct stat st;
+    const char *p, *end, *eq, *eol;
+    int fd;
 
-    r = regcomp(&preg, mstr, 0);
+    hw->map = NULL;
+    hw->len = 0;
+    hw->count = 0;
 
-    f = fopen ("/.hwinfo.cray", "rb");
-    fseek(f, 0, SEEK_END);
-    len = ftell(f);
-    fdata = malloc(len);
-    fseek(f, 0, SEEK_SET);
-    fread(fdata, sizeof(char), len, f);
-    fclose(f);
+    fd = open(APXC_HWINFO_PATH, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        close(fd);
+        return -1;
+    }
+    hw->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (hw->map == MAP_FAILED)
+    {
+        hw->map = NULL;
+        return -1;
+    }
+    hw->len = st.st_size;
+
+    p = hw->map;
+    end = hw->map + hw->len;
+    while (p < end && hw->count < HWINFO_MAX_ENTRIES)
+    {
+        eol = memchr(p, '\n', end - p);
+        if (eol == NULL)
+            eol = end;
+        eq = memchr(p, '=', eol - p);
+        if (eq != NULL && eq > p)
+        {
+            hw->entries[hw->count].key = p;
+            hw->entries[hw->count].key_len = eq - p;
+            hw->entries[hw->count].value = eq + 1;
+            /* the value ends at the first white space, as with %s */
+            for (p = eq + 1; p < eol && !isspace((unsigned char)*p); p++);
+            hw->entries[hw->count].value_len = p - (eq + 1);
+            hw->count++;
+        }
+        p = eol + 1;
+    }
+
+    return 0;
+}
 
-    r = regexec(&preg, fdata, 1, mreg, 0);
-    if ((r == 0) && (mreg[0].rm_so > -1))
+static void hwinfo_unload(struct hwinfo_table *hw)
+{
+    if (hw->map)
     {
-        sscanf(fdata+mreg[0].rm_so+strlen(mstr)-2, "%s", mode);
+        munmap(hw->map, hw->len);
+        hw->map = NULL;
     }
-    regfree(&preg);
-    free(fdata);
 
     return;
 }
 
-static int get_memory_mode (int node)
+/*
+ * Copy the value of key into value, or an empty string if it is missing
+ */
+static void hwinfo_lookup(struct hwinfo_table *hw, const char *key,
+                          char *value, size_t size)
+{
+    size_t key_len = strlen(key);
+    size_t len;
+    int i;
+
+    value[0] = '\0';
+    for (i = 0; i < hw->count; i++)
+    {
+        if (hw->entries[i].key_len == key_len &&
+            memcmp(hw->entries[i].key, key, key_len) == 0)
+        {
+            len = hw->entries[i].value_len;
+            if (len >= size)
+                len = size - 1;
+            memcpy(value, hw->entries[i].value, len);
+            value[len] = '\0';
+            return;
+        }
+    }
+
+    return;
+}
+
+static int get_memory_mode (struct hwinfo_table *hw, int node)
 {
     char memory_mode[64];
     char mcdram_str[64];
 
-    sprintf(mcdram_str, "mcdram_cfg\\[%d\\]=", node);
-    search_hwinfo(mcdram_str, memory_mode);
+    sprintf(mcdram_str, "mcdram_cfg[%d]", node);
+    hwinfo_lookup(hw, mcdram_str, memory_mode, sizeof(memory_mode));
 
     if (strcmp(memory_mode, "flat") == 0)
     {
@@ -61,13 +160,13 @@ static int get_memory_mode (int node)
     return MM_UNKNOWN;
 }
 
-static int get_cluster_mode (int node)
+static int get_cluster_mode (struct hwinfo_table *hw, int node)
 {
     char cluster_mode[64];
     char numa_str[64];
 
-    sprintf(numa_str, "numa_cfg\\[%d\\]=", node);
-    search_hwinfo(numa_str, cluster_mode);
+    sprintf(numa_str, "numa_cfg[%d]", node);
+    hwinfo_lookup(hw, numa_str, cluster_mode, sizeof(cluster_mode));
 
     if (strcmp(cluster_mode, "a2a") == 0)
     {
@@ -98,7 +197,7 @@ static void get_xc_coords (int *group,
                            int *blade,
                            int *node)
 {
-    FILE *f = fopen("/proc/cray_xt/cname","r");
+    FILE *f = fopen(APXC_CNAME_PATH,"r");
 
     if (f != NULL)
     {
@@ -127,16 +226,4 @@ static void get_xc_coords (int *group,
     return;
 }
 
-static unsigned int count_bits(unsigned int *bitvec, int cnt)
-{
-    unsigned int count = 0;
-    int i;
-
-    for (i = 0; i < cnt; i++)
-    {
-        count += __builtin_popcount(bitvec[i]);
-    }
-    return count;
-}
-
 #endif
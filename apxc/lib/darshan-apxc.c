@@ -14,6 +14,8 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <assert.h>
+#include <errno.h>
+#include <time.h>
 #include <papi.h>
 
 #include "uthash.h"
@@ -24,7 +26,8 @@
 #include "darshan-apxc-utils.h"
 
 /*
- * PAPI_events are defined by the Aries counters listed in the log header.
+ * PAPI_events is the default event set, the counters listed in the log
+ * header.
  */
 #define X(a) #a,
 #define Z(a) #a
@@ -39,6 +42,24 @@ static char* PAPI_events[] =
 #define MAX_CHASSIS (MAX_GROUPS*6)
 #define MAX_BLADES (MAX_CHASSIS*16)
 
+/* sections of the topology census, each counting ranks per slot */
+#define CENSUS_BLADES 0
+#define CENSUS_MMODES (CENSUS_BLADES + MAX_BLADES)
+#define CENSUS_CMODES (CENSUS_MMODES + MM_NUM_INDICES)
+#define CENSUS_SIZE (CENSUS_CMODES + CM_NUM_INDICIES)
+
+/* longest unsigned LEB128 varint, for 64 bit values */
+#define VARINT_MAX 10
+
+/* states of the counter sampling thread */
+enum apxc_sampler_state
+{
+    SAMPLER_OFF = 0,
+    SAMPLER_STARTING,
+    SAMPLER_RUNNING,
+    SAMPLER_STOPPING
+};
+
 /*
  * <Description>
  * 
@@ -58,11 +79,37 @@ struct apxc_runtime
     darshan_record_id rtr_id;
     int PAPI_event_set;
     int PAPI_event_count;
+    char *PAPI_event_names; /* NUL terminated names of the counted events */
+    size_t PAPI_event_names_size;
+    int event_request_count; /* names loaded, which PAPI_event_names starts as */
     int group;
     int chassis;
     int blade;
     int node;
+    int router_leader;
     int perf_record_marked;
+    struct darshan_apxc_sample_record *sample_record;
+    darshan_record_id sample_id;
+    unsigned char *sample_data;
+    size_t sample_size;
+    size_t sample_head;
+    size_t sample_used;
+    uint64_t sample_start;
+    uint64_t sample_time;
+    long long sample_prev[APXC_MAX_EVENTS];
+    long long sample_values[APXC_MAX_EVENTS];
+    unsigned char sample_buf[(APXC_MAX_EVENTS+1)*VARINT_MAX];
+    int sample_record_marked;
+    pthread_t sampler;
+    pthread_mutex_t sampler_mutex;
+    pthread_cond_t sampler_cond;
+    int sampler_state;
+    unsigned int census[CENSUS_SIZE];
+    struct darshan_apxc_placement_record *placement_record;
+    struct darshan_apxc_router_entry *placement_entries;
+    int placement_capacity; /* router entries rank 0 has room for */
+    int placement_record_marked;
+    void *output_buf;
 };
 
 static struct apxc_runtime *apxc_runtime = NULL;
@@ -93,28 +140,161 @@ static void apxc_cleanup(
 #define APXC_UNLOCK() pthread_mutex_unlock(&apxc_runtime_mutex)
 
 /*
- * Initialize counters using PAPI
+ * Read an event list file, one or more names per line with '#' starting
+ * a comment, into a string of names separated by white space.
  */
-static void initialize_counters (void)
+static char *read_event_file(const char *path)
+{
+    FILE *f;
+    char *buf;
+    long len;
+    long i;
+    int comment = 0;
+
+    f = fopen(path, "r");
+    if (f == NULL)
+    {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = malloc(len + 1);
+    if (buf)
+    {
+        len = fread(buf, sizeof(char), len, f);
+        buf[len] = '\0';
+        for (i = 0; i < len; i++)
+        {
+            if (buf[i] == '#')
+                comment = 1;
+            else if (buf[i] == '\n')
+                comment = 0;
+            if (comment)
+                buf[i] = ' ';
+        }
+    }
+    fclose(f);
+
+    return buf;
+}
+
+/*
+ * Append an event name to a table of NUL terminated names, unless the log
+ * format has no room for it
+ */
+static void append_event(char *names, int *count, size_t *size, const char *name)
+{
+    size_t len = strlen(name) + 1;
+
+    if (*count == APXC_MAX_EVENTS || len > APXC_EVENT_NAME_MAX)
+        return;
+
+    memcpy(names + *size, name, len);
+    *size += len;
+    (*count)++;
+
+    return;
+}
+
+/*
+ * Load the names of the event set, given by DARSHAN_APXC_EVENTS (comma
+ * separated) or DARSHAN_APXC_EVENTS_FILE, or the default one, into a table
+ * of count NUL terminated names taking size bytes. The records are sized
+ * from the table before the counters are started, so it still holds the
+ * events PAPI may not accept.
+ */
+static char *load_events(int *count, size_t *size)
 {
+    char *env, *list = NULL, *tok, *saveptr = NULL;
+    char *names;
+    size_t len = 0;
     int i;
+
+    *count = 0;
+    *size = 0;
+
+    if ((env = getenv("DARSHAN_APXC_EVENTS")) != NULL)
+        list = strdup(env);
+    else if ((env = getenv("DARSHAN_APXC_EVENTS_FILE")) != NULL)
+        list = read_event_file(env);
+
+    if (list)
+    {
+        /* the names and their NULs fit in the list they are split from */
+        names = malloc(strlen(list) + 1);
+        if (names)
+        {
+            for (tok = strtok_r(list, ", \t\r\n", &saveptr);
+                 tok;
+                 tok = strtok_r(NULL, ", \t\r\n", &saveptr))
+            {
+                append_event(names, count, size, tok);
+            }
+        }
+        free(list);
+    }
+    else
+    {
+        for (i = AR_RTR_0_0_INQ_PRF_INCOMING_FLIT_VC0; i < APXC_NUM_INDICES; i++)
+            len += strlen(PAPI_events[i]) + 1;
+        names = malloc(len);
+        if (names)
+        {
+            for (i = AR_RTR_0_0_INQ_PRF_INCOMING_FLIT_VC0; i < APXC_NUM_INDICES; i++)
+            {
+                append_event(names, count, size, PAPI_events[i]);
+            }
+        }
+    }
+
+    return names;
+}
+
+/*
+ * Add an event to the event set. The names of the events PAPI accepts are
+ * packed in place over the loaded ones, which are added in order.
+ */
+static void add_event(const char *name)
+{
+    size_t len = strlen(name) + 1;
     int code = 0;
 
+    if (PAPI_event_name_to_code((char *)name, &code) != PAPI_OK)
+        return;
+    if (PAPI_add_event(apxc_runtime->PAPI_event_set, code) != PAPI_OK)
+        return;
+
+    memmove(apxc_runtime->PAPI_event_names + apxc_runtime->PAPI_event_names_size,
+            name, len);
+    apxc_runtime->PAPI_event_names_size += len;
+    apxc_runtime->PAPI_event_count++;
+
+    return;
+}
+
+/*
+ * Initialize counters using PAPI, with the loaded event set
+ */
+static void initialize_counters (void)
+{
+    char *name = apxc_runtime->PAPI_event_names;
+    char *next;
+    int i;
+
     PAPI_library_init(PAPI_VER_CURRENT);
     apxc_runtime->PAPI_event_set = PAPI_NULL;
     PAPI_create_eventset(&apxc_runtime->PAPI_event_set);
+    apxc_runtime->PAPI_event_count = 0;
+    apxc_runtime->PAPI_event_names_size = 0;
 
-    /* start with first PAPI counter */
-    for (i = AR_RTR_0_0_INQ_PRF_INCOMING_FLIT_VC0;
-         strcmp(PAPI_events[i], "APXC_NUM_INDICES") != 0;
-         i++)
+    for (i = 0; i < apxc_runtime->event_request_count; i++)
     {
-        PAPI_event_name_to_code(PAPI_events[i], &code);
-        PAPI_add_event(apxc_runtime->PAPI_event_set, code);
+        next = name + strlen(name) + 1;
+        add_event(name);
+        name = next;
     }
 
-    apxc_runtime->PAPI_event_count = i;
-
     PAPI_start(apxc_runtime->PAPI_event_set);
 
     return;
@@ -136,9 +316,10 @@ static void capture(struct darshan_apxc_perf_record *rec,
                     darshan_record_id rec_id)
 {
     PAPI_stop(apxc_runtime->PAPI_event_set,
-          (long long*) &rec->counters[AR_RTR_0_0_INQ_PRF_INCOMING_FLIT_VC0]);
+          (long long*) rec->counters);
     PAPI_reset(apxc_runtime->PAPI_event_set);
 
+    rec->event_count = apxc_runtime->PAPI_event_count;
     rec->group   = apxc_runtime->group;
     rec->chassis = apxc_runtime->chassis;
     rec->blade   = apxc_runtime->blade;
@@ -149,11 +330,508 @@ static void capture(struct darshan_apxc_perf_record *rec,
     return;
 }
 
+/*
+ * Store val as an unsigned LEB128 varint at buf, returning its length
+ */
+static size_t put_varint(unsigned char *buf, uint64_t val)
+{
+    size_t len = 0;
+
+    while (val >= 0x80)
+    {
+        buf[len++] = (unsigned char)(val | 0x80);
+        val >>= 7;
+    }
+    buf[len++] = (unsigned char)val;
+
+    return len;
+}
+
+/*
+ * Read the varint at *off in the sample ring, moving *off past it and
+ * adding its length to *len
+ */
+static uint64_t get_ring_varint(size_t *off, size_t *len)
+{
+    uint64_t val = 0;
+    int shift = 0;
+    unsigned char b;
+
+    do
+    {
+        b = apxc_runtime->sample_data[*off];
+        *off = (*off + 1) % apxc_runtime->sample_size;
+        (*len)++;
+        if (shift < 64)
+            val |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+
+    return val;
+}
+
+/*
+ * Drop the oldest sample of the ring, which moves the start time to it
+ */
+static void drop_sample(void)
+{
+    size_t off = apxc_runtime->sample_head;
+    size_t len = 0;
+    int i;
+
+    apxc_runtime->sample_start += get_ring_varint(&off, &len);
+    for (i = 0; i < apxc_runtime->PAPI_event_count; i++)
+        get_ring_varint(&off, &len);
+
+    apxc_runtime->sample_head = off;
+    apxc_runtime->sample_used -= len;
+    apxc_runtime->sample_record->sample_count--;
+    apxc_runtime->sample_record->dropped_count++;
+
+    return;
+}
+
+/*
+ * Read the counters and append their increase since the previous sample
+ * to the ring, dropping the oldest samples to make room
+ */
+static void take_sample(void)
+{
+    struct darshan_apxc_sample_record *rec = apxc_runtime->sample_record;
+    unsigned char *buf = apxc_runtime->sample_buf;
+    uint64_t now;
+    size_t len = 0;
+    size_t tail, n;
+    int i;
+
+    if (PAPI_read(apxc_runtime->PAPI_event_set, apxc_runtime->sample_values) != PAPI_OK)
+        return;
+    now = (uint64_t)(darshan_core_wtime() * 1e6);
+
+    len += put_varint(buf + len, now - apxc_runtime->sample_time);
+    apxc_runtime->sample_time = now;
+    for (i = 0; i < apxc_runtime->PAPI_event_count; i++)
+    {
+        len += put_varint(buf + len,
+            (uint64_t)(apxc_runtime->sample_values[i] - apxc_runtime->sample_prev[i]));
+        apxc_runtime->sample_prev[i] = apxc_runtime->sample_values[i];
+    }
+
+    if (len > apxc_runtime->sample_size)
+    {
+        /* too large to ever be held, so the series restarts after it */
+        rec->dropped_count += rec->sample_count + 1;
+        rec->sample_count = 0;
+        apxc_runtime->sample_head = 0;
+        apxc_runtime->sample_used = 0;
+        apxc_runtime->sample_start = now;
+        return;
+    }
+    while (apxc_runtime->sample_used + len > apxc_runtime->sample_size)
+        drop_sample();
+
+    tail = (apxc_runtime->sample_head + apxc_runtime->sample_used) % apxc_runtime->sample_size;
+    n = apxc_runtime->sample_size - tail;
+    if (n > len)
+        n = len;
+    memcpy(apxc_runtime->sample_data + tail, buf, n);
+    memcpy(apxc_runtime->sample_data, buf + n, len - n);
+    apxc_runtime->sample_used += len;
+    rec->sample_count++;
+
+    return;
+}
+
+static void reverse_bytes(unsigned char *buf, size_t len)
+{
+    unsigned char c;
+    size_t i;
+
+    for (i = 0; i < len / 2; i++)
+    {
+        c = buf[i];
+        buf[i] = buf[len - 1 - i];
+        buf[len - 1 - i] = c;
+    }
+
+    return;
+}
+
+/*
+ * Rotate the ring in place so the samples start the record's data
+ */
+static void finish_samples(void)
+{
+    struct darshan_apxc_sample_record *rec = apxc_runtime->sample_record;
+    unsigned char *data = apxc_runtime->sample_data;
+    size_t head = apxc_runtime->sample_head;
+    size_t size = apxc_runtime->sample_size;
+
+    reverse_bytes(data, head);
+    reverse_bytes(data + head, size - head);
+    reverse_bytes(data, size);
+    apxc_runtime->sample_head = 0;
+
+    rec->base_rec.id = apxc_runtime->sample_id;
+    rec->base_rec.rank = my_rank;
+    rec->magic = APXC_SAMPLE_MAGIC;
+    rec->group   = apxc_runtime->group;
+    rec->chassis = apxc_runtime->chassis;
+    rec->blade   = apxc_runtime->blade;
+    rec->node    = apxc_runtime->node;
+    rec->data_size = apxc_runtime->sample_used;
+    rec->start_time = apxc_runtime->sample_start / 1e6;
+    apxc_runtime->sample_record_marked = -1;
+
+    return;
+}
+
+/*
+ * Body of the sampling thread. It owns the PAPI event set from start to
+ * the final capture, so PAPI is never used by two threads.
+ */
+static void *sampler_main(void *arg)
+{
+    struct timespec next, now;
+    uint64_t interval = apxc_runtime->sample_record->interval;
+
+    initialize_counters();
+    apxc_runtime->sample_start = (uint64_t)(darshan_core_wtime() * 1e6);
+    apxc_runtime->sample_time = apxc_runtime->sample_start;
+
+    pthread_mutex_lock(&apxc_runtime->sampler_mutex);
+    apxc_runtime->sampler_state = SAMPLER_RUNNING;
+    pthread_cond_broadcast(&apxc_runtime->sampler_cond);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (apxc_runtime->sampler_state == SAMPLER_RUNNING)
+    {
+        next.tv_sec += interval / 1000000;
+        next.tv_nsec += (interval % 1000000) * 1000;
+        if (next.tv_nsec >= 1000000000)
+        {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        while (apxc_runtime->sampler_state == SAMPLER_RUNNING &&
+               pthread_cond_timedwait(&apxc_runtime->sampler_cond,
+                   &apxc_runtime->sampler_mutex, &next) != ETIMEDOUT);
+        if (apxc_runtime->sampler_state != SAMPLER_RUNNING)
+            break;
+
+        take_sample();
+
+        /* skip the intervals missed by a slow read */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > next.tv_sec ||
+            (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec))
+            next = now;
+    }
+    pthread_mutex_unlock(&apxc_runtime->sampler_mutex);
+
+    /* the last sample covers the run up to the shutdown */
+    take_sample();
+    capture(apxc_runtime->perf_record, apxc_runtime->rtr_id);
+    finalize_counters();
+
+    return NULL;
+}
+
+/*
+ * Start the sampling thread, waiting for it to start the counters
+ */
+static int start_sampler(void)
+{
+    pthread_condattr_t attr;
+    int ret;
+
+    pthread_mutex_init(&apxc_runtime->sampler_mutex, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&apxc_runtime->sampler_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_mutex_lock(&apxc_runtime->sampler_mutex);
+    apxc_runtime->sampler_state = SAMPLER_STARTING;
+    ret = pthread_create(&apxc_runtime->sampler, NULL, sampler_main, NULL);
+    if (ret == 0)
+    {
+        while (apxc_runtime->sampler_state == SAMPLER_STARTING)
+            pthread_cond_wait(&apxc_runtime->sampler_cond, &apxc_runtime->sampler_mutex);
+    }
+    else
+    {
+        apxc_runtime->sampler_state = SAMPLER_OFF;
+    }
+    pthread_mutex_unlock(&apxc_runtime->sampler_mutex);
+
+    if (ret != 0)
+    {
+        pthread_cond_destroy(&apxc_runtime->sampler_cond);
+        pthread_mutex_destroy(&apxc_runtime->sampler_mutex);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Stop the sampling thread, which captures the final counters, and lay
+ * out its samples for output
+ */
+static void stop_sampler(void)
+{
+    pthread_mutex_lock(&apxc_runtime->sampler_mutex);
+    apxc_runtime->sampler_state = SAMPLER_STOPPING;
+    pthread_cond_broadcast(&apxc_runtime->sampler_cond);
+    pthread_mutex_unlock(&apxc_runtime->sampler_mutex);
+
+    pthread_join(apxc_runtime->sampler, NULL);
+    pthread_cond_destroy(&apxc_runtime->sampler_cond);
+    pthread_mutex_destroy(&apxc_runtime->sampler_mutex);
+    apxc_runtime->sampler_state = SAMPLER_OFF;
+
+    finish_samples();
+
+    return;
+}
+
+/*
+ * Register the sample record of a router leader, holding size bytes of
+ * samples taken every interval microseconds
+ */
+static void register_sample_record(uint64_t interval, size_t size)
+{
+    apxc_runtime->sample_id = darshan_core_gen_record_id("APXC-SAMPLES");
+    apxc_runtime->sample_record = darshan_core_register_record(
+        apxc_runtime->sample_id,
+        "APXC-SAMPLES",
+        DARSHAN_APXC_MOD,
+        sizeof(struct darshan_apxc_sample_record) + size,
+        NULL);
+    if (!apxc_runtime->sample_record)
+        return;
+
+    apxc_runtime->sample_record->interval = interval;
+    apxc_runtime->sample_data = (unsigned char *)(apxc_runtime->sample_record + 1);
+    apxc_runtime->sample_size = size;
+
+    return;
+}
+
+/*
+ * Memory and cluster mode of this node. One rank per node parses the
+ * hwinfo file and shares the modes with the other ranks on the node.
+ */
+static void get_node_modes(int *mmode, int *cmode)
+{
+    struct hwinfo_table hw;
+    MPI_Comm node_comm;
+    int node_rank;
+    int modes[2] = {MM_UNKNOWN, CM_UNKNOWN};
+
+    PMPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, my_rank,
+                         MPI_INFO_NULL, &node_comm);
+    PMPI_Comm_rank(node_comm, &node_rank);
+    if (node_rank == 0 && hwinfo_load(&hw) == 0)
+    {
+        modes[0] = get_memory_mode(&hw, apxc_runtime->node);
+        modes[1] = get_cluster_mode(&hw, apxc_runtime->node);
+        hwinfo_unload(&hw);
+    }
+    PMPI_Bcast(modes, 2, MPI_INT, 0, node_comm);
+    PMPI_Comm_free(&node_comm);
+
+    *mmode = modes[0];
+    *cmode = modes[1];
+
+    return;
+}
+
+/*
+ * Copy the names of the counted events, which PAPI may have cut down
+ * from the loaded ones, after rank 0's header record
+ */
+static void record_event_names(void)
+{
+    struct darshan_apxc_header_record *hdr = apxc_runtime->header_record;
+    char *names = (char *)(hdr + 1);
+    size_t size = apxc_runtime->PAPI_event_names_size;
+
+    hdr->event_count = apxc_runtime->PAPI_event_count;
+    hdr->event_names_size = APXC_EVENT_NAMES_SIZE(size);
+    if (size)
+        memcpy(names, apxc_runtime->PAPI_event_names, size);
+    memset(names + size, 0, hdr->event_names_size - size);
+
+    return;
+}
+
+/* whether the census, and so the placement map, covers a router */
+static int router_in_census(int group, int chassis, int blade)
+{
+    return(group >= 0 && group < MAX_GROUPS &&
+           chassis >= 0 && chassis < 6 &&
+           blade >= 0 && blade < 16);
+}
+
+/*
+ * Elect the lowest rank on each router to be the only one reading its
+ * counters; every process is its own leader if its router is unknown.
+ * Collective over MPI_COMM_WORLD.
+ */
+static int elect_router_leader(int group, int chassis, int blade, int rank)
+{
+    MPI_Comm router_comm;
+    int color;
+    int router_rank = 0;
+
+    if (group < 0)
+        color = MPI_UNDEFINED;
+    else
+        color = (group << (4+3)) + (chassis << 4) + blade;
+    PMPI_Comm_split(MPI_COMM_WORLD, color, rank, &router_comm);
+    if (router_comm != MPI_COMM_NULL)
+    {
+        PMPI_Comm_rank(router_comm, &router_rank);
+        PMPI_Comm_free(&router_comm);
+    }
+
+    return(router_rank == 0);
+}
+
+/*
+ * Register the router placement map of rank 0, with room for the routers
+ * counted at initialization
+ */
+static void register_placement_record(void)
+{
+    darshan_record_id rec_id;
+
+    rec_id = darshan_core_gen_record_id("APXC-PLACEMENT");
+    apxc_runtime->placement_record = darshan_core_register_record(
+        rec_id,
+        "APXC-PLACEMENT",
+        DARSHAN_APXC_MOD,
+        sizeof(struct darshan_apxc_placement_record) +
+        apxc_runtime->placement_capacity *
+        sizeof(struct darshan_apxc_router_entry),
+        NULL);
+    if (!apxc_runtime->placement_record)
+        return;
+
+    apxc_runtime->placement_record->base_rec.id = rec_id;
+    apxc_runtime->placement_record->base_rec.rank = my_rank;
+    apxc_runtime->placement_record->magic = APXC_PLACEMENT_MAGIC;
+    apxc_runtime->placement_entries =
+        (struct darshan_apxc_router_entry *)(apxc_runtime->placement_record + 1);
+
+    return;
+}
+
+/*
+ * Count the ranks on each router and in each memory and cluster mode in a
+ * single reduction. Rank 0 derives the network dimensions, the mode
+ * consistency and the router placement map from the counts.
+ */
+static void take_census(int mmode, int cmode)
+{
+    struct darshan_apxc_header_record *hdr = apxc_runtime->header_record;
+    struct darshan_apxc_router_entry *entry;
+    unsigned int *census = apxc_runtime->census;
+    int last_group = -1;
+    int last_chassis = -1;
+    int group, chassis;
+    int i;
+    unsigned int nprocs = 0;
+
+    memset(census, 0, sizeof(apxc_runtime->census));
+    /* routers outside of the census are not counted */
+    if (router_in_census(apxc_runtime->group, apxc_runtime->chassis,
+                         apxc_runtime->blade))
+    {
+        census[CENSUS_BLADES +
+               (apxc_runtime->group * 6 + apxc_runtime->chassis) * 16 +
+               apxc_runtime->blade]++;
+    }
+    census[CENSUS_MMODES + mmode]++;
+    census[CENSUS_CMODES + cmode]++;
+
+    PMPI_Reduce((my_rank ? census : MPI_IN_PLACE),
+                census,
+                CENSUS_SIZE,
+                MPI_UNSIGNED,
+                MPI_SUM,
+                0,
+                MPI_COMM_WORLD);
+    if (my_rank != 0)
+        return;
+
+    hdr->nblades  = 0;
+    hdr->nchassis = 0;
+    hdr->ngroups  = 0;
+    for (i = 0; i < MAX_BLADES; i++)
+    {
+        if (!census[CENSUS_BLADES + i])
+            continue;
+
+        group = i / (6 * 16);
+        chassis = (i / 16) % 6;
+        if (group != last_group)
+            hdr->ngroups++;
+        if (group != last_group || chassis != last_chassis)
+            hdr->nchassis++;
+        hdr->nblades++;
+        last_group = group;
+        last_chassis = chassis;
+
+        /* routers come in group, chassis and blade order */
+        if (apxc_runtime->placement_record &&
+            hdr->nblades <= apxc_runtime->placement_capacity)
+        {
+            entry = &apxc_runtime->placement_entries[hdr->nblades - 1];
+            entry->group = group;
+            entry->chassis = chassis;
+            entry->blade = i % 16;
+            entry->ranks = census[CENSUS_BLADES + i];
+        }
+    }
+    if (apxc_runtime->placement_record)
+    {
+        apxc_runtime->placement_record->router_count =
+            hdr->nblades < apxc_runtime->placement_capacity ?
+            hdr->nblades : apxc_runtime->placement_capacity;
+        apxc_runtime->placement_record_marked = -1;
+    }
+
+    /* the modes of rank 0, flagged unless every rank has them */
+    for (i = 0; i < MM_NUM_INDICES; i++)
+        nprocs += census[CENSUS_MMODES + i];
+    hdr->memory_mode = mmode;
+    hdr->cluster_mode = cmode;
+    if (census[CENSUS_MMODES + mmode] != nprocs)
+        hdr->memory_mode |= (1 << 31);
+    if (census[CENSUS_CMODES + cmode] != nprocs)
+        hdr->cluster_mode |= (1 << 31);
+
+    return;
+}
+
 void apxc_runtime_initialize()
 {
     size_t apxc_buf_size;
     size_t apxc_rec_count = 1;
     char rtr_rec_name[128];
+    uint64_t sample_interval = 0;
+    size_t sample_size = APXC_SAMPLE_DEFAULT_BYTES;
+    char *env;
+    int rank;
+    int group, chassis, blade, node;
+    int router_leader;
+    int in_census, router_count = 0;
+    char *event_names = NULL;
+    int event_count = 0;
+    size_t event_names_size = 0;
     int ret;
 
     darshan_module_funcs mod_funcs = {
@@ -178,6 +856,46 @@ void apxc_runtime_initialize()
     apxc_buf_size = sizeof(struct darshan_apxc_header_record) + 
                     sizeof(struct darshan_apxc_perf_record);
 
+    /* optional sampling of the counters, interval given in milliseconds */
+    if ((env = getenv("DARSHAN_APXC_SAMPLE_INTERVAL")) != NULL)
+        sample_interval = strtoull(env, NULL, 10) * 1000;
+    if ((env = getenv("DARSHAN_APXC_SAMPLE_BYTES")) != NULL)
+        sample_size = strtoull(env, NULL, 10);
+    if (sample_size > APXC_SAMPLE_MAX_BYTES)
+        sample_size = APXC_SAMPLE_MAX_BYTES;
+    if (sample_interval > 0 && sample_size > 0)
+        apxc_buf_size += sizeof(struct darshan_apxc_sample_record) + sample_size;
+    else
+        sample_interval = 0;
+
+    /* the election is collective, so every rank takes part before any of
+     * them can give up on the module below
+     */
+    PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    get_xc_coords(&group, &chassis, &blade, &node);
+    router_leader = elect_router_leader(group, chassis, blade, rank);
+
+    /* rank 0 also writes the router placement map, sized from the number
+     * of routers in the census: one leader each
+     */
+    in_census = router_leader && router_in_census(group, chassis, blade);
+    PMPI_Reduce(&in_census, &router_count, 1, MPI_INT, MPI_SUM, 0,
+                MPI_COMM_WORLD);
+    if (rank == 0)
+        apxc_buf_size += sizeof(struct darshan_apxc_placement_record) +
+            router_count * sizeof(struct darshan_apxc_router_entry);
+
+    /* the event set sizes the perf records of the router leaders and the
+     * header record of rank 0, which is one of them
+     */
+    if (router_leader)
+    {
+        event_names = load_events(&event_count, &event_names_size);
+        apxc_buf_size += event_count * sizeof(uint64_t);
+        if (rank == 0)
+            apxc_buf_size += APXC_EVENT_NAMES_SIZE(event_names_size);
+    }
+
     /* register the APXC module with the darshan-core component */
     ret = darshan_core_register_module(
         DARSHAN_APXC_MOD,
@@ -188,6 +906,7 @@ void apxc_runtime_initialize()
         NULL);
     if(ret < 0)
     {
+        free(event_names);
         APXC_UNLOCK();
         return;
     }
@@ -198,10 +917,13 @@ void apxc_runtime_initialize()
     if(!apxc_runtime)
     {
         darshan_core_unregister_module(DARSHAN_APXC_MOD);
+        free(event_names);
         APXC_UNLOCK();
         return;
     }
     memset(apxc_runtime, 0, sizeof(*apxc_runtime));
+    apxc_runtime->PAPI_event_names = event_names;
+    apxc_runtime->event_request_count = event_count;
 
     if (my_rank == 0)
     {
@@ -213,11 +935,13 @@ void apxc_runtime_initialize()
             //NULL,
             "darshan-apxc-header",
             DARSHAN_APXC_MOD,
-            sizeof(struct darshan_apxc_header_record),
+            sizeof(struct darshan_apxc_header_record) +
+            APXC_EVENT_NAMES_SIZE(event_names_size),
             NULL);
         if(!(apxc_runtime->header_record))
         {
             darshan_core_unregister_module(DARSHAN_APXC_MOD);
+            free(apxc_runtime->PAPI_event_names);
             free(apxc_runtime);
             apxc_runtime = NULL;
             APXC_UNLOCK();
@@ -228,33 +952,50 @@ void apxc_runtime_initialize()
         apxc_runtime->header_record->magic = APXC_MAGIC;
     }
 
-    get_xc_coords(&apxc_runtime->group,
-                  &apxc_runtime->chassis,
-                  &apxc_runtime->blade,
-                  &apxc_runtime->node);
-
-    sprintf(rtr_rec_name, "darshan-apxc-rtr-%d-%d-%d",
-            apxc_runtime->group, apxc_runtime->chassis, apxc_runtime->blade);
-    //apxc_runtime->rtr_id = darshan_core_gen_record_id(rtr_rec_name);
-    apxc_runtime->rtr_id = darshan_core_gen_record_id("APXC");
-    apxc_runtime->perf_record = darshan_core_register_record(
-        apxc_runtime->rtr_id,
-        //NULL,
-        "APXC",   // we want the record for each rank to be treated as shared records so that mpi_redux can operate on
-        //rtr_rec_name,
-        DARSHAN_APXC_MOD,
-        sizeof(struct darshan_apxc_perf_record),
-        NULL);
-    if(!(apxc_runtime->perf_record))
+    apxc_runtime->group = group;
+    apxc_runtime->chassis = chassis;
+    apxc_runtime->blade = blade;
+    apxc_runtime->node = node;
+    apxc_runtime->router_leader = router_leader;
+    apxc_runtime->placement_capacity = router_count;
+
+    /* only router leaders read counters and write a perf record */
+    if (apxc_runtime->router_leader)
     {
-        darshan_core_unregister_module(DARSHAN_APXC_MOD);
-        free(apxc_runtime);
-        apxc_runtime = NULL;
-        APXC_UNLOCK();
-        return;
+        sprintf(rtr_rec_name, "darshan-apxc-rtr-%d-%d-%d",
+                apxc_runtime->group, apxc_runtime->chassis, apxc_runtime->blade);
+        //apxc_runtime->rtr_id = darshan_core_gen_record_id(rtr_rec_name);
+        apxc_runtime->rtr_id = darshan_core_gen_record_id("APXC");
+        apxc_runtime->perf_record = darshan_core_register_record(
+            apxc_runtime->rtr_id,
+            //NULL,
+            "APXC",   // we want the record for each rank to be treated as shared records so that mpi_redux can operate on
+            //rtr_rec_name,
+            DARSHAN_APXC_MOD,
+            sizeof(struct darshan_apxc_perf_record) +
+            event_count * sizeof(uint64_t),
+            NULL);
+        if(!(apxc_runtime->perf_record))
+        {
+            darshan_core_unregister_module(DARSHAN_APXC_MOD);
+            free(apxc_runtime->PAPI_event_names);
+            free(apxc_runtime);
+            apxc_runtime = NULL;
+            APXC_UNLOCK();
+            return;
+        }
+
+        if (sample_interval > 0)
+            register_sample_record(sample_interval, sample_size);
+        if (!apxc_runtime->sample_record || start_sampler() < 0)
+            initialize_counters();
     }
 
-    initialize_counters();
+    if (my_rank == 0)
+    {
+        register_placement_record();
+        record_event_names();
+    }
     APXC_UNLOCK();
 
     return;
@@ -272,19 +1013,7 @@ static void apxc_mpi_redux(
     darshan_record_id *shared_recs,
     int shared_rec_count)
 {
-    int i;
-    int color;
-    int router_rank;
-    int router_count;
-    int chassis_count;
-    int group_count;
-    int mmode, rmmode;
-    int cmode, rcmode;
-    unsigned int *bitvec;
-    unsigned int bitlen;
-    unsigned int bitcnt;
-    unsigned int bitsiz;
-    MPI_Comm router_comm;
+    int mmode, cmode;
 
     APXC_LOCK();
     if (!apxc_runtime)
@@ -293,127 +1022,28 @@ static void apxc_mpi_redux(
         return;
     }
 
-    bitcnt = sizeof(unsigned int) * 8;
-    bitlen = sizeof(unsigned int) * (MAX_BLADES/bitcnt);
-    bitsiz = bitlen / sizeof(unsigned int);
-    bitvec = malloc(bitlen);
-    
-    /* collect perf counters */
-    capture(apxc_runtime->perf_record, apxc_runtime->rtr_id);
+    /* collect perf counters, which the sampling thread does when it stops */
+    if (apxc_runtime->sampler_state != SAMPLER_OFF)
+        stop_sampler();
+    else if (apxc_runtime->router_leader)
+        capture(apxc_runtime->perf_record, apxc_runtime->rtr_id);
 
     /* collect memory/cluster config */
-    mmode = get_memory_mode(apxc_runtime->node);
-    cmode = get_cluster_mode(apxc_runtime->node);
+    get_node_modes(&mmode, &cmode);
 
-    PMPI_Reduce(&mmode,
-                &rmmode, 1, MPI_INT, MPI_BOR, 0, MPI_COMM_WORLD);
-    PMPI_Reduce(&cmode,
-                &rcmode, 1, MPI_INT, MPI_BOR, 0, MPI_COMM_WORLD);
+    /* count network dimensions and modes */
+    take_census(mmode, cmode);
 
     if (my_rank == 0)
     {
-        apxc_runtime->header_record->memory_mode = mmode;
-        apxc_runtime->header_record->cluster_mode = cmode;
-        if (mmode != rmmode)
-            apxc_runtime->header_record->memory_mode |= (1 << 31);
-        if (cmode != rcmode)
-            apxc_runtime->header_record->cluster_mode |= (1 << 31);
         apxc_runtime->header_record->appid = atoi((char*)getenv( csJOBID_ENV_STR ));
     }
 
-    /* count network dimensions */
-    if (bitvec)
-    {
-        int idx;
-        unsigned int uchassis;
-        unsigned int ublade;
-
-        /* group */
-        memset(bitvec, 0, bitlen);
-        idx = apxc_runtime->group / bitcnt;
-        bitvec[idx] |= (1 << apxc_runtime->group % bitcnt);
-        PMPI_Reduce((my_rank ? bitvec : MPI_IN_PLACE),
-                     bitvec,
-                     bitsiz,
-                     MPI_INT,
-                     MPI_BOR,
-                     0,
-                     MPI_COMM_WORLD);
-        group_count = count_bits(bitvec, bitsiz);
-
-        /* chassis */
-        memset(bitvec, 0, bitlen);
-        uchassis = apxc_runtime->group * 6 + apxc_runtime->chassis;
-        idx = uchassis / bitcnt;
-        bitvec[idx] |= (1 << uchassis % bitcnt);
-        PMPI_Reduce((my_rank ? bitvec : MPI_IN_PLACE),
-                    bitvec,
-                    bitsiz,
-                    MPI_INT,
-                    MPI_BOR,
-                    0,
-                    MPI_COMM_WORLD);
-        chassis_count = count_bits(bitvec, bitsiz);
-
-        /* blade */
-        memset(bitvec, 0, bitlen);
-        ublade = uchassis * 16 + apxc_runtime->blade;
-        idx = ublade / bitcnt;
-        bitvec[idx] |= (1 << ublade % bitcnt);
-        PMPI_Reduce((my_rank ? bitvec : MPI_IN_PLACE),
-                    bitvec,
-                    bitsiz,
-                    MPI_INT,
-                    MPI_BOR,
-                    0,
-                    MPI_COMM_WORLD);
-        router_count = count_bits(bitvec, bitsiz);
-
-        if (my_rank == 0)
-        {
-            apxc_runtime->header_record->nblades  = router_count;
-            apxc_runtime->header_record->nchassis = chassis_count;
-            apxc_runtime->header_record->ngroups  = group_count;
-        }
-        free(bitvec);
-    }
-    else
-    {
-        apxc_runtime->header_record->nblades  = 0;
-        apxc_runtime->header_record->nchassis = 0;
-        apxc_runtime->header_record->ngroups  = 0;
-    }
-    
-    /*
-     * reduce data
-     *
-     *  aggregate data from processes which share the same blade and avg.
-     *  
-     */ 
-    color = (apxc_runtime->group << (4+3)) + \
-            (apxc_runtime->chassis << 4) + \
-            apxc_runtime->blade;
-    PMPI_Comm_split(MPI_COMM_WORLD, color, my_rank, &router_comm);
-    PMPI_Comm_rank(router_comm,  &router_rank);
-    PMPI_Comm_size(router_comm,  &router_count);
-
-    PMPI_Reduce((router_rank?apxc_runtime->perf_record->counters:MPI_IN_PLACE),
-                apxc_runtime->perf_record->counters,
-                APXC_NUM_INDICES,
-                MPI_LONG_LONG_INT,
-                MPI_SUM,
-                0,
-                router_comm);
-
-    if (router_rank == 0)
+    /* router leaders hold the exact counters of their router */
+    if (apxc_runtime->router_leader)
     {
-        for (i = 0; i < APXC_NUM_INDICES; i++)
-        {
-            apxc_runtime->perf_record->counters[i] /= router_count;
-        }
-            apxc_runtime->perf_record_marked = -1;
+        apxc_runtime->perf_record_marked = -1;
     }
-    PMPI_Comm_free(&router_comm);
 
     APXC_UNLOCK();
 
@@ -425,19 +1055,75 @@ static void apxc_output(
     void **apxc_buf,
     int *apxc_buf_sz)
 {
+    char *out;
+    int hdr_size = 0;
+    int prf_size = 0;
+    int smp_size = 0;
+    int plc_size = 0;
+    int size;
+
     APXC_LOCK();
     assert(apxc_runtime);
     *apxc_buf_sz = 0; 
     
     if (my_rank == 0) { 
-        *apxc_buf_sz += sizeof(*apxc_runtime->header_record); 
+        hdr_size = sizeof(*apxc_runtime->header_record) +
+                   apxc_runtime->header_record->event_names_size;
     }
     
     if (apxc_runtime->perf_record_marked == -1) 
      { 
-       *apxc_buf_sz += sizeof( *apxc_runtime->perf_record); 
+       prf_size = sizeof(*apxc_runtime->perf_record) +
+                  apxc_runtime->perf_record->event_count * sizeof(uint64_t);
      }
 
+    if (apxc_runtime->sample_record_marked == -1)
+    {
+        smp_size = sizeof(*apxc_runtime->sample_record) +
+                   apxc_runtime->sample_record->data_size;
+    }
+
+    if (apxc_runtime->placement_record_marked == -1)
+    {
+        plc_size = sizeof(*apxc_runtime->placement_record) +
+                   apxc_runtime->placement_record->router_count *
+                   sizeof(struct darshan_apxc_router_entry);
+    }
+
+    /*
+     * the records are trimmed to the events counted, the samples held and
+     * the routers found, so they are copied out to be contiguous
+     */
+    size = hdr_size + prf_size + smp_size + plc_size;
+    out = size ? malloc(size) : NULL;
+    if (out)
+    {
+        size = 0;
+        if (hdr_size)
+        {
+            memcpy(out + size, apxc_runtime->header_record, hdr_size);
+            size += hdr_size;
+        }
+        if (prf_size)
+        {
+            memcpy(out + size, apxc_runtime->perf_record, prf_size);
+            size += prf_size;
+        }
+        if (smp_size)
+        {
+            memcpy(out + size, apxc_runtime->sample_record, smp_size);
+            size += smp_size;
+        }
+        if (plc_size)
+        {
+            memcpy(out + size, apxc_runtime->placement_record, plc_size);
+            size += plc_size;
+        }
+        *apxc_buf = out;
+        *apxc_buf_sz = size;
+        apxc_runtime->output_buf = out;
+    }
+
     APXC_UNLOCK();
     return;
 }
@@ -446,7 +1132,12 @@ static void apxc_cleanup()
 {
     APXC_LOCK();
     assert(apxc_runtime);
-    finalize_counters();
+    if (apxc_runtime->sampler_state != SAMPLER_OFF)
+        stop_sampler();
+    else if (apxc_runtime->router_leader && apxc_runtime->sample_record_marked != -1)
+        finalize_counters();
+    free(apxc_runtime->output_buf);
+    free(apxc_runtime->PAPI_event_names);
     free(apxc_runtime);
     apxc_runtime = NULL;
     APXC_UNLOCK();
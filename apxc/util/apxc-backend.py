@@ -13,7 +13,8 @@ struct darshan_apxc_perf_record
     int64_t chassis; 
     int64_t blade; 
     int64_t node;
-    uint64_t counters[392];
+    uint64_t event_count;
+    uint64_t counters[];
 };
 struct darshan_apxc_header_record
 {
@@ -25,6 +26,35 @@ struct darshan_apxc_header_record
     int64_t memory_mode;
     int64_t cluster_mode;
     uint64_t appid;
+    uint64_t event_count;
+    uint64_t event_names_size;
+};
+struct darshan_apxc_sample_record
+{
+    struct darshan_base_record base_rec;
+    int64_t magic;
+    int64_t group;
+    int64_t chassis;
+    int64_t blade;
+    int64_t node;
+    uint64_t interval;
+    uint64_t sample_count;
+    uint64_t dropped_count;
+    uint64_t data_size;
+    double start_time;
+};
+struct darshan_apxc_router_entry
+{
+    int32_t group;
+    int32_t chassis;
+    int32_t blade;
+    uint32_t ranks;
+};
+struct darshan_apxc_placement_record
+{
+    struct darshan_base_record base_rec;
+    int64_t magic;
+    uint64_t router_count;
 };
 
 extern char *apxc_counter_names[];
@@ -35,6 +65,52 @@ def get_apxc_defs():
   return structdefs
 
 
+APXC_SAMPLE_MAGIC = int.from_bytes(b'APXCSMPL', 'big')
+APXC_PLACEMENT_MAGIC = int.from_bytes(b'APXCPLAC', 'big')
+
+# layout of the router entries following a placement record
+_router_dtype = np.dtype([('group', np.int32), ('chassis', np.int32),
+                          ('blade', np.int32), ('ranks', np.uint32)])
+
+
+def _get_varint(data, off):
+    val = 0
+    shift = 0
+    while True:
+        b = data[off]
+        off += 1
+        val |= (b & 0x7f) << shift
+        shift += 7
+        if not b & 0x80:
+            return val, off
+
+
+# decode the samples following a sample record: the end time of each
+# sample and the increase of each event during it
+def _get_apxc_samples(ffi, smp, event_names):
+    data = bytes(ffi.buffer(ffi.cast('char *', smp) +
+        ffi.sizeof('struct darshan_apxc_sample_record'), smp[0].data_size))
+    count = smp[0].sample_count
+    times = np.zeros(count, dtype=np.float64)
+    deltas = np.zeros((count, len(event_names)), dtype=np.uint64)
+    time = smp[0].start_time
+    off = 0
+    for s in range(0, count):
+      dt, off = _get_varint(data, off)
+      time += dt / 1e6
+      times[s] = time
+      for i in range(0, len(event_names)):
+        deltas[s][i], off = _get_varint(data, off)
+    return times, deltas
+
+
+# the names of the events follow the header record, each NUL terminated
+def _get_apxc_event_names(ffi, hdr):
+    names = bytes(ffi.buffer(ffi.cast('char *', hdr) +
+        ffi.sizeof('struct darshan_apxc_header_record'), hdr.event_names_size))
+    return [name.decode('utf-8') for name in names.split(b'\0')[:hdr.event_count]]
+
+
 # load header record
 def log_get_apxc_record(log, mod_name, structname, dtype='dict'):
     from darshan.backend.cffi_backend import ffi, libdutil, log_get_modules, counter_names, _structdefs
@@ -49,6 +125,8 @@ def log_get_apxc_record(log, mod_name, structname, dtype='dict'):
     if r < 1:
         return None
 
+    event_names = log.get('apxc_event_names', [])
+
     memory_modes = ['unknown', 'flat', 'equal', 'split', 'cache']
     cluster_modes = ['unknown', 'all2all', 'quad', 'hemi', 'snc4', 'snc2']
     
@@ -64,6 +142,31 @@ def log_get_apxc_record(log, mod_name, structname, dtype='dict'):
       rec['memory_mode'] = memory_modes[mm]
       rec['cluster_mode'] = cluster_modes[cm]
       rec['appid'] = hdr[0].appid
+      rec['event_names'] = _get_apxc_event_names(ffi, hdr[0])
+      # kept with the log, for the records that follow its header
+      log['apxc_event_names'] = rec['event_names']
+    elif ffi.cast('struct darshan_apxc_sample_record **', buf)[0].magic == APXC_SAMPLE_MAGIC:
+      smp = ffi.cast('struct darshan_apxc_sample_record **', buf)[0]
+      rec['id'] = smp.base_rec.id
+      rec['rank'] = smp.base_rec.rank
+      rec['group'] = smp.group
+      rec['chassis'] = smp.chassis
+      rec['blade'] = smp.blade
+      rec['node'] = smp.node
+      rec['interval'] = smp.interval
+      rec['dropped'] = smp.dropped_count
+      rec['start_time'] = smp.start_time
+
+      times, deltas = _get_apxc_samples(ffi, smp, event_names)
+      rec['times'] = times
+      rec['samples'] = dict(zip(['APXC_' + name for name in event_names], deltas.T))
+    elif ffi.cast('struct darshan_apxc_placement_record **', buf)[0].magic == APXC_PLACEMENT_MAGIC:
+      plc = ffi.cast('struct darshan_apxc_placement_record **', buf)[0]
+      rec['id'] = plc.base_rec.id
+      rec['rank'] = plc.base_rec.rank
+      rec['routers'] = np.frombuffer(ffi.buffer(ffi.cast('char *', plc) +
+          ffi.sizeof('struct darshan_apxc_placement_record'),
+          plc.router_count * _router_dtype.itemsize), dtype=_router_dtype).copy()
     else:
       prf = ffi.cast(mod_type, buf)
       rec['id'] = prf[0].base_rec.id
@@ -74,10 +177,10 @@ def log_get_apxc_record(log, mod_name, structname, dtype='dict'):
       rec['node'] = prf[0].node
       
       lst = []
-      for i in range(0, len(prf[0].counters)):
+      for i in range(0, min(len(event_names), prf[0].event_count)):
         lst.append(prf[0].counters[i])
       np_counters = np.array(lst, dtype=np.uint64)
-      d_counters = dict(zip(counter_names(mod_name), np_counters))
+      d_counters = dict(zip(['APXC_' + name for name in event_names], np_counters))
       
       rec['counters'] = {}
       rec['counters'].update(d_counters)
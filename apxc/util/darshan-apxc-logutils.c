@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -35,6 +36,37 @@ char *apxc_cmodes[] = { APXC_CLUSTER_MODES };
 #undef X
 #undef Z
 
+/* default PAPI event names, for logs that do not record their event set */
+#define X(a) #a,
+#define Z(a) #a
+static char *apxc_default_events[] = {
+    APXC_PERF_COUNTERS
+};
+#undef X
+#undef Z
+
+/* v1 records, before the event set was recorded, lack the event count
+ * and name table of the header record and the event count of the perf
+ * record, which had one counter per default event: the default event
+ * list has not changed since
+ */
+#define APXC_V1_NUM_INDICES (sizeof(apxc_default_events) / sizeof(*apxc_default_events) - 1)
+#define APXC_V1_HEADER_SIZE offsetof(struct darshan_apxc_header_record, event_count)
+#define APXC_V1_PERF_SIZE offsetof(struct darshan_apxc_perf_record, event_count)
+
+/* room for the largest header or perf record of any version; the read
+ * buffer is only grown past it for sample and placement records
+ */
+#define APXC_REC_BUF_SIZE (sizeof(struct darshan_apxc_header_record) + \
+    APXC_MAX_EVENTS * APXC_EVENT_NAME_MAX)
+
+/* names of the PAPI events, taken from the header record; a log's header
+ * is printed before its perf records, and the names are kept per thread so
+ * that threads printing different logs do not see each other's
+ */
+static __thread int apxc_event_count;
+static __thread char apxc_event_names[APXC_MAX_EVENTS][APXC_EVENT_NAME_MAX];
+
 static int darshan_log_get_apxc_rec(darshan_fd fd, void** buf_p);
 static int darshan_log_put_apxc_rec(darshan_fd fd, void* buf);
 static void darshan_log_print_apxc_rec(void *file_rec,
@@ -42,6 +74,7 @@ static void darshan_log_print_apxc_rec(void *file_rec,
 static void darshan_log_print_apxc_description(int ver);
 static void darshan_log_print_apxc_rec_diff(void *file_rec1, char *file_name1,
     void *file_rec2, char *file_name2);
+static void darshan_log_agg_apxc_recs(void *rec, void *agg_rec, int init_flag);
 
 struct darshan_mod_logutil_funcs apxc_logutils =
 {
@@ -50,24 +83,217 @@ struct darshan_mod_logutil_funcs apxc_logutils =
     .log_print_record = &darshan_log_print_apxc_rec,
     .log_print_description = &darshan_log_print_apxc_description,
     .log_print_diff = &darshan_log_print_apxc_rec_diff,
-    .log_agg_records = NULL
+    .log_agg_records = &darshan_log_agg_apxc_recs
 };
 
+/* fill in the default event set of a v1 header record, which predates it */
+static void darshan_log_convert_apxc_v1_header_rec(struct darshan_apxc_header_record *hdr_rec)
+{
+    char *names = (char *)(hdr_rec + 1);
+    uint64_t size = 0;
+    size_t len;
+    int i;
+
+    hdr_rec->event_count = APXC_V1_NUM_INDICES;
+    for (i = 0; i < APXC_V1_NUM_INDICES; i++)
+    {
+        len = strlen(apxc_default_events[i]);
+        memcpy(names + size, apxc_default_events[i], len + 1);
+        size += len + 1;
+    }
+    hdr_rec->event_names_size = APXC_EVENT_NAMES_SIZE(size);
+    memset(names + size, 0, hdr_rec->event_names_size - size);
+
+    return;
+}
+
+/* remember the event names of a header record for printing perf records */
+static void darshan_log_save_apxc_event_names(struct darshan_apxc_header_record *hdr_rec)
+{
+    char *names = (char *)(hdr_rec + 1);
+    uint64_t off = 0;
+    size_t len;
+    int i;
+
+    apxc_event_count = hdr_rec->event_count;
+    if (apxc_event_count > APXC_MAX_EVENTS)
+        apxc_event_count = APXC_MAX_EVENTS;
+    for (i = 0; i < apxc_event_count; i++)
+    {
+        len = off < hdr_rec->event_names_size ?
+            strnlen(names + off, hdr_rec->event_names_size - off) : 0;
+        snprintf(apxc_event_names[i], APXC_EVENT_NAME_MAX, "%.*s", (int)len,
+            names + off);
+        off += len + 1;
+    }
+
+    return;
+}
+
+/* name of the ith counter of a perf record, as printed */
+static char *darshan_log_apxc_counter_name(int i)
+{
+    static __thread char name[APXC_EVENT_NAME_MAX + 8];
+
+    snprintf(name, sizeof(name), "APXC_%s", apxc_event_names[i]);
+
+    return(name);
+}
+
+/* counters of a perf record that have a name in the last header record */
+static int darshan_log_apxc_counter_count(struct darshan_apxc_perf_record *prf_rec)
+{
+    if (prf_rec->event_count < apxc_event_count)
+        return(prf_rec->event_count);
+    return(apxc_event_count);
+}
+
+/* name of the ith counter of a sample, as printed */
+static char *darshan_log_apxc_sample_name(int i)
+{
+    static __thread char name[APXC_EVENT_NAME_MAX + 16];
+
+    snprintf(name, sizeof(name), "APXC_SAMPLE_%s", apxc_event_names[i]);
+
+    return(name);
+}
+
+/* decode the varint at *off of a sample record's data, moving *off past it */
+static uint64_t darshan_log_get_apxc_varint(unsigned char *data, uint64_t size,
+    uint64_t *off)
+{
+    uint64_t val = 0;
+    int shift = 0;
+    unsigned char b;
+
+    do
+    {
+        if (*off >= size)
+            return(val);
+        b = data[(*off)++];
+        if (shift < 64)
+            val |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+
+    return(val);
+}
+
+/* print the summary of a sample record, then each sample as its end time
+ * followed by the events that increased during it
+ */
+static void darshan_log_print_apxc_samples(struct darshan_apxc_sample_record *smp_rec)
+{
+    unsigned char *data = (unsigned char *)(smp_rec + 1);
+    uint64_t off = 0;
+    uint64_t delta;
+    uint64_t s;
+    double time = smp_rec->start_time;
+    int i;
+
+    DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APXC_GROUP", smp_rec->group, "", "", "");
+    DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APXC_CHASSIS", smp_rec->chassis, "", "", "");
+    DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APXC_BLADE", smp_rec->blade, "", "", "");
+    DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APXC_NODE", smp_rec->node, "", "", "");
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APXC_SAMPLE_INTERVAL", smp_rec->interval, "", "", "");
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APXC_SAMPLE_COUNT", smp_rec->sample_count, "", "", "");
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APXC_SAMPLE_DROPPED", smp_rec->dropped_count, "", "", "");
+    DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APXC_SAMPLE_START_TIME", smp_rec->start_time, "", "", "");
+
+    for (s = 0; s < smp_rec->sample_count; s++)
+    {
+        time += darshan_log_get_apxc_varint(data, smp_rec->data_size, &off) / 1e6;
+        DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+            smp_rec->base_rec.rank, smp_rec->base_rec.id,
+            "APXC_SAMPLE_TIME", time, "", "", "");
+        for (i = 0; i < apxc_event_count; i++)
+        {
+            delta = darshan_log_get_apxc_varint(data, smp_rec->data_size, &off);
+            if (delta)
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+                    smp_rec->base_rec.rank, smp_rec->base_rec.id,
+                    darshan_log_apxc_sample_name(i), delta, "", "", "");
+        }
+    }
+
+    return;
+}
+
+/* print the number of routers used by the job, then each router with
+ * the number of ranks on it
+ */
+static void darshan_log_print_apxc_placement(
+    struct darshan_apxc_placement_record *plc_rec)
+{
+    struct darshan_apxc_router_entry *entry =
+        (struct darshan_apxc_router_entry *)(plc_rec + 1);
+    uint64_t r;
+
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+        plc_rec->base_rec.rank, plc_rec->base_rec.id,
+        "APXC_PLACEMENT_ROUTERS", plc_rec->router_count, "", "", "");
+
+    for (r = 0; r < plc_rec->router_count; r++)
+    {
+        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+            plc_rec->base_rec.rank, plc_rec->base_rec.id,
+            "APXC_ROUTER_GROUP", entry[r].group, "", "", "");
+        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+            plc_rec->base_rec.rank, plc_rec->base_rec.id,
+            "APXC_ROUTER_CHASSIS", entry[r].chassis, "", "", "");
+        DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+            plc_rec->base_rec.rank, plc_rec->base_rec.id,
+            "APXC_ROUTER_BLADE", entry[r].blade, "", "", "");
+        DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+            plc_rec->base_rec.rank, plc_rec->base_rec.id,
+            "APXC_ROUTER_RANKS", entry[r].ranks, "", "", "");
+    }
+
+    return;
+}
+
 static int darshan_log_get_apxc_rec(darshan_fd fd, void** buf_p)
 {
     struct darshan_apxc_header_record *hdr_rec;
     struct darshan_apxc_perf_record *prf_rec;
-    int rec_len;
+    struct darshan_apxc_sample_record *smp_rec;
+    struct darshan_apxc_placement_record *plc_rec;
+    struct darshan_apxc_router_entry *entry;
+    uint64_t tail_len = 0;
+    int prefix_len = offsetof(struct darshan_apxc_sample_record, group);
+    int rec_len = 0;
+    int tail_off = 0;
+    int ver;
+    int64_t magic;
     char *buffer;
+    char *tmp;
     int i;
     int ret = -1;
-    static int first_rec = 1;
+    int is_hdr = 0;
+    int is_smp = 0;
+    int is_plc = 0;
 
     if(fd->mod_map[DARSHAN_APXC_MOD].len == 0)
         return(0);
 
-    if(fd->mod_ver[DARSHAN_APXC_MOD] == 0 ||
-        fd->mod_ver[DARSHAN_APXC_MOD] > APXC_VER)
+    ver = fd->mod_ver[DARSHAN_APXC_MOD];
+    if(ver == 0 || ver > APXC_VER)
     {
         fprintf(stderr, "Error: Invalid APXC module version number (got %d)\n",
             fd->mod_ver[DARSHAN_APXC_MOD]);
@@ -76,8 +302,7 @@ static int darshan_log_get_apxc_rec(darshan_fd fd, void** buf_p)
 
     if (!*buf_p)
     {
-        /* assume this is the largest possible record size */
-        buffer = malloc(sizeof(struct darshan_apxc_perf_record));
+        buffer = malloc(APXC_REC_BUF_SIZE);
         if (!buffer)
         {
             return(-1);
@@ -88,91 +313,237 @@ static int darshan_log_get_apxc_rec(darshan_fd fd, void** buf_p)
         buffer = *buf_p;
     }
 
-    if (fd->mod_ver[DARSHAN_APXC_MOD] < APXC_VER)
+    /* the start shared by all records tells the header, sample and
+     * placement records apart by their magic; perf records have their
+     * group there
+     */
+    ret = darshan_log_get_mod(fd, DARSHAN_APXC_MOD, buffer, prefix_len);
+    if (ret <= 0)
     {
-        /* perform conversion as needed */
+        if (!*buf_p) free(buffer);
+        return(ret < 0 ? -1 : 0);
+    }
+    if (ret != prefix_len)
+    {
+        if (!*buf_p) free(buffer);
+        return(-1);
     }
 
-    /* v1, current version */
-    if (fd->mod_ver[DARSHAN_APXC_MOD] == APXC_VER)
+    magic = ((struct darshan_apxc_sample_record *)buffer)->magic;
+    if (fd->swap_flag)
+        DARSHAN_BSWAP64(&magic);
+    is_hdr = magic == APXC_MAGIC;
+    is_smp = !is_hdr && ver > 1 && magic == APXC_SAMPLE_MAGIC;
+    is_plc = !is_hdr && ver > 1 && magic == APXC_PLACEMENT_MAGIC;
+
+    /* each record is a fixed part followed by a tail, the size of which
+     * the fixed part gives; v1 header records have no tail, and the
+     * counters of v1 perf records are read to where they now start
+     */
+    if (is_hdr)
     {
-        if (first_rec)
-        {
-            rec_len = sizeof(struct darshan_apxc_header_record);
-            first_rec = 0;
-        }
-        else
-            rec_len = sizeof(struct darshan_apxc_perf_record);
+        rec_len = ver == 1 ? APXC_V1_HEADER_SIZE : sizeof(*hdr_rec);
+        tail_off = sizeof(*hdr_rec);
+    }
+    else if (is_smp)
+        rec_len = tail_off = sizeof(*smp_rec);
+    else if (is_plc)
+        rec_len = tail_off = sizeof(*plc_rec);
+    else
+    {
+        rec_len = ver == 1 ? APXC_V1_PERF_SIZE : sizeof(*prf_rec);
+        tail_off = sizeof(*prf_rec);
+    }
 
-        ret = darshan_log_get_mod(fd, DARSHAN_APXC_MOD, buffer, rec_len);
+    ret = darshan_log_get_mod(fd, DARSHAN_APXC_MOD, buffer + prefix_len,
+        rec_len - prefix_len);
+    if (ret != rec_len - prefix_len)
+    {
+        if (!*buf_p) free(buffer);
+        return(-1);
     }
 
-    if (ret == rec_len)
+    if (is_hdr)
     {
-        if(fd->swap_flag)
+        hdr_rec = (struct darshan_apxc_header_record *)buffer;
+        if (fd->swap_flag)
         {
-            if (rec_len == sizeof(struct darshan_apxc_header_record))
-            {
-                hdr_rec = (struct darshan_apxc_header_record*)buffer; 
-                /* swap bytes if necessary */
-                DARSHAN_BSWAP64(&(hdr_rec->base_rec.id));
-                DARSHAN_BSWAP64(&(hdr_rec->base_rec.rank));
-                DARSHAN_BSWAP64(&(hdr_rec->magic));
-                DARSHAN_BSWAP64(&(hdr_rec->nblades));
-                DARSHAN_BSWAP64(&(hdr_rec->nchassis));
-                DARSHAN_BSWAP64(&(hdr_rec->ngroups));
-                DARSHAN_BSWAP64(&(hdr_rec->memory_mode));
-                DARSHAN_BSWAP64(&(hdr_rec->cluster_mode));
-                DARSHAN_BSWAP64(&(hdr_rec->appid));
-            }
-            else
+            DARSHAN_BSWAP64(&(hdr_rec->base_rec.id));
+            DARSHAN_BSWAP64(&(hdr_rec->base_rec.rank));
+            DARSHAN_BSWAP64(&(hdr_rec->magic));
+            DARSHAN_BSWAP64(&(hdr_rec->nblades));
+            DARSHAN_BSWAP64(&(hdr_rec->nchassis));
+            DARSHAN_BSWAP64(&(hdr_rec->ngroups));
+            DARSHAN_BSWAP64(&(hdr_rec->memory_mode));
+            DARSHAN_BSWAP64(&(hdr_rec->cluster_mode));
+            DARSHAN_BSWAP64(&(hdr_rec->appid));
+            if (ver > 1)
             {
-                prf_rec = (struct darshan_apxc_perf_record*)buffer;
-                DARSHAN_BSWAP64(&(prf_rec->base_rec.id));
-                DARSHAN_BSWAP64(&(prf_rec->base_rec.rank));
-                DARSHAN_BSWAP64(&(prf_rec->group));
-                DARSHAN_BSWAP64(&(prf_rec->chassis));
-                DARSHAN_BSWAP64(&(prf_rec->blade));
-                DARSHAN_BSWAP64(&(prf_rec->node));
-                for (i = 0; i < APXC_NUM_INDICES; i++)
-                {
-                    DARSHAN_BSWAP64(&prf_rec->counters[i]);
-                }
+                DARSHAN_BSWAP64(&(hdr_rec->event_count));
+                DARSHAN_BSWAP64(&(hdr_rec->event_names_size));
             }
         }
-        *buf_p = buffer;
-        return(1);
+        if (ver > 1 && (hdr_rec->event_count > APXC_MAX_EVENTS ||
+            hdr_rec->event_names_size > APXC_MAX_EVENTS * APXC_EVENT_NAME_MAX))
+        {
+            fprintf(stderr, "Error: invalid APXC header record size\n");
+            if (!*buf_p) free(buffer);
+            return(-1);
+        }
+        tail_len = ver == 1 ? 0 : hdr_rec->event_names_size;
     }
-    else if (ret < 0)
+    else if (is_smp)
     {
-     //*buf_p = NULL;
-     //  if (buffer) free(buffer);
-        if (!*buf_p) free(buffer);
-        return(-1);
+        smp_rec = (struct darshan_apxc_sample_record *)buffer;
+        if (fd->swap_flag)
+        {
+            DARSHAN_BSWAP64(&(smp_rec->base_rec.id));
+            DARSHAN_BSWAP64(&(smp_rec->base_rec.rank));
+            DARSHAN_BSWAP64(&(smp_rec->magic));
+            DARSHAN_BSWAP64(&(smp_rec->group));
+            DARSHAN_BSWAP64(&(smp_rec->chassis));
+            DARSHAN_BSWAP64(&(smp_rec->blade));
+            DARSHAN_BSWAP64(&(smp_rec->node));
+            DARSHAN_BSWAP64(&(smp_rec->interval));
+            DARSHAN_BSWAP64(&(smp_rec->sample_count));
+            DARSHAN_BSWAP64(&(smp_rec->dropped_count));
+            DARSHAN_BSWAP64(&(smp_rec->data_size));
+            DARSHAN_BSWAP64(&(smp_rec->start_time));
+        }
+        if (smp_rec->data_size > APXC_SAMPLE_MAX_BYTES)
+        {
+            fprintf(stderr, "Error: invalid APXC sample record size\n");
+            if (!*buf_p) free(buffer);
+            return(-1);
+        }
+        tail_len = smp_rec->data_size;
+    }
+    else if (is_plc)
+    {
+        plc_rec = (struct darshan_apxc_placement_record *)buffer;
+        if (fd->swap_flag)
+        {
+            DARSHAN_BSWAP64(&(plc_rec->base_rec.id));
+            DARSHAN_BSWAP64(&(plc_rec->base_rec.rank));
+            DARSHAN_BSWAP64(&(plc_rec->magic));
+            DARSHAN_BSWAP64(&(plc_rec->router_count));
+        }
+        if (plc_rec->router_count > APXC_MAX_ROUTERS)
+        {
+            fprintf(stderr, "Error: invalid APXC placement record size\n");
+            if (!*buf_p) free(buffer);
+            return(-1);
+        }
+        tail_len = plc_rec->router_count *
+            sizeof(struct darshan_apxc_router_entry);
     }
     else
     {
-     //  *buf_p = NULL;
-     //  if (buffer) free(buffer);
+        prf_rec = (struct darshan_apxc_perf_record *)buffer;
+        if (fd->swap_flag)
+        {
+            DARSHAN_BSWAP64(&(prf_rec->base_rec.id));
+            DARSHAN_BSWAP64(&(prf_rec->base_rec.rank));
+            DARSHAN_BSWAP64(&(prf_rec->group));
+            DARSHAN_BSWAP64(&(prf_rec->chassis));
+            DARSHAN_BSWAP64(&(prf_rec->blade));
+            DARSHAN_BSWAP64(&(prf_rec->node));
+            if (ver > 1)
+                DARSHAN_BSWAP64(&(prf_rec->event_count));
+        }
+        if (ver == 1)
+            prf_rec->event_count = APXC_V1_NUM_INDICES;
+        if (prf_rec->event_count > APXC_MAX_EVENTS)
+        {
+            fprintf(stderr, "Error: invalid APXC perf record size\n");
+            if (!*buf_p) free(buffer);
+            return(-1);
+        }
+        tail_len = prf_rec->event_count * sizeof(uint64_t);
+    }
+
+    /* samples and routers may not fit the buffer, which is left large
+     * enough for any header or perf record read into it next
+     */
+    tmp = buffer;
+    if (tail_off + tail_len > APXC_REC_BUF_SIZE)
+        tmp = realloc(buffer, tail_off + tail_len);
+    if (!tmp)
+    {
         if (!*buf_p) free(buffer);
-        return(0);
+        return(-1);
+    }
+    if (*buf_p)
+        *buf_p = tmp;
+    buffer = tmp;
+
+    if (tail_len > 0)
+    {
+        ret = darshan_log_get_mod(fd, DARSHAN_APXC_MOD, buffer + tail_off,
+            tail_len);
+        if (ret != tail_len)
+        {
+            if (!*buf_p) free(buffer);
+            return(-1);
+        }
+    }
+
+    /* sample data and event names are bytes, but counters and router
+     * entries need a swap
+     */
+    if (is_hdr)
+    {
+        hdr_rec = (struct darshan_apxc_header_record *)buffer;
+        if (ver == 1)
+            darshan_log_convert_apxc_v1_header_rec(hdr_rec);
+        else if (hdr_rec->event_names_size > 0)
+            /* names never run past the table */
+            ((char *)(hdr_rec + 1))[hdr_rec->event_names_size - 1] = '\0';
     }
+    else if (is_plc && fd->swap_flag)
+    {
+        plc_rec = (struct darshan_apxc_placement_record *)buffer;
+        entry = (struct darshan_apxc_router_entry *)(plc_rec + 1);
+        for (i = 0; i < plc_rec->router_count; i++)
+        {
+            DARSHAN_BSWAP32(&(entry[i].group));
+            DARSHAN_BSWAP32(&(entry[i].chassis));
+            DARSHAN_BSWAP32(&(entry[i].blade));
+            DARSHAN_BSWAP32(&(entry[i].ranks));
+        }
+    }
+    else if (!is_smp && !is_plc && fd->swap_flag)
+    {
+        prf_rec = (struct darshan_apxc_perf_record *)buffer;
+        for (i = 0; i < prf_rec->event_count; i++)
+        {
+            DARSHAN_BSWAP64(&prf_rec->counters[i]);
+        }
+    }
+
+    *buf_p = buffer;
+    return(1);
 }
 
 static int darshan_log_put_apxc_rec(darshan_fd fd, void* buf)
 {
     int ret;
     int rec_len;
-    static int first_rec = 1;
+    struct darshan_apxc_header_record *hdr_rec = buf;
+    struct darshan_apxc_sample_record *smp_rec = buf;
+    struct darshan_apxc_placement_record *plc_rec = buf;
+    struct darshan_apxc_perf_record *prf_rec = buf;
 
-    if (first_rec)
-    {
-        rec_len = sizeof(struct darshan_apxc_header_record);
-        first_rec = 0;
-    }
+    if (hdr_rec->magic == APXC_MAGIC)
+        rec_len = sizeof(*hdr_rec) + hdr_rec->event_names_size;
+    else if (smp_rec->magic == APXC_SAMPLE_MAGIC)
+        rec_len = sizeof(*smp_rec) + smp_rec->data_size;
+    else if (plc_rec->magic == APXC_PLACEMENT_MAGIC)
+        rec_len = sizeof(*plc_rec) + plc_rec->router_count *
+            sizeof(struct darshan_apxc_router_entry);
     else
-        rec_len = sizeof(struct darshan_apxc_perf_record);
-    
+        rec_len = sizeof(*prf_rec) + prf_rec->event_count * sizeof(uint64_t);
+
     ret = darshan_log_put_mod(fd, DARSHAN_APXC_MOD, buf,
                               rec_len, APXC_VER);
     if(ret < 0)
@@ -185,11 +556,10 @@ static void darshan_log_print_apxc_rec(void *rec, char *file_name,
     char *mnt_pt, char *fs_type)
 {
     int i;
-    static int first_rec = 1;
     struct darshan_apxc_header_record *hdr_rec;
     struct darshan_apxc_perf_record *prf_rec;
     
-    if (first_rec)
+    if (((struct darshan_apxc_header_record *)rec)->magic == APXC_MAGIC)
     { 
         hdr_rec = rec;
         DARSHAN_D_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
@@ -216,7 +586,18 @@ static void darshan_log_print_apxc_rec(void *rec, char *file_name,
         DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
             hdr_rec->base_rec.rank, hdr_rec->base_rec.id,
             "APXC_APPLICATION_ID", hdr_rec->appid, "", "", "");
-        first_rec = 0;
+        DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+            hdr_rec->base_rec.rank, hdr_rec->base_rec.id,
+            "APXC_EVENT_COUNT", hdr_rec->event_count, "", "", "");
+        darshan_log_save_apxc_event_names(hdr_rec);
+    }
+    else if (((struct darshan_apxc_sample_record *)rec)->magic == APXC_SAMPLE_MAGIC)
+    {
+        darshan_log_print_apxc_samples(rec);
+    }
+    else if (((struct darshan_apxc_placement_record *)rec)->magic == APXC_PLACEMENT_MAGIC)
+    {
+        darshan_log_print_apxc_placement(rec);
     }
     else
     {
@@ -235,12 +616,12 @@ static void darshan_log_print_apxc_rec(void *rec, char *file_name,
             prf_rec->base_rec.rank, prf_rec->base_rec.id,
             "APXC_NODE", prf_rec->node, "", "", "");
 
-        for(i = 0; i < APXC_NUM_INDICES; i++)
+        for(i = 0; i < darshan_log_apxc_counter_count(prf_rec); i++)
         {
             
             DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
                 prf_rec->base_rec.rank, prf_rec->base_rec.id,
-                apxc_counter_names[i], prf_rec->counters[i],
+                darshan_log_apxc_counter_name(i), prf_rec->counters[i],
                 "", "", "");
         }
     }
@@ -259,21 +640,136 @@ static void darshan_log_print_apxc_description(int ver)
     printf("#     APXC_CLUSTER_MODE: Intel Xeon NUMA configuration\n");
     printf("#     APXC_MEMORY_MODE_CONSISTENT: Intel Xeon memory mode consistent across all nodes\n");
     printf("#     APXC_CLUSTER_MODE_CONSISTENT: Intel Xeon cluster mode consistent across all nodes\n");
+    printf("#     APXC_EVENT_COUNT: number of PAPI events counted on each router\n");
     printf("#   per-router statistics for the APXC module:\n");
     printf("#     APXC_GROUP:   group this router is on\n");
     printf("#     APXC_CHASSIS: chassis this router is on\n");
     printf("#     APXC_BLADE:   blade this router is on\n");
     printf("#     APXC_NODE:    node connected to this router\n");
+    printf("#     APXC_<event>: count of each PAPI event, set with DARSHAN_APXC_EVENTS or\n");
+    printf("#       DARSHAN_APXC_EVENTS_FILE; the default events are:\n");
     printf("#     APXC_AR_RTR_* port counters for the 40 router-router ports\n");
     printf("#     APXC_AR_RTR_x_y_INQ_PRF_INCOMING_FLIT_VC[0-7]: flits on VCs of x y tile\n");
     printf("#     APXC_AR_RTR_x_y_INQ_PRF_ROWBUS_STALL_CNT: stalls on x y tile\n");
     printf("#     APXC_AR_RTR_PT_* port counters for the 8 router-nic ports\n");
     printf("#     APXC_AR_RTR_PT_x_y_INQ_PRF_INCOMING_FLIT_VC[0,4]: flits on VCs of x y tile\n");
     printf("#     APXC_AR_RTR_PT_x_y_INQ_PRF_REQ_ROWBUS_STALL_CNT: stalls on x y tile\n"); 
+    printf("#   per-router samples for the APXC module, with DARSHAN_APXC_SAMPLE_INTERVAL set:\n");
+    printf("#     APXC_SAMPLE_INTERVAL: requested time between samples in microseconds\n");
+    printf("#     APXC_SAMPLE_COUNT: number of samples held\n");
+    printf("#     APXC_SAMPLE_DROPPED: oldest samples dropped when the buffer of\n");
+    printf("#       DARSHAN_APXC_SAMPLE_BYTES filled up\n");
+    printf("#     APXC_SAMPLE_START_TIME: time the first sample counts from, in seconds\n");
+    printf("#     APXC_SAMPLE_TIME: end time of a sample, followed by\n");
+    printf("#     APXC_SAMPLE_<event>: increase of each event during that sample, if any\n");
+    printf("#   router placement map for the APXC module:\n");
+    printf("#     APXC_PLACEMENT_ROUTERS: number of routers used by the job, each as\n");
+    printf("#     APXC_ROUTER_GROUP, APXC_ROUTER_CHASSIS, APXC_ROUTER_BLADE: router position\n");
+    printf("#     APXC_ROUTER_RANKS: number of ranks on that router\n");
+
+    return;
+}
+
+/* print the summary of one sample record, prefixed with sign */
+static void darshan_log_print_apxc_sample_summary(
+    struct darshan_apxc_sample_record *smp_rec, char *sign)
+{
+    printf("%s", sign);
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APXC_SAMPLE_INTERVAL", smp_rec->interval, "", "", "");
+    printf("%s", sign);
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APXC_SAMPLE_COUNT", smp_rec->sample_count, "", "", "");
+    printf("%s", sign);
+    DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APXC_SAMPLE_DROPPED", smp_rec->dropped_count, "", "", "");
+    printf("%s", sign);
+    DARSHAN_F_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+        smp_rec->base_rec.rank, smp_rec->base_rec.id,
+        "APXC_SAMPLE_START_TIME", smp_rec->start_time, "", "", "");
+
+    return;
+}
+
+/* sample records only differ when their summary or samples do */
+static void darshan_log_print_apxc_sample_diff(
+    struct darshan_apxc_sample_record *smp_rec1,
+    struct darshan_apxc_sample_record *smp_rec2)
+{
+    if (smp_rec1 && smp_rec2 &&
+        smp_rec1->interval == smp_rec2->interval &&
+        smp_rec1->sample_count == smp_rec2->sample_count &&
+        smp_rec1->dropped_count == smp_rec2->dropped_count &&
+        smp_rec1->start_time == smp_rec2->start_time &&
+        smp_rec1->data_size == smp_rec2->data_size &&
+        memcmp(smp_rec1 + 1, smp_rec2 + 1, smp_rec1->data_size) == 0)
+        return;
+
+    if (smp_rec1)
+        darshan_log_print_apxc_sample_summary(smp_rec1, "- ");
+    if (smp_rec2)
+        darshan_log_print_apxc_sample_summary(smp_rec2, "+ ");
 
     return;
 }
 
+/* placement records only differ when their routers do */
+static void darshan_log_print_apxc_placement_diff(
+    struct darshan_apxc_placement_record *plc_rec1,
+    struct darshan_apxc_placement_record *plc_rec2)
+{
+    if (plc_rec1 && plc_rec2 &&
+        plc_rec1->router_count == plc_rec2->router_count &&
+        memcmp(plc_rec1 + 1, plc_rec2 + 1, plc_rec1->router_count *
+            sizeof(struct darshan_apxc_router_entry)) == 0)
+        return;
+
+    if (plc_rec1)
+    {
+        printf("- ");
+        DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+            plc_rec1->base_rec.rank, plc_rec1->base_rec.id,
+            "APXC_PLACEMENT_ROUTERS", plc_rec1->router_count, "", "", "");
+    }
+    if (plc_rec2)
+    {
+        printf("+ ");
+        DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+            plc_rec2->base_rec.rank, plc_rec2->base_rec.id,
+            "APXC_PLACEMENT_ROUTERS", plc_rec2->router_count, "", "", "");
+    }
+
+    return;
+}
+
+/* index of the first counter from i on that differs between the arrays a
+ * and b of n counters, or n. Blocks of counters are compared without a
+ * branch per counter, which vectorizes, so the events of a router that did
+ * not change are skipped at little more than the cost of reading them.
+ */
+#define APXC_DIFF_BLOCK 8
+
+static int apxc_next_diff(const uint64_t *a, const uint64_t *b, int i, int n)
+{
+    uint64_t d;
+    int j;
+
+    for(; i + APXC_DIFF_BLOCK <= n; i += APXC_DIFF_BLOCK)
+    {
+        d = 0;
+        for(j = 0; j < APXC_DIFF_BLOCK; j++)
+            d |= a[i+j] ^ b[i+j];
+        if(d)
+            break;
+    }
+    for(; i < n && a[i] == b[i]; i++);
+
+    return(i);
+}
+
 static void darshan_log_print_apxc_rec_diff(void *file_rec1, char *file_name1,
     void *file_rec2, char *file_name2)
 {
@@ -281,15 +777,24 @@ static void darshan_log_print_apxc_rec_diff(void *file_rec1, char *file_name1,
     struct darshan_apxc_header_record *hdr_rec2;
     struct darshan_apxc_perf_record   *prf_rec1;
     struct darshan_apxc_perf_record   *prf_rec2;
+    struct darshan_apxc_sample_record *smp_rec1;
+    struct darshan_apxc_sample_record *smp_rec2;
+    struct darshan_apxc_placement_record *plc_rec1;
+    struct darshan_apxc_placement_record *plc_rec2;
 
     hdr_rec1 = (struct darshan_apxc_header_record*) file_rec1;
     hdr_rec2 = (struct darshan_apxc_header_record*) file_rec2;
     prf_rec1 = (struct darshan_apxc_perf_record*) file_rec1;
     prf_rec2 = (struct darshan_apxc_perf_record*) file_rec2;
+    smp_rec1 = (struct darshan_apxc_sample_record*) file_rec1;
+    smp_rec2 = (struct darshan_apxc_sample_record*) file_rec2;
+    plc_rec1 = (struct darshan_apxc_placement_record*) file_rec1;
+    plc_rec2 = (struct darshan_apxc_placement_record*) file_rec2;
 
     if (hdr_rec1->magic == APXC_MAGIC)
     {
         /* this is the header record */
+        darshan_log_save_apxc_event_names(hdr_rec1 ? hdr_rec1 : hdr_rec2);
         if (!hdr_rec2)
         {
             printf("- ");
@@ -454,8 +959,28 @@ static void darshan_log_print_apxc_rec_diff(void *file_rec1, char *file_name1,
                 hdr_rec2->base_rec.rank, hdr_rec2->base_rec.id,
                 "APXC_APPLICATION_ID", hdr_rec2->appid, "", "", "");
             }
+            if (hdr_rec1->event_count != hdr_rec2->event_count)
+            {
+                printf("- ");
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+                hdr_rec1->base_rec.rank, hdr_rec1->base_rec.id,
+                "APXC_EVENT_COUNT", hdr_rec1->event_count, "", "", "");
+
+                printf("+ ");
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+                hdr_rec2->base_rec.rank, hdr_rec2->base_rec.id,
+                "APXC_EVENT_COUNT", hdr_rec2->event_count, "", "", "");
+            }
         }
     }
+    else if ((smp_rec1 ? smp_rec1 : smp_rec2)->magic == APXC_SAMPLE_MAGIC)
+    {
+        darshan_log_print_apxc_sample_diff(smp_rec1, smp_rec2);
+    }
+    else if ((plc_rec1 ? plc_rec1 : plc_rec2)->magic == APXC_PLACEMENT_MAGIC)
+    {
+        darshan_log_print_apxc_placement_diff(plc_rec1, plc_rec2);
+    }
     else
     {
         if (!prf_rec2)
@@ -543,38 +1068,66 @@ static void darshan_log_print_apxc_rec_diff(void *file_rec1, char *file_name1,
             }
         } 
 
-        int i;
+        int i, n, n1, n2;
         /* router tile record */
-        for(i = 0; i < APXC_NUM_INDICES; i++)
+        if (!prf_rec2)
         {
-            if (!prf_rec2)
+            for(i = 0; i < darshan_log_apxc_counter_count(prf_rec1); i++)
             {
                 printf("- ");
                 DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
                 prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                apxc_counter_names[i], prf_rec1->counters[i],
+                darshan_log_apxc_counter_name(i), prf_rec1->counters[i],
                 "", "", "");
             }
-            else if (!prf_rec1)
+        }
+        else if (!prf_rec1)
+        {
+            for(i = 0; i < darshan_log_apxc_counter_count(prf_rec2); i++)
             {
                 printf("+ ");
                 DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
                 prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                apxc_counter_names[i], prf_rec2->counters[i],
+                darshan_log_apxc_counter_name(i), prf_rec2->counters[i],
                 "", "", "");
             }
-            else if (prf_rec1->counters[i] != prf_rec2->counters[i])
+        }
+        else
+        {
+            /* counters both records have are compared, the rest printed */
+            n1 = darshan_log_apxc_counter_count(prf_rec1);
+            n2 = darshan_log_apxc_counter_count(prf_rec2);
+            n = n1 < n2 ? n1 : n2;
+            for(i = apxc_next_diff(prf_rec1->counters, prf_rec2->counters, 0, n);
+                i < n;
+                i = apxc_next_diff(prf_rec1->counters, prf_rec2->counters, i + 1, n))
             {
                 printf("- ");
                 DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
                 prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
-                apxc_counter_names[i], prf_rec1->counters[i],
+                darshan_log_apxc_counter_name(i), prf_rec1->counters[i],
                 "", "", "");
 
                 printf("+ ");
                 DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
                 prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
-                apxc_counter_names[i], prf_rec2->counters[i],
+                darshan_log_apxc_counter_name(i), prf_rec2->counters[i],
+                "", "", "");
+            }
+            for(i = n2; i < n1; i++)
+            {
+                printf("- ");
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+                prf_rec1->base_rec.rank, prf_rec1->base_rec.id,
+                darshan_log_apxc_counter_name(i), prf_rec1->counters[i],
+                "", "", "");
+            }
+            for(i = n1; i < n2; i++)
+            {
+                printf("+ ");
+                DARSHAN_U_COUNTER_PRINT(darshan_module_names[DARSHAN_APXC_MOD],
+                prf_rec2->base_rec.rank, prf_rec2->base_rec.id,
+                darshan_log_apxc_counter_name(i), prf_rec2->counters[i],
                 "", "", "");
             }
         }
@@ -583,6 +1136,64 @@ static void darshan_log_print_apxc_rec_diff(void *file_rec1, char *file_name1,
     return;
 }
 
+/* fold the perf record of a router, rec, into the aggregate perf record
+ * agg_rec, which is reset first if init_flag is set. The counters are
+ * summed over the routers, and a topology index is kept only while every
+ * router shares it. Header, sample and placement records are skipped.
+ * agg_rec must have room for APXC_MAX_EVENTS counters.
+ */
+static void darshan_log_agg_apxc_recs(void *rec, void *agg_rec, int init_flag)
+{
+    struct darshan_apxc_perf_record *prf_rec = rec;
+    struct darshan_apxc_perf_record *agg_prf_rec = agg_rec;
+    int64_t magic = ((struct darshan_apxc_sample_record *)rec)->magic;
+    int i;
+
+    if (init_flag)
+    {
+        memset(agg_prf_rec, 0, sizeof(*agg_prf_rec));
+        agg_prf_rec->base_rec.rank = -1;
+    }
+
+    if (magic == APXC_MAGIC || magic == APXC_SAMPLE_MAGIC ||
+        magic == APXC_PLACEMENT_MAGIC)
+        return;
+
+    /* an empty aggregate has no record id yet */
+    if (agg_prf_rec->base_rec.id == 0)
+    {
+        agg_prf_rec->base_rec.id = prf_rec->base_rec.id;
+        agg_prf_rec->group = prf_rec->group;
+        agg_prf_rec->chassis = prf_rec->chassis;
+        agg_prf_rec->blade = prf_rec->blade;
+        agg_prf_rec->node = prf_rec->node;
+    }
+    else
+    {
+        if (agg_prf_rec->group != prf_rec->group)
+            agg_prf_rec->group = -1;
+        if (agg_prf_rec->chassis != prf_rec->chassis)
+            agg_prf_rec->chassis = -1;
+        if (agg_prf_rec->blade != prf_rec->blade)
+            agg_prf_rec->blade = -1;
+        if (agg_prf_rec->node != prf_rec->node)
+            agg_prf_rec->node = -1;
+    }
+
+    /* the aggregate grows to the longest record; counters a record does
+     * not have count as 0
+     */
+    for (i = agg_prf_rec->event_count; i < prf_rec->event_count; i++)
+        agg_prf_rec->counters[i] = 0;
+    if (agg_prf_rec->event_count < prf_rec->event_count)
+        agg_prf_rec->event_count = prf_rec->event_count;
+    for (i = 0; i < prf_rec->event_count; i++)
+        agg_prf_rec->counters[i] += prf_rec->counters[i];
+
+    return;
+}
+
+
 /*
  * Local variables:
  *  c-indent-level: 4
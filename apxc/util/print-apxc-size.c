@@ -7,6 +7,9 @@ int main (int argc, char **argv)
    printf ("APXC_NUM_INDICES = %d\n", APXC_NUM_INDICES);
    printf ("sizeof darshan_apxc_header_record = %d\n", sizeof(struct darshan_apxc_header_record));
    printf ("sizeof darshan_apxc_perf_record = %d\n", sizeof(struct darshan_apxc_perf_record));
+   printf ("sizeof darshan_apxc_sample_record = %d\n", sizeof(struct darshan_apxc_sample_record));
+   printf ("sizeof darshan_apxc_placement_record = %d\n", sizeof(struct darshan_apxc_placement_record));
+   printf ("sizeof darshan_apxc_router_entry = %d\n", sizeof(struct darshan_apxc_router_entry));
 
    return 0;
 }
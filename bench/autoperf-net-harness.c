@@ -0,0 +1,877 @@
+/*
+ * Copyright (C) 2017 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Runs the APXC or APSS module off the machine, against the stub
+ * darshan-core, the fake PAPI in this directory and fake node information,
+ * checking and timing its shutdown reduction with any number of ranks.
+ *
+ * Every rank pretends to sit on its own compute node (or shares one with
+ * -n ranks per node). APXC nodes are laid out as on Cray XC, with 4 nodes
+ * per blade, 16 blades per chassis and 6 chassis per group, and the module
+ * reads its coordinates from a per-rank cname file and the memory and
+ * cluster mode from a per-rank hwinfo file. APSS nodes get HPE Cray EX
+ * x-names, which the harness hands to the module as the hostname while it
+ * initializes: 2 boards of 2 nodes per slot, in slots 3, 8 and 13 of
+ * chassis 1, 3 and 5 of cabinets 3000, 3012 and so on, so that even small
+ * jobs span several slots, chassis and cabinets.
+ *
+ * After the reduction rank 0 checks the event name table in the header
+ * record, and the topology counts and the placement map against the
+ * routers (blades, or EX slots) the harness laid the ranks out on, none
+ * of which may be empty. It also checks that there is exactly one leader
+ * reading counters per router for APXC and per node for APSS, the first
+ * rank on each. Every leader checks that its counters are the fake PAPI
+ * values it read itself, one per recorded event, and that its perf record
+ * holds its coordinates; the other ranks check that they wrote no perf
+ * record. With DARSHAN_APXC_SAMPLE_INTERVAL
+ * or DARSHAN_APSS_SAMPLE_INTERVAL set, leaders also decode their
+ * sample record and check every delta against the fake PAPI reads; -w
+ * keeps the module running for that many milliseconds before the
+ * reduction so that samples are taken. The event set can be changed as for the real module, through
+ * DARSHAN_APXC_EVENTS or DARSHAN_APSS_EVENTS and their _FILE variants;
+ * the fake PAPI accepts any name. With DARSHAN_APSS_BACKEND=cxi, APSS reads
+ * a fake CXI telemetry tree of two devices instead, holding the default
+ * events or those of DARSHAN_APSS_EVENTS, which the harness advances by
+ * the second fake PAPI read before the reduction; leaders then check
+ * their counters and the sum of their sample deltas against that read.
+ *
+ * Timings are written as CSV on stdout, one line per phase, with the
+ * maximum over all ranks:
+ *
+ *   module,ranks,ranks_per_node,routers,phase,seconds
+ *
+ * followed by the output size over all ranks. Lines starting with '#'
+ * carry the verification result; the exit status is non zero if any
+ * check failed. Built from a static darshan-runtime build tree with
+ * either module:
+ *
+ *   mpicc -O2 -DHARNESS_APXC -I. -I<darshan-runtime> -I<darshan-runtime>/lib \
+ *       -I../apxc -I../apxc/lib \
+ *       -DAPXC_CNAME_PATH=\"cname\" -DAPXC_HWINFO_PATH=\"hwinfo.cray\" \
+ *       -o apxc-harness autoperf-net-harness.c darshan-core-stub.c papi-stub.c \
+ *       ../apxc/lib/darshan-apxc.c <darshan-runtime>/lib/lookup3.o -lpthread
+ *
+ *   mpicc -O2 -DHARNESS_APSS -I. -I<darshan-runtime> -I<darshan-runtime>/lib \
+ *       -I../apss -I../apss/lib -DAPSS_CXI_PATH=\"cxi\" \
+ *       -o apss-harness autoperf-net-harness.c darshan-core-stub.c papi-stub.c \
+ *       ../apss/lib/darshan-apss.c <darshan-runtime>/lib/lookup3.o -lpthread
+ *
+ * usage: apxc-harness [-n ranks per node] [-w milliseconds]
+ */
+
+#define _GNU_SOURCE
+#include "darshan-runtime-config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <mpi.h>
+
+#include "darshan.h"
+#include "darshan-core-stub.h"
+#include "papi.h"
+
+#define HARNESS_NODES_PER_BLADE 4
+#ifdef HARNESS_APXC
+#define HARNESS_BLADES_PER_CHASSIS 16
+#define HARNESS_CHASSIS_PER_GROUP 6
+#else
+/* slots of each chassis, and chassis of each cabinet, used on EX */
+#define HARNESS_BLADES_PER_CHASSIS 3
+#define HARNESS_CHASSIS_PER_GROUP 3
+#endif
+#define HARNESS_MAX_GROUPS 128
+#define HARNESS_APPID 4242
+
+#if defined(HARNESS_APXC)
+#include "darshan-apxc-log-format.h"
+#define HARNESS_MOD_NAME "apxc"
+#define HARNESS_MOD_UPPER "APXC"
+#define HARNESS_HEADER_NAME "darshan-apxc-header"
+#define HARNESS_PERF_NAME "APXC"
+#define HARNESS_SAMPLE_NAME "APXC-SAMPLES"
+#define HARNESS_SAMPLE_MAGIC APXC_SAMPLE_MAGIC
+#define HARNESS_PLACEMENT_NAME "APXC-PLACEMENT"
+#define HARNESS_PLACEMENT_MAGIC APXC_PLACEMENT_MAGIC
+#define HARNESS_JOBID_ENV "ALPS_APP_ID"
+#define HARNESS_NUM_INDICES APXC_NUM_INDICES
+#define HARNESS_MAX_EVENTS APXC_MAX_EVENTS
+typedef struct darshan_apxc_header_record harness_header_record;
+typedef struct darshan_apxc_perf_record harness_perf_record;
+typedef struct darshan_apxc_sample_record harness_sample_record;
+typedef struct darshan_apxc_placement_record harness_placement_record;
+typedef struct darshan_apxc_router_entry harness_router_entry;
+extern void apxc_runtime_initialize(void);
+#define harness_runtime_initialize apxc_runtime_initialize
+#elif defined(HARNESS_APSS)
+#include "darshan-apss-log-format.h"
+#define HARNESS_MOD_NAME "apss"
+#define HARNESS_MOD_UPPER "APSS"
+#define HARNESS_HEADER_NAME "darshan-apss-header"
+#define HARNESS_PERF_NAME "APSS"
+#define HARNESS_SAMPLE_NAME "APSS-SAMPLES"
+#define HARNESS_SAMPLE_MAGIC APSS_SAMPLE_MAGIC
+#define HARNESS_PLACEMENT_NAME "APSS-PLACEMENT"
+#define HARNESS_PLACEMENT_MAGIC APSS_PLACEMENT_MAGIC
+#define HARNESS_JOBID_ENV "PALS_APP_ID"
+#define HARNESS_NUM_INDICES APSS_NUM_INDICES
+#define HARNESS_MAX_EVENTS APSS_MAX_EVENTS
+typedef struct darshan_apss_header_record harness_header_record;
+typedef struct darshan_apss_perf_record harness_perf_record;
+typedef struct darshan_apss_sample_record harness_sample_record;
+typedef struct darshan_apss_placement_record harness_placement_record;
+typedef struct darshan_apss_router_entry harness_router_entry;
+extern void apss_runtime_initialize(void);
+#define harness_runtime_initialize apss_runtime_initialize
+#else
+#error "define HARNESS_APXC or HARNESS_APSS"
+#endif
+
+struct harness_coords
+{
+    int group;
+    int chassis;
+    int blade;
+    int node;
+};
+
+static int ranks_per_node = 1;
+static int my_rank;
+static int nprocs;
+static int failures = 0;
+
+/* set when APSS reads the fake CXI tree instead of the fake PAPI, whose
+ * counters move by the read below, which the fake PAPI would not give first
+ */
+static int harness_cxi = 0;
+#define HARNESS_CXI_READ 2
+
+/* hostname handed to the module while it initializes, if set */
+static char harness_hostname[HOST_NAME_MAX + 1];
+
+int gethostname(char *name, size_t len)
+{
+    struct utsname u;
+
+    if(harness_hostname[0])
+    {
+        strncpy(name, harness_hostname, len);
+        return(0);
+    }
+
+    if(uname(&u) < 0)
+        return(-1);
+    strncpy(name, u.nodename, len);
+
+    return(0);
+}
+
+static void harness_get_coords(int rank, struct harness_coords *c)
+{
+    int node_index = rank / ranks_per_node;
+
+    c->node = node_index % HARNESS_NODES_PER_BLADE;
+    node_index /= HARNESS_NODES_PER_BLADE;
+    c->blade = node_index % HARNESS_BLADES_PER_CHASSIS;
+    node_index /= HARNESS_BLADES_PER_CHASSIS;
+    c->chassis = node_index % HARNESS_CHASSIS_PER_GROUP;
+    c->group = node_index / HARNESS_CHASSIS_PER_GROUP;
+
+#ifdef HARNESS_APSS
+    /* spread out as on an EX system, keeping the ranks in router order */
+    c->group = 3000 + 12 * c->group;
+    c->chassis = 1 + 2 * c->chassis;
+    c->blade = 3 + 5 * c->blade;
+#endif
+
+    return;
+}
+
+/* router (blade) index of a rank, counting from 0 */
+static int harness_router(int rank)
+{
+    return(rank / ranks_per_node / HARNESS_NODES_PER_BLADE);
+}
+
+/* index of the rank's counter reader, counting from 0: one per router on
+ * APXC, one per node on APSS
+ */
+static int harness_leader(int rank)
+{
+#ifdef HARNESS_APXC
+    return(harness_router(rank));
+#else
+    return(rank / ranks_per_node);
+#endif
+}
+
+/* the modules find their node with a shared memory split, which the
+ * harness turns into nodes of ranks_per_node consecutive ranks
+ */
+int PMPI_Comm_split_type(MPI_Comm comm, int split_type, int key, MPI_Info info,
+    MPI_Comm *newcomm)
+{
+    int rank;
+
+    PMPI_Comm_rank(comm, &rank);
+    return(PMPI_Comm_split(comm, rank / ranks_per_node, key, newcomm));
+}
+
+static void harness_check(int ok, const char *what, long long got, long long expected)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "rank %d: %s is %lld, expected %lld\n",
+            my_rank, what, got, expected);
+        failures++;
+    }
+
+    return;
+}
+
+#ifdef HARNESS_APXC
+/* write the cname and hwinfo files the module reads into dir */
+static int harness_write_node_info(const char *dir, struct harness_coords *c)
+{
+    char path[PATH_MAX];
+    FILE *f;
+    int racki, rackj, cchassis;
+    int i;
+
+    /* inverse of get_xc_coords() */
+    rackj = c->group / 6;
+    racki = (c->group % 6) * 2 + c->chassis / 3;
+    cchassis = c->chassis % 3;
+
+    if(snprintf(path, sizeof(path), "%s/%s", dir, APXC_CNAME_PATH) >=
+        (int)sizeof(path))
+        return(-1);
+    f = fopen(path, "w");
+    if(!f)
+        return(-1);
+    fprintf(f, "c%d-%dc%ds%dn%d\n", racki, rackj, cchassis, c->blade, c->node);
+    fclose(f);
+
+    if(snprintf(path, sizeof(path), "%s/%s", dir, APXC_HWINFO_PATH) >=
+        (int)sizeof(path))
+        return(-1);
+    f = fopen(path, "w");
+    if(!f)
+        return(-1);
+    for(i = 0; i < HARNESS_NODES_PER_BLADE; i++)
+        fprintf(f, "mcdram_cfg[%d]=cache\nnuma_cfg[%d]=quad\n", i, i);
+    fclose(f);
+
+    return(0);
+}
+
+static void harness_remove_node_info(const char *dir)
+{
+    char path[PATH_MAX];
+
+    /* paths too long to have been written are skipped */
+    if(snprintf(path, sizeof(path), "%s/%s", dir, APXC_CNAME_PATH) <
+        (int)sizeof(path))
+        unlink(path);
+    if(snprintf(path, sizeof(path), "%s/%s", dir, APXC_HWINFO_PATH) <
+        (int)sizeof(path))
+        unlink(path);
+
+    return;
+}
+
+static int harness_advance_counters(const char *dir)
+{
+    return(0);
+}
+#else
+/* fake CXI tree the module must be built to read, relative to dir */
+#ifndef APSS_CXI_PATH
+#define APSS_CXI_PATH "cxi"
+#endif
+#define HARNESS_CXI_DEVICES 2
+
+#define X(a) #a,
+#define Z(a) #a
+static char *harness_default_events[] =
+{
+    APSS_PERF_COUNTERS
+};
+#undef X
+#undef Z
+
+static char harness_events[APSS_MAX_EVENTS][APSS_EVENT_NAME_MAX];
+static int harness_event_count = 0;
+
+/* list the events the module looks for, as it does without a _FILE list */
+static void harness_list_events(void)
+{
+    char *env, *list, *tok, *saveptr = NULL;
+    int i;
+
+    harness_event_count = 0;
+    env = getenv("DARSHAN_APSS_EVENTS");
+    if(env && (list = strdup(env)) != NULL)
+    {
+        for(tok = strtok_r(list, ", \t\r\n", &saveptr);
+            tok && harness_event_count < APSS_MAX_EVENTS;
+            tok = strtok_r(NULL, ", \t\r\n", &saveptr))
+        {
+            if(strlen(tok) < APSS_EVENT_NAME_MAX)
+                strcpy(harness_events[harness_event_count++], tok);
+        }
+        free(list);
+        return;
+    }
+
+    for(i = CQ_CQ_OXE_NUM_STALLS; i < APSS_NUM_INDICES; i++)
+        strcpy(harness_events[harness_event_count++], harness_default_events[i]);
+
+    return;
+}
+
+/* path of the telemetry file of the ith event on fake CXI device d; -1 if
+ * it does not fit in size
+ */
+static int harness_cxi_path(char *path, size_t size, const char *dir, int d, int i)
+{
+    int k;
+
+    k = snprintf(path, size, "%s/%s/cxi%d/device/telemetry/", dir, APSS_CXI_PATH, d);
+    if(k < 0 || k >= (int)size ||
+        snprintf(path + k, size - k, "%s", harness_events[i]) >= (int)size - k)
+        return(-1);
+    for(; path[k]; k++)
+        path[k] = tolower((unsigned char)path[k]);
+
+    return(0);
+}
+
+/* write the telemetry files of every event on each fake CXI device, with
+ * the nth fake PAPI read of the event split between the devices on top of
+ * a large count since boot
+ */
+static int harness_write_cxi(const char *dir, int n)
+{
+    char path[PATH_MAX];
+    long long value;
+    FILE *f;
+    int i, d;
+
+    for(d = 0; d < HARNESS_CXI_DEVICES; d++)
+    {
+        for(i = 0; i < harness_event_count; i++)
+        {
+            value = (d + 1) * (1LL << 40) + i;
+            if(n > 0)
+                value += (papi_stub_counter(i, my_rank, n) + d) / HARNESS_CXI_DEVICES;
+            if(harness_cxi_path(path, sizeof(path), dir, d, i) < 0)
+                return(-1);
+            f = fopen(path, "w");
+            if(!f)
+                return(-1);
+            fprintf(f, "%lld@%d.000000000\n", value, n);
+            fclose(f);
+        }
+    }
+
+    return(0);
+}
+
+/* make or remove the directories of the fake CXI tree */
+static int harness_cxi_dirs(const char *dir, int make)
+{
+    const char *sub[] = {"", "/device", "/device/telemetry"};
+    char path[PATH_MAX];
+    int d, j;
+
+    for(d = 0; d < HARNESS_CXI_DEVICES; d++)
+    {
+        for(j = 0; j < 3; j++)
+        {
+            if(snprintf(path, sizeof(path), "%s/%s/cxi%d%s", dir, APSS_CXI_PATH,
+                d, sub[make ? j : 2 - j]) >= (int)sizeof(path))
+            {
+                if(make)
+                    return(-1);
+                continue;
+            }
+            if(make && mkdir(path, 0700) < 0)
+                return(-1);
+            if(!make)
+                rmdir(path);
+        }
+    }
+
+    return(0);
+}
+
+static int harness_write_node_info(const char *dir, struct harness_coords *c)
+{
+    char path[PATH_MAX];
+    char *env;
+
+    /* EX x-name parsed by sstopo_get_mycoords(), which numbers the nodes
+     * of a slot as 2 * board + node
+     */
+    snprintf(harness_hostname, sizeof(harness_hostname), "x%dc%ds%db%dn%d",
+        c->group, c->chassis, c->blade, c->node / 2, c->node % 2);
+
+    env = getenv("DARSHAN_APSS_BACKEND");
+    harness_cxi = env && strcmp(env, "cxi") == 0;
+    if(!harness_cxi)
+        return(0);
+
+    harness_list_events();
+    if(snprintf(path, sizeof(path), "%s/%s", dir, APSS_CXI_PATH) >=
+        (int)sizeof(path))
+        return(-1);
+    if(mkdir(path, 0700) < 0 || harness_cxi_dirs(dir, 1) < 0)
+        return(-1);
+
+    return(harness_write_cxi(dir, 0));
+}
+
+static void harness_remove_node_info(const char *dir)
+{
+    char path[PATH_MAX];
+    int i, d;
+
+    if(!harness_cxi)
+        return;
+
+    for(d = 0; d < HARNESS_CXI_DEVICES; d++)
+    {
+        for(i = 0; i < harness_event_count; i++)
+        {
+            if(harness_cxi_path(path, sizeof(path), dir, d, i) == 0)
+                unlink(path);
+        }
+    }
+    harness_cxi_dirs(dir, 0);
+    if(snprintf(path, sizeof(path), "%s/%s", dir, APSS_CXI_PATH) <
+        (int)sizeof(path))
+        rmdir(path);
+
+    return;
+}
+
+/* move the fake CXI counters on */
+static int harness_advance_counters(const char *dir)
+{
+    if(!harness_cxi)
+        return(0);
+
+    return(harness_write_cxi(dir, HARNESS_CXI_READ));
+}
+#endif
+
+/* decode the varint at *off of data, moving *off past it */
+static uint64_t harness_get_varint(unsigned char *data, uint64_t size, uint64_t *off)
+{
+    uint64_t val = 0;
+    int shift = 0;
+    unsigned char b;
+
+    do
+    {
+        if(*off >= size)
+            return(val);
+        b = data[(*off)++];
+        if(shift < 64)
+            val |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while(b & 0x80);
+
+    return(val);
+}
+
+/* check the samples of a leader, returning the number of reads the
+ * fake PAPI got before the final one (1 if nothing was sampled)
+ */
+static int harness_verify_samples(int event_count, int *bytes)
+{
+    harness_sample_record *smp;
+    struct harness_coords c;
+    unsigned char *data;
+    uint64_t off = 0;
+    uint64_t sums[HARNESS_MAX_EVENTS];
+    uint64_t n, s;
+    long long expected;
+    char *env;
+    int i;
+
+    smp = darshan_core_stub_record(darshan_core_gen_record_id(HARNESS_SAMPLE_NAME));
+    env = getenv("DARSHAN_" HARNESS_MOD_UPPER "_SAMPLE_INTERVAL");
+    if(!env || atoi(env) <= 0)
+    {
+        harness_check(!smp, "sample record", 1, 0);
+        return(1);
+    }
+    if(!smp)
+    {
+        harness_check(0, "sample record", 0, 1);
+        return(1);
+    }
+    *bytes += sizeof(*smp) + smp->data_size;
+
+    harness_get_coords(my_rank, &c);
+    harness_check(smp->magic == HARNESS_SAMPLE_MAGIC, "sample magic", smp->magic,
+        HARNESS_SAMPLE_MAGIC);
+    harness_check(smp->blade == c.blade, "sample blade", smp->blade, c.blade);
+    harness_check(smp->interval == atoi(env) * 1000ULL, "sample interval",
+        smp->interval, atoi(env) * 1000LL);
+    harness_check(smp->sample_count + smp->dropped_count > 0, "sample count",
+        smp->sample_count + smp->dropped_count, 1);
+
+    data = (unsigned char *)(smp + 1);
+
+    /* the fake CXI counters only move once, so the samples add up to that */
+    if(harness_cxi)
+    {
+        memset(sums, 0, sizeof(sums));
+        for(s = 0; s < smp->sample_count; s++)
+        {
+            harness_get_varint(data, smp->data_size, &off);
+            for(i = 0; i < event_count; i++)
+                sums[i] += harness_get_varint(data, smp->data_size, &off);
+        }
+        for(i = 0; i < event_count && smp->dropped_count == 0; i++)
+        {
+            expected = papi_stub_counter(i, my_rank, HARNESS_CXI_READ);
+            if((long long)sums[i] != expected)
+            {
+                harness_check(0, "sample sum", sums[i], expected);
+                break;
+            }
+        }
+        harness_check(off == smp->data_size, "sample data size", off, smp->data_size);
+        return(HARNESS_CXI_READ);
+    }
+
+    /* the nth read of the fake PAPI is n times the first, plus the rank */
+    n = smp->dropped_count;
+    for(s = 0; s < smp->sample_count; s++)
+    {
+        n++;
+        harness_get_varint(data, smp->data_size, &off);
+        for(i = 0; i < event_count; i++)
+        {
+            expected = papi_stub_counter(i, my_rank, n) -
+                (n > 1 ? papi_stub_counter(i, my_rank, n - 1) : 0);
+            if((long long)harness_get_varint(data, smp->data_size, &off) != expected)
+            {
+                harness_check(0, "sample delta", s, n);
+                return(n + 1);
+            }
+        }
+    }
+    harness_check(off == smp->data_size, "sample data size", off, smp->data_size);
+
+    return(n + 1);
+}
+
+/* number of names in the event name table following a header record */
+static int harness_count_event_names(harness_header_record *hdr)
+{
+    char *names = (char *)(hdr + 1);
+    uint64_t off = 0;
+    int count = 0;
+
+    while(off < hdr->event_names_size && names[off])
+    {
+        off += strnlen(names + off, hdr->event_names_size - off) + 1;
+        count++;
+    }
+
+    return(count);
+}
+
+static void harness_verify(int *bytes)
+{
+    harness_header_record *hdr;
+    harness_perf_record *rec;
+    harness_placement_record *plc;
+    harness_router_entry *entry = NULL;
+    struct harness_coords c, last;
+    int routers, chassis, groups;
+    unsigned int ranks = 0;
+    long long expected;
+    int event_count = 0;
+    int reads;
+    int leader, leaders = 0;
+    int i, r;
+
+    /* the event set is only recorded by rank 0 */
+    hdr = darshan_core_stub_record(darshan_core_gen_record_id(HARNESS_HEADER_NAME));
+    if(hdr)
+        event_count = hdr->event_count;
+    PMPI_Bcast(&event_count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    /* exactly one rank reads the counters of each router or node */
+    rec = darshan_core_stub_record(darshan_core_gen_record_id(HARNESS_PERF_NAME));
+    leader = (rec != NULL);
+    PMPI_Reduce(&leader, &leaders, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    if(my_rank == 0)
+        harness_check(leaders == harness_leader(nprocs - 1) + 1, "leaders",
+            leaders, harness_leader(nprocs - 1) + 1);
+
+    if(my_rank == 0)
+    {
+        if(!hdr)
+        {
+            harness_check(0, "header record", 0, 1);
+            return;
+        }
+        if(!getenv("DARSHAN_" HARNESS_MOD_UPPER "_EVENTS") &&
+           !getenv("DARSHAN_" HARNESS_MOD_UPPER "_EVENTS_FILE"))
+            harness_check(hdr->event_count == HARNESS_NUM_INDICES, "event_count",
+                hdr->event_count, HARNESS_NUM_INDICES);
+        harness_check(harness_count_event_names(hdr) == hdr->event_count,
+            "event names", harness_count_event_names(hdr), hdr->event_count);
+        harness_check(hdr->event_names_size % 8 == 0, "event_names_size",
+            hdr->event_names_size, 8);
+        *bytes += sizeof(*hdr) + hdr->event_names_size;
+
+        plc = darshan_core_stub_record(darshan_core_gen_record_id(HARNESS_PLACEMENT_NAME));
+        if(!plc)
+            harness_check(0, "placement record", 0, 1);
+        else
+        {
+            harness_check(plc->magic == HARNESS_PLACEMENT_MAGIC, "placement magic",
+                plc->magic, HARNESS_PLACEMENT_MAGIC);
+            entry = (harness_router_entry *)(plc + 1);
+        }
+
+        /* ranks are laid out in order, so each new blade, chassis and
+         * group starts a new one, which is the next placement entry
+         */
+        routers = chassis = groups = 0;
+        last.group = last.chassis = last.blade = -1;
+        for(r = 0; r < nprocs; r++)
+        {
+            harness_get_coords(r, &c);
+            if(c.group != last.group)
+                groups++;
+            if(c.group != last.group || c.chassis != last.chassis)
+                chassis++;
+            if(c.group != last.group || c.chassis != last.chassis ||
+               c.blade != last.blade)
+            {
+                routers++;
+                ranks = 0;
+                if(entry && routers <= plc->router_count &&
+                   (entry[routers-1].group != c.group ||
+                    entry[routers-1].chassis != c.chassis ||
+                    entry[routers-1].blade != c.blade))
+                    harness_check(0, "placement router", routers - 1, r);
+            }
+            ranks++;
+            if(entry && routers <= plc->router_count &&
+               (r == nprocs - 1 || harness_router(r + 1) != harness_router(r)))
+                harness_check(entry[routers-1].ranks == ranks, "placement ranks",
+                    entry[routers-1].ranks, ranks);
+            last = c;
+        }
+        if(plc)
+        {
+            harness_check(plc->router_count > 0, "placement routers",
+                plc->router_count, routers);
+            harness_check(plc->router_count == routers, "placement routers",
+                plc->router_count, routers);
+        }
+        harness_check(hdr->nblades > 0 && hdr->nchassis > 0 && hdr->ngroups > 0,
+            "census", hdr->nblades, routers);
+
+        harness_check(hdr->nblades == routers, "nblades", hdr->nblades, routers);
+        harness_check(hdr->nchassis == chassis, "nchassis", hdr->nchassis, chassis);
+        harness_check(hdr->ngroups == groups, "ngroups", hdr->ngroups, groups);
+        harness_check(hdr->appid == HARNESS_APPID, "appid", hdr->appid, HARNESS_APPID);
+#ifdef HARNESS_APXC
+        harness_check(hdr->memory_mode == MM_CACHE, "memory_mode", hdr->memory_mode, MM_CACHE);
+        harness_check(hdr->cluster_mode == CM_QUAD, "cluster_mode", hdr->cluster_mode, CM_QUAD);
+#endif
+    }
+
+    /* leaders are the first rank on each blade (APXC) or node (APSS) */
+    if(my_rank != 0 && harness_leader(my_rank - 1) == harness_leader(my_rank))
+    {
+        harness_check(!rec, "perf record", 1, 0);
+        return;
+    }
+    reads = harness_verify_samples(event_count, bytes);
+    if(harness_cxi)
+        reads = HARNESS_CXI_READ;
+
+    if(!rec)
+    {
+        harness_check(0, "perf record", 0, 1);
+        return;
+    }
+
+    harness_check(rec->event_count == event_count, "perf event_count",
+        rec->event_count, event_count);
+    *bytes += sizeof(*rec) + rec->event_count * sizeof(uint64_t);
+
+    harness_get_coords(my_rank, &c);
+    harness_check(rec->group == c.group, "group", rec->group, c.group);
+    harness_check(rec->chassis == c.chassis, "chassis", rec->chassis, c.chassis);
+    harness_check(rec->blade == c.blade, "blade", rec->blade, c.blade);
+    harness_check(rec->node == c.node, "node", rec->node, c.node);
+
+    /* the fake PAPI codes events in the order they are added */
+    for(i = 0; i < event_count && i < rec->event_count; i++)
+    {
+        expected = papi_stub_counter(i, my_rank, reads);
+        if((long long)rec->counters[i] != expected)
+        {
+            harness_check(0, "counter", rec->counters[i], expected);
+            break;
+        }
+    }
+
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    struct harness_coords c;
+    char cwd[PATH_MAX];
+    char dir[PATH_MAX];
+    char appid[32];
+    double t[4], dt[3], max_dt[3];
+    int size, total_size;
+    int record_bytes = 0, total_record_bytes;
+    int wait_ms = 0;
+    int routers;
+    long long expected;
+    int provided;
+    int total_failures;
+    int opt;
+    int i;
+
+    while((opt = getopt(argc, argv, "n:w:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n':
+                ranks_per_node = atoi(optarg);
+                break;
+            case 'w':
+                wait_ms = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n ranks per node] [-w milliseconds]\n",
+                    argv[0]);
+                return(1);
+        }
+    }
+    if(ranks_per_node < 1)
+        ranks_per_node = 1;
+
+    /* the fake PAPI asks for the rank from the sampling thread */
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if(harness_router(nprocs - 1) /
+       (HARNESS_BLADES_PER_CHASSIS * HARNESS_CHASSIS_PER_GROUP) >= HARNESS_MAX_GROUPS)
+    {
+        if(my_rank == 0)
+            fprintf(stderr, "Error: %d ranks do not fit in %d groups\n",
+                nprocs, HARNESS_MAX_GROUPS);
+        MPI_Finalize();
+        return(1);
+    }
+
+    /* per rank directory holding the fake node information */
+    snprintf(dir, sizeof(dir), "%s/autoperf-harness-XXXXXX",
+        getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if(!getcwd(cwd, sizeof(cwd)) || !mkdtemp(dir))
+    {
+        fprintf(stderr, "Error: failed to create directory %s\n", dir);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    harness_get_coords(my_rank, &c);
+    if(harness_write_node_info(dir, &c) < 0)
+    {
+        fprintf(stderr, "Error: failed to write node information to %s\n", dir);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    snprintf(appid, sizeof(appid), "%d", HARNESS_APPID);
+    setenv(HARNESS_JOBID_ENV, appid, 1);
+
+    /* the module only opens relative paths while it runs in dir */
+    if(chdir(dir) < 0)
+        MPI_Abort(MPI_COMM_WORLD, 1);
+
+    PMPI_Barrier(MPI_COMM_WORLD);
+    t[0] = PMPI_Wtime();
+    harness_runtime_initialize();
+    harness_hostname[0] = '\0';
+    t[1] = PMPI_Wtime();
+    dt[0] = t[1] - t[0];
+    /* the fake CXI counters move halfway through the wait */
+    if(wait_ms > 0)
+        usleep(wait_ms * 500);
+    if(harness_advance_counters(dir) < 0)
+    {
+        fprintf(stderr, "Error: failed to advance the counters in %s\n", dir);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if(wait_ms > 0)
+        usleep(wait_ms * 500);
+    t[1] = PMPI_Wtime();
+    darshan_core_stub_redux();
+    t[2] = PMPI_Wtime();
+    size = darshan_core_stub_output();
+    t[3] = PMPI_Wtime();
+
+    if(chdir(cwd) < 0)
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    harness_remove_node_info(dir);
+    rmdir(dir);
+
+    harness_verify(&record_bytes);
+
+    for(i = 1; i < 3; i++)
+        dt[i] = t[i+1] - t[i];
+    PMPI_Reduce(dt, max_dt, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(&size, &total_size, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(&record_bytes, &total_record_bytes, 1, MPI_INT, MPI_SUM, 0,
+        MPI_COMM_WORLD);
+    routers = harness_router(nprocs - 1) + 1;
+    /* the header, perf and sample records are sized by what they hold */
+    expected = total_record_bytes +
+        sizeof(harness_placement_record) + routers * sizeof(harness_router_entry);
+    if(my_rank == 0)
+        harness_check(total_size == expected, "output size", total_size, expected);
+    PMPI_Allreduce(&failures, &total_failures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+    if(my_rank == 0)
+    {
+        printf("# %s harness: %s (%d failed checks)\n", HARNESS_MOD_NAME,
+            total_failures ? "FAILED" : "ok", total_failures);
+        printf("module,ranks,ranks_per_node,routers,phase,seconds\n");
+        printf("%s,%d,%d,%d,initialize,%.6f\n", HARNESS_MOD_NAME, nprocs,
+            ranks_per_node, harness_router(nprocs - 1) + 1, max_dt[0]);
+        printf("%s,%d,%d,%d,redux,%.6f\n", HARNESS_MOD_NAME, nprocs,
+            ranks_per_node, harness_router(nprocs - 1) + 1, max_dt[1]);
+        printf("%s,%d,%d,%d,output,%.6f\n", HARNESS_MOD_NAME, nprocs,
+            ranks_per_node, harness_router(nprocs - 1) + 1, max_dt[2]);
+        printf("# output bytes: %d\n", total_size);
+    }
+
+    darshan_core_stub_cleanup();
+    MPI_Finalize();
+
+    return(total_failures ? 1 : 0);
+}
@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2017 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Runs the APPERF module against the stub darshan-core and the real
+ * perf_event interface, checking and timing its shutdown reduction with
+ * any number of ranks. Unlike the network modules there is nothing to
+ * fake: software events count in any container, and events the kernel
+ * refuses (hardware events where the PMU is hidden, node scope without
+ * the privilege to count every CPU) must be left out of the counted mask.
+ *
+ * Ranks are split into nodes of -n ranks, which the harness hands to the
+ * module in place of the shared memory split. Between the initialization
+ * and the reduction every rank touches HARNESS_PAGES fresh pages and spins
+ * for -w milliseconds of CPU time. After the reduction rank 0 checks the
+ * header record, and every rank expected to write a perf record (all of
+ * them in rank scope, the first rank of each node with
+ * DARSHAN_APPERF_SCOPE=node) checks its node, its ranks, that events it
+ * did not count are 0 and, in rank scope, that the software events were
+ * counted and account for the page faults and CPU time of the harness.
+ * The event list can be changed as for the real module, through
+ * DARSHAN_APPERF_EVENTS or DARSHAN_APPERF_EVENTS_FILE.
+ *
+ * Timings are written as CSV on stdout, one line per phase, with the
+ * maximum over all ranks:
+ *
+ *   module,ranks,ranks_per_node,nodes,phase,seconds
+ *
+ * followed by the output size over all ranks. Lines starting with '#'
+ * carry the verification result; the exit status is non zero if any
+ * check failed. Built from a static darshan-runtime build tree:
+ *
+ *   mpicc -O2 -I. -I<darshan-runtime> -I<darshan-runtime>/lib \
+ *       -I../apperf -I../apperf/lib \
+ *       -o apperf-harness autoperf-perf-harness.c darshan-core-stub.c \
+ *       ../apperf/lib/darshan-apperf.c <darshan-runtime>/lib/lookup3.o -lpthread
+ *
+ * usage: apperf-harness [-n ranks per node] [-w milliseconds]
+ */
+
+#define _GNU_SOURCE
+#include "darshan-runtime-config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <mpi.h>
+
+#include "darshan.h"
+#include "darshan-core-stub.h"
+#include "darshan-apperf-log-format.h"
+
+#define HARNESS_MOD_NAME "apperf"
+#define HARNESS_HEADER_NAME "darshan-apperf-header"
+#define HARNESS_PERF_NAME "APPERF"
+#define HARNESS_PAGES 1024
+
+extern void apperf_runtime_initialize(void);
+
+/* events every rank must count in rank scope, when they are listed */
+static const char *harness_software_events[] =
+{
+    "TASK_CLOCK", "CPU_CLOCK", "CONTEXT_SWITCHES", "CPU_MIGRATIONS",
+    "PAGE_FAULTS", "MINOR_FAULTS", "MAJOR_FAULTS", NULL
+};
+
+#define X(a) #a,
+#define Z(a) #a
+static char *harness_default_events[] =
+{
+    APPERF_PERF_COUNTERS
+};
+#undef X
+#undef Z
+
+static int ranks_per_node = 1;
+static int my_rank;
+static int nprocs;
+static int failures = 0;
+
+/* the module finds its node with a shared memory split, which the harness
+ * turns into nodes of ranks_per_node consecutive ranks
+ */
+int PMPI_Comm_split_type(MPI_Comm comm, int split_type, int key, MPI_Info info,
+    MPI_Comm *newcomm)
+{
+    int rank;
+
+    PMPI_Comm_rank(comm, &rank);
+    return(PMPI_Comm_split(comm, rank / ranks_per_node, key, newcomm));
+}
+
+static int harness_nodes(void)
+{
+    return((nprocs + ranks_per_node - 1) / ranks_per_node);
+}
+
+static void harness_check(int ok, const char *what, long long got, long long expected)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "rank %d: %s is %lld, expected %lld\n",
+            my_rank, what, got, expected);
+        failures++;
+    }
+
+    return;
+}
+
+static double harness_cpu_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/* touch fresh pages and spin, returning the CPU time spent spinning */
+static double harness_work(int wait_ms)
+{
+    volatile unsigned long sink = 0;
+    char *pages;
+    long page_size = sysconf(_SC_PAGESIZE);
+    double start, now;
+    int i;
+
+    pages = mmap(NULL, HARNESS_PAGES * page_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(pages == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: failed to map %d pages\n", HARNESS_PAGES);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+#ifdef MADV_NOHUGEPAGE
+    madvise(pages, HARNESS_PAGES * page_size, MADV_NOHUGEPAGE);
+#endif
+    for(i = 0; i < HARNESS_PAGES; i++)
+        pages[i * page_size] = 1;
+    munmap(pages, HARNESS_PAGES * page_size);
+
+    start = harness_cpu_time();
+    do
+    {
+        for(i = 0; i < 100000; i++)
+            sink += i;
+        now = harness_cpu_time();
+    } while(now - start < wait_ms / 1e3);
+
+    return(now - start);
+}
+
+/* a header record with room for a full table of event names */
+struct harness_header
+{
+    struct darshan_apperf_header_record rec;
+    char names[APPERF_MAX_EVENTS * APPERF_EVENT_NAME_MAX];
+};
+
+/* the ith name of the event name table following a header record */
+static char *harness_event_name(struct darshan_apperf_header_record *hdr, int i)
+{
+    char *names = (char *)(hdr + 1);
+    uint64_t off = 0;
+
+    while(off < hdr->event_names_size && names[off])
+    {
+        if(i-- == 0)
+            return(names + off);
+        off += strnlen(names + off, hdr->event_names_size - off) + 1;
+    }
+
+    return(NULL);
+}
+
+static int harness_event_index(struct darshan_apperf_header_record *hdr,
+    const char *name)
+{
+    char *event;
+    int i;
+
+    for(i = 0; i < hdr->event_count && i < APPERF_MAX_EVENTS; i++)
+    {
+        event = harness_event_name(hdr, i);
+        if(event && strcmp(event, name) == 0)
+            return(i);
+    }
+
+    return(-1);
+}
+
+static void harness_verify(int scope, double spin, int *counted,
+    uint64_t *names_size)
+{
+    struct darshan_apperf_header_record *hdr;
+    struct darshan_apperf_perf_record *rec;
+    struct harness_header names_buf;
+    struct darshan_apperf_header_record *names = &names_buf.rec;
+    char *event;
+    int leader = (my_rank % ranks_per_node == 0);
+    int ranks;
+    int i;
+
+    /* the event list is only recorded by rank 0 */
+    memset(&names_buf, 0, sizeof(names_buf));
+    hdr = darshan_core_stub_record(darshan_core_gen_record_id(HARNESS_HEADER_NAME));
+    if(hdr && hdr->event_names_size <= sizeof(names_buf.names))
+        memcpy(&names_buf, hdr, sizeof(*hdr) + hdr->event_names_size);
+    PMPI_Bcast(&names_buf, sizeof(names_buf), MPI_BYTE, 0, MPI_COMM_WORLD);
+    *names_size = names->event_names_size;
+
+    if(my_rank == 0)
+    {
+        if(!hdr)
+        {
+            harness_check(0, "header record", 0, 1);
+            return;
+        }
+        harness_check(hdr->magic == APPERF_MAGIC, "magic", hdr->magic, APPERF_MAGIC);
+        harness_check(hdr->scope == scope, "scope", hdr->scope, scope);
+        harness_check(hdr->nnodes == harness_nodes(), "nnodes", hdr->nnodes,
+            harness_nodes());
+        harness_check(hdr->event_names_size % 8 == 0, "event_names_size",
+            hdr->event_names_size, 8);
+        harness_check(!harness_event_name(hdr, hdr->event_count) &&
+            (hdr->event_count == 0 || harness_event_name(hdr, hdr->event_count - 1)),
+            "event names", hdr->event_names_size, hdr->event_count);
+        if(!getenv("DARSHAN_APPERF_EVENTS") && !getenv("DARSHAN_APPERF_EVENTS_FILE"))
+        {
+            harness_check(hdr->event_count == APPERF_NUM_INDICES, "event_count",
+                hdr->event_count, APPERF_NUM_INDICES);
+            for(i = 0; i < APPERF_NUM_INDICES; i++)
+            {
+                event = harness_event_name(hdr, i);
+                if(!event || strcmp(event, harness_default_events[i]) != 0)
+                    harness_check(0, "default event", i, i);
+            }
+        }
+    }
+
+    rec = darshan_core_stub_record(darshan_core_gen_record_id(HARNESS_PERF_NAME));
+    if(scope == SCOPE_NODE && !leader)
+    {
+        harness_check(!rec, "perf record", 1, 0);
+        return;
+    }
+    if(!rec)
+    {
+        harness_check(0, "perf record", 0, 1);
+        return;
+    }
+
+    ranks = 1;
+    if(scope == SCOPE_NODE)
+    {
+        ranks = nprocs - my_rank;
+        if(ranks > ranks_per_node)
+            ranks = ranks_per_node;
+    }
+    harness_check(rec->base_rec.rank == my_rank, "rank", rec->base_rec.rank, my_rank);
+    harness_check(rec->node == my_rank / ranks_per_node, "node", rec->node,
+        my_rank / ranks_per_node);
+    harness_check(rec->ranks == ranks, "ranks", rec->ranks, ranks);
+    harness_check(rec->time_running <= rec->time_enabled, "time_running",
+        rec->time_running, rec->time_enabled);
+
+    for(i = 0; i < APPERF_MAX_EVENTS; i++)
+    {
+        if(i >= names->event_count)
+            harness_check(!(rec->counted & ((uint64_t)1 << i)), "counted beyond list", i,
+                names->event_count);
+        if(!(rec->counted & ((uint64_t)1 << i)))
+            harness_check(rec->counters[i] == 0, "uncounted event", rec->counters[i], 0);
+        else
+            (*counted)++;
+    }
+    if(scope == SCOPE_NODE)
+        return;
+
+    for(i = 0; harness_software_events[i]; i++)
+    {
+        int e = harness_event_index(names, harness_software_events[i]);
+
+        if(e >= 0 && !(rec->counted & ((uint64_t)1 << e)))
+        {
+            fprintf(stderr, "rank %d: software event %s was not counted\n",
+                my_rank, harness_software_events[i]);
+            failures++;
+        }
+    }
+
+    /* the spin and the page faults happened between init and redux */
+    i = harness_event_index(names, "TASK_CLOCK");
+    if(i >= 0)
+        harness_check(rec->counters[i] >= spin * 0.9e9, "TASK_CLOCK",
+            rec->counters[i], spin * 0.9e9);
+    i = harness_event_index(names, "PAGE_FAULTS");
+    if(i >= 0)
+        harness_check(rec->counters[i] >= HARNESS_PAGES, "PAGE_FAULTS",
+            rec->counters[i], HARNESS_PAGES);
+
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    double t[4], dt[3], max_dt[3];
+    double spin;
+    char *env;
+    int scope = SCOPE_RANK;
+    int size, total_size;
+    int counted = 0, total_counted;
+    int records;
+    int wait_ms = 0;
+    long long expected;
+    uint64_t names_size;
+    int total_failures;
+    int opt;
+    int i;
+
+    while((opt = getopt(argc, argv, "n:w:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n':
+                ranks_per_node = atoi(optarg);
+                break;
+            case 'w':
+                wait_ms = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n ranks per node] [-w milliseconds]\n",
+                    argv[0]);
+                return(1);
+        }
+    }
+    if(ranks_per_node < 1)
+        ranks_per_node = 1;
+    if((env = getenv("DARSHAN_APPERF_SCOPE")) != NULL && strcmp(env, "node") == 0)
+        scope = SCOPE_NODE;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    PMPI_Barrier(MPI_COMM_WORLD);
+    t[0] = PMPI_Wtime();
+    apperf_runtime_initialize();
+    t[1] = PMPI_Wtime();
+    dt[0] = t[1] - t[0];
+    spin = harness_work(wait_ms);
+    t[1] = PMPI_Wtime();
+    darshan_core_stub_redux();
+    t[2] = PMPI_Wtime();
+    size = darshan_core_stub_output();
+    t[3] = PMPI_Wtime();
+
+    harness_verify(scope, spin, &counted, &names_size);
+
+    for(i = 1; i < 3; i++)
+        dt[i] = t[i+1] - t[i];
+    PMPI_Reduce(dt, max_dt, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(&size, &total_size, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(&counted, &total_counted, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    records = (scope == SCOPE_NODE) ? harness_nodes() : nprocs;
+    expected = sizeof(struct darshan_apperf_header_record) + names_size +
+        records * sizeof(struct darshan_apperf_perf_record);
+    if(my_rank == 0)
+        harness_check(total_size == expected, "output size", total_size, expected);
+    PMPI_Allreduce(&failures, &total_failures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+    if(my_rank == 0)
+    {
+        printf("# %s harness: %s (%d failed checks)\n", HARNESS_MOD_NAME,
+            total_failures ? "FAILED" : "ok", total_failures);
+        printf("# %s scope: %d events counted over %d records\n",
+            (scope == SCOPE_NODE) ? "node" : "rank", total_counted, records);
+        printf("module,ranks,ranks_per_node,nodes,phase,seconds\n");
+        printf("%s,%d,%d,%d,initialize,%.6f\n", HARNESS_MOD_NAME, nprocs,
+            ranks_per_node, harness_nodes(), max_dt[0]);
+        printf("%s,%d,%d,%d,redux,%.6f\n", HARNESS_MOD_NAME, nprocs,
+            ranks_per_node, harness_nodes(), max_dt[1]);
+        printf("%s,%d,%d,%d,output,%.6f\n", HARNESS_MOD_NAME, nprocs,
+            ranks_per_node, harness_nodes(), max_dt[2]);
+        printf("# output bytes: %d\n", total_size);
+    }
+
+    darshan_core_stub_cleanup();
+    MPI_Finalize();
+
+    return(total_failures ? 1 : 0);
+}
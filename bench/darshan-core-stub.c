@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2017 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Minimal stand-in for darshan-core, providing just what the AutoPerf
+ * modules need to run outside of a Darshan instrumented job: module and
+ * record registration, the timer, the __darshan_disabled flag and the
+ * variance reduction of darshan-common. Records are kept in memory and
+ * never written to a log. darshan_core_gen_record_id() is inline in
+ * darshan.h and needs lookup3.o from the darshan-runtime build.
+ */
+
+#include "darshan-runtime-config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+#include "darshan.h"
+#include "darshan-common.h"
+#include "darshan-core-stub.h"
+
+#define STUB_MAX_RECORDS 8
+
+int __darshan_disabled = 0;
+
+static darshan_module_funcs stub_mod_funcs;
+static int stub_mod_registered = 0;
+static void *stub_records[STUB_MAX_RECORDS];
+static darshan_record_id stub_record_ids[STUB_MAX_RECORDS];
+static int stub_record_count = 0;
+static double stub_start_time = -1;
+
+int darshan_core_register_module(
+    darshan_module_id mod_id,
+    darshan_module_funcs mod_funcs,
+    size_t rec_size,
+    size_t *rec_count,
+    int *rank,
+    int *sys_mem_alignment)
+{
+    if(stub_mod_registered)
+        return(-1);
+
+    stub_mod_funcs = mod_funcs;
+    stub_mod_registered = 1;
+    if(rank)
+        PMPI_Comm_rank(MPI_COMM_WORLD, rank);
+    if(sys_mem_alignment)
+        *sys_mem_alignment = 8;
+
+    return(0);
+}
+
+void darshan_core_unregister_module(
+    darshan_module_id mod_id)
+{
+    stub_mod_registered = 0;
+    return;
+}
+
+void *darshan_core_register_record(
+    darshan_record_id rec_id,
+    const char *name,
+    darshan_module_id mod_id,
+    size_t rec_size,
+    struct darshan_fs_info *fs_info)
+{
+    void *rec;
+
+    if(stub_record_count == STUB_MAX_RECORDS)
+        return(NULL);
+    rec = calloc(1, rec_size);
+    if(rec)
+    {
+        stub_record_ids[stub_record_count] = rec_id;
+        stub_records[stub_record_count++] = rec;
+    }
+
+    return(rec);
+}
+
+double darshan_core_wtime()
+{
+    if(stub_start_time < 0)
+        stub_start_time = PMPI_Wtime();
+    return(PMPI_Wtime() - stub_start_time);
+}
+
+void darshan_variance_reduce(void *invec, void *inoutvec, int *len,
+    MPI_Datatype *dt)
+{
+    int i;
+    struct darshan_variance_dt *X = invec;
+    struct darshan_variance_dt *Y = inoutvec;
+    struct darshan_variance_dt Z;
+
+    for(i = 0; i < *len; i++, X++, Y++)
+    {
+        Z.n = X->n + Y->n;
+        Z.T = X->T + Y->T;
+        Z.S = X->S + Y->S + (X->n/(Y->n*Z.n)) *
+           ((Y->n/X->n)*X->T - Y->T) * ((Y->n/X->n)*X->T - Y->T);
+
+        *Y = Z;
+    }
+
+    return;
+}
+
+void darshan_core_stub_redux()
+{
+    if(stub_mod_registered && stub_mod_funcs.mod_redux_func)
+        stub_mod_funcs.mod_redux_func(NULL, MPI_COMM_WORLD, NULL, 0);
+
+    return;
+}
+
+int darshan_core_stub_output()
+{
+    void *buf = NULL;
+    int size = 0;
+
+    if(stub_mod_registered && stub_mod_funcs.mod_output_func)
+        stub_mod_funcs.mod_output_func(&buf, &size);
+
+    return(size);
+}
+
+void *darshan_core_stub_record(darshan_record_id rec_id)
+{
+    int i;
+
+    for(i = 0; i < stub_record_count; i++)
+    {
+        if(stub_record_ids[i] == rec_id)
+            return(stub_records[i]);
+    }
+
+    return(NULL);
+}
+
+void darshan_core_stub_cleanup()
+{
+    int i;
+
+    if(stub_mod_registered && stub_mod_funcs.mod_cleanup_func)
+        stub_mod_funcs.mod_cleanup_func();
+    stub_mod_registered = 0;
+
+    for(i = 0; i < stub_record_count; i++)
+        free(stub_records[i]);
+    stub_record_count = 0;
+
+    return;
+}
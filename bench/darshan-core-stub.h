@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) 2017 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef __DARSHAN_CORE_STUB_H
+#define __DARSHAN_CORE_STUB_H
+
+#include "darshan.h"
+
+/* run the shutdown reduction (over MPI_COMM_WORLD, with no shared
+ * records), output (freezing the module, returns the output size) and
+ * cleanup callbacks of the module registered with the stub darshan-core
+ */
+void darshan_core_stub_redux(void);
+int darshan_core_stub_output(void);
+void darshan_core_stub_cleanup(void);
+
+/* record registered by the module under rec_id, or NULL */
+void *darshan_core_stub_record(darshan_record_id rec_id);
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2017 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Fake PAPI for running the AutoPerf network modules off the machine.
+ * Event names are given codes in the order they are first looked up, and
+ * a single event set holds up to PAPI_STUB_MAX_EVENTS events whose values
+ * only depend on the event code, the MPI rank and the number of reads.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "papi.h"
+
+#define PAPI_STUB_MAX_EVENTS 512
+#define PAPI_STUB_EVENT_SET 1
+
+static char *stub_names[PAPI_STUB_MAX_EVENTS];
+static int stub_name_count = 0;
+static int stub_events[PAPI_STUB_MAX_EVENTS];
+static int stub_event_count = 0;
+static int stub_set_created = 0;
+static int stub_running = 0;
+static int stub_reads = 0;
+
+long long papi_stub_counter(int code, int rank, int n)
+{
+    return((long long)(code + 1) * 1000 * n + rank);
+}
+
+static int stub_rank()
+{
+    int initialized = 0;
+    int rank = 0;
+
+    PMPI_Initialized(&initialized);
+    if(initialized)
+        PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    return(rank);
+}
+
+static void stub_values(long long *values)
+{
+    int rank = stub_rank();
+    int i;
+
+    stub_reads++;
+    for(i = 0; i < stub_event_count; i++)
+        values[i] = papi_stub_counter(stub_events[i], rank, stub_reads);
+
+    return;
+}
+
+int PAPI_library_init(int version)
+{
+    return(PAPI_VER_CURRENT);
+}
+
+int PAPI_create_eventset(int *EventSet)
+{
+    if(stub_set_created)
+        return(PAPI_ENOMEM);
+
+    stub_set_created = 1;
+    stub_event_count = 0;
+    stub_reads = 0;
+    *EventSet = PAPI_STUB_EVENT_SET;
+
+    return(PAPI_OK);
+}
+
+int PAPI_event_name_to_code(const char *in, int *out)
+{
+    int i;
+
+    for(i = 0; i < stub_name_count; i++)
+    {
+        if(strcmp(stub_names[i], in) == 0)
+        {
+            *out = i;
+            return(PAPI_OK);
+        }
+    }
+
+    if(stub_name_count == PAPI_STUB_MAX_EVENTS)
+        return(PAPI_ENOMEM);
+    stub_names[stub_name_count] = strdup(in);
+    if(!stub_names[stub_name_count])
+        return(PAPI_ENOMEM);
+    *out = stub_name_count++;
+
+    return(PAPI_OK);
+}
+
+int PAPI_add_event(int EventSet, int Event)
+{
+    if(EventSet != PAPI_STUB_EVENT_SET || !stub_set_created)
+        return(PAPI_EINVAL);
+    if(Event < 0 || Event >= stub_name_count)
+        return(PAPI_ENOEVNT);
+    if(stub_event_count == PAPI_STUB_MAX_EVENTS)
+        return(PAPI_ENOMEM);
+
+    stub_events[stub_event_count++] = Event;
+
+    return(PAPI_OK);
+}
+
+int PAPI_start(int EventSet)
+{
+    if(EventSet != PAPI_STUB_EVENT_SET || stub_running)
+        return(PAPI_EINVAL);
+
+    stub_running = 1;
+
+    return(PAPI_OK);
+}
+
+int PAPI_read(int EventSet, long long *values)
+{
+    if(EventSet != PAPI_STUB_EVENT_SET || !stub_running)
+        return(PAPI_EINVAL);
+
+    stub_values(values);
+
+    return(PAPI_OK);
+}
+
+int PAPI_stop(int EventSet, long long *values)
+{
+    if(EventSet != PAPI_STUB_EVENT_SET || !stub_running)
+        return(PAPI_EINVAL);
+
+    if(values)
+        stub_values(values);
+    stub_running = 0;
+
+    return(PAPI_OK);
+}
+
+int PAPI_reset(int EventSet)
+{
+    if(EventSet != PAPI_STUB_EVENT_SET)
+        return(PAPI_EINVAL);
+
+    stub_reads = 0;
+
+    return(PAPI_OK);
+}
+
+int PAPI_cleanup_eventset(int EventSet)
+{
+    if(EventSet != PAPI_STUB_EVENT_SET || stub_running)
+        return(PAPI_EINVAL);
+
+    stub_event_count = 0;
+
+    return(PAPI_OK);
+}
+
+int PAPI_destroy_eventset(int *EventSet)
+{
+    if(*EventSet != PAPI_STUB_EVENT_SET || stub_event_count)
+        return(PAPI_EINVAL);
+
+    stub_set_created = 0;
+    *EventSet = PAPI_NULL;
+
+    return(PAPI_OK);
+}
+
+void PAPI_shutdown()
+{
+    int i;
+
+    for(i = 0; i < stub_name_count; i++)
+        free(stub_names[i]);
+    stub_name_count = 0;
+    stub_event_count = 0;
+    stub_set_created = 0;
+    stub_running = 0;
+
+    return;
+}
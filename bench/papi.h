@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2017 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef __PAPI_STUB_H
+#define __PAPI_STUB_H
+
+/* Stand-in for the subset of the PAPI low level API used by the AutoPerf
+ * network modules, implemented by papi-stub.c. Any event name is accepted
+ * and every event counts a deterministic stream (see papi_stub_counter()),
+ * so the module reductions can be checked without network hardware.
+ */
+
+#define PAPI_VER_CURRENT 0x07000000
+#define PAPI_OK 0
+#define PAPI_EINVAL -1
+#define PAPI_ENOMEM -2
+#define PAPI_ENOEVNT -7
+#define PAPI_NULL -1
+
+int PAPI_library_init(int version);
+int PAPI_create_eventset(int *EventSet);
+int PAPI_event_name_to_code(const char *in, int *out);
+int PAPI_add_event(int EventSet, int Event);
+int PAPI_start(int EventSet);
+int PAPI_read(int EventSet, long long *values);
+int PAPI_stop(int EventSet, long long *values);
+int PAPI_reset(int EventSet);
+int PAPI_cleanup_eventset(int EventSet);
+int PAPI_destroy_eventset(int *EventSet);
+void PAPI_shutdown(void);
+
+/* value read for event code on rank after the nth read since the last
+ * reset of its event set (n starts at 1)
+ */
+long long papi_stub_counter(int code, int rank, int n);
+
+#endif